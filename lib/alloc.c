@@ -0,0 +1,428 @@
+// alloc.h is header-only, this file holds its tests
+#if defined(ALLOC_C_TEST) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // fork and waitpid
+#endif
+
+#include "alloc.h"
+
+#ifdef ALLOC_C_TEST
+
+#include "test.h"
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef POOL_DEBUG
+// Runs fn in a child with stderr silenced, true when the child aborted
+static int allocAborts(void (*fn)(void)) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    if (!freopen("/dev/null", "w", stderr))
+      _exit(2);
+    fn();
+    _exit(0);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+static void allocFreeTwice(void) {
+  pool_t *pool = poolCreate(32);
+  void *object = poolAlloc(pool);
+  poolFree(pool, object);
+  poolFree(pool, object);
+}
+
+static void allocWriteAfterFree(void) {
+  pool_t *pool = poolCreate(64);
+  char *object = (char *)poolAlloc(pool);
+  poolFree(pool, object);
+  object[40] = 1;
+  (void)poolAlloc(pool);
+}
+
+static void allocFreeOnce(void) {
+  pool_t *pool = poolCreate(32);
+  void *object = poolAlloc(pool);
+  poolFree(pool, object);
+  object = poolAlloc(pool);
+  poolFree(pool, object);
+  poolDestroy(&pool);
+}
+
+void allocPoolDebug(void) {
+  expectTrue(allocAborts(allocFreeTwice), "panics on a double free");
+  expectTrue(allocAborts(allocWriteAfterFree), "panics on a write after free");
+  expectFalse(allocAborts(allocFreeOnce), "lets objects be freed once");
+}
+#endif
+
+void allocArena(void) {
+  arena_t *arena = arenaCreate(1024);
+  expectNotNull(arena, "creates an arena");
+
+  char *first = (char *)arenaAlloc(arena, 24);
+  char *second = (char *)arenaAlloc(arena, 8);
+  expectTrue(first && (uintptr_t)first % ARENA_ALIGNMENT == 0 &&
+                 second == first + 32,
+             "bumps aligned allocations");
+  char *line = (char *)arenaAllocAligned(arena, 64, 256);
+  expectTrue(line && (uintptr_t)line % 256 == 0, "aligns on request");
+
+  arena_mark_t mark = arenaMark(arena);
+  char *big = (char *)arenaAlloc(arena, 4096);
+  expectTrue(big && big[4095] == 0, "fits allocations larger than a chunk");
+  arenaRewind(arena, mark);
+  expectTrue(arenaAllocUninit(arena, 64) == line + 64,
+             "rewinds to a mark");
+
+  test("overflow");
+  expectNull(arenaAllocUninit(arena, SIZE_MAX - 8),
+             "refuses sizes that wrap the bump");
+  expectNull(arenaAlloc(arena, SIZE_MAX), "refuses the largest size");
+  expectNull(arenaAllocAligned(arena, SIZE_MAX - 4096, 4096),
+             "refuses sizes that wrap the alignment");
+  // Half the address space is never free, so only a new chunk could fit it
+  volatile size_t half = SIZE_MAX / 2;
+  expectNull(arenaAlloc(arena, half), "refuses sizes past the chunk");
+  expectTrue(arenaAllocUninit(arena, 16) == line + 128,
+             "keeps bumping after a refusal");
+
+  arenaDestroy(&arena);
+  expectNull(arena, "destroy sets pointer to NULL");
+}
+
+void allocPool(void) {
+  pool_t *pool = poolCreate(24);
+  expectNotNull(pool, "creates a pool");
+
+  uint64_t *first = (uint64_t *)poolAlloc(pool);
+  expectTrue(first && (uintptr_t)first % sizeof(void *) == 0,
+             "aligns objects to a pointer");
+  first[0] = first[1] = first[2] = 42;
+  poolFree(pool, first);
+  uint64_t *again = (uint64_t *)poolAlloc(pool);
+  expectTrue(again == first, "reuses freed objects");
+  expectTrue(again[0] == 0 && again[1] == 0 && again[2] == 0,
+             "zeroes reused objects");
+  expectTrue(poolAlloc(pool) != again, "hands out distinct objects");
+
+  test("growth");
+  pool_t *grown = poolCreate(100);
+  const size_t count = POOL_SLAB_SIZE / 100 + 10;
+  size_t **objects = (size_t **)allocate(count * sizeof(size_t *));
+  for (size_t i = 0; i < count; i++) {
+    objects[i] = (size_t *)poolAlloc(grown);
+    objects[i][0] = i;
+    objects[i][12] = i;
+  }
+  int intact = 1;
+  for (size_t i = 0; i < count; i++) {
+    intact &= objects[i][0] == i && objects[i][12] == i;
+  }
+  expectTrue(intact, "keeps objects apart across slabs");
+  pool_stats_t stats = poolStats(grown);
+  expectEqllu(stats.slabs, 2, "grows past a 64 KiB slab");
+  expectTrue(stats.capacity >= count && stats.capacity < 2 * count,
+             "counts the capacity of every slab");
+
+  test("stats");
+  expectEqllu(stats.used, count, "counts objects in use");
+  for (size_t i = 0; i < count / 2; i++) {
+    poolFree(grown, objects[i]);
+  }
+  poolFree(grown, NULL);
+  stats = poolStats(grown);
+  expectEqllu(stats.used, count - count / 2, "counts freed objects");
+  expectEqllu(stats.peak, count, "keeps the peak");
+  for (size_t i = 0; i < count / 2; i++) {
+    objects[i] = (size_t *)poolAlloc(grown);
+  }
+  expectEqllu(poolStats(grown).slabs, 2, "refills from freed objects");
+
+  test("large objects");
+  pool_t *large = poolCreate(POOL_SLAB_SIZE * 2);
+  char *big = (char *)poolAlloc(large);
+  expectTrue(big && big[POOL_SLAB_SIZE * 2 - 1] == 0,
+             "fits objects larger than a slab");
+
+  deallocate(&objects);
+  poolDestroy(&large);
+  poolDestroy(&grown);
+  poolDestroy(&pool);
+  expectNull(pool, "destroy sets pointer to NULL");
+}
+
+#ifdef ALLOC_THREAD_CACHE
+#include <pthread.h>
+
+#define ALLOC_TEST_THREADS 4
+#define ALLOC_TEST_BLOCKS 1000
+
+static size_t allocClassOf(const void *ptr) {
+  return *(const size_t *)((const char *)ptr - __ALLOC_HEADER);
+}
+
+void allocCache(void) {
+  int zeroed = 1, classed = 1;
+  for (size_t size = 1; size <= ALLOC_CLASSES * ALLOC_CLASS_SIZE; size++) {
+    unsigned char *block = (unsigned char *)allocate(size);
+    for (size_t i = 0; i < size; i++) {
+      zeroed &= block[i] == 0;
+    }
+    classed &= allocClassOf(block) == (size - 1) / ALLOC_CLASS_SIZE;
+    memset(block, 0xff, size);
+    deallocate(&block);
+  }
+  expectTrue(zeroed, "zeroes cached blocks");
+  expectTrue(classed, "rounds sizes up to their class");
+
+  char *block = (char *)allocate(40);
+  char *first = block;
+  deallocate(&block);
+  block = (char *)allocate(33);
+  expectTrue(block == first, "reuses the last freed block of a class");
+  deallocate(&block);
+
+  block = (char *)allocate(1000);
+  expectEqllu(allocClassOf(block), ALLOC_CLASSES, "leaves large blocks out");
+  deallocate(&block);
+  expectNull(block, "deallocate sets pointer to NULL");
+
+  test("resize");
+  block = (char *)reallocate((void **)&block, 20);
+  memcpy(block, "0123456789abcdefghi", 20);
+  first = block;
+  block = (char *)reallocate((void **)&block, 32);
+  expectTrue(block == first, "keeps blocks within their class");
+  block = (char *)reallocate((void **)&block, 100);
+  expectTrue(block != first && allocClassOf(block) == 6 &&
+                 memcmp(block, "0123456789abcdefghi", 20) == 0,
+             "moves to a larger class with the contents");
+  block = (char *)reallocate((void **)&block, 5000);
+  expectTrue(allocClassOf(block) == ALLOC_CLASSES &&
+                 memcmp(block, "0123456789abcdefghi", 20) == 0,
+             "moves to a large block with the contents");
+  block[4999] = 'z';
+  block = (char *)reallocate((void **)&block, 9000);
+  expectTrue(block[4999] == 'z', "grows large blocks in place or copies");
+  block = (char *)reallocate((void **)&block, 10);
+  expectTrue(allocClassOf(block) == 0 && memcmp(block, "0123456789", 10) == 0,
+             "shrinks large blocks back into the cache");
+  deallocate(&block);
+
+  test("flush");
+  const size_t count = 3 * ALLOC_BATCH, size_class = 3;
+  void *blocks[3 * ALLOC_BATCH];
+  for (size_t i = 0; i < count; i++) {
+    blocks[i] = allocate(size_class * ALLOC_CLASS_SIZE + 1);
+  }
+  const size_t central = __alloc_central[size_class].list.count;
+  for (size_t i = 0; i < count; i++) {
+    deallocate(&blocks[i]);
+  }
+  expectTrue(__alloc_cache[size_class].count <= 2 * ALLOC_BATCH,
+             "caps the cache of a thread");
+  expectTrue(__alloc_central[size_class].list.count >= central + ALLOC_BATCH,
+             "moves batches to the central pool");
+}
+
+// Caches and frees blocks of a class nothing else uses, then exits
+static void *allocExiting(void *unused) {
+  (void)unused;
+  void *blocks[10];
+  for (size_t i = 0; i < 10; i++) {
+    blocks[i] = allocate(12 * ALLOC_CLASS_SIZE + 1);
+  }
+  for (size_t i = 0; i < 10; i++) {
+    deallocate(&blocks[i]);
+  }
+  return NULL;
+}
+
+static void *allocBlocks[ALLOC_TEST_THREADS][ALLOC_TEST_BLOCKS];
+
+static void *allocFill(void *argument) {
+  const size_t id = (size_t)(uintptr_t)argument;
+  for (size_t i = 0; i < ALLOC_TEST_BLOCKS; i++) {
+    const size_t size = 1 + (i * 37 + id) % 300;
+    allocBlocks[id][i] = allocate(size);
+    memset(allocBlocks[id][i], (int)id + 1, size);
+  }
+  return NULL;
+}
+
+// Frees the blocks another thread allocated
+static void *allocSteal(void *argument) {
+  const size_t id = (size_t)(uintptr_t)argument;
+  const size_t owner = (id + 1) % ALLOC_TEST_THREADS;
+  for (size_t i = 0; i < ALLOC_TEST_BLOCKS; i++) {
+    const unsigned char *block = (const unsigned char *)allocBlocks[owner][i];
+    if (block[0] != owner + 1)
+      return argument;
+    deallocate(&allocBlocks[owner][i]);
+  }
+  return NULL;
+}
+
+// Frees a block of another thread and takes one of the same class
+static void *allocSwap(void *block) {
+  deallocate(&block);
+  return allocate(40);
+}
+
+static int allocPointerOrder(const void *a, const void *b) {
+  const uintptr_t left = (uintptr_t) * (void *const *)a;
+  const uintptr_t right = (uintptr_t) * (void *const *)b;
+  return left < right ? -1 : left > right;
+}
+
+void allocCacheThreads(void) {
+  const size_t size_class = 12;
+  const size_t central = __alloc_central[size_class].list.count;
+  pthread_t thread;
+  pthread_create(&thread, NULL, allocExiting, NULL);
+  pthread_join(thread, NULL);
+  expectEqllu(__alloc_central[size_class].list.count, central + ALLOC_BATCH,
+              "returns the cache of an exiting thread");
+
+  pthread_t threads[ALLOC_TEST_THREADS];
+  for (size_t id = 0; id < ALLOC_TEST_THREADS; id++) {
+    pthread_create(&threads[id], NULL, allocFill, (void *)(uintptr_t)id);
+  }
+  for (size_t id = 0; id < ALLOC_TEST_THREADS; id++) {
+    pthread_join(threads[id], NULL);
+  }
+
+  static void *sorted[ALLOC_TEST_THREADS * ALLOC_TEST_BLOCKS];
+  memcpy((void *)sorted, (const void *)allocBlocks, sizeof(sorted));
+  qsort((void *)sorted, ALLOC_TEST_THREADS * ALLOC_TEST_BLOCKS,
+        sizeof(void *), allocPointerOrder);
+  int distinct = 1;
+  for (size_t i = 1; i < ALLOC_TEST_THREADS * ALLOC_TEST_BLOCKS; i++) {
+    distinct &= sorted[i] != sorted[i - 1];
+  }
+  expectTrue(distinct, "never hands a block to two threads");
+
+  int intact = 1;
+  for (size_t id = 0; id < ALLOC_TEST_THREADS; id++) {
+    pthread_create(&threads[id], NULL, allocSteal, (void *)(uintptr_t)id);
+  }
+  for (size_t id = 0; id < ALLOC_TEST_THREADS; id++) {
+    void *result;
+    pthread_join(threads[id], &result);
+    intact &= result == NULL;
+  }
+  expectTrue(intact, "frees blocks of other threads");
+
+  void *block = allocate(40), *taken;
+  pthread_create(&thread, NULL, allocSwap, block);
+  pthread_join(thread, &taken);
+  expectTrue(taken == block, "caches blocks in the thread freeing them");
+  deallocate(&taken);
+}
+#endif
+
+#ifdef ALLOC_TRACK
+// Reads what fn prints to stderr in a child exiting normally
+static size_t allocStderr(void (*fn)(void), char *text, size_t capacity) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return 0;
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDERR_FILENO);
+    fn();
+    exit(0);
+  }
+
+  close(fds[1]);
+  size_t length = 0;
+  ssize_t bytes;
+  while (length + 1 < capacity &&
+         (bytes = read(fds[0], text + length, capacity - length - 1)) > 0) {
+    length += (size_t)bytes;
+  }
+  text[length] = '\0';
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+  return length;
+}
+
+static void allocLeak(void) {
+  void *leaked = allocate(123);
+  (void)leaked;
+}
+static const int allocLeakLine = __LINE__ - 3;
+
+void allocTrack(void) {
+  const size_t live = __alloc_total.live;
+  const int line = __LINE__ + 1;
+  char *block = (char *)allocate(100);
+  alloc_site_t *site = __allocSite(__FILE__, line);
+  expectEqllu(site->live, 100, "counts live bytes per site");
+  expectEqllu(site->allocations, 1, "counts allocations per site");
+  expectEqllu(__alloc_total.live, live + 100, "counts live bytes in total");
+
+  const int grown_line = __LINE__ + 1;
+  block = (char *)reallocate((void **)&block, 300);
+  alloc_site_t *grown = __allocSite(__FILE__, grown_line);
+  expectTrue(site->live == 0 && grown->live == 300,
+             "moves resized bytes to the resizing site");
+  expectEqllu(__alloc_total.live, live + 300, "keeps the total in step");
+
+  deallocate(&block);
+  expectTrue(grown->live == 0 && grown->frees == 1 && grown->peak == 300,
+             "counts frees and keeps the peak");
+  expectEqllu(__alloc_total.live, live, "returns the total to zero");
+
+  test("report");
+  block = (char *)allocate(4000);
+  char expected[128];
+  snprintf(expected, sizeof(expected), "%14d %14d %12d %12d  %s:%d", 4000,
+           4000, 1, 0, __FILE__, __LINE__ - 3);
+  FILE *stream = tmpfile();
+  allocReport(stream, 1);
+  rewind(stream);
+  char text[4096];
+  const size_t length = fread(text, 1, sizeof(text) - 1, stream);
+  text[length] = '\0';
+  fclose(stream);
+  deallocate(&block);
+  expectIncls(text, "bytes live", "prints the totals");
+  expectIncls(text, "allocations        frees  site", "prints a header");
+  expectIncls(text, expected, "lists the site holding the most memory");
+
+  test("leaks");
+  allocStderr(allocLeak, text, sizeof(text));
+  snprintf(expected, sizeof(expected), "%s:%d", __FILE__, allocLeakLine);
+  expectIncls(text, "alloc: 123 bytes leaked", "reports leaks at exit");
+  expectIncls(text, expected, "names the leaking site");
+}
+#endif
+
+int main(void) {
+  suite(allocArena);
+  suite(allocPool);
+#ifdef POOL_DEBUG
+  suite(allocPoolDebug);
+#endif
+#ifdef ALLOC_THREAD_CACHE
+  suite(allocCache);
+  suite(allocCacheThreads);
+#endif
+#ifdef ALLOC_TRACK
+  suite(allocTrack);
+#endif
+
+  return report();
+}
+
+#endif
@@ -1,7 +1,22 @@
-// Alloc (v0.1.0)
+// Alloc (v0.7.0)
 // ---
 //
-// Functions and macros for safer memory management.
+// Functions and macros for safer memory management, an arena for
+// short-lived allocations that are all released at once, and a pool for
+// many objects of the same size. allocator_t lets containers take their
+// memory from the heap, an arena or memory managed by the caller.
+//
+// Defining ALLOC_THREAD_CACHE (and linking with -pthread) makes allocate
+// serve blocks up to 256 bytes from per-thread caches, which exchange
+// batches with a central pool shared by all threads. Memory from allocate
+// must then only be released with deallocate.
+//
+// Defining ALLOC_TRACK counts live bytes, peak bytes and calls for every line
+// calling allocate or reallocate. allocReport prints the top sites on demand
+// and leaks are printed to stderr at exit.
+//
+// Defining POOL_DEBUG poisons freed pool objects and checks them when they
+// are handed out again, so double frees and writes after free panic.
 //
 // ```c
 // void* result = allocate(100);
@@ -9,11 +24,219 @@
 // allocate(100); // gives a compiler warning if not checked
 //
 // deallocate(&result);
+//
+// void* line = allocateAligned(256, 64);
+// deallocateAligned(&line);
+//
+// uint64_t* table = allocateLarge(1 << 30); // mapped, zeroed on first touch
+// deallocateLarge(&table);
+//
+// arena_t* arena = arenaCreate(0);
+// char* name = arenaAlloc(arena, 32);
+//
+// arena_mark_t mark = arenaMark(arena);
+// void* scratch = arenaAllocUninit(arena, 4096);
+// arenaRewind(arena, mark);  // releases scratch
+//
+// arenaReset(arena);         // releases everything, keeps the memory
+// arenaDestroy(&arena);
+//
+// pool_t* pool = poolCreate(sizeof(my_type_t));
+// my_type_t* value = poolAlloc(pool);
+// poolFree(pool, value);
+// poolDestroy(&pool);
 // ```
 // ___HEADER_END___
 #pragma once
 
+#include "panic.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef ALLOC_THREAD_CACHE
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "ALLOC_THREAD_CACHE needs GCC or Clang"
+#endif
+
+#include <pthread.h>
+
+#define ALLOC_CLASS_SIZE 16 // size classes are multiples of this
+#define ALLOC_CLASSES 16    // blocks up to 256 bytes are cached
+#define ALLOC_BATCH 32      // blocks moved to or from the central pool at once
+
+// Every block starts with its size class, ALLOC_CLASSES for uncached blocks
+#define __ALLOC_HEADER 16
+
+typedef struct __alloc_block_t {
+  struct __alloc_block_t *next;
+} __alloc_block_t;
+
+typedef struct {
+  __alloc_block_t *head;
+  size_t count;
+} __alloc_list_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  __alloc_list_t list;
+} __alloc_central_t;
+
+// Weak so that every translation unit shares the same pool and caches
+__attribute__((weak)) __alloc_central_t __alloc_central[ALLOC_CLASSES];
+__attribute__((weak)) pthread_once_t __alloc_once = PTHREAD_ONCE_INIT;
+__attribute__((weak)) pthread_key_t __alloc_key;
+__attribute__((weak)) __thread __alloc_list_t __alloc_cache[ALLOC_CLASSES];
+__attribute__((weak)) __thread int __alloc_registered;
+
+// Moves the blocks past the first keep ones to the central pool
+static inline void __allocFlush(size_t size_class, size_t keep) {
+  __alloc_list_t *cache = &__alloc_cache[size_class];
+  if (cache->count <= keep)
+    return;
+
+  const size_t moved = cache->count - keep;
+  __alloc_block_t *first = cache->head, *last = first;
+  for (size_t i = 1; i < moved; i++) {
+    last = last->next;
+  }
+  cache->head = last->next;
+  cache->count = keep;
+
+  __alloc_central_t *central = &__alloc_central[size_class];
+  pthread_mutex_lock(&central->lock);
+  last->next = central->list.head;
+  central->list.head = first;
+  central->list.count += moved;
+  pthread_mutex_unlock(&central->lock);
+}
+
+// Gives the cache of an exiting thread back to the central pool
+static inline void __allocThreadExit(void *unused) {
+  (void)unused;
+  for (size_t i = 0; i < ALLOC_CLASSES; i++) {
+    __allocFlush(i, 0);
+  }
+}
+
+static inline void __allocInit(void) {
+  for (size_t i = 0; i < ALLOC_CLASSES; i++) {
+    pthread_mutex_init(&__alloc_central[i].lock, NULL);
+  }
+  pthread_key_create(&__alloc_key, __allocThreadExit);
+}
+
+static inline void __allocRegister(void) {
+  if (__alloc_registered)
+    return;
+  pthread_once(&__alloc_once, __allocInit);
+  // Destructors only run for threads with a non-NULL value
+  pthread_setspecific(__alloc_key, &__alloc_registered);
+  __alloc_registered = 1;
+}
+
+static inline int __allocRefill(size_t size_class) {
+  __allocRegister();
+  __alloc_list_t *cache = &__alloc_cache[size_class];
+  __alloc_central_t *central = &__alloc_central[size_class];
+
+  pthread_mutex_lock(&central->lock);
+  while (central->list.head && cache->count < ALLOC_BATCH) {
+    __alloc_block_t *block = central->list.head;
+    central->list.head = block->next;
+    central->list.count--;
+    block->next = cache->head;
+    cache->head = block;
+    cache->count++;
+  }
+  pthread_mutex_unlock(&central->lock);
+  if (cache->head)
+    return 1;
+
+  // Carve a new batch; its memory stays in the caches for the process
+  const size_t block_size =
+      __ALLOC_HEADER + (size_class + 1) * ALLOC_CLASS_SIZE;
+  char *batch = (char *)malloc(block_size * ALLOC_BATCH);
+  if (!batch)
+    return 0;
+  for (size_t i = 0; i < ALLOC_BATCH; i++) {
+    __alloc_block_t *block = (__alloc_block_t *)(batch + i * block_size);
+    block->next = cache->head;
+    cache->head = block;
+  }
+  cache->count = ALLOC_BATCH;
+  return 1;
+}
+
+static inline void *__allocTake(size_t size) {
+  const size_t size_class = size ? (size - 1) / ALLOC_CLASS_SIZE : 0;
+  char *block;
+
+  if (size_class < ALLOC_CLASSES) {
+    __alloc_list_t *cache = &__alloc_cache[size_class];
+    if (!cache->head && !__allocRefill(size_class))
+      return NULL;
+    block = (char *)cache->head;
+    cache->head = cache->head->next;
+    cache->count--;
+    *(size_t *)block = size_class;
+  } else {
+    if (size > (size_t)-1 - __ALLOC_HEADER)
+      return NULL;
+    block = (char *)malloc(__ALLOC_HEADER + size);
+    if (!block)
+      return NULL;
+    *(size_t *)block = ALLOC_CLASSES;
+  }
+
+  return block + __ALLOC_HEADER;
+}
+
+// Frees from any thread go to the cache of that thread
+static inline void __allocRelease(void *ptr) {
+  char *block = (char *)ptr - __ALLOC_HEADER;
+  const size_t size_class = *(size_t *)block;
+  if (size_class == ALLOC_CLASSES) {
+    free(block);
+    return;
+  }
+
+  __allocRegister();
+  __alloc_list_t *cache = &__alloc_cache[size_class];
+  ((__alloc_block_t *)block)->next = cache->head;
+  cache->head = (__alloc_block_t *)block;
+  if (++cache->count > 2 * ALLOC_BATCH)
+    __allocFlush(size_class, ALLOC_BATCH);
+}
+
+static inline void *__allocResize(void *ptr, size_t size) {
+  if (!ptr)
+    return __allocTake(size);
+
+  char *block = (char *)ptr - __ALLOC_HEADER;
+  const size_t size_class = *(size_t *)block;
+  if (size_class == ALLOC_CLASSES && size > ALLOC_CLASSES * ALLOC_CLASS_SIZE) {
+    if (size > (size_t)-1 - __ALLOC_HEADER)
+      return NULL;
+    block = (char *)realloc(block, __ALLOC_HEADER + size);
+    return block ? block + __ALLOC_HEADER : NULL;
+  }
+
+  const size_t capacity = size_class == ALLOC_CLASSES
+                              ? size
+                              : (size_class + 1) * ALLOC_CLASS_SIZE;
+  if (size_class != ALLOC_CLASSES && size <= capacity)
+    return ptr;
+
+  void *result = __allocTake(size);
+  if (result) {
+    memcpy(result, ptr, size < capacity ? size : capacity);
+    __allocRelease(ptr);
+  }
+  return result;
+}
+#endif
 
 /**
  * Allocate zero-ed memory.
@@ -24,7 +247,30 @@
  *   void* result = allocate(100);
  */
 static inline void *allocate(size_t size) {
+#ifdef ALLOC_THREAD_CACHE
+  void *result = __allocTake(size);
+  if (result)
+    memset(result, 0, size);
+  return result;
+#else
   return calloc(1, size);
+#endif
+}
+
+/**
+ * Allocate memory without zeroing it.
+ * @name allocateUninit
+ * @param {size_t} size - Number of bytes to allocate
+ * @returns {void*} Allocated memory pointer
+ * @example
+ *   char* buffer = allocateUninit(4096);
+ */
+static inline void *allocateUninit(size_t size) {
+#ifdef ALLOC_THREAD_CACHE
+  return __allocTake(size);
+#else
+  return malloc(size);
+#endif
 }
 
 /**
@@ -38,7 +284,11 @@ static inline void *allocate(size_t size) {
  *   result = reallocate(&result, 200);
  */
 static inline void *reallocate(void **ptr, size_t size) {
+#ifdef ALLOC_THREAD_CACHE
+  return __allocResize(*ptr, size);
+#else
   return realloc(*ptr, size);
+#endif
 }
 
 /**
@@ -49,10 +299,843 @@ static inline void *reallocate(void **ptr, size_t size) {
  *   char *ptr = allocate(100);
  *   deallocate(&ptr);  // ptr is now NULL
  */
+#ifdef ALLOC_THREAD_CACHE
+#define __ALLOC_FREE(Pointer) __allocRelease(Pointer)
+#else
+#define __ALLOC_FREE(Pointer) free(Pointer)
+#endif
+
+#define deallocate(DoublePointer)                                              \
+  {                                                                            \
+    if (*(DoublePointer) != NULL) {                                            \
+      __ALLOC_FREE((void *)*(DoublePointer));                                  \
+      *(DoublePointer) = NULL;                                                 \
+    }                                                                          \
+  }
+
+#ifdef ALLOC_TRACK
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "ALLOC_TRACK needs GCC or Clang"
+#endif
+
+#include <stdio.h>
+#include <time.h>
+
+#define ALLOC_TRACK_SITES 4096
+
+typedef struct {
+  const char *file;
+  int line;
+  size_t live; // bytes allocated and not yet freed
+  size_t peak; // highest live so far
+  size_t allocations;
+  size_t frees;
+} alloc_site_t;
+
+// Weak so that every translation unit shares the same records
+__attribute__((weak)) alloc_site_t __alloc_sites[ALLOC_TRACK_SITES];
+__attribute__((weak)) alloc_site_t __alloc_total;    // every site
+__attribute__((weak)) alloc_site_t __alloc_overflow; // sites past the table
+__attribute__((weak)) int __alloc_track_started;
+__attribute__((weak)) clock_t __alloc_track_start;
+
+// Blocks start with their site and size
+#define __ALLOC_TRACK_HEADER 16
+
+typedef struct {
+  alloc_site_t *site;
+  size_t size;
+} __alloc_track_header_t;
+
+static inline alloc_site_t *__allocSite(const char *file, int line) {
+  const size_t hash = ((uintptr_t)file >> 3) ^ ((size_t)line * 2654435761U);
+  for (size_t i = 0; i < ALLOC_TRACK_SITES; i++) {
+    alloc_site_t *site = &__alloc_sites[(hash + i) % ALLOC_TRACK_SITES];
+    const char *owner = __atomic_load_n(&site->file, __ATOMIC_ACQUIRE);
+    if (!owner && __atomic_compare_exchange_n(&site->file, &owner, file, 0,
+                                              __ATOMIC_ACQ_REL,
+                                              __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&site->line, line, __ATOMIC_RELEASE);
+      return site;
+    }
+
+    if (owner == file) {
+      // A line of 0 means the owner is still filling in the site
+      int owner_line;
+      while (!(owner_line = __atomic_load_n(&site->line, __ATOMIC_ACQUIRE))) {
+      }
+      if (owner_line == line)
+        return site;
+    }
+  }
+  return &__alloc_overflow;
+}
+
+static inline void __allocTrackAdd(alloc_site_t *site, size_t size) {
+  const size_t live = __atomic_add_fetch(&site->live, size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&site->allocations, 1, __ATOMIC_RELAXED);
+  size_t peak = __atomic_load_n(&site->peak, __ATOMIC_RELAXED);
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&site->peak, &peak, live, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+static inline void __allocTrackRemove(alloc_site_t *site, size_t size) {
+  __atomic_sub_fetch(&site->live, size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&site->frees, 1, __ATOMIC_RELAXED);
+}
+
+static inline int __allocSiteOrder(const void *a, const void *b) {
+  const alloc_site_t *left = *(const alloc_site_t *const *)a;
+  const alloc_site_t *right = *(const alloc_site_t *const *)b;
+  if (left->live != right->live)
+    return left->live < right->live ? 1 : -1;
+  if (left->peak != right->peak)
+    return left->peak < right->peak ? 1 : -1;
+  return 0;
+}
+
+static inline void __allocPrintSites(FILE *stream, size_t limit,
+                                     int leaks_only) {
+  alloc_site_t *sites[ALLOC_TRACK_SITES + 1];
+  size_t count = 0;
+  for (size_t i = 0; i < ALLOC_TRACK_SITES; i++) {
+    if (__alloc_sites[i].file &&
+        (!leaks_only || __alloc_sites[i].live > 0)) {
+      sites[count++] = &__alloc_sites[i];
+    }
+  }
+  if (__alloc_overflow.allocations && (!leaks_only || __alloc_overflow.live))
+    sites[count++] = &__alloc_overflow;
+  qsort(sites, count, sizeof(alloc_site_t *), __allocSiteOrder);
+
+  fprintf(stream, "%14s %14s %12s %12s  site\n", "live", "peak",
+          "allocations", "frees");
+  for (size_t i = 0; i < count && i < limit; i++) {
+    fprintf(stream, "%14zu %14zu %12zu %12zu  %s:%d\n", sites[i]->live,
+            sites[i]->peak, sites[i]->allocations, sites[i]->frees,
+            sites[i]->file ? sites[i]->file : "(other)", sites[i]->line);
+  }
+}
+
+static inline void __allocReportLeaks(void) {
+  if (__alloc_total.live == 0)
+    return;
+  fprintf(stderr, "alloc: %zu bytes leaked\n", __alloc_total.live);
+  __allocPrintSites(stderr, ALLOC_TRACK_SITES + 1, 1);
+}
+
+static inline void *__allocTrack(void *block, size_t size, const char *file,
+                                 int line) {
+  if (!block)
+    return NULL;
+
+  if (!__atomic_exchange_n(&__alloc_track_started, 1, __ATOMIC_ACQ_REL)) {
+    __alloc_track_start = clock();
+    atexit(__allocReportLeaks);
+  }
+
+  __alloc_track_header_t *header = (__alloc_track_header_t *)block;
+  header->site = __allocSite(file, line);
+  header->size = size;
+  __allocTrackAdd(header->site, size);
+  __allocTrackAdd(&__alloc_total, size);
+  return (char *)block + __ALLOC_TRACK_HEADER;
+}
+
+static inline void *__allocateTracked(size_t size, const char *file,
+                                      int line) {
+  if (size > (size_t)-1 - __ALLOC_TRACK_HEADER)
+    return NULL;
+  return __allocTrack(allocate(__ALLOC_TRACK_HEADER + size), size, file, line);
+}
+
+static inline void *__allocateUninitTracked(size_t size, const char *file,
+                                            int line) {
+  if (size > (size_t)-1 - __ALLOC_TRACK_HEADER)
+    return NULL;
+  return __allocTrack(allocateUninit(__ALLOC_TRACK_HEADER + size), size, file,
+                      line);
+}
+
+static inline void *__reallocateTracked(void **ptr, size_t size,
+                                        const char *file, int line) {
+  if (!*ptr)
+    return __allocateUninitTracked(size, file, line);
+  if (size > (size_t)-1 - __ALLOC_TRACK_HEADER)
+    return NULL;
+
+  void *block = (char *)*ptr - __ALLOC_TRACK_HEADER;
+  const __alloc_track_header_t previous = *(__alloc_track_header_t *)block;
+  void *grown = reallocate(&block, __ALLOC_TRACK_HEADER + size);
+  if (!grown)
+    return NULL;
+
+  // The bytes move to the site of the last resize
+  __allocTrackRemove(previous.site, previous.size);
+  __allocTrackRemove(&__alloc_total, previous.size);
+  return __allocTrack(grown, size, file, line);
+}
+
+static inline void __deallocateTracked(void *ptr) {
+  void *block = (char *)ptr - __ALLOC_TRACK_HEADER;
+  const __alloc_track_header_t *header = (__alloc_track_header_t *)block;
+  __allocTrackRemove(header->site, header->size);
+  __allocTrackRemove(&__alloc_total, header->size);
+  __ALLOC_FREE(block);
+}
+
+/**
+ * Print the call sites holding the most memory, with their peak usage and
+ * call counts. Only available when ALLOC_TRACK is defined.
+ * @name allocReport
+ * @param {FILE*} stream - Where to print the report
+ * @param {size_t} limit - Maximum number of sites to print
+ * @example
+ *   allocReport(stderr, 10);
+ */
+static inline void allocReport(FILE *stream, size_t limit) {
+  const double seconds =
+      (double)(clock() - __alloc_track_start) / CLOCKS_PER_SEC;
+  fprintf(stream,
+          "alloc: %zu bytes live, %zu peak, %zu allocations, %zu frees",
+          __alloc_total.live, __alloc_total.peak, __alloc_total.allocations,
+          __alloc_total.frees);
+  if (seconds > 0)
+    fprintf(stream, ", %.0f allocations per CPU second",
+            (double)__alloc_total.allocations / seconds);
+  fputc('\n', stream);
+  __allocPrintSites(stream, limit, 0);
+}
+
+#define allocate(Size) __allocateTracked(Size, __FILE__, __LINE__)
+#define allocateUninit(Size) __allocateUninitTracked(Size, __FILE__, __LINE__)
+#define reallocate(Pointer, Size)                                              \
+  __reallocateTracked(Pointer, Size, __FILE__, __LINE__)
+
+#undef deallocate
 #define deallocate(DoublePointer)                                              \
   {                                                                            \
     if (*(DoublePointer) != NULL) {                                            \
-      free((void *)*(DoublePointer));                                          \
+      __deallocateTracked((void *)*(DoublePointer));                           \
+      *(DoublePointer) = NULL;                                                 \
+    }                                                                          \
+  }
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define ALLOC_MMAP 1
+#endif
+
+#define ALLOC_LARGE_THRESHOLD ((size_t)1 << 21)
+
+// Large blocks start with the length of their mapping, 0 if on the heap
+#define __ALLOC_LARGE_HEADER 64
+
+/**
+ * Allocate zero-ed memory aligned to a power of two.
+ * @name allocateAligned
+ * @param {size_t} size - Number of bytes to allocate
+ * @param {size_t} alignment - Alignment in bytes, a power of two
+ * @returns {void*} Allocated memory pointer, to release with
+ * deallocateAligned
+ * @example
+ *   void* line = allocateAligned(256, 64);
+ */
+static inline void *allocateAligned(size_t size, size_t alignment) {
+  if (alignment < sizeof(void *))
+    alignment = sizeof(void *);
+  if (size > (size_t)-1 - alignment - sizeof(void *))
+    return NULL;
+
+  char *block = (char *)allocate(size + alignment - 1 + sizeof(void *));
+  if (!block)
+    return NULL;
+
+  // The original block is kept just before the aligned start
+  const uintptr_t start =
+      ((uintptr_t)(block + sizeof(void *)) + alignment - 1) &
+      ~(uintptr_t)(alignment - 1);
+  ((void **)start)[-1] = block;
+  return (void *)start;
+}
+
+static inline void __deallocateAligned(void *ptr) {
+  void *block = ((void **)ptr)[-1];
+  deallocate(&block);
+}
+
+/**
+ * Safely deallocate memory from allocateAligned and set pointer to NULL.
+ * @name deallocateAligned
+ * @param {void**} DoublePointer - Pointer to the pointer that should be freed
+ * @example
+ *   deallocateAligned(&line);  // line is now NULL
+ */
+#define deallocateAligned(DoublePointer)                                       \
+  {                                                                            \
+    if (*(DoublePointer) != NULL) {                                            \
+      __deallocateAligned((void *)*(DoublePointer));                           \
+      *(DoublePointer) = NULL;                                                 \
+    }                                                                          \
+  }
+
+#ifdef ALLOC_MMAP
+static inline char *__allocMap(size_t length, size_t *mapped) {
+  void *base = MAP_FAILED;
+
+#if defined(ALLOC_HUGETLB) && defined(MAP_ANONYMOUS) && defined(MAP_HUGETLB)
+  // Explicit huge pages only exist if the system reserved some
+  const size_t huge = (length + ALLOC_LARGE_THRESHOLD - 1) &
+                      ~(ALLOC_LARGE_THRESHOLD - 1);
+  base = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (base != MAP_FAILED) {
+    *mapped = huge;
+    return (char *)base;
+  }
+#endif
+
+#ifdef MAP_ANONYMOUS
+  base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+              -1, 0);
+#else
+  // A private mapping of /dev/zero is anonymous memory as well
+  const int zero = open("/dev/zero", O_RDWR);
+  if (zero >= 0) {
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, zero, 0);
+    close(zero);
+  }
+#endif
+  if (base == MAP_FAILED)
+    return NULL;
+
+#ifdef MADV_HUGEPAGE
+  (void)madvise(base, length, MADV_HUGEPAGE);
+#endif
+  *mapped = length;
+  return (char *)base;
+}
+#endif
+
+/**
+ * Allocate zero-ed memory for a large table, aligned to 64 bytes. From
+ * ALLOC_LARGE_THRESHOLD bytes the memory is mapped directly: pages are zeroed
+ * by the system when first touched and backed by transparent huge pages where
+ * available. Defining ALLOC_HUGETLB tries reserved huge pages first.
+ * @name allocateLarge
+ * @param {size_t} size - Number of bytes to allocate
+ * @returns {void*} Allocated memory pointer, to release with deallocateLarge
+ * @example
+ *   uint64_t* table = allocateLarge(sizeof(uint64_t) * count);
+ */
+static inline void *allocateLarge(size_t size) {
+  if (size > (size_t)-1 - ALLOC_LARGE_THRESHOLD - __ALLOC_LARGE_HEADER)
+    return NULL;
+
+  const size_t length = __ALLOC_LARGE_HEADER + size;
+  size_t mapped = 0;
+  char *base = NULL;
+#ifdef ALLOC_MMAP
+  if (length >= ALLOC_LARGE_THRESHOLD)
+    base = __allocMap(length, &mapped);
+#endif
+  if (!base) {
+    base = (char *)allocateAligned(length, 64);
+    if (!base)
+      return NULL;
+  }
+
+  *(size_t *)base = mapped;
+  return base + __ALLOC_LARGE_HEADER;
+}
+
+static inline void __deallocateLarge(void *ptr) {
+  char *base = (char *)ptr - __ALLOC_LARGE_HEADER;
+#ifdef ALLOC_MMAP
+  const size_t mapped = *(size_t *)base;
+  if (mapped) {
+    munmap(base, mapped);
+    return;
+  }
+#endif
+  __deallocateAligned(base);
+}
+
+/**
+ * Safely deallocate memory from allocateLarge and set pointer to NULL.
+ * @name deallocateLarge
+ * @param {void**} DoublePointer - Pointer to the pointer that should be freed
+ * @example
+ *   deallocateLarge(&table);  // table is now NULL
+ */
+#define deallocateLarge(DoublePointer)                                         \
+  {                                                                            \
+    if (*(DoublePointer) != NULL) {                                            \
+      __deallocateLarge((void *)*(DoublePointer));                             \
       *(DoublePointer) = NULL;                                                 \
     }                                                                          \
   }
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_CHUNK_SIZE 65536
+
+typedef struct arena_chunk_t {
+  struct arena_chunk_t *next; // chunks after the current one are spare
+  size_t size;
+  size_t used;
+} arena_chunk_t;
+
+typedef struct {
+  size_t chunk_size;
+  arena_chunk_t *first;
+  arena_chunk_t *current;
+} arena_t;
+
+typedef struct {
+  arena_chunk_t *chunk;
+  size_t used;
+} arena_mark_t;
+
+// Chunk contents start after the header, rounded up to ARENA_ALIGNMENT
+#define __ARENA_HEADER                                                         \
+  ((sizeof(arena_chunk_t) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT *          \
+   ARENA_ALIGNMENT)
+
+static inline arena_chunk_t *__arenaChunk(size_t size) {
+  arena_chunk_t *chunk = (arena_chunk_t *)malloc(__ARENA_HEADER + size);
+  if (chunk) {
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+  }
+  return chunk;
+}
+
+static inline void *__arenaBump(arena_t *self, size_t size, size_t alignment) {
+  // Larger sizes would wrap the sums below and the size of a new chunk
+  if (size > SIZE_MAX - alignment - __ARENA_HEADER)
+    return NULL;
+
+  arena_chunk_t *chunk = self->current;
+  for (;;) {
+    const uintptr_t base = (uintptr_t)chunk + __ARENA_HEADER;
+    const uintptr_t end = base + chunk->size;
+    const uintptr_t start =
+        (base + chunk->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (start <= end && size <= end - start) {
+      chunk->used = (size_t)(start + size - base);
+      self->current = chunk;
+      return (void *)start;
+    }
+
+    // Reuse the next spare chunk if it fits, otherwise put a new one before it
+    arena_chunk_t *next = chunk->next;
+    if (next && next->size >= size + alignment) {
+      next->used = 0;
+      chunk = next;
+      continue;
+    }
+
+    const size_t needed = size + alignment;
+    next = __arenaChunk(needed > self->chunk_size ? needed : self->chunk_size);
+    if (!next)
+      return NULL;
+    next->next = chunk->next;
+    chunk->next = next;
+    chunk = next;
+  }
+}
+
+/**
+ * Create an arena. Memory is taken from the system in chunks and only given
+ * back when the arena is destroyed.
+ * @name arenaCreate
+ * @param {size_t} chunk_size - Bytes per chunk, or 0 for ARENA_CHUNK_SIZE
+ * @returns {arena_t*} Pointer to the newly created arena, or NULL on failure
+ * @example
+ *   arena_t* arena = arenaCreate(0);
+ */
+static inline arena_t *arenaCreate(size_t chunk_size) {
+  arena_t *self = (arena_t *)allocate(sizeof(arena_t));
+  if (!self)
+    return NULL;
+
+  self->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+  self->first = __arenaChunk(self->chunk_size);
+  if (!self->first) {
+    deallocate(&self);
+    return NULL;
+  }
+  self->current = self->first;
+  return self;
+}
+
+/**
+ * Allocate memory from an arena without zeroing it, aligned to
+ * ARENA_ALIGNMENT.
+ * @name arenaAllocUninit
+ * @param {arena_t*} self - Pointer to the arena
+ * @param {size_t} size - Number of bytes to allocate
+ * @returns {void*} Allocated memory pointer, or NULL on failure
+ * @example
+ *   char* buffer = arenaAllocUninit(arena, 4096);
+ */
+static inline void *arenaAllocUninit(arena_t *self, size_t size) {
+  return __arenaBump(self, size, ARENA_ALIGNMENT);
+}
+
+/**
+ * Allocate zero-ed memory from an arena, aligned to ARENA_ALIGNMENT.
+ * @name arenaAlloc
+ * @param {arena_t*} self - Pointer to the arena
+ * @param {size_t} size - Number of bytes to allocate
+ * @returns {void*} Allocated memory pointer, or NULL on failure
+ * @example
+ *   my_type_t* value = arenaAlloc(arena, sizeof(my_type_t));
+ */
+static inline void *arenaAlloc(arena_t *self, size_t size) {
+  void *result = __arenaBump(self, size, ARENA_ALIGNMENT);
+  if (result)
+    memset(result, 0, size);
+  return result;
+}
+
+/**
+ * Allocate zero-ed memory from an arena with a custom alignment.
+ * @name arenaAllocAligned
+ * @param {arena_t*} self - Pointer to the arena
+ * @param {size_t} size - Number of bytes to allocate
+ * @param {size_t} alignment - Alignment in bytes, a power of two
+ * @returns {void*} Allocated memory pointer, or NULL on failure
+ * @example
+ *   void* line = arenaAllocAligned(arena, 64, 64);
+ */
+static inline void *arenaAllocAligned(arena_t *self, size_t size,
+                                      size_t alignment) {
+  void *result = __arenaBump(self, size, alignment);
+  if (result)
+    memset(result, 0, size);
+  return result;
+}
+
+/**
+ * Remember the current position of an arena.
+ * @name arenaMark
+ * @param {const arena_t*} self - Pointer to the arena
+ * @returns {arena_mark_t} The position, to pass to arenaRewind
+ * @example
+ *   arena_mark_t mark = arenaMark(arena);
+ */
+static inline arena_mark_t arenaMark(const arena_t *self) {
+  arena_mark_t mark;
+  mark.chunk = self->current;
+  mark.used = self->current->used;
+  return mark;
+}
+
+/**
+ * Release everything allocated since a mark. Chunks filled in the meantime
+ * are kept for later allocations.
+ * @name arenaRewind
+ * @param {arena_t*} self - Pointer to the arena
+ * @param {arena_mark_t} mark - Position returned by arenaMark
+ * @example
+ *   arenaRewind(arena, mark);
+ */
+static inline void arenaRewind(arena_t *self, arena_mark_t mark) {
+  self->current = mark.chunk;
+  self->current->used = mark.used;
+}
+
+/**
+ * Release everything allocated from an arena, keeping its memory.
+ * @name arenaReset
+ * @param {arena_t*} self - Pointer to the arena
+ * @example
+ *   arenaReset(arena);
+ */
+static inline void arenaReset(arena_t *self) {
+  self->current = self->first;
+  self->current->used = 0;
+}
+
+/**
+ * Destroy an arena and give its memory back to the system.
+ * @name arenaDestroy
+ * @param {arena_t**} self - Pointer to the arena pointer (will be set to NULL)
+ * @example
+ *   arenaDestroy(&arena);
+ */
+static inline void arenaDestroy(arena_t **self) {
+  if (!self || !*self)
+    return;
+
+  arena_chunk_t *chunk = (*self)->first;
+  while (chunk) {
+    arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  deallocate(self);
+}
+
+#define POOL_SLAB_SIZE 65536
+
+#ifdef POOL_DEBUG
+// Freed objects are filled with POOL_POISON and tagged with POOL_FREED to
+// catch double frees and writes after free
+#define POOL_POISON 0xdd
+#define POOL_FREED ((uintptr_t)0xf4eef4eef4eef4eeULL)
+#endif
+
+typedef struct pool_slab_t {
+  struct pool_slab_t *next;
+} pool_slab_t;
+
+typedef struct {
+  size_t slabs;
+  size_t capacity; // objects that fit in the slabs
+  size_t used;
+  size_t peak; // highest used so far
+} pool_stats_t;
+
+typedef struct {
+  size_t object_size;
+  size_t slab_size;
+  pool_slab_t *slabs;
+  void *free;      // freed objects, linked through their first word
+  char *fresh;     // never used objects of the newest slab
+  char *fresh_end;
+  pool_stats_t stats;
+} pool_t;
+
+#define __POOL_HEADER                                                          \
+  ((sizeof(pool_slab_t) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT *             \
+   ARENA_ALIGNMENT)
+
+static inline int __poolGrow(pool_t *self) {
+  pool_slab_t *slab = (pool_slab_t *)malloc(self->slab_size);
+  if (!slab)
+    return 0;
+
+  slab->next = self->slabs;
+  self->slabs = slab;
+  self->fresh = (char *)slab + __POOL_HEADER;
+  const size_t count = (self->slab_size - __POOL_HEADER) / self->object_size;
+  self->fresh_end = self->fresh + count * self->object_size;
+  self->stats.slabs++;
+  self->stats.capacity += count;
+  return 1;
+}
+
+/**
+ * Create a pool of objects of the same size. Objects are packed in slabs of
+ * POOL_SLAB_SIZE bytes and aligned to the size of a pointer.
+ * @name poolCreate
+ * @param {size_t} object_size - Size of each object in bytes
+ * @returns {pool_t*} Pointer to the newly created pool, or NULL on failure
+ * @example
+ *   pool_t* pool = poolCreate(sizeof(my_type_t));
+ */
+static inline pool_t *poolCreate(size_t object_size) {
+  pool_t *self = (pool_t *)allocate(sizeof(pool_t));
+  if (!self)
+    return NULL;
+
+  // Free objects hold the list pointer, and the freed tag with POOL_DEBUG
+  const size_t word = sizeof(void *);
+  if (object_size < 2 * word)
+    object_size = 2 * word;
+  self->object_size = (object_size + word - 1) / word * word;
+
+  self->slab_size = POOL_SLAB_SIZE;
+  if (self->slab_size < __POOL_HEADER + self->object_size)
+    self->slab_size = __POOL_HEADER + self->object_size;
+  return self;
+}
+
+/**
+ * Take an object from a pool without zeroing it.
+ * @name poolAllocUninit
+ * @param {pool_t*} self - Pointer to the pool
+ * @returns {void*} Pointer to the object, or NULL on failure
+ * @example
+ *   my_type_t* value = poolAllocUninit(pool);
+ */
+static inline void *poolAllocUninit(pool_t *self) {
+  void *object = self->free;
+  if (object) {
+    self->free = *(void **)object;
+#ifdef POOL_DEBUG
+    const unsigned char *poison = (const unsigned char *)object;
+    for (size_t i = 2 * sizeof(void *); i < self->object_size; i++) {
+      panicif(poison[i] != POOL_POISON, "pool object written after free");
+    }
+    ((uintptr_t *)object)[1] = 0;
+#endif
+  } else {
+    if (self->fresh == self->fresh_end && !__poolGrow(self))
+      return NULL;
+    object = self->fresh;
+    self->fresh += self->object_size;
+  }
+
+  if (++self->stats.used > self->stats.peak)
+    self->stats.peak = self->stats.used;
+  return object;
+}
+
+/**
+ * Take a zero-ed object from a pool.
+ * @name poolAlloc
+ * @param {pool_t*} self - Pointer to the pool
+ * @returns {void*} Pointer to the object, or NULL on failure
+ * @example
+ *   my_type_t* value = poolAlloc(pool);
+ */
+static inline void *poolAlloc(pool_t *self) {
+  void *object = poolAllocUninit(self);
+  if (object)
+    memset(object, 0, self->object_size);
+  return object;
+}
+
+/**
+ * Give an object back to its pool.
+ * @name poolFree
+ * @param {pool_t*} self - Pointer to the pool
+ * @param {void*} object - Object returned by poolAlloc, or NULL
+ * @example
+ *   poolFree(pool, value);
+ */
+static inline void poolFree(pool_t *self, void *object) {
+  if (!object)
+    return;
+
+#ifdef POOL_DEBUG
+  panicif(((uintptr_t *)object)[1] == POOL_FREED, "pool object freed twice");
+  memset(object, POOL_POISON, self->object_size);
+  ((uintptr_t *)object)[1] = POOL_FREED;
+#endif
+
+  *(void **)object = self->free;
+  self->free = object;
+  self->stats.used--;
+}
+
+/**
+ * Get usage statistics of a pool.
+ * @name poolStats
+ * @param {const pool_t*} self - Pointer to the pool
+ * @returns {pool_stats_t} Slabs, object capacity, objects in use and peak use
+ * @example
+ *   pool_stats_t stats = poolStats(pool);
+ *   printf("%zu objects in use\n", stats.used);
+ */
+static inline pool_stats_t poolStats(const pool_t *self) {
+  return self->stats;
+}
+
+/**
+ * Destroy a pool, releasing every object still in use.
+ * @name poolDestroy
+ * @param {pool_t**} self - Pointer to the pool pointer (will be set to NULL)
+ * @example
+ *   poolDestroy(&pool);
+ */
+static inline void poolDestroy(pool_t **self) {
+  if (!self || !*self)
+    return;
+
+  pool_slab_t *slab = (*self)->slabs;
+  while (slab) {
+    pool_slab_t *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  deallocate(self);
+}
+
+typedef struct {
+  void *(*alloc)(void *context, size_t size); // memory need not be zeroed
+  void *(*realloc)(void *context, void *ptr, size_t old_size, size_t size);
+  void (*free)(void *context, void *ptr, size_t size);
+  void *context;
+} allocator_t;
+
+static inline void *__allocatorHeapAlloc(void *context, size_t size) {
+  (void)context;
+  return allocateUninit(size);
+}
+
+static inline void *__allocatorHeapRealloc(void *context, void *ptr,
+                                           size_t old_size, size_t size) {
+  (void)context;
+  (void)old_size;
+  return reallocate(&ptr, size);
+}
+
+static inline void __allocatorHeapFree(void *context, void *ptr, size_t size) {
+  (void)context;
+  (void)size;
+  deallocate(&ptr);
+}
+
+static inline void *__allocatorArenaAlloc(void *context, size_t size) {
+  return arenaAllocUninit((arena_t *)context, size);
+}
+
+static inline void *__allocatorArenaRealloc(void *context, void *ptr,
+                                            size_t old_size, size_t size) {
+  void *result = arenaAllocUninit((arena_t *)context, size);
+  if (result && ptr)
+    memcpy(result, ptr, old_size < size ? old_size : size);
+  return result;
+}
+
+static inline void __allocatorArenaFree(void *context, void *ptr,
+                                        size_t size) {
+  (void)context;
+  (void)ptr;
+  (void)size;
+}
+
+/**
+ * Get an allocator using allocate, reallocate and deallocate.
+ * @name allocatorHeap
+ * @returns {allocator_t} The allocator
+ * @example
+ *   allocator_t heap = allocatorHeap();
+ */
+static inline allocator_t allocatorHeap(void) {
+  allocator_t allocator;
+  allocator.alloc = __allocatorHeapAlloc;
+  allocator.realloc = __allocatorHeapRealloc;
+  allocator.free = __allocatorHeapFree;
+  allocator.context = NULL;
+  return allocator;
+}
+
+/**
+ * Get an allocator taking memory from an arena. Freeing does nothing: the
+ * memory comes back when the arena is reset or destroyed.
+ * @name allocatorArena
+ * @param {arena_t*} arena - Pointer to the arena
+ * @returns {allocator_t} The allocator
+ * @example
+ *   allocator_t allocator = allocatorArena(arena);
+ *   map_t* map = mapCreateWithAllocator(64, &allocator);
+ */
+static inline allocator_t allocatorArena(arena_t *arena) {
+  allocator_t allocator;
+  allocator.alloc = __allocatorArenaAlloc;
+  allocator.realloc = __allocatorArenaRealloc;
+  allocator.free = __allocatorArenaFree;
+  allocator.context = arena;
+  return allocator;
+}
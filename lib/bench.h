@@ -0,0 +1,620 @@
+// Bench (v0.0.4)
+// ---
+//
+// Microbenchmarks in the style of test.h. A benchmark is a function running
+// its body b->iterations times. benchmark() first grows the count until one
+// sample takes about BENCH_SAMPLE_NS, then warms up and times BENCH_SAMPLES
+// samples. It reports the min, median, p99 and standard deviation per
+// operation, plus operations per second from the median. Below 100 samples
+// the p99 is the slowest sample, so the column is labelled max instead. The
+// counters of perf.h are read over each timed sample and summed, and reported
+// per operation too when the system provides them; like the timer, they skip
+// the setup before benchResetTimer and between benchPause and benchResume.
+//
+// Timing uses CLOCK_MONOTONIC, which strict C99 builds only declare with
+// _POSIX_C_SOURCE or _DEFAULT_SOURCE defined (see the bench targets of the
+// Makefile); otherwise it falls back to clock(). The statistics and
+// benchZipf use sqrt and pow, so link with -lm.
+//
+// The environment selects the output and comparison at run time:
+//
+// - BENCH_FORMAT=csv or json prints every result at benchReport instead of
+//   the table printed while running
+// - BENCH_BASELINE=path compares medians with a run saved as csv or json
+// - BENCH_THRESHOLD=10 is the percentage slower than the baseline that
+//   counts as a regression, 10 by default
+// - BENCH_FILTER=text runs only the benchmarks whose name contains text
+//
+// benchRandom, benchZipf and benchStrings generate workloads.
+//
+// ```c
+// // example.bench.c
+// #include "../lib/bench.h"
+//
+// void benchSum(bench_t *b) {
+//   uint64_t sum = 0;
+//   for (uint64_t i = 0; i < b->iterations; i++) {
+//     sum += i;
+//     benchDoNotOptimize(sum);
+//   }
+// }
+//
+// int main(void) {
+//   benchmark(benchSum);
+//   return benchReport(); // the number of regressions
+// }
+// ```
+//
+// ```sh
+// BENCH_FORMAT=csv ./example.bench > baseline.csv
+// BENCH_BASELINE=baseline.csv ./example.bench
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "perf.h"
+#include <math.h>   // sqrt
+#include <stdint.h> // uint64_t
+#include <stdio.h>  // printf, fopen
+#include <stdlib.h> // getenv, qsort, strtod
+#include <string.h> // strstr
+#include <time.h>   // clock_gettime
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 11 // timed samples per benchmark
+#endif
+#ifndef BENCH_SAMPLE_NS
+#define BENCH_SAMPLE_NS 20000000ULL // target duration of one sample
+#endif
+#ifndef BENCH_WARMUP
+#define BENCH_WARMUP 1 // untimed samples before measuring
+#endif
+#if BENCH_SAMPLES >= 100
+#define __BENCH_TAIL "p99"
+#else
+#define __BENCH_TAIL "max"
+#endif
+#define BENCH_MAX 512 // benchmarks per executable
+#define BENCH_NAME 96 // bytes kept of each name
+
+typedef struct {
+  const char *name;
+  uint64_t iterations; // number of times to run the body
+  void *context;       // given to benchmarkWith
+  uint64_t start;
+  uint64_t paused_at;
+  uint64_t excluded; // nanoseconds spent paused
+  int counting;      // 1 while the samples are read by the counters
+} bench_t;
+
+typedef struct {
+  char name[BENCH_NAME];
+  uint64_t iterations;
+  double min;
+  double median;
+  double tail; // p99 of the samples, their max below 100 samples
+  double mean;
+  double stddev;
+  double ops;
+  double baseline; // median of the baseline run, 0 if none
+  double counters[PERF_COUNTERS]; // per operation, -1 when missing
+} bench_result_t;
+
+typedef void (*bench_fn_t)(bench_t *b);
+
+static bench_result_t __bench_results[BENCH_MAX];
+static int __bench_count = 0;
+static int __bench_regressions = 0;
+static int __bench_header = 0;
+static perf_t __bench_perf;
+static int __bench_perf_open = 0;
+
+static struct {
+  char name[BENCH_NAME];
+  double median;
+} __bench_baseline[BENCH_MAX];
+static int __bench_baseline_count = -1; // -1 until loaded
+
+/**
+ * Get a monotonic timestamp in nanoseconds.
+ * @name benchNow
+ * @returns {uint64_t} Nanoseconds since an arbitrary point
+ * @example
+ *   uint64_t start = benchNow();
+ */
+uint64_t benchNow(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#else
+  return (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+static inline void __benchUse(const void *value) {
+  __asm__ __volatile__("" : : "r"(value) : "memory");
+}
+#else
+static const void *volatile __bench_sink;
+static inline void __benchUse(const void *value) { __bench_sink = value; }
+#endif
+
+/**
+ * Keep the compiler from optimizing away a value or the work producing it.
+ * @name benchDoNotOptimize
+ * @param {lvalue} Value - A variable holding the result
+ * @example
+ *   uint64_t hash = hashOf(key);
+ *   benchDoNotOptimize(hash);
+ */
+#define benchDoNotOptimize(Value) __benchUse((const void *)&(Value))
+
+/**
+ * Make the compiler assume all memory was read and written, so pending
+ * stores are not dropped.
+ * @name benchClobber
+ * @example
+ *   buffer[i] = 0;
+ *   benchClobber();
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define benchClobber() __asm__ __volatile__("" : : : "memory")
+#else
+#define benchClobber() __benchUse(NULL)
+#endif
+
+/**
+ * Restart the timer and the counters of the current sample, excluding any
+ * setup done so far.
+ * @name benchResetTimer
+ * @param {bench_t*} b - The benchmark
+ * @example
+ *   fill(table);
+ *   benchResetTimer(b);
+ */
+void benchResetTimer(bench_t *b) {
+  if (b->counting)
+    perfBegin(&__bench_perf);
+  b->excluded = 0;
+  b->start = benchNow();
+}
+
+/**
+ * Stop timing, e.g. around setup inside the loop. Resume with benchResume.
+ * @name benchPause
+ * @param {bench_t*} b - The benchmark
+ * @example
+ *   benchPause(b);
+ *   refill(table);
+ *   benchResume(b);
+ */
+void benchPause(bench_t *b) {
+  if (b->counting)
+    perfPause(&__bench_perf);
+  b->paused_at = benchNow();
+}
+
+/**
+ * Resume timing after benchPause.
+ * @name benchResume
+ * @param {bench_t*} b - The benchmark
+ * @example
+ *   benchResume(b);
+ */
+void benchResume(bench_t *b) {
+  b->excluded += benchNow() - b->paused_at;
+  if (b->counting)
+    perfResume(&__bench_perf);
+}
+
+static double __benchSample(bench_t *b, bench_fn_t fn, uint64_t iterations) {
+  b->iterations = iterations;
+  b->excluded = 0;
+  if (b->counting)
+    perfBegin(&__bench_perf);
+  b->start = benchNow();
+  fn(b);
+  const uint64_t elapsed = benchNow() - b->start;
+  if (b->counting)
+    perfEnd(&__bench_perf);
+  return elapsed > b->excluded ? (double)(elapsed - b->excluded) : 0;
+}
+
+static int __benchOrder(const void *a, const void *b) {
+  const double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Reads the name and median of every result of a csv or json run
+static void __benchLoadBaseline(void) {
+  __bench_baseline_count = 0;
+  const char *path = getenv("BENCH_BASELINE");
+  if (!path)
+    return;
+
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "bench: cannot read baseline %s\n", path);
+    return;
+  }
+
+  char line[1024];
+  while (__bench_baseline_count < BENCH_MAX &&
+         fgets(line, sizeof(line), file)) {
+    char *name, *end, *median;
+    if ((name = strstr(line, "\"name\": \""))) {
+      name += 9;
+      end = strchr(name, '"');
+      median = strstr(line, "\"median_ns\": ");
+      if (median)
+        median += 13;
+    } else {
+      name = line;
+      end = strchr(name, ',');
+      // Skip the iterations and min columns to reach the median
+      median = end;
+      for (int column = 0; median && column < 2; column++) {
+        median = strchr(median + 1, ',');
+      }
+      if (median)
+        median++;
+    }
+    if (!end || !median || end - name >= BENCH_NAME)
+      continue;
+
+    const double value = strtod(median, NULL);
+    if (value <= 0)
+      continue; // the csv header
+    memcpy(__bench_baseline[__bench_baseline_count].name, name,
+           (size_t)(end - name));
+    __bench_baseline[__bench_baseline_count].name[end - name] = '\0';
+    __bench_baseline[__bench_baseline_count].median = value;
+    __bench_baseline_count++;
+  }
+  fclose(file);
+}
+
+static double __benchBaselineOf(const char *name) {
+  for (int i = 0; i < __bench_baseline_count; i++) {
+    if (strcmp(__bench_baseline[i].name, name) == 0)
+      return __bench_baseline[i].median;
+  }
+  return 0;
+}
+
+static double __benchThreshold(void) {
+  const char *threshold = getenv("BENCH_THRESHOLD");
+  return (threshold ? strtod(threshold, NULL) : 10) / 100;
+}
+
+static int __benchTable(void) {
+  const char *format = getenv("BENCH_FORMAT");
+  return !format || (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0);
+}
+
+// Prints a count per operation, or "-" when it is missing
+static void __benchPrintCounter(double value) {
+  if (value < 0)
+    printf(" %10s", "-");
+  else
+    printf(" %10.3f", value);
+}
+
+static void __benchPrint(const bench_result_t *result) {
+  // Hardware counters get columns when at least one of them opened
+  const int counters = __bench_perf.leader >= 0;
+  if (!__bench_header) {
+    __bench_header = 1;
+    printf("%-60s %12s %12s %12s %8s %14s", "benchmark", "median ns",
+           "min ns", __BENCH_TAIL " ns", "stddev", "ops/s");
+    if (counters)
+      printf(" %10s %10s %10s %10s", "IPC", "instrs/op", "LLC miss", "br miss");
+    printf("\n");
+  }
+  printf("%-60s %12.2f %12.2f %12.2f %7.1f%% %14.0f", result->name,
+         result->median, result->min, result->tail,
+         result->median > 0 ? result->stddev / result->mean * 100 : 0,
+         result->ops);
+  if (counters) {
+    const double instructions = result->counters[PERF_INSTRUCTIONS];
+    const double cycles = result->counters[PERF_CYCLES];
+    __benchPrintCounter(instructions >= 0 && cycles > 0 ? instructions / cycles
+                                                        : -1);
+    __benchPrintCounter(instructions);
+    __benchPrintCounter(result->counters[PERF_CACHE_MISSES]);
+    __benchPrintCounter(result->counters[PERF_BRANCH_MISSES]);
+  }
+  if (result->baseline > 0) {
+    const double change = result->median / result->baseline - 1;
+    printf(" %+6.1f%%%s", change * 100,
+           change > __benchThreshold() ? " REGRESSION" : "");
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+/**
+ * Check whether BENCH_FILTER selects a benchmark, to skip preparing the
+ * inputs of benchmarks that won't run.
+ * @name benchSelected
+ * @param {const char*} name - Name of the benchmark
+ * @returns {int} 1 if benchmarkWith would run it, 0 otherwise
+ * @example
+ *   if (benchSelected("lookup/1m")) {
+ *     table = buildTable(1000000);
+ *     benchmarkWith("lookup/1m", benchLookup, table);
+ *   }
+ */
+int benchSelected(const char *name) {
+  const char *filter = getenv("BENCH_FILTER");
+  return !filter || strstr(name, filter) != NULL;
+}
+
+/**
+ * Run a benchmark under a given name, passing a context to it through
+ * b->context. Use it to run one function over several inputs.
+ * @name benchmarkWith
+ * @param {const char*} name - Name of the benchmark, without quotes or commas
+ * @param {bench_fn_t} fn - The benchmark function
+ * @param {void*} context - Value available as b->context
+ * @example
+ *   benchmarkWith("lookup/1k", benchLookup, &small_table);
+ */
+void benchmarkWith(const char *name, bench_fn_t fn, void *context) {
+  if (!benchSelected(name))
+    return;
+  if (__bench_count == BENCH_MAX) {
+    fprintf(stderr, "bench: more than %d benchmarks, skipping %s\n",
+            BENCH_MAX, name);
+    return;
+  }
+  if (__bench_baseline_count < 0)
+    __benchLoadBaseline();
+  if (!__bench_perf_open) {
+    perfOpen(&__bench_perf);
+    __bench_perf_open = 1;
+  }
+
+  bench_t b;
+  memset(&b, 0, sizeof(b));
+  b.name = name;
+  b.context = context;
+
+  // Grow the count until a sample is long enough to time reliably
+  uint64_t iterations = 1;
+  double elapsed = __benchSample(&b, fn, iterations);
+  while (elapsed < BENCH_SAMPLE_NS && iterations < (1ULL << 40)) {
+    double grow = elapsed > 0 ? BENCH_SAMPLE_NS * 1.2 / elapsed : 100;
+    grow = grow > 100 ? 100 : grow < 2 ? 2 : grow;
+    iterations = (uint64_t)((double)iterations * grow);
+    elapsed = __benchSample(&b, fn, iterations);
+  }
+
+  for (int i = 0; i < BENCH_WARMUP; i++) {
+    (void)__benchSample(&b, fn, iterations);
+  }
+
+  // Each sample is counted on its own, so benchResetTimer can restart it
+  double samples[BENCH_SAMPLES];
+  double sum = 0;
+  double counts[PERF_COUNTERS] = {0}; // -1 once a sample misses a counter
+  b.counting = 1;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    samples[i] = __benchSample(&b, fn, iterations) / (double)iterations;
+    sum += samples[i];
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+      const double value = __bench_perf.values[c];
+      counts[c] = counts[c] < 0 || value < 0 ? -1 : counts[c] + value;
+    }
+  }
+  b.counting = 0;
+  qsort(samples, BENCH_SAMPLES, sizeof(double), __benchOrder);
+
+  bench_result_t *result = &__bench_results[__bench_count++];
+  strncpy(result->name, name, BENCH_NAME - 1);
+  result->name[BENCH_NAME - 1] = '\0';
+  result->iterations = iterations;
+  result->min = samples[0];
+  result->median = BENCH_SAMPLES % 2
+                       ? samples[BENCH_SAMPLES / 2]
+                       : (samples[BENCH_SAMPLES / 2 - 1] +
+                          samples[BENCH_SAMPLES / 2]) /
+                             2;
+  result->tail = samples[(BENCH_SAMPLES * 99 + 99) / 100 - 1];
+  result->mean = sum / BENCH_SAMPLES;
+  double squares = 0;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+  }
+  result->stddev = BENCH_SAMPLES > 1 ? sqrt(squares / (BENCH_SAMPLES - 1)) : 0;
+  result->ops = result->median > 0 ? 1e9 / result->median : 0;
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    result->counters[i] =
+        counts[i] < 0 ? -1 : counts[i] / (double)(iterations * BENCH_SAMPLES);
+  }
+  result->baseline = __benchBaselineOf(result->name);
+  if (result->baseline > 0 &&
+      result->median > result->baseline * (1 + __benchThreshold()))
+    __bench_regressions++;
+
+  if (__benchTable())
+    __benchPrint(result);
+}
+
+/**
+ * Run a benchmark function, named after the function.
+ * @name benchmark
+ * @example
+ *    benchmark(benchMapGet);
+ */
+#define benchmark(fn) benchmarkWith(#fn, fn, NULL)
+
+/**
+ * Get the next number of a xorshift64* sequence.
+ * @name benchRandom
+ * @param {uint64_t*} state - The sequence state, any nonzero seed
+ * @returns {uint64_t} A pseudo-random number
+ * @example
+ *   uint64_t state = 42;
+ *   uint64_t value = benchRandom(&state);
+ */
+uint64_t benchRandom(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Draw ranks from 0 to n - 1 following a Zipf distribution, where rank 0 is
+ * the most frequent. An exponent of 0 or less draws uniformly.
+ * @name benchZipf
+ * @param {uint32_t*} ranks - Receives the draws
+ * @param {size_t} count - Number of draws
+ * @param {uint32_t} n - Number of distinct ranks
+ * @param {double} exponent - Skew of the distribution, 1 is typical
+ * @param {uint64_t*} state - State for benchRandom
+ * @returns {int} 1 on success, 0 if memory runs out
+ * @example
+ *   benchZipf(ranks, 1 << 20, keys, 1.1, &state);
+ */
+int benchZipf(uint32_t *ranks, size_t count, uint32_t n, double exponent,
+              uint64_t *state) {
+  if (exponent <= 0.0) {
+    for (size_t i = 0; i < count; i++) {
+      ranks[i] = (uint32_t)(benchRandom(state) % n);
+    }
+    return 1;
+  }
+
+  double *cdf = (double *)malloc(sizeof(double) * n);
+  if (!cdf)
+    return 0;
+  double sum = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    sum += 1.0 / pow(i + 1.0, exponent);
+    cdf[i] = sum;
+  }
+
+  // Invert the cumulative function with a binary search per draw
+  for (size_t i = 0; i < count; i++) {
+    const double target =
+        (double)(benchRandom(state) >> 11) / 9007199254740992.0 * sum;
+    uint32_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+      const uint32_t mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < target)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    ranks[i] = lo;
+  }
+
+  free(cdf);
+  return 1;
+}
+
+/**
+ * Make count distinct NUL-terminated strings of length bytes, the i-th at
+ * i * (length + 1). The first four bytes tell them apart, so up to 2^24
+ * strings of at least four bytes are distinct; the rest is random.
+ * @name benchStrings
+ * @param {size_t} count - Number of strings
+ * @param {size_t} length - Bytes per string, without the NUL
+ * @param {uint64_t*} state - State for benchRandom
+ * @returns {char*} The strings, to be released with free, or NULL if memory
+ * runs out
+ * @example
+ *   char* keys = benchStrings(1000, 16, &state);
+ *   const char* third = keys + 2 * 17;
+ */
+char *benchStrings(size_t count, size_t length, uint64_t *state) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "0123456789-_";
+  char *strings = (char *)malloc(count * (length + 1));
+  if (!strings)
+    return NULL;
+
+  for (size_t i = 0; i < count; i++) {
+    char *string = strings + i * (length + 1);
+    for (size_t j = 0; j < length; j++) {
+      // Six bits of the index per byte, then random bytes
+      string[j] = j < 4 ? alphabet[(i >> (6 * j)) & 63]
+                        : alphabet[benchRandom(state) % 64];
+    }
+    string[length] = '\0';
+  }
+  return strings;
+}
+
+/**
+ * Print the results in the chosen format and return the number of
+ * regressions against the baseline.
+ * @name benchReport
+ * @example
+ *   return benchReport();
+ */
+int benchReport(void) {
+  if (__bench_perf_open) {
+    perfClose(&__bench_perf);
+    __bench_perf_open = 0;
+  }
+
+  const char *format = getenv("BENCH_FORMAT");
+  if (format && strcmp(format, "csv") == 0) {
+    printf("name,iterations,min_ns,median_ns," __BENCH_TAIL "_ns,mean_ns,"
+           "stddev_ns,ops_per_sec,baseline_ns");
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+      printf(",%s_per_op", perfName((perf_counter_t)c));
+    }
+    printf("\n");
+    for (int i = 0; i < __bench_count; i++) {
+      const bench_result_t *r = &__bench_results[i];
+      printf("%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.3f", r->name,
+             (unsigned long long)r->iterations, r->min, r->median, r->tail,
+             r->mean, r->stddev, r->ops, r->baseline);
+      // Missing counters are left empty
+      for (int c = 0; c < PERF_COUNTERS; c++) {
+        if (r->counters[c] < 0)
+          printf(",");
+        else
+          printf(",%.4f", r->counters[c]);
+      }
+      printf("\n");
+    }
+  } else if (format && strcmp(format, "json") == 0) {
+    printf("[\n");
+    for (int i = 0; i < __bench_count; i++) {
+      const bench_result_t *r = &__bench_results[i];
+      printf("  {\"name\": \"%s\", \"iterations\": %llu, \"min_ns\": %.3f, "
+             "\"median_ns\": %.3f, \"" __BENCH_TAIL "_ns\": %.3f, "
+             "\"mean_ns\": %.3f, \"stddev_ns\": %.3f, \"ops_per_sec\": %.1f, "
+             "\"baseline_ns\": %.3f",
+             r->name, (unsigned long long)r->iterations, r->min, r->median,
+             r->tail, r->mean, r->stddev, r->ops, r->baseline);
+      // Missing counters are null
+      for (int c = 0; c < PERF_COUNTERS; c++) {
+        if (r->counters[c] < 0)
+          printf(", \"%s_per_op\": null", perfName((perf_counter_t)c));
+        else
+          printf(", \"%s_per_op\": %.4f", perfName((perf_counter_t)c),
+                 r->counters[c]);
+      }
+      printf("}%s\n", i + 1 < __bench_count ? "," : "");
+    }
+    printf("]\n");
+  } else {
+    printf("\n%d benchmarks, %d regressions\n", __bench_count,
+           __bench_regressions);
+    return __bench_regressions;
+  }
+
+  if (__bench_regressions)
+    fprintf(stderr, "%d regressions\n", __bench_regressions);
+  return __bench_regressions;
+}
@@ -0,0 +1,1234 @@
+#include "bitmap.h"
+#include "alloc.h"
+#include "panic.h"
+#include <string.h>
+
+// An array container switches to a bitset past this many members: 4096
+// 16-bit members take as much space as the 8KB bitset.
+#define BITMAP_ARRAY_MAX 4096
+#define BITMAP_BITSET_WORDS 1024
+// Past this many runs (4 bytes each) a bitset is smaller
+#define BITMAP_RUN_MAX 2048
+
+#define BITMAP_MAGIC_SIZE 4
+static const uint8_t BITMAP_MAGIC[BITMAP_MAGIC_SIZE] = {'R', 'B', 'M', 1};
+#define BITMAP_HEADER_SIZE (BITMAP_MAGIC_SIZE + 8)
+#define BITMAP_CONTAINER_HEADER_SIZE (8 + 1 + 4 + 4)
+
+static inline uint32_t bitmapPopcount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint32_t)__builtin_popcountll(word);
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ULL);
+  word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+  word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (uint32_t)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline uint32_t bitmapCountTrailingZeros(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint32_t)__builtin_ctzll(word);
+#else
+  uint32_t count = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
+// Sets bits from start to end, both inclusive
+static void bitmapSetRange(uint64_t *words, uint32_t start, uint32_t end) {
+  uint32_t first = start >> 6, last = end >> 6;
+  uint64_t first_mask = ~0ULL << (start & 63);
+  uint64_t last_mask = ~0ULL >> (63 - (end & 63));
+
+  if (first == last) {
+    words[first] |= first_mask & last_mask;
+    return;
+  }
+
+  words[first] |= first_mask;
+  for (uint32_t i = first + 1; i < last; i++) {
+    words[i] = ~0ULL;
+  }
+  words[last] |= last_mask;
+}
+
+// The loops below are kept branch-free over whole bitsets so that compilers
+// vectorise them; counting is a separate pass to not block that.
+static uint32_t bitmapCountWords(const uint64_t *words) {
+  uint32_t cardinality = 0;
+  for (uint32_t i = 0; i < BITMAP_BITSET_WORDS; i++) {
+    cardinality += bitmapPopcount(words[i]);
+  }
+  return cardinality;
+}
+
+static uint32_t bitmapAndWords(const uint64_t *a, const uint64_t *b,
+                               uint64_t *result) {
+  for (uint32_t i = 0; i < BITMAP_BITSET_WORDS; i++) {
+    result[i] = a[i] & b[i];
+  }
+  return bitmapCountWords(result);
+}
+
+static uint32_t bitmapOrWords(const uint64_t *a, const uint64_t *b,
+                              uint64_t *result) {
+  for (uint32_t i = 0; i < BITMAP_BITSET_WORDS; i++) {
+    result[i] = a[i] | b[i];
+  }
+  return bitmapCountWords(result);
+}
+
+static uint32_t bitmapCountRunsInWords(const uint64_t *words) {
+  uint32_t runs = 0;
+  uint64_t previous = 0;
+  for (uint32_t i = 0; i < BITMAP_BITSET_WORDS; i++) {
+    // A run starts on every set bit whose predecessor is unset
+    runs += bitmapPopcount(words[i] & ~((words[i] << 1) | (previous >> 63)));
+    previous = words[i];
+  }
+  return runs;
+}
+
+// Runs are stored as (start, length - 1) pairs so that one run can span all
+// 65536 members of a container.
+static inline uint32_t bitmapRunEnd(const uint16_t *runs, uint32_t index) {
+  return (uint32_t)runs[2 * index] + runs[2 * index + 1];
+}
+
+// Returns the index of the last run starting at or before low, or -1
+static int64_t bitmapRunFind(const bitmap_container_t *container,
+                             uint16_t low) {
+  const uint16_t *runs = (const uint16_t *)container->data;
+  int64_t lo = 0, hi = (int64_t)container->length - 1, result = -1;
+
+  while (lo <= hi) {
+    int64_t mid = lo + (hi - lo) / 2;
+    if (runs[2 * mid] <= low) {
+      result = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  return result;
+}
+
+// Returns the index of the first member greater or equal to low
+static uint32_t bitmapArrayFind(const bitmap_container_t *container,
+                                uint16_t low) {
+  const uint16_t *values = (const uint16_t *)container->data;
+  uint32_t lo = 0, hi = container->length;
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (values[mid] < low) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static int bitmapContainerHas(const bitmap_container_t *container,
+                              uint16_t low) {
+  switch (container->type) {
+  case BITMAP_CONTAINER_ARRAY: {
+    uint32_t index = bitmapArrayFind(container, low);
+    return index < container->length &&
+           ((const uint16_t *)container->data)[index] == low;
+  }
+  case BITMAP_CONTAINER_BITSET: {
+    const uint64_t *words = (const uint64_t *)container->data;
+    return (int)((words[low >> 6] >> (low & 63)) & 1);
+  }
+  case BITMAP_CONTAINER_RUN: {
+    int64_t index = bitmapRunFind(container, low);
+    return index >= 0 &&
+           low <= bitmapRunEnd(container->data, (uint32_t)index);
+  }
+  default:
+    panic("unknown container type");
+  }
+  return 0;
+}
+
+static void bitmapContainerToWords(const bitmap_container_t *container,
+                                   uint64_t *words) {
+  memset(words, 0, sizeof(uint64_t) * BITMAP_BITSET_WORDS);
+
+  switch (container->type) {
+  case BITMAP_CONTAINER_ARRAY: {
+    const uint16_t *values = (const uint16_t *)container->data;
+    for (uint32_t i = 0; i < container->length; i++) {
+      words[values[i] >> 6] |= 1ULL << (values[i] & 63);
+    }
+    break;
+  }
+  case BITMAP_CONTAINER_BITSET:
+    memcpy(words, container->data, sizeof(uint64_t) * BITMAP_BITSET_WORDS);
+    break;
+  case BITMAP_CONTAINER_RUN: {
+    const uint16_t *runs = (const uint16_t *)container->data;
+    for (uint32_t i = 0; i < container->length; i++) {
+      bitmapSetRange(words, runs[2 * i], bitmapRunEnd(runs, i));
+    }
+    break;
+  }
+  default:
+    panic("unknown container type");
+  }
+}
+
+// Returns the container bitset, expanding arrays and runs in scratch
+static const uint64_t *bitmapContainerWords(const bitmap_container_t *container,
+                                            uint64_t *scratch) {
+  if (container->type == BITMAP_CONTAINER_BITSET)
+    return (const uint64_t *)container->data;
+  bitmapContainerToWords(container, scratch);
+  return scratch;
+}
+
+// Replaces the container data with words in the requested representation
+static bitmap_result_t bitmapContainerFromWords(bitmap_container_t *container,
+                                                const uint64_t *words,
+                                                uint32_t cardinality,
+                                                bitmap_container_type_t type) {
+  void *data = NULL;
+  uint32_t length = 0;
+
+  switch (type) {
+  case BITMAP_CONTAINER_ARRAY: {
+    uint16_t *values = (uint16_t *)allocate(sizeof(uint16_t) * cardinality);
+    if (!values)
+      return BITMAP_ERROR_ALLOCATION;
+
+    for (uint32_t i = 0; i < BITMAP_BITSET_WORDS; i++) {
+      uint64_t word = words[i];
+      while (word) {
+        values[length++] =
+            (uint16_t)((i << 6) + bitmapCountTrailingZeros(word));
+        word &= word - 1;
+      }
+    }
+    data = values;
+    break;
+  }
+  case BITMAP_CONTAINER_BITSET: {
+    length = BITMAP_BITSET_WORDS;
+    data = allocate(sizeof(uint64_t) * BITMAP_BITSET_WORDS);
+    if (!data)
+      return BITMAP_ERROR_ALLOCATION;
+    memcpy(data, words, sizeof(uint64_t) * BITMAP_BITSET_WORDS);
+    break;
+  }
+  case BITMAP_CONTAINER_RUN: {
+    uint32_t runs_count = bitmapCountRunsInWords(words);
+    uint16_t *runs = (uint16_t *)allocate(sizeof(uint16_t) * 2 * runs_count);
+    if (!runs)
+      return BITMAP_ERROR_ALLOCATION;
+
+    int in_run = 0;
+    for (uint32_t i = 0; i < BITMAP_BITSET_WORDS * 64; i++) {
+      int bit = (int)((words[i >> 6] >> (i & 63)) & 1);
+      if (bit && !in_run) {
+        runs[2 * length] = (uint16_t)i;
+        in_run = 1;
+      } else if (!bit && in_run) {
+        runs[2 * length + 1] = (uint16_t)(i - 1 - runs[2 * length]);
+        length++;
+        in_run = 0;
+      }
+    }
+    if (in_run) {
+      runs[2 * length + 1] = (uint16_t)(UINT16_MAX - runs[2 * length]);
+      length++;
+    }
+    data = runs;
+    break;
+  }
+  default:
+    panic("unknown container type");
+  }
+
+  deallocate(&container->data);
+  container->data = data;
+  container->type = type;
+  container->length = length;
+  container->capacity = type == BITMAP_CONTAINER_RUN ? length * 2 : length;
+  container->cardinality = cardinality;
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapContainerConvert(bitmap_container_t *container,
+                                              bitmap_container_type_t type) {
+  uint64_t words[BITMAP_BITSET_WORDS];
+  bitmapContainerToWords(container, words);
+  return bitmapContainerFromWords(container, words, container->cardinality,
+                                  type);
+}
+
+// Grows data to hold at least capacity elements of element_size bytes
+static bitmap_result_t bitmapContainerReserve(bitmap_container_t *container,
+                                              uint32_t capacity,
+                                              size_t element_size) {
+  if (container->capacity >= capacity)
+    return BITMAP_RESULT_OK;
+
+  uint32_t new_capacity = container->capacity ? container->capacity * 2 : 4;
+  if (new_capacity < capacity)
+    new_capacity = capacity;
+
+  void *data = reallocate(&container->data, element_size * new_capacity);
+  if (!data)
+    return BITMAP_ERROR_ALLOCATION;
+
+  container->data = data;
+  container->capacity = new_capacity;
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapArrayAdd(bitmap_container_t *container,
+                                      uint16_t low) {
+  uint32_t index = bitmapArrayFind(container, low);
+  uint16_t *values = (uint16_t *)container->data;
+  if (index < container->length && values[index] == low)
+    return BITMAP_RESULT_OK;
+
+  if (container->length == BITMAP_ARRAY_MAX) {
+    bitmap_result_t result =
+        bitmapContainerConvert(container, BITMAP_CONTAINER_BITSET);
+    if (result != BITMAP_RESULT_OK)
+      return result;
+
+    uint64_t *words = (uint64_t *)container->data;
+    words[low >> 6] |= 1ULL << (low & 63);
+    container->cardinality++;
+    return BITMAP_RESULT_OK;
+  }
+
+  if (bitmapContainerReserve(container, container->length + 1,
+                             sizeof(uint16_t)) !=
+      BITMAP_RESULT_OK)
+    return BITMAP_ERROR_ALLOCATION;
+
+  values = (uint16_t *)container->data;
+  memmove(&values[index + 1], &values[index],
+          sizeof(uint16_t) * (container->length - index));
+  values[index] = low;
+  container->length++;
+  container->cardinality++;
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapRunInsert(bitmap_container_t *container,
+                                       uint32_t index, uint16_t start,
+                                       uint16_t length) {
+  if (bitmapContainerReserve(container, (container->length + 1) * 2,
+                             sizeof(uint16_t)) != BITMAP_RESULT_OK)
+    return BITMAP_ERROR_ALLOCATION;
+
+  uint16_t *runs = (uint16_t *)container->data;
+  memmove(&runs[2 * (index + 1)], &runs[2 * index],
+          sizeof(uint16_t) * 2 * (container->length - index));
+  runs[2 * index] = start;
+  runs[2 * index + 1] = length;
+  container->length++;
+  return BITMAP_RESULT_OK;
+}
+
+static void bitmapRunRemove(bitmap_container_t *container, uint32_t index) {
+  uint16_t *runs = (uint16_t *)container->data;
+  memmove(&runs[2 * index], &runs[2 * (index + 1)],
+          sizeof(uint16_t) * 2 * (container->length - index - 1));
+  container->length--;
+}
+
+static bitmap_result_t bitmapRunAdd(bitmap_container_t *container,
+                                    uint16_t low) {
+  int64_t index = bitmapRunFind(container, low);
+  uint16_t *runs = (uint16_t *)container->data;
+
+  if (index >= 0 && low <= bitmapRunEnd(runs, (uint32_t)index))
+    return BITMAP_RESULT_OK;
+
+  uint32_t next = (uint32_t)(index + 1);
+  int extends_previous =
+      index >= 0 && bitmapRunEnd(runs, (uint32_t)index) + 1 == low;
+  int extends_next = next < container->length && (uint32_t)low + 1 == runs[2 * next];
+
+  if (extends_previous && extends_next) {
+    runs[2 * index + 1] =
+        (uint16_t)(bitmapRunEnd(runs, next) - runs[2 * index]);
+    bitmapRunRemove(container, next);
+  } else if (extends_previous) {
+    runs[2 * index + 1]++;
+  } else if (extends_next) {
+    runs[2 * next]--;
+    runs[2 * next + 1]++;
+  } else if (container->length == BITMAP_RUN_MAX) {
+    bitmap_result_t result =
+        bitmapContainerConvert(container, BITMAP_CONTAINER_BITSET);
+    if (result != BITMAP_RESULT_OK)
+      return result;
+
+    uint64_t *words = (uint64_t *)container->data;
+    words[low >> 6] |= 1ULL << (low & 63);
+  } else if (bitmapRunInsert(container, next, low, 0) != BITMAP_RESULT_OK) {
+    return BITMAP_ERROR_ALLOCATION;
+  }
+
+  container->cardinality++;
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapContainerAdd(bitmap_container_t *container,
+                                          uint16_t low) {
+  switch (container->type) {
+  case BITMAP_CONTAINER_ARRAY:
+    return bitmapArrayAdd(container, low);
+  case BITMAP_CONTAINER_BITSET: {
+    uint64_t *words = (uint64_t *)container->data;
+    uint64_t mask = 1ULL << (low & 63);
+    if (!(words[low >> 6] & mask)) {
+      words[low >> 6] |= mask;
+      container->cardinality++;
+    }
+    return BITMAP_RESULT_OK;
+  }
+  case BITMAP_CONTAINER_RUN:
+    return bitmapRunAdd(container, low);
+  default:
+    panic("unknown container type");
+  }
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapContainerDelete(bitmap_container_t *container,
+                                             uint16_t low) {
+  switch (container->type) {
+  case BITMAP_CONTAINER_ARRAY: {
+    uint32_t index = bitmapArrayFind(container, low);
+    uint16_t *values = (uint16_t *)container->data;
+    if (index < container->length && values[index] == low) {
+      memmove(&values[index], &values[index + 1],
+              sizeof(uint16_t) * (container->length - index - 1));
+      container->length--;
+      container->cardinality--;
+    }
+    return BITMAP_RESULT_OK;
+  }
+  case BITMAP_CONTAINER_BITSET: {
+    uint64_t *words = (uint64_t *)container->data;
+    uint64_t mask = 1ULL << (low & 63);
+    if (words[low >> 6] & mask) {
+      words[low >> 6] &= ~mask;
+      container->cardinality--;
+      if (container->cardinality <= BITMAP_ARRAY_MAX)
+        return bitmapContainerConvert(container, BITMAP_CONTAINER_ARRAY);
+    }
+    return BITMAP_RESULT_OK;
+  }
+  case BITMAP_CONTAINER_RUN: {
+    int64_t found = bitmapRunFind(container, low);
+    uint16_t *runs = (uint16_t *)container->data;
+    if (found < 0 || low > bitmapRunEnd(runs, (uint32_t)found))
+      return BITMAP_RESULT_OK;
+
+    uint32_t index = (uint32_t)found;
+    uint16_t start = runs[2 * index];
+    uint32_t end = bitmapRunEnd(runs, index);
+
+    if (start == end) {
+      bitmapRunRemove(container, index);
+    } else if (low == start) {
+      runs[2 * index]++;
+      runs[2 * index + 1]--;
+    } else if (low == end) {
+      runs[2 * index + 1]--;
+    } else {
+      if (container->length == BITMAP_RUN_MAX) {
+        bitmap_result_t result =
+            bitmapContainerConvert(container, BITMAP_CONTAINER_BITSET);
+        if (result != BITMAP_RESULT_OK)
+          return result;
+        return bitmapContainerDelete(container, low);
+      }
+      if (bitmapRunInsert(container, index + 1, (uint16_t)(low + 1),
+                          (uint16_t)(end - low - 1)) != BITMAP_RESULT_OK)
+        return BITMAP_ERROR_ALLOCATION;
+      runs = (uint16_t *)container->data;
+      runs[2 * index + 1] = (uint16_t)(low - 1 - start);
+    }
+    container->cardinality--;
+    return BITMAP_RESULT_OK;
+  }
+  default:
+    panic("unknown container type");
+  }
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapContainerCopy(const bitmap_container_t *source,
+                                           bitmap_container_t *destination) {
+  size_t bytes;
+  switch (source->type) {
+  case BITMAP_CONTAINER_ARRAY:
+    bytes = sizeof(uint16_t) * source->length;
+    break;
+  case BITMAP_CONTAINER_BITSET:
+    bytes = sizeof(uint64_t) * BITMAP_BITSET_WORDS;
+    break;
+  case BITMAP_CONTAINER_RUN:
+    bytes = sizeof(uint16_t) * 2 * source->length;
+    break;
+  default:
+    panic("unknown container type");
+    return BITMAP_ERROR_ALLOCATION;
+  }
+
+  *destination = *source;
+  destination->data = allocate(bytes);
+  if (!destination->data)
+    return BITMAP_ERROR_ALLOCATION;
+
+  memcpy(destination->data, source->data, bytes);
+  destination->capacity =
+      source->type == BITMAP_CONTAINER_RUN ? source->length * 2 : source->length;
+  return BITMAP_RESULT_OK;
+}
+
+static bitmap_result_t bitmapContainerIntersect(const bitmap_container_t *a,
+                                                const bitmap_container_t *b,
+                                                bitmap_container_t *result) {
+  memset(result, 0, sizeof(bitmap_container_t));
+  result->key = a->key;
+
+  if (b->type == BITMAP_CONTAINER_ARRAY && a->type != BITMAP_CONTAINER_ARRAY) {
+    const bitmap_container_t *swap = a;
+    a = b;
+    b = swap;
+  }
+
+  if (a->type == BITMAP_CONTAINER_ARRAY) {
+    uint16_t *values = (uint16_t *)allocate(sizeof(uint16_t) * a->length);
+    if (!values)
+      return BITMAP_ERROR_ALLOCATION;
+
+    const uint16_t *left = (const uint16_t *)a->data;
+    uint32_t length = 0;
+
+    if (b->type == BITMAP_CONTAINER_ARRAY) {
+      const uint16_t *right = (const uint16_t *)b->data;
+      uint32_t i = 0, j = 0;
+      while (i < a->length && j < b->length) {
+        if (left[i] < right[j]) {
+          i++;
+        } else if (left[i] > right[j]) {
+          j++;
+        } else {
+          values[length++] = left[i];
+          i++;
+          j++;
+        }
+      }
+    } else {
+      for (uint32_t i = 0; i < a->length; i++) {
+        if (bitmapContainerHas(b, left[i]))
+          values[length++] = left[i];
+      }
+    }
+
+    result->type = BITMAP_CONTAINER_ARRAY;
+    result->data = values;
+    result->length = length;
+    result->capacity = a->length;
+    result->cardinality = length;
+    return BITMAP_RESULT_OK;
+  }
+
+  uint64_t scratch_a[BITMAP_BITSET_WORDS], scratch_b[BITMAP_BITSET_WORDS];
+  uint64_t words[BITMAP_BITSET_WORDS];
+  uint32_t cardinality =
+      bitmapAndWords(bitmapContainerWords(a, scratch_a),
+                     bitmapContainerWords(b, scratch_b), words);
+  if (cardinality == 0)
+    return BITMAP_RESULT_OK;
+
+  return bitmapContainerFromWords(result, words, cardinality,
+                                  cardinality <= BITMAP_ARRAY_MAX
+                                      ? BITMAP_CONTAINER_ARRAY
+                                      : BITMAP_CONTAINER_BITSET);
+}
+
+static bitmap_result_t bitmapContainerUnion(const bitmap_container_t *a,
+                                            const bitmap_container_t *b,
+                                            bitmap_container_t *result) {
+  memset(result, 0, sizeof(bitmap_container_t));
+  result->key = a->key;
+
+  if (a->type == BITMAP_CONTAINER_ARRAY && b->type == BITMAP_CONTAINER_ARRAY &&
+      a->length + b->length <= BITMAP_ARRAY_MAX) {
+    uint16_t *values =
+        (uint16_t *)allocate(sizeof(uint16_t) * (a->length + b->length));
+    if (!values)
+      return BITMAP_ERROR_ALLOCATION;
+
+    const uint16_t *left = (const uint16_t *)a->data;
+    const uint16_t *right = (const uint16_t *)b->data;
+    uint32_t i = 0, j = 0, length = 0;
+    while (i < a->length || j < b->length) {
+      if (j == b->length || (i < a->length && left[i] < right[j])) {
+        values[length++] = left[i++];
+      } else if (i == a->length || right[j] < left[i]) {
+        values[length++] = right[j++];
+      } else {
+        values[length++] = left[i];
+        i++;
+        j++;
+      }
+    }
+
+    result->type = BITMAP_CONTAINER_ARRAY;
+    result->data = values;
+    result->length = length;
+    result->capacity = a->length + b->length;
+    result->cardinality = length;
+    return BITMAP_RESULT_OK;
+  }
+
+  uint64_t scratch_a[BITMAP_BITSET_WORDS], scratch_b[BITMAP_BITSET_WORDS];
+  uint64_t words[BITMAP_BITSET_WORDS];
+  uint32_t cardinality =
+      bitmapOrWords(bitmapContainerWords(a, scratch_a),
+                    bitmapContainerWords(b, scratch_b), words);
+
+  // Two run containers usually stay cheaper as runs
+  bitmap_container_type_t type = cardinality <= BITMAP_ARRAY_MAX
+                                     ? BITMAP_CONTAINER_ARRAY
+                                     : BITMAP_CONTAINER_BITSET;
+  if (a->type == BITMAP_CONTAINER_RUN && b->type == BITMAP_CONTAINER_RUN &&
+      bitmapCountRunsInWords(words) <= BITMAP_RUN_MAX)
+    type = BITMAP_CONTAINER_RUN;
+
+  return bitmapContainerFromWords(result, words, cardinality, type);
+}
+
+// Returns 1 if a container with key exists; index is its position or the
+// position where it should be inserted
+static int bitmapFind(const bitmap_t *self, uint64_t key,
+                      bitmap_size_t *index) {
+  bitmap_size_t lo = 0, hi = self->count;
+
+  while (lo < hi) {
+    bitmap_size_t mid = lo + (hi - lo) / 2;
+    if (self->containers[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  *index = lo;
+  return lo < self->count && self->containers[lo].key == key;
+}
+
+static bitmap_result_t bitmapReserve(bitmap_t *self, bitmap_size_t capacity) {
+  if (self->capacity >= capacity)
+    return BITMAP_RESULT_OK;
+
+  bitmap_size_t new_capacity = self->capacity ? self->capacity * 2 : 4;
+  if (new_capacity < capacity)
+    new_capacity = capacity;
+
+  void *containers = reallocate((void **)&self->containers,
+                                sizeof(bitmap_container_t) * new_capacity);
+  if (!containers)
+    return BITMAP_ERROR_ALLOCATION;
+
+  self->containers = (bitmap_container_t *)containers;
+  self->capacity = new_capacity;
+  return BITMAP_RESULT_OK;
+}
+
+// Appends a container, taking ownership of its data. Empty ones are dropped.
+static bitmap_result_t bitmapPush(bitmap_t *self,
+                                  bitmap_container_t *container) {
+  if (container->cardinality == 0) {
+    deallocate(&container->data);
+    return BITMAP_RESULT_OK;
+  }
+
+  if (bitmapReserve(self, self->count + 1) != BITMAP_RESULT_OK) {
+    deallocate(&container->data);
+    return BITMAP_ERROR_ALLOCATION;
+  }
+
+  self->containers[self->count++] = *container;
+  return BITMAP_RESULT_OK;
+}
+
+static void bitmapRemove(bitmap_t *self, bitmap_size_t index) {
+  deallocate(&self->containers[index].data);
+  memmove(&self->containers[index], &self->containers[index + 1],
+          sizeof(bitmap_container_t) * (self->count - index - 1));
+  self->count--;
+}
+
+bitmap_t *bitmapCreate(void) {
+  return (bitmap_t *)allocate(sizeof(bitmap_t));
+}
+
+bitmap_result_t bitmapAdd(bitmap_t *self, uint64_t value) {
+  panicif(!self, "bitmap cannot be null");
+  const uint64_t key = value >> 16;
+  const uint16_t low = (uint16_t)(value & UINT16_MAX);
+  bitmap_size_t index;
+
+  if (bitmapFind(self, key, &index))
+    return bitmapContainerAdd(&self->containers[index], low);
+
+  if (bitmapReserve(self, self->count + 1) != BITMAP_RESULT_OK)
+    return BITMAP_ERROR_ALLOCATION;
+
+  bitmap_container_t container = {0};
+  container.key = key;
+  container.type = BITMAP_CONTAINER_ARRAY;
+  if (bitmapArrayAdd(&container, low) != BITMAP_RESULT_OK)
+    return BITMAP_ERROR_ALLOCATION;
+
+  memmove(&self->containers[index + 1], &self->containers[index],
+          sizeof(bitmap_container_t) * (self->count - index));
+  self->containers[index] = container;
+  self->count++;
+  return BITMAP_RESULT_OK;
+}
+
+int bitmapHas(const bitmap_t *self, uint64_t value) {
+  panicif(!self, "bitmap cannot be null");
+  bitmap_size_t index;
+  if (!bitmapFind(self, value >> 16, &index))
+    return 0;
+  return bitmapContainerHas(&self->containers[index],
+                            (uint16_t)(value & UINT16_MAX));
+}
+
+void bitmapDelete(bitmap_t *self, uint64_t value) {
+  panicif(!self, "bitmap cannot be null");
+  bitmap_size_t index;
+  if (!bitmapFind(self, value >> 16, &index))
+    return;
+
+  bitmap_container_t *container = &self->containers[index];
+  // Deleting can only fail while splitting a run into a new bitset, in which
+  // case the member stays in the bitmap
+  (void)bitmapContainerDelete(container, (uint16_t)(value & UINT16_MAX));
+  if (container->cardinality == 0)
+    bitmapRemove(self, index);
+}
+
+bitmap_size_t bitmapCardinality(const bitmap_t *self) {
+  panicif(!self, "bitmap cannot be null");
+  bitmap_size_t cardinality = 0;
+  for (bitmap_size_t i = 0; i < self->count; i++) {
+    cardinality += self->containers[i].cardinality;
+  }
+  return cardinality;
+}
+
+bitmap_result_t bitmapOptimize(bitmap_t *self) {
+  panicif(!self, "bitmap cannot be null");
+
+  for (bitmap_size_t i = 0; i < self->count; i++) {
+    bitmap_container_t *container = &self->containers[i];
+    uint64_t scratch[BITMAP_BITSET_WORDS];
+    const uint64_t *words = bitmapContainerWords(container, scratch);
+
+    const uint64_t array_size = 2ULL * container->cardinality;
+    const uint64_t bitset_size = 8ULL * BITMAP_BITSET_WORDS;
+    const uint64_t run_size = 4ULL * bitmapCountRunsInWords(words);
+
+    bitmap_container_type_t type = BITMAP_CONTAINER_BITSET;
+    if (array_size <= bitset_size && array_size <= run_size)
+      type = BITMAP_CONTAINER_ARRAY;
+    else if (run_size < bitset_size)
+      type = BITMAP_CONTAINER_RUN;
+
+    if (type == container->type)
+      continue;
+
+    if (words != scratch) {
+      memcpy(scratch, words, sizeof(scratch));
+    }
+    if (bitmapContainerFromWords(container, scratch, container->cardinality,
+                                 type) != BITMAP_RESULT_OK)
+      return BITMAP_ERROR_ALLOCATION;
+  }
+
+  return BITMAP_RESULT_OK;
+}
+
+bitmap_t *bitmapUnion(const bitmap_t *a, const bitmap_t *b) {
+  panicif(!a || !b, "bitmap cannot be null");
+  bitmap_t *self = bitmapCreate();
+  if (!self)
+    return NULL;
+
+  bitmap_size_t i = 0, j = 0;
+  while (i < a->count || j < b->count) {
+    bitmap_container_t container;
+    bitmap_result_t result;
+
+    if (j == b->count ||
+        (i < a->count && a->containers[i].key < b->containers[j].key)) {
+      result = bitmapContainerCopy(&a->containers[i++], &container);
+    } else if (i == a->count || b->containers[j].key < a->containers[i].key) {
+      result = bitmapContainerCopy(&b->containers[j++], &container);
+    } else {
+      result = bitmapContainerUnion(&a->containers[i++], &b->containers[j++],
+                                    &container);
+    }
+
+    if (result != BITMAP_RESULT_OK || bitmapPush(self, &container) != BITMAP_RESULT_OK) {
+      bitmapDestroy(&self);
+      return NULL;
+    }
+  }
+
+  return self;
+}
+
+bitmap_t *bitmapIntersect(const bitmap_t *a, const bitmap_t *b) {
+  panicif(!a || !b, "bitmap cannot be null");
+  bitmap_t *self = bitmapCreate();
+  if (!self)
+    return NULL;
+
+  bitmap_size_t i = 0, j = 0;
+  while (i < a->count && j < b->count) {
+    if (a->containers[i].key < b->containers[j].key) {
+      i++;
+      continue;
+    }
+    if (b->containers[j].key < a->containers[i].key) {
+      j++;
+      continue;
+    }
+
+    bitmap_container_t container;
+    if (bitmapContainerIntersect(&a->containers[i++], &b->containers[j++],
+                                 &container) != BITMAP_RESULT_OK ||
+        bitmapPush(self, &container) != BITMAP_RESULT_OK) {
+      bitmapDestroy(&self);
+      return NULL;
+    }
+  }
+
+  return self;
+}
+
+static bitmap_size_t bitmapPayloadSize(const bitmap_container_t *container) {
+  switch (container->type) {
+  case BITMAP_CONTAINER_ARRAY:
+    return 2ULL * container->length;
+  case BITMAP_CONTAINER_BITSET:
+    return 8ULL * BITMAP_BITSET_WORDS;
+  case BITMAP_CONTAINER_RUN:
+    return 4ULL * container->length;
+  default:
+    panic("unknown container type");
+  }
+  return 0;
+}
+
+static void bitmapWriteLE(uint8_t **cursor, uint64_t value, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) {
+    (*cursor)[i] = (uint8_t)(value >> (8 * i));
+  }
+  *cursor += bytes;
+}
+
+static uint64_t bitmapReadLE(const uint8_t **cursor, uint8_t bytes) {
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < bytes; i++) {
+    value |= (uint64_t)(*cursor)[i] << (8 * i);
+  }
+  *cursor += bytes;
+  return value;
+}
+
+bitmap_size_t bitmapSerializedSize(const bitmap_t *self) {
+  panicif(!self, "bitmap cannot be null");
+  bitmap_size_t size = BITMAP_HEADER_SIZE;
+  for (bitmap_size_t i = 0; i < self->count; i++) {
+    size += BITMAP_CONTAINER_HEADER_SIZE +
+            bitmapPayloadSize(&self->containers[i]);
+  }
+  return size;
+}
+
+bitmap_size_t bitmapSerialize(const bitmap_t *self, uint8_t *buffer,
+                              bitmap_size_t size) {
+  panicif(!self, "bitmap cannot be null");
+  const bitmap_size_t needed = bitmapSerializedSize(self);
+  if (!buffer || size < needed)
+    return 0;
+
+  uint8_t *cursor = buffer;
+  memcpy(cursor, BITMAP_MAGIC, BITMAP_MAGIC_SIZE);
+  cursor += BITMAP_MAGIC_SIZE;
+  bitmapWriteLE(&cursor, self->count, 8);
+
+  for (bitmap_size_t i = 0; i < self->count; i++) {
+    const bitmap_container_t *container = &self->containers[i];
+    bitmapWriteLE(&cursor, container->key, 8);
+    bitmapWriteLE(&cursor, (uint64_t)container->type, 1);
+    bitmapWriteLE(&cursor, container->cardinality, 4);
+    bitmapWriteLE(&cursor, container->length, 4);
+
+    if (container->type == BITMAP_CONTAINER_BITSET) {
+      const uint64_t *words = (const uint64_t *)container->data;
+      for (uint32_t j = 0; j < BITMAP_BITSET_WORDS; j++) {
+        bitmapWriteLE(&cursor, words[j], 8);
+      }
+    } else {
+      const uint16_t *values = (const uint16_t *)container->data;
+      const uint32_t count = container->type == BITMAP_CONTAINER_RUN
+                                 ? container->length * 2
+                                 : container->length;
+      for (uint32_t j = 0; j < count; j++) {
+        bitmapWriteLE(&cursor, values[j], 2);
+      }
+    }
+  }
+
+  return needed;
+}
+
+// Reads and validates one container; it must be non-empty and canonical
+static int bitmapReadContainer(const uint8_t **cursor, const uint8_t *end,
+                               bitmap_container_t *container) {
+  memset(container, 0, sizeof(bitmap_container_t));
+  if ((bitmap_size_t)(end - *cursor) < BITMAP_CONTAINER_HEADER_SIZE)
+    return 0;
+
+  container->key = bitmapReadLE(cursor, 8);
+  uint64_t type = bitmapReadLE(cursor, 1);
+  container->cardinality = (uint32_t)bitmapReadLE(cursor, 4);
+  container->length = (uint32_t)bitmapReadLE(cursor, 4);
+
+  if (container->key >> 48 || container->cardinality == 0 ||
+      container->cardinality > 65536)
+    return 0;
+
+  uint32_t cardinality = 0;
+  switch (type) {
+  case BITMAP_CONTAINER_ARRAY: {
+    container->type = BITMAP_CONTAINER_ARRAY;
+    if (container->length > BITMAP_ARRAY_MAX ||
+        (bitmap_size_t)(end - *cursor) < 2ULL * container->length)
+      return 0;
+    container->capacity = container->length;
+    uint16_t *values =
+        (uint16_t *)allocate(sizeof(uint16_t) * container->length);
+    if (!values)
+      return 0;
+    container->data = values;
+    for (uint32_t i = 0; i < container->length; i++) {
+      values[i] = (uint16_t)bitmapReadLE(cursor, 2);
+      if (i > 0 && values[i] <= values[i - 1])
+        return 0;
+    }
+    cardinality = container->length;
+    break;
+  }
+  case BITMAP_CONTAINER_BITSET: {
+    container->type = BITMAP_CONTAINER_BITSET;
+    if (container->length != BITMAP_BITSET_WORDS ||
+        (bitmap_size_t)(end - *cursor) < 8ULL * BITMAP_BITSET_WORDS)
+      return 0;
+    container->capacity = container->length;
+    uint64_t *words =
+        (uint64_t *)allocate(sizeof(uint64_t) * BITMAP_BITSET_WORDS);
+    if (!words)
+      return 0;
+    container->data = words;
+    for (uint32_t i = 0; i < BITMAP_BITSET_WORDS; i++) {
+      words[i] = bitmapReadLE(cursor, 8);
+    }
+    cardinality = bitmapCountWords(words);
+    break;
+  }
+  case BITMAP_CONTAINER_RUN: {
+    container->type = BITMAP_CONTAINER_RUN;
+    if (container->length > BITMAP_RUN_MAX ||
+        (bitmap_size_t)(end - *cursor) < 4ULL * container->length)
+      return 0;
+    container->capacity = container->length * 2;
+    uint16_t *runs =
+        (uint16_t *)allocate(sizeof(uint16_t) * 2 * container->length);
+    if (!runs)
+      return 0;
+    container->data = runs;
+    for (uint32_t i = 0; i < container->length; i++) {
+      runs[2 * i] = (uint16_t)bitmapReadLE(cursor, 2);
+      runs[2 * i + 1] = (uint16_t)bitmapReadLE(cursor, 2);
+      if (bitmapRunEnd(runs, i) > UINT16_MAX)
+        return 0;
+      // Runs must be sorted and separated by at least one missing member
+      if (i > 0 && runs[2 * i] <= bitmapRunEnd(runs, i - 1) + 1)
+        return 0;
+      cardinality += (uint32_t)runs[2 * i + 1] + 1;
+    }
+    break;
+  }
+  default:
+    return 0;
+  }
+
+  return cardinality == container->cardinality;
+}
+
+bitmap_t *bitmapDeserialize(const uint8_t *buffer, bitmap_size_t size) {
+  if (!buffer || size < BITMAP_HEADER_SIZE ||
+      memcmp(buffer, BITMAP_MAGIC, BITMAP_MAGIC_SIZE) != 0)
+    return NULL;
+
+  const uint8_t *cursor = buffer + BITMAP_MAGIC_SIZE;
+  const uint8_t *end = buffer + size;
+  const bitmap_size_t count = bitmapReadLE(&cursor, 8);
+  if (count > (size - BITMAP_HEADER_SIZE) / BITMAP_CONTAINER_HEADER_SIZE)
+    return NULL;
+
+  bitmap_t *self = bitmapCreate();
+  if (!self || bitmapReserve(self, count) != BITMAP_RESULT_OK) {
+    bitmapDestroy(&self);
+    return NULL;
+  }
+
+  for (bitmap_size_t i = 0; i < count; i++) {
+    bitmap_container_t container;
+    const int valid = bitmapReadContainer(&cursor, end, &container);
+    const int sorted =
+        i == 0 || self->containers[i - 1].key < container.key;
+
+    if (!valid || !sorted) {
+      deallocate(&container.data);
+      bitmapDestroy(&self);
+      return NULL;
+    }
+    self->containers[self->count++] = container;
+  }
+
+  if (cursor != end) {
+    bitmapDestroy(&self);
+    return NULL;
+  }
+
+  return self;
+}
+
+void bitmapDestroy(bitmap_t **self) {
+  if (!self || !*self)
+    return;
+
+  for (bitmap_size_t i = 0; i < (*self)->count; i++) {
+    deallocate(&(*self)->containers[i].data);
+  }
+
+  deallocate(&(*self)->containers);
+  deallocate(self);
+}
+
+#ifdef BITMAP_C_TEST
+
+#include "test.h"
+
+void addHas(void) {
+  bitmap_t *bitmap = bitmapCreate();
+  panicif(!bitmap, "cannot create bitmap");
+
+  bitmap_result_t result = bitmapAdd(bitmap, 42);
+  expectEqlu(result, BITMAP_RESULT_OK, "add returns OK");
+  expectTrue(bitmapHas(bitmap, 42), "finds added member");
+  expectFalse(bitmapHas(bitmap, 43), "does not find missing member");
+  expectEqllu(bitmapCardinality(bitmap), 1, "counts members");
+
+  test("idempotency");
+  (void)bitmapAdd(bitmap, 42);
+  expectEqllu(bitmapCardinality(bitmap), 1, "does not count duplicates");
+
+  test("64-bit members");
+  (void)bitmapAdd(bitmap, UINT64_MAX);
+  (void)bitmapAdd(bitmap, 1ULL << 40);
+  expectTrue(bitmapHas(bitmap, UINT64_MAX), "finds largest member");
+  expectTrue(bitmapHas(bitmap, 1ULL << 40), "finds member above 32 bits");
+  expectFalse(bitmapHas(bitmap, (1ULL << 40) + 42),
+              "keeps containers apart");
+  expectEqllu(bitmap->count, 3, "creates one container per high bits");
+
+  test("deletion");
+  bitmapDelete(bitmap, 42);
+  bitmapDelete(bitmap, 7);
+  expectFalse(bitmapHas(bitmap, 42), "does not find deleted member");
+  expectEqllu(bitmapCardinality(bitmap), 2, "reduces cardinality");
+  expectEqllu(bitmap->count, 2, "drops empty containers");
+
+  bitmapDestroy(&bitmap);
+  expectNull(bitmap, "destroy sets pointer to NULL");
+}
+
+void containers(void) {
+  bitmap_t *bitmap = bitmapCreate();
+  panicif(!bitmap, "cannot create bitmap");
+
+  for (uint64_t i = 0; i < 10000; i += 2) {
+    (void)bitmapAdd(bitmap, i);
+  }
+  expectEqlu(bitmap->containers[0].type, BITMAP_CONTAINER_BITSET,
+             "switches to bitset past 4096 members");
+  expectEqllu(bitmapCardinality(bitmap), 5000, "counts bitset members");
+  expectTrue(bitmapHas(bitmap, 9998), "finds bitset member");
+  expectFalse(bitmapHas(bitmap, 9999), "does not find missing bitset member");
+
+  for (uint64_t i = 0; i < 2000; i += 2) {
+    bitmapDelete(bitmap, i);
+  }
+  expectEqlu(bitmap->containers[0].type, BITMAP_CONTAINER_ARRAY,
+             "switches back to array");
+  expectEqllu(bitmapCardinality(bitmap), 4000, "counts array members");
+  expectTrue(bitmapHas(bitmap, 2000), "keeps members across conversions");
+
+  test("runs");
+  bitmap_t *runs = bitmapCreate();
+  for (uint64_t i = 100; i < 60000; i++) {
+    (void)bitmapAdd(runs, i);
+  }
+  (void)bitmapOptimize(runs);
+  expectEqlu(runs->containers[0].type, BITMAP_CONTAINER_RUN,
+             "optimizes consecutive members to runs");
+  expectEqllu(runs->containers[0].length, 1, "uses one run");
+  expectTrue(bitmapHas(runs, 100), "finds first member of run");
+  expectTrue(bitmapHas(runs, 59999), "finds last member of run");
+  expectFalse(bitmapHas(runs, 99), "does not find member before run");
+
+  bitmapDelete(runs, 500);
+  expectFalse(bitmapHas(runs, 500), "deletes from the middle of a run");
+  expectEqllu(runs->containers[0].length, 2, "splits the run");
+  (void)bitmapAdd(runs, 500);
+  expectEqllu(runs->containers[0].length, 1, "merges adjacent runs");
+  (void)bitmapAdd(runs, 99);
+  (void)bitmapAdd(runs, 60001);
+  expectEqllu(runs->containers[0].length, 2, "extends and adds runs");
+  expectEqllu(bitmapCardinality(runs), 59902, "counts run members");
+
+  bitmapDestroy(&runs);
+  bitmapDestroy(&bitmap);
+}
+
+void operations(void) {
+  bitmap_t *a = bitmapCreate();
+  bitmap_t *b = bitmapCreate();
+  panicif(!a || !b, "cannot create bitmap");
+
+  // Multiples of 3 and 5 across array, bitset and run containers
+  for (uint64_t i = 0; i < 200000; i += 3) {
+    (void)bitmapAdd(a, i);
+  }
+  for (uint64_t i = 0; i < 200000; i += 5) {
+    (void)bitmapAdd(b, i);
+  }
+  for (uint64_t i = 300000; i < 310000; i++) {
+    (void)bitmapAdd(a, i);
+    (void)bitmapAdd(b, i + 5000);
+  }
+  (void)bitmapOptimize(a);
+  (void)bitmapOptimize(b);
+
+  bitmap_t *both = bitmapIntersect(a, b);
+  bitmap_t *either = bitmapUnion(a, b);
+  panicif(!both || !either, "cannot combine bitmaps");
+
+  int intersect_ok = 1, union_ok = 1;
+  bitmap_size_t intersect_count = 0, union_count = 0;
+  for (uint64_t i = 0; i < 320000; i++) {
+    const int in_a = bitmapHas(a, i), in_b = bitmapHas(b, i);
+    intersect_ok &= bitmapHas(both, i) == (in_a && in_b);
+    union_ok &= bitmapHas(either, i) == (in_a || in_b);
+    intersect_count += in_a && in_b;
+    union_count += in_a || in_b;
+  }
+
+  expectTrue(intersect_ok, "intersection has members of both");
+  expectTrue(union_ok, "union has members of either");
+  expectEqllu(bitmapCardinality(both), intersect_count,
+              "intersection cardinality");
+  expectEqllu(bitmapCardinality(either), union_count, "union cardinality");
+
+  bitmap_t *empty = bitmapCreate();
+  bitmap_t *none = bitmapIntersect(a, empty);
+  expectEqllu(bitmapCardinality(none), 0, "intersection with empty");
+
+  bitmapDestroy(&none);
+  bitmapDestroy(&empty);
+  bitmapDestroy(&either);
+  bitmapDestroy(&both);
+  bitmapDestroy(&b);
+  bitmapDestroy(&a);
+}
+
+void serialization(void) {
+  bitmap_t *bitmap = bitmapCreate();
+  panicif(!bitmap, "cannot create bitmap");
+
+  for (uint64_t i = 0; i < 100000; i += 7) {
+    (void)bitmapAdd(bitmap, i);
+  }
+  for (uint64_t i = 1ULL << 33; i < (1ULL << 33) + 5000; i++) {
+    (void)bitmapAdd(bitmap, i);
+  }
+  (void)bitmapOptimize(bitmap);
+
+  bitmap_size_t size = bitmapSerializedSize(bitmap);
+  uint8_t *buffer = (uint8_t *)allocate(size);
+  panicif(!buffer, "cannot allocate buffer");
+
+  expectEqllu(bitmapSerialize(bitmap, buffer, size - 1), 0,
+              "refuses small buffers");
+  expectEqllu(bitmapSerialize(bitmap, buffer, size), size,
+              "writes the whole bitmap");
+
+  bitmap_t *copy = bitmapDeserialize(buffer, size);
+  panicif(!copy, "cannot deserialize bitmap");
+  expectEqllu(bitmapCardinality(copy), bitmapCardinality(bitmap),
+              "keeps cardinality");
+  expectTrue(bitmapHas(copy, 700), "keeps array members");
+  expectTrue(bitmapHas(copy, (1ULL << 33) + 4999), "keeps run members");
+  expectFalse(bitmapHas(copy, 701), "does not add members");
+
+  test("malformed input");
+  expectNull(bitmapDeserialize(buffer, size - 1), "rejects truncated input");
+  buffer[0] = 'X';
+  expectNull(bitmapDeserialize(buffer, size), "rejects bad magic");
+
+  deallocate(&buffer);
+  bitmapDestroy(&copy);
+  bitmapDestroy(&bitmap);
+}
+
+int main(void) {
+  suite(addHas);
+  suite(containers);
+  suite(operations);
+  suite(serialization);
+
+  return report();
+}
+#endif
@@ -0,0 +1,192 @@
+// Bitmap (v0.0.1)
+// ---
+//
+// A compressed bitmap for integer members in the style of Roaring bitmaps.
+// Members are split by their upper 48 bits into containers holding the lower
+// 16 bits as a sorted array, a 65536-bit bitset, or a list of runs, whichever
+// fits the data.
+//
+// ```c
+// bitmap_t* bitmap = bitmapCreate();
+//
+// bitmapAdd(bitmap, 42);    // returns result
+// bitmapHas(bitmap, 42);    // returns 1
+// bitmapDelete(bitmap, 42);
+//
+// bitmapOptimize(bitmap);   // convert containers to runs where smaller
+//
+// bitmap_t* both = bitmapIntersect(bitmap, another);
+// bitmapCardinality(both);  // number of members
+//
+// bitmapDestroy(&both);
+// bitmapDestroy(&bitmap);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint64_t bitmap_size_t;
+
+typedef enum {
+  BITMAP_RESULT_OK = 0,
+  BITMAP_ERROR_ALLOCATION
+} bitmap_result_t;
+
+typedef enum {
+  BITMAP_CONTAINER_ARRAY = 0,
+  BITMAP_CONTAINER_BITSET,
+  BITMAP_CONTAINER_RUN
+} bitmap_container_type_t;
+
+typedef struct {
+  uint64_t key;         // upper 48 bits shared by the members
+  uint32_t cardinality; // members in the container
+  uint32_t length;      // array: members, run: runs, bitset: words
+  uint32_t capacity;    // allocated elements of data
+  bitmap_container_type_t type;
+  void *data;
+} bitmap_container_t;
+
+typedef struct {
+  bitmap_size_t count;
+  bitmap_size_t capacity;
+  bitmap_container_t *containers;
+} bitmap_t;
+
+/**
+ * Create a new empty bitmap.
+ * @name bitmapCreate
+ * @returns {bitmap_t*} Pointer to the newly created bitmap, or NULL on failure
+ * @example
+ *   bitmap_t* bitmap = bitmapCreate();
+ */
+bitmap_t *bitmapCreate(void);
+
+/**
+ * Add a member to the bitmap.
+ * @name bitmapAdd
+ * @param {bitmap_t*} self - Pointer to the bitmap
+ * @param {uint64_t} value - The member to add
+ * @returns {bitmap_result_t} BITMAP_RESULT_OK on success,
+ * BITMAP_ERROR_ALLOCATION if memory runs out
+ * @example
+ *   bitmapAdd(bitmap, 42);
+ */
+bitmap_result_t bitmapAdd(bitmap_t *self, uint64_t value);
+
+/**
+ * Check if a member exists in the bitmap.
+ * @name bitmapHas
+ * @param {const bitmap_t*} self - Pointer to the bitmap
+ * @param {uint64_t} value - The member to look up
+ * @returns {int} 1 if the member exists, 0 otherwise
+ * @example
+ *   if (bitmapHas(bitmap, 42)) {
+ *     // member exists
+ *   }
+ */
+int bitmapHas(const bitmap_t *self, uint64_t value);
+
+/**
+ * Delete a member from the bitmap.
+ * @name bitmapDelete
+ * @param {bitmap_t*} self - Pointer to the bitmap
+ * @param {uint64_t} value - The member to delete
+ * @example
+ *   bitmapDelete(bitmap, 42);
+ */
+void bitmapDelete(bitmap_t *self, uint64_t value);
+
+/**
+ * Get the number of members in the bitmap.
+ * @name bitmapCardinality
+ * @param {const bitmap_t*} self - Pointer to the bitmap
+ * @returns {bitmap_size_t} The number of members
+ * @example
+ *   bitmap_size_t count = bitmapCardinality(bitmap);
+ */
+bitmap_size_t bitmapCardinality(const bitmap_t *self);
+
+/**
+ * Convert every container to the smallest of the array, bitset and run
+ * representations. Call it after bulk loading runs of consecutive members.
+ * @name bitmapOptimize
+ * @param {bitmap_t*} self - Pointer to the bitmap
+ * @returns {bitmap_result_t} BITMAP_RESULT_OK on success,
+ * BITMAP_ERROR_ALLOCATION if memory runs out
+ * @example
+ *   for (uint64_t i = 0; i < 100000; i++) bitmapAdd(bitmap, i);
+ *   bitmapOptimize(bitmap);
+ */
+bitmap_result_t bitmapOptimize(bitmap_t *self);
+
+/**
+ * Create a new bitmap holding the members of either bitmap.
+ * @name bitmapUnion
+ * @param {const bitmap_t*} a - Pointer to the first bitmap
+ * @param {const bitmap_t*} b - Pointer to the second bitmap
+ * @returns {bitmap_t*} Pointer to the union, or NULL on failure
+ * @example
+ *   bitmap_t* either = bitmapUnion(a, b);
+ */
+bitmap_t *bitmapUnion(const bitmap_t *a, const bitmap_t *b);
+
+/**
+ * Create a new bitmap holding the members of both bitmaps.
+ * @name bitmapIntersect
+ * @param {const bitmap_t*} a - Pointer to the first bitmap
+ * @param {const bitmap_t*} b - Pointer to the second bitmap
+ * @returns {bitmap_t*} Pointer to the intersection, or NULL on failure
+ * @example
+ *   bitmap_t* both = bitmapIntersect(a, b);
+ */
+bitmap_t *bitmapIntersect(const bitmap_t *a, const bitmap_t *b);
+
+/**
+ * Get the number of bytes bitmapSerialize needs to write the bitmap.
+ * @name bitmapSerializedSize
+ * @param {const bitmap_t*} self - Pointer to the bitmap
+ * @returns {bitmap_size_t} Size of the serialized bitmap in bytes
+ * @example
+ *   uint8_t *buffer = allocate(bitmapSerializedSize(bitmap));
+ */
+bitmap_size_t bitmapSerializedSize(const bitmap_t *self);
+
+/**
+ * Write the bitmap in a portable little-endian format.
+ * @name bitmapSerialize
+ * @param {const bitmap_t*} self - Pointer to the bitmap
+ * @param {uint8_t*} buffer - Destination buffer
+ * @param {bitmap_size_t} size - Size of the destination buffer
+ * @returns {bitmap_size_t} Bytes written, or 0 if the buffer is too small
+ * @example
+ *   bitmap_size_t size = bitmapSerializedSize(bitmap);
+ *   uint8_t *buffer = allocate(size);
+ *   bitmapSerialize(bitmap, buffer, size);
+ */
+bitmap_size_t bitmapSerialize(const bitmap_t *self, uint8_t *buffer,
+                              bitmap_size_t size);
+
+/**
+ * Create a bitmap from the output of bitmapSerialize.
+ * @name bitmapDeserialize
+ * @param {const uint8_t*} buffer - Serialized bitmap
+ * @param {bitmap_size_t} size - Size of the serialized bitmap
+ * @returns {bitmap_t*} Pointer to the bitmap, or NULL if the buffer is
+ * malformed or memory runs out
+ * @example
+ *   bitmap_t* copy = bitmapDeserialize(buffer, size);
+ */
+bitmap_t *bitmapDeserialize(const uint8_t *buffer, bitmap_size_t size);
+
+/**
+ * Destroy the bitmap and free all allocated memory.
+ * @name bitmapDestroy
+ * @param {bitmap_t**} self - Pointer to the bitmap pointer (will be set to
+ * NULL)
+ * @example
+ *   bitmapDestroy(&bitmap);
+ */
+void bitmapDestroy(bitmap_t **self);
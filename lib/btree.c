@@ -0,0 +1,709 @@
+#include "btree.h"
+#include "alloc.h"
+#include "panic.h"
+#include <string.h>
+
+// Nodes split into halves of BTREE_ORDER / 2 keys and leaves are never freed,
+// so no tree that fits in memory gets this deep
+#define BTREE_DEPTH 16
+
+#ifdef BTREE_C_TEST
+// The tests count live allocations, and fail the next one when
+// btree_fail_in counts down to 0
+static long btree_fail_in = -1;
+static long btree_live = 0;
+
+static void *btreeTestAllocate(size_t size) {
+  if (btree_fail_in >= 0 && btree_fail_in-- == 0)
+    return NULL;
+  void *result = calloc(1, size);
+  btree_live += result != NULL;
+  return result;
+}
+
+static void *btreeTestReallocate(void **ptr, size_t size) {
+  if (btree_fail_in >= 0 && btree_fail_in-- == 0)
+    return NULL;
+  void *result = realloc(*ptr, size);
+  btree_live += result != NULL && *ptr == NULL;
+  return result;
+}
+
+#undef allocate
+#undef reallocate
+#undef deallocate
+#define allocate(Size) btreeTestAllocate(Size)
+#define reallocate(Pointer, Size) btreeTestReallocate(Pointer, Size)
+#define deallocate(DoublePointer)                                              \
+  {                                                                            \
+    if (*(DoublePointer) != NULL) {                                            \
+      free((void *)*(DoublePointer));                                          \
+      *(DoublePointer) = NULL;                                                 \
+      btree_live--;                                                            \
+    }                                                                          \
+  }
+#endif
+
+// Packs the first 4 bytes of a suffix so that comparing heads orders suffixes
+// like strcmp does; shorter suffixes are padded with NUL, which sorts first
+static uint32_t btreeHead(const char *suffix) {
+  uint32_t head = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    head <<= 8;
+    if (*suffix) {
+      head |= (unsigned char)*suffix++;
+    }
+  }
+  return head;
+}
+
+static size_t btreeCommonLength(const char *a, const char *b, size_t limit) {
+  size_t i = 0;
+  while (i < limit && a[i] && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+static btree_node_t *btreeNodeCreate(uint32_t leaf) {
+  btree_node_t *node = (btree_node_t *)allocate(sizeof(btree_node_t));
+  if (node)
+    node->leaf = leaf;
+  return node;
+}
+
+static void btreeNodeDestroy(btree_node_t **node) {
+  if (!node || !*node)
+    return;
+
+  for (uint32_t i = 0; i < (*node)->count; i++) {
+    deallocate(&(*node)->suffixes[i]);
+  }
+  if (!(*node)->leaf) {
+    for (uint32_t i = 0; i <= (*node)->count; i++) {
+      btreeNodeDestroy(&(*node)->children[i]);
+    }
+  }
+
+  deallocate(&(*node)->prefix);
+  deallocate(node);
+}
+
+// Returns the position of the first key in the node not lower than key and
+// sets found when that key is equal
+static uint32_t btreeNodeSearch(const btree_node_t *node, const char *key,
+                                int *found) {
+  *found = 0;
+  if (node->count == 0)
+    return 0;
+
+  if (node->prefix_length > 0) {
+    const int order = strncmp(key, node->prefix, node->prefix_length);
+    if (order < 0)
+      return 0;
+    if (order > 0)
+      return node->count;
+  }
+
+  const char *rest = key + node->prefix_length;
+  const uint32_t head = btreeHead(rest);
+  uint32_t lo = 0, hi = node->count;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    int order;
+    if (head != node->heads[mid]) {
+      order = head < node->heads[mid] ? -1 : 1;
+    } else {
+      order = strcmp(rest, node->suffixes[mid]);
+    }
+
+    if (order > 0) {
+      lo = mid + 1;
+    } else {
+      if (order == 0)
+        *found = 1;
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+// Returns a copy of the full key at index
+static char *btreeNodeKey(const btree_node_t *node, uint32_t index) {
+  const size_t suffix_length = strlen(node->suffixes[index]);
+  char *key = (char *)allocate(node->prefix_length + suffix_length + 1);
+  if (!key)
+    return NULL;
+
+  if (node->prefix_length > 0)
+    memcpy(key, node->prefix, node->prefix_length);
+  memcpy(key + node->prefix_length, node->suffixes[index], suffix_length + 1);
+  return key;
+}
+
+// Moves the last bytes of the prefix back into every suffix, so that the
+// prefix is only length bytes long
+static btree_result_t btreeNodeShrinkPrefix(btree_node_t *node,
+                                            uint32_t length) {
+  const uint32_t extra = node->prefix_length - length;
+  char *suffixes[BTREE_ORDER + 1];
+
+  for (uint32_t i = 0; i < node->count; i++) {
+    const size_t suffix_length = strlen(node->suffixes[i]);
+    suffixes[i] = (char *)allocate(extra + suffix_length + 1);
+    if (!suffixes[i]) {
+      for (uint32_t j = 0; j < i; j++) {
+        deallocate(&suffixes[j]);
+      }
+      return BTREE_ERROR_ALLOCATION;
+    }
+    memcpy(suffixes[i], node->prefix + length, extra);
+    memcpy(suffixes[i] + extra, node->suffixes[i], suffix_length + 1);
+  }
+
+  for (uint32_t i = 0; i < node->count; i++) {
+    deallocate(&node->suffixes[i]);
+    node->suffixes[i] = suffixes[i];
+    node->heads[i] = btreeHead(suffixes[i]);
+  }
+  node->prefix_length = length;
+  return BTREE_RESULT_OK;
+}
+
+// Grows the prefix to everything the keys of the node have in common. For
+// sorted keys that is what the first and the last have in common.
+static void btreeNodeGrowPrefix(btree_node_t *node) {
+  if (node->count == 0) {
+    node->prefix_length = 0;
+    return;
+  }
+
+  const char *first = node->suffixes[0];
+  const char *last = node->suffixes[node->count - 1];
+  const size_t extra = btreeCommonLength(first, last, SIZE_MAX);
+  if (extra == 0)
+    return;
+
+  // Growing is an optimisation: the node stays valid if it fails
+  char *prefix = (char *)reallocate((void **)&node->prefix,
+                                    node->prefix_length + extra + 1);
+  if (!prefix)
+    return;
+
+  memcpy(prefix + node->prefix_length, first, extra);
+  prefix[node->prefix_length + extra] = '\0';
+  node->prefix = prefix;
+  node->prefix_length += (uint32_t)extra;
+
+  for (uint32_t i = 0; i < node->count; i++) {
+    char *suffix = node->suffixes[i];
+    memmove(suffix, suffix + extra, strlen(suffix + extra) + 1);
+    node->heads[i] = btreeHead(suffix);
+  }
+}
+
+static btree_result_t btreeNodeInsertKey(btree_node_t *node, uint32_t position,
+                                         const char *key, size_t length) {
+  if (node->count == 0) {
+    node->prefix_length = 0;
+  } else {
+    const size_t shared =
+        btreeCommonLength(key, node->prefix, node->prefix_length);
+    if (shared < node->prefix_length &&
+        btreeNodeShrinkPrefix(node, (uint32_t)shared) != BTREE_RESULT_OK)
+      return BTREE_ERROR_ALLOCATION;
+  }
+
+  const size_t suffix_length = length - node->prefix_length;
+  char *suffix = (char *)allocate(suffix_length + 1);
+  if (!suffix)
+    return BTREE_ERROR_ALLOCATION;
+  memcpy(suffix, key + node->prefix_length, suffix_length + 1);
+
+  memmove(&node->suffixes[position + 1], &node->suffixes[position],
+          sizeof(char *) * (node->count - position));
+  memmove(&node->heads[position + 1], &node->heads[position],
+          sizeof(uint32_t) * (node->count - position));
+  node->suffixes[position] = suffix;
+  node->heads[position] = btreeHead(suffix);
+  node->count++;
+  return BTREE_RESULT_OK;
+}
+
+// Removes the key at position, and in internal nodes the child after it
+static void btreeNodeRemoveKey(btree_node_t *node, uint32_t position) {
+  deallocate(&node->suffixes[position]);
+  memmove(&node->suffixes[position], &node->suffixes[position + 1],
+          sizeof(char *) * (node->count - position - 1));
+  memmove(&node->heads[position], &node->heads[position + 1],
+          sizeof(uint32_t) * (node->count - position - 1));
+  if (!node->leaf)
+    memmove(&node->children[position + 1], &node->children[position + 2],
+            sizeof(btree_node_t *) * (node->count - position - 1));
+  node->count--;
+}
+
+// Moves the upper half of an overflowing node to a new sibling. Returns the
+// sibling and a copy of the key separating the two. The node keeps the moved
+// pointers past its count, so btreeNodeUnsplit can undo this without
+// allocating until btreeNodeSplitDone.
+static btree_result_t btreeNodeSplit(btree_node_t *node, btree_node_t **right,
+                                     char **separator) {
+  const uint32_t mid = node->count / 2;
+  btree_node_t *sibling = btreeNodeCreate(node->leaf);
+  char *key = btreeNodeKey(node, mid);
+  char *prefix = (char *)allocate(node->prefix_length + 1);
+  if (!sibling || !key || !prefix) {
+    deallocate(&sibling);
+    deallocate(&key);
+    deallocate(&prefix);
+    return BTREE_ERROR_ALLOCATION;
+  }
+
+  if (node->prefix_length > 0)
+    memcpy(prefix, node->prefix, node->prefix_length);
+  sibling->prefix = prefix;
+  sibling->prefix_length = node->prefix_length;
+
+  // Leaves keep the separator as their first key; internal nodes hand it up
+  const uint32_t first = node->leaf ? mid : mid + 1;
+  sibling->count = node->count - first;
+  memcpy(sibling->suffixes, &node->suffixes[first],
+         sizeof(char *) * sibling->count);
+  memcpy(sibling->heads, &node->heads[first],
+         sizeof(uint32_t) * sibling->count);
+
+  if (node->leaf) {
+    sibling->next = node->next;
+    node->next = sibling;
+  } else {
+    memcpy(sibling->children, &node->children[mid + 1],
+           sizeof(btree_node_t *) * (sibling->count + 1));
+  }
+  node->count = mid;
+
+  *right = sibling;
+  *separator = key;
+  return BTREE_RESULT_OK;
+}
+
+// Puts the keys of a sibling back into the node it was split from
+static void btreeNodeUnsplit(btree_node_t *node, btree_node_t *sibling) {
+  if (node->leaf) {
+    node->next = sibling->next;
+    node->count += sibling->count;
+  } else {
+    node->count += sibling->count + 1;
+  }
+  deallocate(&sibling->prefix);
+  deallocate(&sibling);
+}
+
+// Frees the separator an internal node handed up and shortens the suffixes
+// of both halves
+static void btreeNodeSplitDone(btree_node_t *node, btree_node_t *sibling) {
+  if (!node->leaf)
+    deallocate(&node->suffixes[node->count]);
+  btreeNodeGrowPrefix(node);
+  btreeNodeGrowPrefix(sibling);
+}
+
+static btree_node_t *btreeFindLeaf(const btree_t *self, const char *key,
+                                   uint32_t *position, int *found) {
+  btree_node_t *node = self->root;
+  *position = btreeNodeSearch(node, key, found);
+
+  while (!node->leaf) {
+    node = node->children[*found ? *position + 1 : *position];
+    *position = btreeNodeSearch(node, key, found);
+  }
+
+  return node;
+}
+
+btree_t *btreeCreate(void) {
+  btree_t *self = (btree_t *)allocate(sizeof(btree_t));
+  if (!self)
+    return NULL;
+
+  self->root = btreeNodeCreate(1);
+  if (!self->root) {
+    deallocate(&self);
+    return NULL;
+  }
+
+  return self;
+}
+
+btree_result_t btreeAdd(btree_t *self, const char *key) {
+  panicif(!self, "btree cannot be null");
+  panicif(!key, "key cannot be null");
+
+  // The nodes from the root to the leaf, and where the key goes in each
+  btree_node_t *path[BTREE_DEPTH];
+  uint32_t positions[BTREE_DEPTH];
+  uint32_t depth = 0;
+  int found;
+  for (btree_node_t *node = self->root;; depth++) {
+    panicif(depth == BTREE_DEPTH, "btree too deep");
+    const uint32_t position = btreeNodeSearch(node, key, &found);
+    path[depth] = node;
+    if (node->leaf) {
+      positions[depth] = position;
+      break;
+    }
+    // Keys equal to a separator live in the subtree on its right
+    positions[depth] = found ? position + 1 : position;
+    node = node->children[positions[depth]];
+  }
+  if (found)
+    return BTREE_RESULT_OK;
+
+  if (btreeNodeInsertKey(path[depth], positions[depth], key, strlen(key)) !=
+      BTREE_RESULT_OK)
+    return BTREE_ERROR_ALLOCATION;
+
+  // Split overflowing nodes from the leaf up, handing each separator to the
+  // parent, or to a new root once the old one splits
+  btree_node_t *rights[BTREE_DEPTH];
+  btree_node_t *root = NULL;
+  btree_result_t result = BTREE_RESULT_OK;
+  uint32_t top = depth; // highest node that got a key
+  uint32_t split = 0;   // nodes split, from the leaf up
+  for (uint32_t level = depth; path[level]->count > BTREE_ORDER; level--) {
+    char *separator;
+    result = btreeNodeSplit(path[level], &rights[level], &separator);
+    if (result != BTREE_RESULT_OK)
+      break;
+    split++;
+
+    if (level == 0) {
+      root = btreeNodeCreate(0);
+      result = root ? btreeNodeInsertKey(root, 0, separator, strlen(separator))
+                    : BTREE_ERROR_ALLOCATION;
+    } else {
+      btree_node_t *parent = path[level - 1];
+      const uint32_t child = positions[level - 1];
+      result =
+          btreeNodeInsertKey(parent, child, separator, strlen(separator));
+      if (result == BTREE_RESULT_OK) {
+        memmove(&parent->children[child + 2], &parent->children[child + 1],
+                sizeof(btree_node_t *) * (parent->count - child - 1));
+        parent->children[child + 1] = rights[level];
+        top = level - 1;
+      }
+    }
+    deallocate(&separator);
+    if (result != BTREE_RESULT_OK || level == 0)
+      break;
+  }
+
+  if (result != BTREE_RESULT_OK) {
+    // Undo from the top down, so the tree is left as it was
+    btreeNodeDestroy(&root);
+    for (uint32_t level = top; level <= depth; level++) {
+      if (level + split > depth)
+        btreeNodeUnsplit(path[level], rights[level]);
+      btreeNodeRemoveKey(path[level], positions[level]);
+    }
+    return BTREE_ERROR_ALLOCATION;
+  }
+
+  for (uint32_t i = 0; i < split; i++) {
+    btreeNodeSplitDone(path[depth - i], rights[depth - i]);
+  }
+  if (root) {
+    root->children[0] = self->root;
+    root->children[1] = rights[0];
+    self->root = root;
+  }
+  self->count++;
+  return BTREE_RESULT_OK;
+}
+
+int btreeHas(const btree_t *self, const char *key) {
+  panicif(!self, "btree cannot be null");
+  panicif(!key, "key cannot be null");
+
+  uint32_t position;
+  int found;
+  (void)btreeFindLeaf(self, key, &position, &found);
+  return found;
+}
+
+void btreeDelete(btree_t *self, const char *key) {
+  panicif(!self, "btree cannot be null");
+  panicif(!key, "key cannot be null");
+
+  uint32_t position;
+  int found;
+  btree_node_t *leaf = btreeFindLeaf(self, key, &position, &found);
+  if (!found)
+    return;
+
+  btreeNodeRemoveKey(leaf, position);
+  self->count--;
+}
+
+btree_size_t btreeUsed(const btree_t *self) {
+  panicif(!self, "btree cannot be null");
+  return self->count;
+}
+
+void btreeSeek(const btree_t *self, const char *from,
+               btree_iterator_t *iterator) {
+  panicif(!self, "btree cannot be null");
+  panicif(!iterator, "iterator cannot be null");
+  memset(iterator, 0, sizeof(btree_iterator_t));
+
+  if (!from) {
+    const btree_node_t *node = self->root;
+    while (!node->leaf) {
+      node = node->children[0];
+    }
+    iterator->node = node;
+    return;
+  }
+
+  int found;
+  iterator->node = btreeFindLeaf(self, from, &iterator->index, &found);
+}
+
+const char *btreeIteratorNext(btree_iterator_t *iterator) {
+  panicif(!iterator, "iterator cannot be null");
+
+  while (iterator->node && iterator->index >= iterator->node->count) {
+    iterator->node = iterator->node->next;
+    iterator->index = 0;
+  }
+  if (!iterator->node)
+    return NULL;
+
+  const btree_node_t *node = iterator->node;
+  const char *suffix = node->suffixes[iterator->index];
+  const size_t suffix_length = strlen(suffix);
+  const size_t length = node->prefix_length + suffix_length + 1;
+
+  if (length > iterator->capacity) {
+    char *key = (char *)reallocate((void **)&iterator->key, length);
+    if (!key)
+      return NULL;
+    iterator->key = key;
+    iterator->capacity = length;
+  }
+
+  if (node->prefix_length > 0)
+    memcpy(iterator->key, node->prefix, node->prefix_length);
+  memcpy(iterator->key + node->prefix_length, suffix, suffix_length + 1);
+  iterator->index++;
+  return iterator->key;
+}
+
+void btreeIteratorEnd(btree_iterator_t *iterator) {
+  if (!iterator)
+    return;
+
+  deallocate(&iterator->key);
+  iterator->capacity = 0;
+  iterator->node = NULL;
+}
+
+void btreeDestroy(btree_t **self) {
+  if (!self || !*self)
+    return;
+
+  btreeNodeDestroy(&(*self)->root);
+  deallocate(self);
+}
+
+#ifdef BTREE_C_TEST
+
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int compareKeys(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Every key is found, in order, and as many as the tree counts
+static int btreeConsistent(const btree_t *tree) {
+  btree_iterator_t it;
+  btreeSeek(tree, NULL, &it);
+  char previous[64] = "";
+  btree_size_t seen = 0;
+  int consistent = 1;
+  const char *key;
+  while ((key = btreeIteratorNext(&it))) {
+    consistent &= (seen == 0 || strcmp(previous, key) < 0) &&
+                  btreeHas(tree, key);
+    snprintf(previous, sizeof(previous), "%s", key);
+    seen++;
+  }
+  btreeIteratorEnd(&it);
+  return consistent && seen == btreeUsed(tree);
+}
+
+void addHas(void) {
+  btree_t *tree = btreeCreate();
+  panicif(!tree, "cannot create btree");
+
+  btree_result_t result = btreeAdd(tree, "key");
+  expectEqlu(result, BTREE_RESULT_OK, "add returns OK");
+  expectTrue(btreeHas(tree, "key"), "finds added key");
+  expectFalse(btreeHas(tree, "ke"), "does not find prefix of key");
+  expectFalse(btreeHas(tree, "key1"), "does not find extension of key");
+  expectEqllu(btreeUsed(tree), 1, "updates used");
+
+  test("idempotency");
+  (void)btreeAdd(tree, "key");
+  expectEqllu(btreeUsed(tree), 1, "does not count duplicates");
+
+  test("empty key");
+  (void)btreeAdd(tree, "");
+  expectTrue(btreeHas(tree, ""), "finds empty key");
+
+  test("deletion");
+  btreeDelete(tree, "key");
+  btreeDelete(tree, "missing");
+  expectFalse(btreeHas(tree, "key"), "does not find deleted key");
+  expectEqllu(btreeUsed(tree), 1, "reduces used");
+
+  btreeDestroy(&tree);
+  expectNull(tree, "destroy sets pointer to NULL");
+}
+
+void ordering(void) {
+  btree_t *tree = btreeCreate();
+  panicif(!tree, "cannot create btree");
+
+  // URL-like keys share long prefixes, inserted in scrambled order
+  enum { COUNT = 5000 };
+  char *keys[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    char key[64];
+    int id = (i * 7919) % COUNT;
+    snprintf(key, sizeof(key), "https://example.com/%s/%d",
+             id % 3 ? "users" : "posts", id);
+    keys[i] = (char *)allocate(strlen(key) + 1);
+    memcpy(keys[i], key, strlen(key) + 1);
+    (void)btreeAdd(tree, key);
+  }
+  qsort(keys, COUNT, sizeof(char *), compareKeys);
+
+  expectEqllu(btreeUsed(tree), COUNT, "counts every key");
+  expectFalse(tree->root->leaf, "grows past a single node");
+  expectTrue(tree->root->children[0]->prefix_length >= 20,
+             "stores shared prefixes once");
+
+  int found_all = 1;
+  for (int i = 0; i < COUNT; i++) {
+    found_all &= btreeHas(tree, keys[i]);
+  }
+  expectTrue(found_all, "finds every key");
+
+  test("iteration");
+  btree_iterator_t it;
+  btreeSeek(tree, NULL, &it);
+  int in_order = 1, seen = 0;
+  const char *key;
+  while ((key = btreeIteratorNext(&it))) {
+    in_order &= seen < COUNT && strcmp(key, keys[seen]) == 0;
+    seen++;
+  }
+  btreeIteratorEnd(&it);
+  expectTrue(in_order, "iterates in sorted order");
+  expectEqli(seen, COUNT, "iterates every key");
+
+  test("range");
+  const char *from = keys[1000];
+  btreeSeek(tree, from, &it);
+  expectEqls(btreeIteratorNext(&it), from, 64, "seek starts at bound");
+  expectEqls(btreeIteratorNext(&it), keys[1001], 64, "continues in order");
+  btreeIteratorEnd(&it);
+
+  btreeSeek(tree, "https://example.com/posts/9999", &it);
+  key = btreeIteratorNext(&it);
+  expectTrue(key && strcmp(key, "https://example.com/posts/9999") > 0,
+             "seek to missing key starts after it");
+  btreeIteratorEnd(&it);
+
+  btreeSeek(tree, "zzz", &it);
+  expectNull(btreeIteratorNext(&it), "seek past the end finds nothing");
+  btreeIteratorEnd(&it);
+
+  test("deletion");
+  for (int i = 0; i < COUNT; i += 2) {
+    btreeDelete(tree, keys[i]);
+  }
+  btreeSeek(tree, NULL, &it);
+  in_order = 1;
+  seen = 0;
+  while ((key = btreeIteratorNext(&it))) {
+    in_order &= strcmp(key, keys[2 * seen + 1]) == 0;
+    seen++;
+  }
+  btreeIteratorEnd(&it);
+  expectTrue(in_order, "skips deleted keys");
+  expectEqllu(btreeUsed(tree), COUNT / 2, "counts remaining keys");
+
+  for (int i = 0; i < COUNT; i += 2) {
+    (void)btreeAdd(tree, keys[i]);
+  }
+  expectEqllu(btreeUsed(tree), COUNT, "re-adds deleted keys");
+  expectTrue(btreeHas(tree, keys[0]), "finds re-added key");
+
+  for (int i = 0; i < COUNT; i++) {
+    deallocate(&keys[i]);
+  }
+  btreeDestroy(&tree);
+}
+
+void failures(void) {
+  const long live = btree_live;
+  btree_t *tree = btreeCreate();
+  panicif(!tree, "cannot create btree");
+
+  // Fail each allocation of every add in turn, splits and new roots included
+  enum { COUNT = 3000 };
+  char key[64];
+  long refused = 0;
+  int unchanged = 1, consistent = 1;
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(key, sizeof(key), "https://example.com/%d/posts/%d",
+             i * 7919 % COUNT, i);
+    for (long fail_in = 0;; fail_in++) {
+      const btree_size_t used = btreeUsed(tree);
+      btree_fail_in = fail_in;
+      const btree_result_t result = btreeAdd(tree, key);
+      btree_fail_in = -1;
+      if (result == BTREE_RESULT_OK)
+        break;
+      refused++;
+      unchanged &= result == BTREE_ERROR_ALLOCATION &&
+                   btreeUsed(tree) == used && !btreeHas(tree, key);
+      // The first allocation copies the key, later ones split nodes
+      if (fail_in > 0)
+        consistent &= btreeConsistent(tree);
+    }
+  }
+  expectTrue(refused > COUNT, "fails allocations while adding");
+  expectTrue(unchanged, "leaves failed keys out");
+  expectTrue(consistent && btreeConsistent(tree),
+             "keeps the tree consistent after failed splits");
+  expectEqllu(btreeUsed(tree), COUNT, "adds every key once memory is back");
+
+  btreeDestroy(&tree);
+  expectTrue(btree_live == live, "leaks nothing after failures");
+}
+
+int main(void) {
+  suite(addHas);
+  suite(ordering);
+  suite(failures);
+
+  return report();
+}
+#endif
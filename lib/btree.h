@@ -0,0 +1,166 @@
+// B-tree (v0.0.1)
+// ---
+//
+// An ordered set of owned string keys stored in a B+tree with wide nodes.
+// Keys in a node share a common prefix stored once, and the first bytes of
+// every suffix are kept inline so most comparisons don't follow a pointer.
+// Leaves are linked, so range scans read nodes sequentially.
+//
+// Deleting does not merge nodes: emptied leaves are skipped while iterating
+// and filled again by later inserts in their range.
+//
+// ```c
+// btree_t* tree = btreeCreate();
+//
+// btreeAdd(tree, "banana");    // returns result
+// btreeAdd(tree, "apple");
+// btreeHas(tree, "apple");     // returns 1
+//
+// btree_iterator_t it;
+// btreeSeek(tree, "b", &it);   // first key not lower than "b"
+// const char* key;
+// while ((key = btreeIteratorNext(&it)) && strcmp(key, "c") < 0) {
+//   printf("%s\n", key);       // prints "banana"
+// }
+// btreeIteratorEnd(&it);
+//
+// btreeDelete(tree, "apple");
+// btreeDestroy(&tree);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BTREE_ORDER 32
+
+typedef uint64_t btree_size_t;
+
+typedef enum { BTREE_RESULT_OK = 0, BTREE_ERROR_ALLOCATION } btree_result_t;
+
+typedef struct btree_node_t {
+  uint32_t count;
+  uint32_t leaf;
+  uint32_t prefix_length;
+  char *prefix; // shared by every key in the node
+  // One slot more than BTREE_ORDER so that nodes can overflow before a split
+  uint32_t heads[BTREE_ORDER + 1]; // first 4 suffix bytes, big-endian
+  char *suffixes[BTREE_ORDER + 1];
+  struct btree_node_t *children[BTREE_ORDER + 2]; // internal nodes only
+  struct btree_node_t *next;                      // leaves only
+} btree_node_t;
+
+typedef struct {
+  btree_size_t count;
+  btree_node_t *root;
+} btree_t;
+
+typedef struct {
+  const btree_node_t *node;
+  uint32_t index;
+  char *key; // last key returned, owned by the iterator
+  size_t capacity;
+} btree_iterator_t;
+
+/**
+ * Create a new empty tree.
+ * @name btreeCreate
+ * @returns {btree_t*} Pointer to the newly created tree, or NULL on failure
+ * @example
+ *   btree_t* tree = btreeCreate();
+ */
+btree_t *btreeCreate(void);
+
+/**
+ * Add a key to the tree. The key is copied and owned by the tree.
+ * @name btreeAdd
+ * @param {btree_t*} self - Pointer to the tree
+ * @param {const char*} key - The key to add
+ * @returns {btree_result_t} BTREE_RESULT_OK on success,
+ * BTREE_ERROR_ALLOCATION if memory runs out
+ * @example
+ *   btreeAdd(tree, "key");
+ */
+btree_result_t btreeAdd(btree_t *self, const char *key);
+
+/**
+ * Check if a key exists in the tree.
+ * @name btreeHas
+ * @param {const btree_t*} self - Pointer to the tree
+ * @param {const char*} key - The key to look up
+ * @returns {int} 1 if the key exists, 0 otherwise
+ * @example
+ *   if (btreeHas(tree, "key")) {
+ *     // key exists
+ *   }
+ */
+int btreeHas(const btree_t *self, const char *key);
+
+/**
+ * Delete a key from the tree.
+ * @name btreeDelete
+ * @param {btree_t*} self - Pointer to the tree
+ * @param {const char*} key - The key to delete
+ * @example
+ *   btreeDelete(tree, "key");
+ */
+void btreeDelete(btree_t *self, const char *key);
+
+/**
+ * Get the number of keys currently stored in the tree.
+ * @name btreeUsed
+ * @param {const btree_t*} self - Pointer to the tree
+ * @returns {btree_size_t} The number of keys in the tree
+ * @example
+ *   btree_size_t count = btreeUsed(tree);
+ */
+btree_size_t btreeUsed(const btree_t *self);
+
+/**
+ * Position an iterator before the first key not lower than from. The tree
+ * must not change while the iterator is in use.
+ * @name btreeSeek
+ * @param {const btree_t*} self - Pointer to the tree
+ * @param {const char*} from - Lower bound of the scan, or NULL to start from
+ * the smallest key
+ * @param {btree_iterator_t*} iterator - Iterator to position
+ * @example
+ *   btree_iterator_t it;
+ *   btreeSeek(tree, "b", &it);
+ */
+void btreeSeek(const btree_t *self, const char *from,
+               btree_iterator_t *iterator);
+
+/**
+ * Advance the iterator to the next key in ascending order.
+ * @name btreeIteratorNext
+ * @param {btree_iterator_t*} iterator - Pointer to the iterator
+ * @returns {const char*} The next key, valid until the following call, or
+ * NULL when there are no more keys or memory runs out
+ * @example
+ *   const char* key;
+ *   while ((key = btreeIteratorNext(&it))) {
+ *     printf("%s\n", key);
+ *   }
+ */
+const char *btreeIteratorNext(btree_iterator_t *iterator);
+
+/**
+ * Release the memory held by an iterator.
+ * @name btreeIteratorEnd
+ * @param {btree_iterator_t*} iterator - Pointer to the iterator
+ * @example
+ *   btreeIteratorEnd(&it);
+ */
+void btreeIteratorEnd(btree_iterator_t *iterator);
+
+/**
+ * Destroy the tree and free all allocated memory.
+ * @name btreeDestroy
+ * @param {btree_t**} self - Pointer to the tree pointer (will be set to NULL)
+ * @example
+ *   btreeDestroy(&tree);
+ */
+void btreeDestroy(btree_t **self);
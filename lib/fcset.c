@@ -0,0 +1,459 @@
+#include "fcset.h"
+#include "alloc.h"
+#include "panic.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t *fcsetReadVarint(const uint8_t *at, size_t *value) {
+  size_t result = 0;
+  uint8_t shift = 0;
+  while (*at & 0x80) {
+    result |= (size_t)(*at++ & 0x7f) << shift;
+    shift += 7;
+  }
+  *value = result | (size_t)*at++ << shift;
+  return at;
+}
+
+static void fcsetWriteVarint(fcset_t *self, size_t value) {
+  while (value >= 0x80) {
+    self->data[self->size++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  self->data[self->size++] = (uint8_t)value;
+}
+
+static void fcsetWriteBytes(fcset_t *self, const char *bytes, size_t length) {
+  if (length > 0) {
+    memcpy(self->data + self->size, bytes, length);
+    self->size += length;
+  }
+}
+
+// Orders length bytes at data against key like strcmp does
+static int fcsetCompare(const uint8_t *data, size_t length, const char *key,
+                        size_t key_length) {
+  const int order =
+      memcmp(data, key, length < key_length ? length : key_length);
+  if (order != 0)
+    return order;
+  return (length > key_length) - (length < key_length);
+}
+
+// Returns the number of keys lower than key and sets found when key is in the
+// set. Within a block only the bytes past the prefix shared with the key are
+// compared: an entry sharing less with its predecessor than the predecessor
+// shared with the key is already greater, one sharing more is still lower.
+static fcset_size_t fcsetLocate(const fcset_t *self, const char *key,
+                                int *found) {
+  *found = 0;
+  const size_t key_length = strlen(key);
+  const fcset_size_t blocks = (self->count + FCSET_BLOCK - 1) / FCSET_BLOCK;
+
+  // Find the last block starting with a key not greater than key
+  fcset_size_t lo = 0, hi = blocks;
+  while (lo < hi) {
+    const fcset_size_t mid = lo + (hi - lo) / 2;
+    size_t length;
+    const uint8_t *at =
+        fcsetReadVarint(self->data + self->blocks[mid], &length);
+    if (fcsetCompare(at, length, key, key_length) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0)
+    return 0;
+
+  fcset_size_t position = (lo - 1) * FCSET_BLOCK;
+  const fcset_size_t end = position + FCSET_BLOCK < self->count
+                               ? position + FCSET_BLOCK
+                               : self->count;
+
+  size_t length;
+  const uint8_t *at =
+      fcsetReadVarint(self->data + self->blocks[lo - 1], &length);
+  size_t match = 0;
+  while (match < length && match < key_length &&
+         at[match] == (uint8_t)key[match]) {
+    match++;
+  }
+  if (match == length && match == key_length) {
+    *found = 1;
+    return position;
+  }
+  at += length;
+
+  for (position++; position < end; position++) {
+    size_t common, suffix;
+    at = fcsetReadVarint(at, &common);
+    at = fcsetReadVarint(at, &suffix);
+
+    if (common < match)
+      return position;
+
+    if (common == match) {
+      size_t i = 0;
+      while (i < suffix && match + i < key_length &&
+             at[i] == (uint8_t)key[match + i]) {
+        i++;
+      }
+      if (match + i == key_length) {
+        *found = i == suffix;
+        return position;
+      }
+      if (i < suffix && at[i] > (uint8_t)key[match + i])
+        return position;
+      match += i;
+    }
+
+    at += suffix;
+  }
+
+  return position;
+}
+
+fcset_t *fcsetCreate(void) {
+  fcset_t *self = (fcset_t *)allocate(sizeof(fcset_t));
+  if (!self)
+    return NULL;
+
+  self->capacity = 256;
+  self->data = (uint8_t *)allocate(self->capacity);
+  self->block_capacity = 16;
+  self->blocks =
+      (fcset_size_t *)allocate(sizeof(fcset_size_t) * self->block_capacity);
+  self->last_size = 64;
+  self->last = (char *)allocate(self->last_size);
+  if (!self->data || !self->blocks || !self->last) {
+    fcsetDestroy(&self);
+    return NULL;
+  }
+
+  return self;
+}
+
+static int fcsetCompareKeys(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+fcset_t *fcsetFromSet(const set_t *set) {
+  panicif(!set, "set cannot be null");
+  const set_size_t used = setUsed(set);
+  const char **keys =
+      (const char **)allocate(sizeof(const char *) * (used ? used : 1));
+  if (!keys)
+    return NULL;
+
+  set_size_t cursor = 0, count = 0;
+  const char *key;
+  while ((key = setNext(set, &cursor))) {
+    keys[count++] = key;
+  }
+  qsort(keys, count, sizeof(const char *), fcsetCompareKeys);
+
+  fcset_t *self = fcsetCreate();
+  for (set_size_t i = 0; self && i < count; i++) {
+    if (fcsetAppend(self, keys[i]) != FCSET_RESULT_OK)
+      fcsetDestroy(&self);
+  }
+  deallocate(&keys);
+
+  // The set is complete: give back the spare capacity
+  if (self && self->size > 0) {
+    void *data = reallocate((void **)&self->data, self->size);
+    if (data) {
+      self->data = (uint8_t *)data;
+      self->capacity = self->size;
+    }
+  }
+
+  return self;
+}
+
+fcset_result_t fcsetAppend(fcset_t *self, const char *key) {
+  panicif(!self, "fcset cannot be null");
+  const size_t length = strlen(key);
+  size_t common = 0;
+
+  if (self->count > 0) {
+    const int order = strcmp(key, self->last);
+    if (order < 0)
+      return FCSET_ERROR_ORDER;
+    if (order == 0)
+      return FCSET_RESULT_OK;
+    while (key[common] && key[common] == self->last[common]) {
+      common++;
+    }
+  }
+
+  // The first key of a block is stored whole
+  const fcset_size_t block = self->count / FCSET_BLOCK;
+  const int starts_block = self->count % FCSET_BLOCK == 0;
+  const size_t shared = starts_block ? 0 : common;
+
+  // Grow everything first so that a failure leaves the set unchanged
+  if (starts_block && block == self->block_capacity) {
+    void *blocks = reallocate((void **)&self->blocks,
+                              sizeof(fcset_size_t) * self->block_capacity * 2);
+    if (!blocks)
+      return FCSET_ERROR_ALLOCATION;
+    self->blocks = (fcset_size_t *)blocks;
+    self->block_capacity *= 2;
+  }
+
+  // Two varints take at most 20 bytes
+  const fcset_size_t needed = self->size + (length - shared) + 20;
+  if (needed > self->capacity) {
+    fcset_size_t capacity = self->capacity * 2;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    void *data = reallocate((void **)&self->data, capacity);
+    if (!data)
+      return FCSET_ERROR_ALLOCATION;
+    self->data = (uint8_t *)data;
+    self->capacity = capacity;
+  }
+
+  if (length + 1 > self->last_size) {
+    size_t size = self->last_size * 2;
+    while (size < length + 1) {
+      size *= 2;
+    }
+    void *last = reallocate((void **)&self->last, size);
+    if (!last)
+      return FCSET_ERROR_ALLOCATION;
+    self->last = (char *)last;
+    self->last_size = size;
+  }
+
+  if (starts_block) {
+    self->blocks[block] = self->size;
+  } else {
+    fcsetWriteVarint(self, shared);
+  }
+  fcsetWriteVarint(self, length - shared);
+  fcsetWriteBytes(self, key + shared, length - shared);
+
+  memcpy(self->last + common, key + common, length - common + 1);
+  if (length > self->longest)
+    self->longest = length;
+  self->count++;
+  return FCSET_RESULT_OK;
+}
+
+int fcsetHas(const fcset_t *self, const char *key) {
+  panicif(!self, "fcset cannot be null");
+  int found;
+  (void)fcsetLocate(self, key, &found);
+  return found;
+}
+
+fcset_size_t fcsetRank(const fcset_t *self, const char *key) {
+  panicif(!self, "fcset cannot be null");
+  int found;
+  return fcsetLocate(self, key, &found);
+}
+
+fcset_size_t fcsetPrefix(const fcset_t *self, const char *prefix,
+                         fcset_callback_t callback, void *context) {
+  panicif(!self, "fcset cannot be null");
+  panicif(!callback, "callback cannot be null");
+  int found;
+  const fcset_size_t start = fcsetLocate(self, prefix, &found);
+  if (start >= self->count)
+    return 0;
+
+  char *key = (char *)allocate(self->longest + 1);
+  if (!key)
+    return 0;
+
+  // Keys are decoded from the start of the block holding the first match
+  const size_t prefix_length = strlen(prefix);
+  fcset_size_t position = start - start % FCSET_BLOCK, visited = 0;
+  const uint8_t *at = self->data + self->blocks[position / FCSET_BLOCK];
+
+  for (; position < self->count; position++) {
+    size_t common = 0, suffix;
+    if (position % FCSET_BLOCK != 0)
+      at = fcsetReadVarint(at, &common);
+    at = fcsetReadVarint(at, &suffix);
+    if (suffix > 0)
+      memcpy(key + common, at, suffix);
+    at += suffix;
+    const size_t length = common + suffix;
+    key[length] = '\0';
+
+    if (position < start)
+      continue;
+    if (length < prefix_length || memcmp(key, prefix, prefix_length) != 0)
+      break;
+
+    visited++;
+    if (callback(key, length, context))
+      break;
+  }
+
+  deallocate(&key);
+  return visited;
+}
+
+fcset_size_t fcsetUsed(const fcset_t *self) {
+  panicif(!self, "fcset cannot be null");
+  return self->count;
+}
+
+fcset_size_t fcsetBytes(const fcset_t *self) {
+  panicif(!self, "fcset cannot be null");
+  const fcset_size_t blocks = (self->count + FCSET_BLOCK - 1) / FCSET_BLOCK;
+  return self->size + blocks * sizeof(fcset_size_t);
+}
+
+void fcsetDestroy(fcset_t **self) {
+  if (!self || !*self)
+    return;
+
+  deallocate(&(*self)->data);
+  deallocate(&(*self)->blocks);
+  deallocate(&(*self)->last);
+  deallocate(self);
+}
+
+#ifdef FCSET_C_TEST
+
+#include "test.h"
+#include <stdio.h>
+
+static int countKey(const char *key, size_t length, void *context) {
+  (void)key;
+  (void)length;
+  (*(int *)context)++;
+  return 0;
+}
+
+static int stopAtSecond(const char *key, size_t length, void *context) {
+  (void)key;
+  (void)length;
+  return ++(*(int *)context) == 2;
+}
+
+static int checkPrefix(const char *key, size_t length, void *context) {
+  const char *prefix = (const char *)context;
+  panicif(strlen(key) != length, "length does not match key");
+  panicif(strncmp(key, prefix, strlen(prefix)) != 0, "key outside prefix");
+  return 0;
+}
+
+void appendHas(void) {
+  fcset_t *dict = fcsetCreate();
+  panicif(!dict, "cannot create fcset");
+
+  expectFalse(fcsetHas(dict, "a"), "empty set has no keys");
+  expectEqllu(fcsetRank(dict, "a"), 0, "empty set ranks 0");
+
+  expectEqlu(fcsetAppend(dict, ""), FCSET_RESULT_OK, "appends empty key");
+  expectEqlu(fcsetAppend(dict, "apple"), FCSET_RESULT_OK, "appends key");
+  (void)fcsetAppend(dict, "apricot");
+  (void)fcsetAppend(dict, "banana");
+
+  test("ordering");
+  expectEqlu(fcsetAppend(dict, "banana"), FCSET_RESULT_OK,
+             "ignores repeated key");
+  expectEqlu(fcsetAppend(dict, "avocado"), FCSET_ERROR_ORDER,
+             "rejects lower key");
+  expectEqllu(fcsetUsed(dict), 4, "counts distinct keys");
+
+  test("membership");
+  expectTrue(fcsetHas(dict, ""), "finds empty key");
+  expectTrue(fcsetHas(dict, "apricot"), "finds key");
+  expectFalse(fcsetHas(dict, "apri"), "does not find prefix of key");
+  expectFalse(fcsetHas(dict, "apricots"), "does not find extension of key");
+  expectFalse(fcsetHas(dict, "avocado"), "does not find rejected key");
+
+  test("rank");
+  expectEqllu(fcsetRank(dict, "apple"), 1, "ranks key");
+  expectEqllu(fcsetRank(dict, "b"), 3, "ranks missing key");
+  expectEqllu(fcsetRank(dict, "zebra"), 4, "ranks past the end");
+
+  fcsetDestroy(&dict);
+  expectNull(dict, "destroy sets pointer to NULL");
+}
+
+void blocks(void) {
+  fcset_t *dict = fcsetCreate();
+  panicif(!dict, "cannot create fcset");
+
+  enum { COUNT = 5000 };
+  size_t raw = 0;
+  char key[64];
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(key, sizeof(key), "https://example.com/%s/%05d",
+             i < COUNT / 3 ? "posts" : "users", i);
+    raw += strlen(key);
+    panicif(fcsetAppend(dict, key) != FCSET_RESULT_OK, "append failed");
+  }
+
+  int all_found = 1, all_ranked = 1, none_found = 1;
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(key, sizeof(key), "https://example.com/%s/%05d",
+             i < COUNT / 3 ? "posts" : "users", i);
+    all_found &= fcsetHas(dict, key);
+    all_ranked &= fcsetRank(dict, key) == (fcset_size_t)i;
+    strcat(key, "x");
+    none_found &= !fcsetHas(dict, key);
+    all_ranked &= fcsetRank(dict, key) == (fcset_size_t)i + 1;
+  }
+  expectTrue(all_found, "finds every key");
+  expectTrue(none_found, "does not find extended keys");
+  expectTrue(all_ranked, "ranks every key");
+  expectTrue(fcsetBytes(dict) * 3 < raw, "takes a fraction of raw bytes");
+
+  test("prefix");
+  int visited = 0;
+  expectEqllu(fcsetPrefix(dict, "https://example.com/posts/", countKey,
+                          &visited),
+              COUNT / 3, "visits every key with prefix");
+  expectEqli(visited, COUNT / 3, "calls back once per key");
+  char users[] = "https://example.com/users/0400";
+  expectEqllu(fcsetPrefix(dict, users, checkPrefix, users), 10,
+              "visits keys starting mid block");
+  expectEqllu(fcsetPrefix(dict, "", countKey, &visited), COUNT,
+              "visits every key with empty prefix");
+  expectEqllu(fcsetPrefix(dict, "https://example.com/z", countKey, &visited),
+              0, "visits nothing for missing prefix");
+  visited = 0;
+  expectEqllu(fcsetPrefix(dict, "https", stopAtSecond, &visited), 2,
+              "stops when the callback asks");
+
+  fcsetDestroy(&dict);
+}
+
+void fromSet(void) {
+  set_t *set = setCreate(16);
+  panicif(!set, "cannot create set");
+  (void)setAdd(set, "pear");
+  (void)setAdd(set, "apple");
+  (void)setAdd(set, "fig");
+  setDelete(set, "fig");
+
+  fcset_t *dict = fcsetFromSet(set);
+  panicif(!dict, "cannot create fcset");
+  expectEqllu(fcsetUsed(dict), 2, "copies live keys");
+  expectEqllu(fcsetRank(dict, "pear"), 1, "sorts keys");
+  expectFalse(fcsetHas(dict, "fig"), "skips deleted keys");
+
+  fcsetDestroy(&dict);
+  setDestroy(&set);
+}
+
+int main(void) {
+  suite(appendHas);
+  suite(blocks);
+  suite(fromSet);
+
+  return report();
+}
+
+#endif
@@ -0,0 +1,163 @@
+// Front-coded set (v0.0.1)
+// ---
+//
+// A read-only set of strings stored sorted and front-coded: keys are grouped
+// in blocks of FCSET_BLOCK, the first key of each block is stored whole and
+// every other key only as the length it shares with the previous key plus the
+// remaining bytes. An array with the start of each block is binary searched,
+// then a single block is decoded. Large dictionaries of URLs or paths take a
+// fraction of their raw size.
+//
+// Sets are built by appending keys in ascending order, or from a set_t.
+//
+// ```c
+// fcset_t* dict = fcsetCreate();
+//
+// fcsetAppend(dict, "apple");    // returns result
+// fcsetAppend(dict, "apricot");
+// fcsetAppend(dict, "banana");
+//
+// fcsetHas(dict, "apricot");     // returns 1
+// fcsetRank(dict, "b");          // returns 2, keys lower than "b"
+// fcsetPrefix(dict, "ap", printKey, NULL);  // visits "apple", "apricot"
+//
+// fcsetDestroy(&dict);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "set.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define FCSET_BLOCK 16
+
+typedef uint64_t fcset_size_t;
+
+typedef enum {
+  FCSET_RESULT_OK = 0,
+  FCSET_ERROR_ALLOCATION,
+  FCSET_ERROR_ORDER
+} fcset_result_t;
+
+// Receives each key and its length; returning non-zero stops the enumeration
+typedef int (*fcset_callback_t)(const char *key, size_t length, void *context);
+
+typedef struct {
+  fcset_size_t count;
+  fcset_size_t size;     // bytes of data in use
+  fcset_size_t capacity; // bytes of data allocated
+  uint8_t *data;
+  fcset_size_t *blocks; // offset in data of each block
+  fcset_size_t block_capacity;
+  size_t longest;   // length of the longest key
+  char *last;       // last key appended
+  size_t last_size; // bytes allocated for last
+} fcset_t;
+
+/**
+ * Create a new empty set, ready to receive keys in ascending order.
+ * @name fcsetCreate
+ * @returns {fcset_t*} Pointer to the newly created set, or NULL on failure
+ * @example
+ *   fcset_t* dict = fcsetCreate();
+ */
+fcset_t *fcsetCreate(void);
+
+/**
+ * Build a set with the keys of a set_t.
+ * @name fcsetFromSet
+ * @param {const set_t*} set - Pointer to the source set
+ * @returns {fcset_t*} Pointer to the newly created set, or NULL on failure
+ * @example
+ *   fcset_t* dict = fcsetFromSet(set);
+ *   setDestroy(&set);
+ */
+fcset_t *fcsetFromSet(const set_t *set);
+
+/**
+ * Append a key to the set. Keys must come in strcmp order; appending the last
+ * key again does nothing.
+ * @name fcsetAppend
+ * @param {fcset_t*} self - Pointer to the set
+ * @param {const char*} key - The key to append
+ * @returns {fcset_result_t} FCSET_RESULT_OK on success, FCSET_ERROR_ORDER if
+ * the key is lower than the last one, FCSET_ERROR_ALLOCATION if memory runs
+ * out
+ * @example
+ *   fcsetAppend(dict, "apple");
+ */
+fcset_result_t fcsetAppend(fcset_t *self, const char *key);
+
+/**
+ * Check if a key exists in the set.
+ * @name fcsetHas
+ * @param {const fcset_t*} self - Pointer to the set
+ * @param {const char*} key - The key to look up
+ * @returns {int} 1 if the key exists, 0 otherwise
+ * @example
+ *   if (fcsetHas(dict, "apple")) {
+ *     // key exists
+ *   }
+ */
+int fcsetHas(const fcset_t *self, const char *key);
+
+/**
+ * Count the keys lower than a key. For a key in the set this is its position.
+ * @name fcsetRank
+ * @param {const fcset_t*} self - Pointer to the set
+ * @param {const char*} key - The key to rank
+ * @returns {fcset_size_t} The number of keys lower than key
+ * @example
+ *   fcset_size_t position = fcsetRank(dict, "apple");
+ */
+fcset_size_t fcsetRank(const fcset_t *self, const char *key);
+
+/**
+ * Visit the keys starting with a prefix in ascending order.
+ * @name fcsetPrefix
+ * @param {const fcset_t*} self - Pointer to the set
+ * @param {const char*} prefix - The prefix to look for, "" for every key
+ * @param {fcset_callback_t} callback - Called with each key, which is only
+ * valid during the call
+ * @param {void*} context - Passed to the callback
+ * @returns {fcset_size_t} The number of keys visited
+ * @example
+ *   int printKey(const char* key, size_t length, void* context) {
+ *     printf("%s\n", key);
+ *     return 0;
+ *   }
+ *   fcsetPrefix(dict, "ap", printKey, NULL);
+ */
+fcset_size_t fcsetPrefix(const fcset_t *self, const char *prefix,
+                         fcset_callback_t callback, void *context);
+
+/**
+ * Get the number of keys in the set.
+ * @name fcsetUsed
+ * @param {const fcset_t*} self - Pointer to the set
+ * @returns {fcset_size_t} The number of keys in the set
+ * @example
+ *   fcset_size_t count = fcsetUsed(dict);
+ */
+fcset_size_t fcsetUsed(const fcset_t *self);
+
+/**
+ * Get the memory used by the encoded keys and the block index.
+ * @name fcsetBytes
+ * @param {const fcset_t*} self - Pointer to the set
+ * @returns {fcset_size_t} Size in bytes
+ * @example
+ *   fcset_size_t bytes = fcsetBytes(dict);
+ */
+fcset_size_t fcsetBytes(const fcset_t *self);
+
+/**
+ * Destroy the set and free all allocated memory.
+ * @name fcsetDestroy
+ * @param {fcset_t**} self - Pointer to the set pointer (will be set to NULL)
+ * @example
+ *   fcsetDestroy(&dict);
+ */
+void fcsetDestroy(fcset_t **self);
@@ -0,0 +1,180 @@
+// File (v0.0.1)
+// ---
+//
+// Read whole files without copying them. On POSIX systems the file is mapped
+// privately in memory: pages are read on demand and writes stay local to the
+// process. Elsewhere, or when the mapping cannot hold the terminator, the
+// file is read into memory instead. Either way the contents end with a NUL
+// byte.
+//
+// ```c
+// file_t* file = fileOpen("keys.txt");
+//
+// size_t offset = 0, length;
+// char* line;
+// while (fileNextLine(file, &offset, &line, &length)) {
+//   // line is not NUL-terminated, use length
+// }
+//
+// fileClose(&file);
+// ```
+// ___HEADER_END___
+#pragma once
+
+#include "alloc.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FILE_MMAP 1
+#endif
+
+typedef struct {
+  char *data;    // file contents followed by a NUL byte
+  size_t size;   // size of the contents, without the NUL byte
+  size_t length; // bytes mapped, or 0 if data was read into memory
+} file_t;
+
+static inline file_t *__fileRead(const char *path, file_t *self) {
+  FILE *stream = fopen(path, "rb");
+  if (!stream)
+    return NULL;
+
+  size_t capacity = 4096, size = 0, read;
+  char *data = (char *)allocate(capacity);
+  while (data && (read = fread(data + size, 1, capacity - size - 1, stream))) {
+    size += read;
+    if (capacity - size - 1 == 0) {
+      void *grown = reallocate((void **)&data, capacity * 2);
+      if (!grown) {
+        deallocate(&data);
+        break;
+      }
+      data = (char *)grown;
+      capacity *= 2;
+    }
+  }
+
+  const int failed = !data || ferror(stream);
+  fclose(stream);
+  if (failed) {
+    deallocate(&data);
+    return NULL;
+  }
+
+  data[size] = '\0';
+  self->data = data;
+  self->size = size;
+  self->length = 0;
+  return self;
+}
+
+/**
+ * Open a file and make its contents available in memory.
+ * @name fileOpen
+ * @param {const char*} path - Path of the file
+ * @returns {file_t*} Pointer to the open file, or NULL if it cannot be read
+ * @example
+ *   file_t* file = fileOpen("keys.txt");
+ *   printf("%s", file->data);
+ */
+static inline file_t *fileOpen(const char *path) {
+  file_t *self = (file_t *)allocate(sizeof(file_t));
+  if (!self)
+    return NULL;
+
+#ifdef FILE_MMAP
+  int descriptor = open(path, O_RDONLY);
+  struct stat info;
+  if (descriptor >= 0 && fstat(descriptor, &info) == 0 && info.st_size > 0) {
+    const size_t size = (size_t)info.st_size;
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    // The rest of the last page reads as zeroes, which gives the terminator
+    // for free unless the file fills the page exactly
+    if (size % page != 0) {
+      void *data = mmap(NULL, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        descriptor, 0);
+      if (data != MAP_FAILED) {
+#ifdef POSIX_MADV_SEQUENTIAL
+        (void)posix_madvise(data, size + 1, POSIX_MADV_SEQUENTIAL);
+#endif
+        close(descriptor);
+        self->data = (char *)data;
+        self->size = size;
+        self->length = size + 1;
+        return self;
+      }
+    }
+  }
+  if (descriptor >= 0)
+    close(descriptor);
+#endif
+
+  if (!__fileRead(path, self))
+    deallocate(&self);
+  return self;
+}
+
+/**
+ * Find the next line of a file, without its line terminator ("\n" or
+ * "\r\n").
+ * @name fileNextLine
+ * @param {const file_t*} self - Pointer to the file
+ * @param {size_t*} offset - Where to start; updated to the following line
+ * @param {char**} line - Set to the start of the line
+ * @param {size_t*} length - Set to the length of the line
+ * @returns {int} 1 if a line was found, 0 at the end of the file
+ * @example
+ *   size_t offset = 0, length;
+ *   char* line;
+ *   while (fileNextLine(file, &offset, &line, &length)) {
+ *     fwrite(line, 1, length, stdout);
+ *   }
+ */
+static inline int fileNextLine(const file_t *self, size_t *offset, char **line,
+                               size_t *length) {
+  if (*offset >= self->size)
+    return 0;
+
+  char *start = self->data + *offset;
+  const size_t remaining = self->size - *offset;
+  // memchr is vectorised by every mainstream libc
+  const char *end = (const char *)memchr(start, '\n', remaining);
+  size_t found = end ? (size_t)(end - start) : remaining;
+
+  *offset += found + 1;
+  if (found > 0 && start[found - 1] == '\r')
+    found--;
+
+  *line = start;
+  // Always found, but spelled out so GCC's -O2 overread check sees the bound
+  *length = found < remaining ? found : remaining;
+  return 1;
+}
+
+/**
+ * Close a file, releasing its contents.
+ * @name fileClose
+ * @param {file_t**} self - Pointer to the file pointer (will be set to NULL)
+ * @example
+ *   fileClose(&file);
+ */
+static inline void fileClose(file_t **self) {
+  if (!self || !*self)
+    return;
+
+#ifdef FILE_MMAP
+  if ((*self)->length > 0) {
+    munmap((*self)->data, (*self)->length);
+    (*self)->data = NULL;
+  }
+#endif
+
+  deallocate(&(*self)->data);
+  deallocate(self);
+}
@@ -0,0 +1,490 @@
+#include "hll.h"
+#include "alloc.h"
+#include "panic.h"
+#include <math.h>
+#include <string.h>
+
+#define HLL_MAGIC_SIZE 4
+static const uint8_t HLL_MAGIC[HLL_MAGIC_SIZE] = {'H', 'L', 'L', 1};
+#define HLL_HEADER_SIZE (HLL_MAGIC_SIZE + 1 + 1 + 4)
+
+static inline uint32_t hllRegisters(const hll_t *self) {
+  return 1U << self->precision;
+}
+
+static inline uint8_t hllCountLeadingZeros(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint8_t)__builtin_clzll(word);
+#else
+  uint8_t count = 0;
+  while (!(word & (1ULL << 63))) {
+    word <<= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
+// FNV-1a as used by set, followed by the MurmurHash3 finalizer: FNV-1a alone
+// leaves the high bits poorly mixed for short keys, and those pick registers
+static uint64_t hllHash(const char *key) {
+  uint64_t hash = 14695981039346656037U;
+  const uint64_t prime = 1099511628211U;
+  const size_t length = strlen(key);
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint64_t)(unsigned char)key[i];
+    hash *= prime;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static inline uint32_t hllSparseIndex(uint32_t entry) { return entry >> 8; }
+static inline uint8_t hllSparseRank(uint32_t entry) {
+  return (uint8_t)(entry & 0xFF);
+}
+
+// Returns the position of the first entry with an index not lower than index
+static uint32_t hllSparseFind(const hll_t *self, uint32_t index) {
+  uint32_t lo = 0, hi = self->length;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (hllSparseIndex(self->sparse[mid]) < index) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static hll_result_t hllToDense(hll_t *self) {
+  uint8_t *registers = (uint8_t *)allocate(hllRegisters(self));
+  if (!registers)
+    return HLL_ERROR_ALLOCATION;
+
+  for (uint32_t i = 0; i < self->length; i++) {
+    registers[hllSparseIndex(self->sparse[i])] = hllSparseRank(self->sparse[i]);
+  }
+
+  deallocate(&self->sparse);
+  self->registers = registers;
+  self->encoding = HLL_ENCODING_DENSE;
+  self->length = 0;
+  self->capacity = 0;
+  return HLL_RESULT_OK;
+}
+
+// Raises the register at index to rank if that is higher
+static hll_result_t hllUpdate(hll_t *self, uint32_t index, uint8_t rank) {
+  if (self->encoding == HLL_ENCODING_DENSE) {
+    if (self->registers[index] < rank)
+      self->registers[index] = rank;
+    return HLL_RESULT_OK;
+  }
+
+  uint32_t position = hllSparseFind(self, index);
+  if (position < self->length &&
+      hllSparseIndex(self->sparse[position]) == index) {
+    if (hllSparseRank(self->sparse[position]) < rank)
+      self->sparse[position] = index << 8 | rank;
+    return HLL_RESULT_OK;
+  }
+
+  // Sparse entries take 4 bytes against 1 byte per dense register
+  if ((self->length + 1) * 4 > hllRegisters(self)) {
+    hll_result_t result = hllToDense(self);
+    if (result != HLL_RESULT_OK)
+      return result;
+    return hllUpdate(self, index, rank);
+  }
+
+  if (self->length == self->capacity) {
+    uint32_t capacity = self->capacity ? self->capacity * 2 : 8;
+    void *sparse =
+        reallocate((void **)&self->sparse, sizeof(uint32_t) * capacity);
+    if (!sparse)
+      return HLL_ERROR_ALLOCATION;
+    self->sparse = (uint32_t *)sparse;
+    self->capacity = capacity;
+  }
+
+  memmove(&self->sparse[position + 1], &self->sparse[position],
+          sizeof(uint32_t) * (self->length - position));
+  self->sparse[position] = index << 8 | rank;
+  self->length++;
+  return HLL_RESULT_OK;
+}
+
+hll_t *hllCreate(uint8_t precision) {
+  panicif(precision < HLL_PRECISION_MIN || precision > HLL_PRECISION_MAX,
+          "precision out of range");
+
+  hll_t *self = (hll_t *)allocate(sizeof(hll_t));
+  if (!self)
+    return NULL;
+
+  self->precision = precision;
+  self->encoding = HLL_ENCODING_SPARSE;
+  return self;
+}
+
+hll_result_t hllAddHash(hll_t *self, uint64_t hash) {
+  panicif(!self, "hll cannot be null");
+  const uint32_t index = (uint32_t)(hash >> (64 - self->precision));
+  const uint64_t rest = hash << self->precision;
+  const uint8_t rank = rest ? (uint8_t)(hllCountLeadingZeros(rest) + 1)
+                            : (uint8_t)(64 - self->precision + 1);
+  return hllUpdate(self, index, rank);
+}
+
+hll_result_t hllAdd(hll_t *self, const char *key) {
+  panicif(!self, "hll cannot be null");
+  panicif(!key, "key cannot be null");
+  return hllAddHash(self, hllHash(key));
+}
+
+hll_size_t hllCount(const hll_t *self) {
+  panicif(!self, "hll cannot be null");
+  const uint32_t registers = hllRegisters(self);
+  const double m = (double)registers;
+  double sum = 0;
+  uint32_t zeros = 0;
+
+  if (self->encoding == HLL_ENCODING_DENSE) {
+    for (uint32_t i = 0; i < registers; i++) {
+      sum += ldexp(1.0, -self->registers[i]);
+      zeros += self->registers[i] == 0;
+    }
+  } else {
+    zeros = registers - self->length;
+    sum = zeros;
+    for (uint32_t i = 0; i < self->length; i++) {
+      sum += ldexp(1.0, -hllSparseRank(self->sparse[i]));
+    }
+  }
+
+  double alpha;
+  switch (registers) {
+  case 16:
+    alpha = 0.673;
+    break;
+  case 32:
+    alpha = 0.697;
+    break;
+  case 64:
+    alpha = 0.709;
+    break;
+  default:
+    alpha = 0.7213 / (1.0 + 1.079 / m);
+  }
+
+  double estimate = alpha * m * m / sum;
+
+  // Linear counting is more accurate while many registers are still empty
+  if (estimate <= 2.5 * m && zeros > 0) {
+    estimate = m * log(m / zeros);
+  }
+
+  return (hll_size_t)(estimate + 0.5);
+}
+
+hll_result_t hllMerge(hll_t *self, const hll_t *source) {
+  panicif(!self || !source, "hll cannot be null");
+  if (self->precision != source->precision)
+    return HLL_ERROR_PRECISION;
+
+  if (source->encoding == HLL_ENCODING_SPARSE) {
+    for (uint32_t i = 0; i < source->length; i++) {
+      hll_result_t result =
+          hllUpdate(self, hllSparseIndex(source->sparse[i]),
+                    hllSparseRank(source->sparse[i]));
+      if (result != HLL_RESULT_OK)
+        return result;
+    }
+    return HLL_RESULT_OK;
+  }
+
+  if (self->encoding == HLL_ENCODING_SPARSE) {
+    hll_result_t result = hllToDense(self);
+    if (result != HLL_RESULT_OK)
+      return result;
+  }
+
+  const uint32_t registers = hllRegisters(self);
+  for (uint32_t i = 0; i < registers; i++) {
+    if (self->registers[i] < source->registers[i])
+      self->registers[i] = source->registers[i];
+  }
+  return HLL_RESULT_OK;
+}
+
+hll_size_t hllSerializedSize(const hll_t *self) {
+  panicif(!self, "hll cannot be null");
+  if (self->encoding == HLL_ENCODING_DENSE)
+    return HLL_HEADER_SIZE + (hll_size_t)hllRegisters(self);
+  return HLL_HEADER_SIZE + 4ULL * self->length;
+}
+
+hll_size_t hllSerialize(const hll_t *self, uint8_t *buffer, hll_size_t size) {
+  panicif(!self, "hll cannot be null");
+  const hll_size_t needed = hllSerializedSize(self);
+  if (!buffer || size < needed)
+    return 0;
+
+  uint8_t *cursor = buffer;
+  memcpy(cursor, HLL_MAGIC, HLL_MAGIC_SIZE);
+  cursor += HLL_MAGIC_SIZE;
+  *cursor++ = self->precision;
+  *cursor++ = (uint8_t)self->encoding;
+
+  const uint32_t length = self->encoding == HLL_ENCODING_DENSE
+                              ? hllRegisters(self)
+                              : self->length;
+  for (uint8_t i = 0; i < 4; i++) {
+    *cursor++ = (uint8_t)(length >> (8 * i));
+  }
+
+  if (self->encoding == HLL_ENCODING_DENSE) {
+    memcpy(cursor, self->registers, length);
+    return needed;
+  }
+
+  for (uint32_t i = 0; i < self->length; i++) {
+    for (uint8_t j = 0; j < 4; j++) {
+      *cursor++ = (uint8_t)(self->sparse[i] >> (8 * j));
+    }
+  }
+  return needed;
+}
+
+hll_t *hllDeserialize(const uint8_t *buffer, hll_size_t size) {
+  if (!buffer || size < HLL_HEADER_SIZE ||
+      memcmp(buffer, HLL_MAGIC, HLL_MAGIC_SIZE) != 0)
+    return NULL;
+
+  const uint8_t *cursor = buffer + HLL_MAGIC_SIZE;
+  const uint8_t precision = *cursor++;
+  const uint8_t encoding = *cursor++;
+  uint32_t length = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    length |= (uint32_t)*cursor++ << (8 * i);
+  }
+
+  if (precision < HLL_PRECISION_MIN || precision > HLL_PRECISION_MAX)
+    return NULL;
+
+  const uint32_t registers = 1U << precision;
+  const uint8_t max_rank = (uint8_t)(64 - precision + 1);
+
+  if (encoding == HLL_ENCODING_DENSE) {
+    if (length != registers || size != HLL_HEADER_SIZE + (hll_size_t)length)
+      return NULL;
+    for (uint32_t i = 0; i < length; i++) {
+      if (cursor[i] > max_rank)
+        return NULL;
+    }
+  } else if (encoding == HLL_ENCODING_SPARSE) {
+    if (length > registers / 4 || size != HLL_HEADER_SIZE + 4ULL * length)
+      return NULL;
+  } else {
+    return NULL;
+  }
+
+  hll_t *self = hllCreate(precision);
+  if (!self)
+    return NULL;
+
+  if (encoding == HLL_ENCODING_DENSE) {
+    self->registers = (uint8_t *)allocate(registers);
+    if (!self->registers) {
+      hllDestroy(&self);
+      return NULL;
+    }
+    memcpy(self->registers, cursor, registers);
+    self->encoding = HLL_ENCODING_DENSE;
+    return self;
+  }
+
+  if (length > 0) {
+    self->sparse = (uint32_t *)allocate(sizeof(uint32_t) * length);
+    if (!self->sparse) {
+      hllDestroy(&self);
+      return NULL;
+    }
+    self->capacity = length;
+  }
+
+  for (uint32_t i = 0; i < length; i++) {
+    uint32_t entry = 0;
+    for (uint8_t j = 0; j < 4; j++) {
+      entry |= (uint32_t)*cursor++ << (8 * j);
+    }
+
+    // Entries must be sorted by index, in range and carry a rank
+    const int valid = hllSparseIndex(entry) < registers &&
+                      hllSparseRank(entry) > 0 &&
+                      hllSparseRank(entry) <= max_rank &&
+                      (i == 0 || hllSparseIndex(self->sparse[i - 1]) <
+                                     hllSparseIndex(entry));
+    if (!valid) {
+      hllDestroy(&self);
+      return NULL;
+    }
+    self->sparse[i] = entry;
+    self->length++;
+  }
+
+  return self;
+}
+
+void hllDestroy(hll_t **self) {
+  if (!self || !*self)
+    return;
+
+  deallocate(&(*self)->sparse);
+  deallocate(&(*self)->registers);
+  deallocate(self);
+}
+
+#ifdef HLL_C_TEST
+
+#include "test.h"
+#include <stdio.h>
+
+static double relativeError(hll_size_t estimate, hll_size_t actual) {
+  return fabs((double)estimate - (double)actual) / (double)actual;
+}
+
+void addCount(void) {
+  hll_t *hll = hllCreate(14);
+  panicif(!hll, "cannot create hll");
+
+  expectEqllu(hllCount(hll), 0, "empty sketch counts zero");
+
+  hll_result_t result = hllAdd(hll, "key");
+  expectEqlu(result, HLL_RESULT_OK, "add returns OK");
+  (void)hllAdd(hll, "key");
+  expectEqllu(hllCount(hll), 1, "does not count duplicates");
+  expectEqlu(hll->encoding, HLL_ENCODING_SPARSE, "starts sparse");
+
+  test("accuracy");
+  char key[32];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)hllAdd(hll, key);
+  }
+  expectTrue(relativeError(hllCount(hll), 1001) < 0.01,
+             "counts small sets within 1%");
+  expectEqlu(hll->encoding, HLL_ENCODING_SPARSE, "stays sparse while small");
+
+  for (int i = 1000; i < 200000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)hllAdd(hll, key);
+  }
+  expectEqlu(hll->encoding, HLL_ENCODING_DENSE, "switches to dense");
+  expectTrue(relativeError(hllCount(hll), 200001) < 0.03,
+             "counts large sets within 3%");
+
+  hllDestroy(&hll);
+  expectNull(hll, "destroy sets pointer to NULL");
+}
+
+void merge(void) {
+  hll_t *a = hllCreate(12);
+  hll_t *b = hllCreate(12);
+  hll_t *all = hllCreate(12);
+  panicif(!a || !b || !all, "cannot create hll");
+
+  char key[32];
+  for (int i = 0; i < 50000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)hllAdd(i % 2 ? a : b, key);
+    (void)hllAdd(all, key);
+  }
+  // Overlapping keys must not be counted twice
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)hllAdd(a, key);
+    (void)hllAdd(b, key);
+  }
+
+  hll_result_t result = hllMerge(a, b);
+  expectEqlu(result, HLL_RESULT_OK, "merge returns OK");
+  expectEqllu(hllCount(a), hllCount(all), "merged sketch equals union");
+
+  test("sparse into dense");
+  hll_t *small = hllCreate(12);
+  (void)hllAdd(small, "only");
+  (void)hllMerge(small, all);
+  expectEqlu(small->encoding, HLL_ENCODING_DENSE, "becomes dense");
+  expectTrue(relativeError(hllCount(small), 50001) < 0.05,
+             "keeps counting within error");
+
+  test("precision mismatch");
+  hll_t *other = hllCreate(10);
+  expectEqlu(hllMerge(a, other), HLL_ERROR_PRECISION,
+             "refuses different precision");
+
+  hllDestroy(&other);
+  hllDestroy(&small);
+  hllDestroy(&all);
+  hllDestroy(&b);
+  hllDestroy(&a);
+}
+
+void serialization(void) {
+  hll_t *sparse = hllCreate(10);
+  hll_t *dense = hllCreate(10);
+  panicif(!sparse || !dense, "cannot create hll");
+
+  char key[32];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)hllAdd(sparse, key);
+  }
+  for (int i = 0; i < 10000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)hllAdd(dense, key);
+  }
+
+  hll_t *sketches[] = {sparse, dense};
+  for (int i = 0; i < 2; i++) {
+    hll_size_t size = hllSerializedSize(sketches[i]);
+    uint8_t *buffer = (uint8_t *)allocate(size);
+    panicif(!buffer, "cannot allocate buffer");
+
+    test(i ? "dense" : "sparse");
+    expectEqllu(hllSerialize(sketches[i], buffer, size - 1), 0,
+                "refuses small buffers");
+    expectEqllu(hllSerialize(sketches[i], buffer, size), size,
+                "writes the whole sketch");
+
+    hll_t *copy = hllDeserialize(buffer, size);
+    panicif(!copy, "cannot deserialize hll");
+    expectEqlu(copy->encoding, sketches[i]->encoding, "keeps encoding");
+    expectEqllu(hllCount(copy), hllCount(sketches[i]), "keeps count");
+    expectNull(hllDeserialize(buffer, size - 1), "rejects truncated input");
+
+    hllDestroy(&copy);
+    deallocate(&buffer);
+  }
+
+  hllDestroy(&dense);
+  hllDestroy(&sparse);
+}
+
+int main(void) {
+  suite(addCount);
+  suite(merge);
+  suite(serialization);
+
+  return report();
+}
+#endif
@@ -0,0 +1,150 @@
+// HyperLogLog (v0.0.1)
+// ---
+//
+// Estimate the number of distinct keys in fixed memory. Keys are hashed with
+// FNV-1a like in set, so sketches and sets agree on what a distinct key is.
+// Small sketches keep a sorted sparse list of registers and switch to dense
+// registers once that is smaller. The standard error is 1.04 / sqrt(2^p).
+//
+// ```c
+// hll_t* hll = hllCreate(14);  // 16K registers, ~0.8% standard error
+//
+// hllAdd(hll, "key");
+// hllAdd(hll, "key");
+// hllCount(hll);               // returns 1
+//
+// hllMerge(total, hll);        // aggregate per-thread sketches
+//
+// hllDestroy(&hll);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include <stdint.h>
+
+#define HLL_PRECISION_MIN 4
+#define HLL_PRECISION_MAX 16
+
+typedef uint64_t hll_size_t;
+
+typedef enum {
+  HLL_RESULT_OK = 0,
+  HLL_ERROR_ALLOCATION,
+  HLL_ERROR_PRECISION
+} hll_result_t;
+
+typedef enum { HLL_ENCODING_SPARSE = 0, HLL_ENCODING_DENSE } hll_encoding_t;
+
+typedef struct {
+  uint8_t precision;
+  hll_encoding_t encoding;
+  uint32_t length;    // sparse entries in use
+  uint32_t capacity;  // sparse entries allocated
+  uint32_t *sparse;   // sorted (index << 8 | rank) entries
+  uint8_t *registers; // 2^precision ranks, only when dense
+} hll_t;
+
+/**
+ * Create a new sketch with 2^precision registers.
+ * @name hllCreate
+ * @param {uint8_t} precision - Between HLL_PRECISION_MIN and
+ * HLL_PRECISION_MAX; higher is more accurate and uses more memory
+ * @returns {hll_t*} Pointer to the newly created sketch, or NULL on failure
+ * @example
+ *   hll_t* hll = hllCreate(14);
+ */
+hll_t *hllCreate(uint8_t precision);
+
+/**
+ * Add a key to the sketch.
+ * @name hllAdd
+ * @param {hll_t*} self - Pointer to the sketch
+ * @param {const char*} key - The key to add
+ * @returns {hll_result_t} HLL_RESULT_OK on success, HLL_ERROR_ALLOCATION if
+ * memory runs out
+ * @example
+ *   hllAdd(hll, "key");
+ */
+hll_result_t hllAdd(hll_t *self, const char *key);
+
+/**
+ * Add an already hashed key to the sketch. Hashes must be well mixed 64-bit
+ * values.
+ * @name hllAddHash
+ * @param {hll_t*} self - Pointer to the sketch
+ * @param {uint64_t} hash - The hash of the key to add
+ * @returns {hll_result_t} HLL_RESULT_OK on success, HLL_ERROR_ALLOCATION if
+ * memory runs out
+ * @example
+ *   hllAddHash(hll, myHash(id));
+ */
+hll_result_t hllAddHash(hll_t *self, uint64_t hash);
+
+/**
+ * Estimate the number of distinct keys added to the sketch.
+ * @name hllCount
+ * @param {const hll_t*} self - Pointer to the sketch
+ * @returns {hll_size_t} The estimated number of distinct keys
+ * @example
+ *   hll_size_t distinct = hllCount(hll);
+ */
+hll_size_t hllCount(const hll_t *self);
+
+/**
+ * Merge a sketch into another, as if the keys of source were added to self.
+ * @name hllMerge
+ * @param {hll_t*} self - Pointer to the destination sketch
+ * @param {const hll_t*} source - Pointer to the sketch to merge
+ * @returns {hll_result_t} HLL_RESULT_OK on success, HLL_ERROR_PRECISION if
+ * the sketches have different precision, HLL_ERROR_ALLOCATION if memory runs
+ * out
+ * @example
+ *   hllMerge(total, perThread);
+ */
+hll_result_t hllMerge(hll_t *self, const hll_t *source);
+
+/**
+ * Get the number of bytes hllSerialize needs to write the sketch.
+ * @name hllSerializedSize
+ * @param {const hll_t*} self - Pointer to the sketch
+ * @returns {hll_size_t} Size of the serialized sketch in bytes
+ * @example
+ *   uint8_t *buffer = allocate(hllSerializedSize(hll));
+ */
+hll_size_t hllSerializedSize(const hll_t *self);
+
+/**
+ * Write the sketch in a portable little-endian format.
+ * @name hllSerialize
+ * @param {const hll_t*} self - Pointer to the sketch
+ * @param {uint8_t*} buffer - Destination buffer
+ * @param {hll_size_t} size - Size of the destination buffer
+ * @returns {hll_size_t} Bytes written, or 0 if the buffer is too small
+ * @example
+ *   hll_size_t size = hllSerializedSize(hll);
+ *   uint8_t *buffer = allocate(size);
+ *   hllSerialize(hll, buffer, size);
+ */
+hll_size_t hllSerialize(const hll_t *self, uint8_t *buffer, hll_size_t size);
+
+/**
+ * Create a sketch from the output of hllSerialize.
+ * @name hllDeserialize
+ * @param {const uint8_t*} buffer - Serialized sketch
+ * @param {hll_size_t} size - Size of the serialized sketch
+ * @returns {hll_t*} Pointer to the sketch, or NULL if the buffer is malformed
+ * or memory runs out
+ * @example
+ *   hll_t* copy = hllDeserialize(buffer, size);
+ */
+hll_t *hllDeserialize(const uint8_t *buffer, hll_size_t size);
+
+/**
+ * Destroy the sketch and free all allocated memory.
+ * @name hllDestroy
+ * @param {hll_t**} self - Pointer to the sketch pointer (will be set to NULL)
+ * @example
+ *   hllDestroy(&hll);
+ */
+void hllDestroy(hll_t **self);
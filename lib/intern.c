@@ -0,0 +1,296 @@
+#include "intern.h"
+#include "alloc.h"
+#include "panic.h"
+#include <stddef.h>
+#include <string.h>
+
+#define INTERN_INITIAL_CAPACITY 64
+
+static uint64_t internMakeHash(const char *bytes, size_t length) {
+  uint64_t hash = 14695981039346656037U;
+  const uint64_t prime = 1099511628211U;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint64_t)(unsigned char)bytes[i];
+    hash *= prime;
+  }
+
+  return hash;
+}
+
+static const intern_entry_t *internEntry(const char *interned) {
+  const void *entry = interned - offsetof(intern_entry_t, string);
+  return (const intern_entry_t *)entry;
+}
+
+static void internLock(intern_t *self) {
+#ifdef INTERN_THREADS
+  if (self->shared)
+    pthread_mutex_lock(&self->lock);
+#else
+  (void)self;
+#endif
+}
+
+static void internUnlock(intern_t *self) {
+#ifdef INTERN_THREADS
+  if (self->shared)
+    pthread_mutex_unlock(&self->lock);
+#else
+  (void)self;
+#endif
+}
+
+// Returns the slot holding the bytes, or the empty slot where they belong
+static intern_entry_t **internFind(const intern_t *self, const char *bytes,
+                                   size_t length, uint64_t hash) {
+  const intern_size_t mask = self->capacity - 1;
+  for (intern_size_t i = hash & mask;; i = (i + 1) & mask) {
+    intern_entry_t *entry = self->slots[i];
+    if (!entry || (entry->hash == hash && entry->length == length &&
+                   memcmp(entry->string, bytes, length) == 0)) {
+      return &self->slots[i];
+    }
+  }
+}
+
+// Doubles the slots, reusing the stored hashes
+static int internGrow(intern_t *self) {
+  const intern_size_t capacity = self->capacity * 2;
+  intern_entry_t **slots =
+      (intern_entry_t **)allocate(sizeof(intern_entry_t *) * capacity);
+  if (!slots)
+    return 0;
+
+  for (intern_size_t i = 0; i < self->capacity; i++) {
+    intern_entry_t *entry = self->slots[i];
+    if (!entry)
+      continue;
+    intern_size_t j = entry->hash & (capacity - 1);
+    while (slots[j]) {
+      j = (j + 1) & (capacity - 1);
+    }
+    slots[j] = entry;
+  }
+
+  deallocate(&self->slots);
+  self->slots = slots;
+  self->capacity = capacity;
+  return 1;
+}
+
+static intern_t *internCreateWith(int shared) {
+  intern_t *self = (intern_t *)allocate(sizeof(intern_t));
+  if (!self)
+    return NULL;
+
+  self->capacity = INTERN_INITIAL_CAPACITY;
+  self->slots = (intern_entry_t **)allocate(sizeof(intern_entry_t *) *
+                                            self->capacity);
+  self->arena = arenaCreate(0);
+  if (!self->slots || !self->arena) {
+    deallocate(&self->slots);
+    arenaDestroy(&self->arena);
+    deallocate(&self);
+    return NULL;
+  }
+
+#ifdef INTERN_THREADS
+  if (shared)
+    pthread_mutex_init(&self->lock, NULL);
+#endif
+  self->shared = shared;
+  return self;
+}
+
+intern_t *internCreate(void) { return internCreateWith(0); }
+
+intern_t *internCreateShared(void) { return internCreateWith(1); }
+
+const char *internBytes(intern_t *self, const char *bytes, size_t length) {
+  panicif(!self, "intern cannot be null");
+  const uint64_t hash = internMakeHash(bytes, length);
+
+  internLock(self);
+  intern_entry_t **slot = internFind(self, bytes, length, hash);
+  if (*slot) {
+    internUnlock(self);
+    return (*slot)->string;
+  }
+
+  // Keep the load below 3/4 so probes stay short and always end
+  if ((self->count + 1) * 4 > self->capacity * 3) {
+    if (!internGrow(self)) {
+      internUnlock(self);
+      return NULL;
+    }
+    slot = internFind(self, bytes, length, hash);
+  }
+
+  intern_entry_t *entry = (intern_entry_t *)arenaAllocUninit(
+      self->arena, sizeof(intern_entry_t) + length + 1);
+  if (!entry) {
+    internUnlock(self);
+    return NULL;
+  }
+  entry->hash = hash;
+  entry->length = length;
+  if (length > 0)
+    memcpy(entry->string, bytes, length);
+  entry->string[length] = '\0';
+
+  *slot = entry;
+  self->count++;
+  internUnlock(self);
+  return entry->string;
+}
+
+const char *internString(intern_t *self, const char *string) {
+  return internBytes(self, string, strlen(string));
+}
+
+const char *internLookup(intern_t *self, const char *string) {
+  panicif(!self, "intern cannot be null");
+  const size_t length = strlen(string);
+  const uint64_t hash = internMakeHash(string, length);
+
+  internLock(self);
+  const intern_entry_t *entry = *internFind(self, string, length, hash);
+  internUnlock(self);
+  return entry ? entry->string : NULL;
+}
+
+size_t internLength(const char *interned) {
+  return internEntry(interned)->length;
+}
+
+uint64_t internHash(const char *interned) {
+  return internEntry(interned)->hash;
+}
+
+intern_size_t internUsed(intern_t *self) {
+  panicif(!self, "intern cannot be null");
+  internLock(self);
+  const intern_size_t count = self->count;
+  internUnlock(self);
+  return count;
+}
+
+void internDestroy(intern_t **self) {
+  if (!self || !*self)
+    return;
+
+#ifdef INTERN_THREADS
+  if ((*self)->shared)
+    pthread_mutex_destroy(&(*self)->lock);
+#endif
+  arenaDestroy(&(*self)->arena);
+  deallocate(&(*self)->slots);
+  deallocate(self);
+}
+
+#ifdef INTERN_C_TEST
+
+#include "test.h"
+#include <stdio.h>
+
+void internEquality(void) {
+  intern_t *names = internCreate();
+  panicif(!names, "cannot create intern");
+
+  char copy[] = "tenant";
+  const char *a = internString(names, "tenant");
+  const char *b = internString(names, copy);
+  expectTrue(a == b, "returns the same pointer for equal strings");
+  expectTrue(a != copy, "returns its own copy");
+  expectTrue(internString(names, "field") != a,
+             "returns different pointers for different strings");
+  expectEqllu(internUsed(names), 2, "counts distinct strings");
+
+  test("bytes and lookup");
+  expectTrue(internBytes(names, "tenants", 6) == a,
+             "interns a prefix of longer bytes");
+  expectNull(internLookup(names, "missing"), "lookup does not add");
+  expectTrue(internLookup(names, "field") == internString(names, "field"),
+             "lookup finds interned strings");
+  expectEqllu(internLength(a), 6, "stores the length");
+  expectTrue(internString(names, "") != NULL, "interns the empty string");
+
+  test("growth");
+  const char *first[1000];
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    first[i] = internString(names, key);
+  }
+  int stable = 1;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    stable &= internString(names, key) == first[i];
+  }
+  expectTrue(stable, "keeps pointers stable while growing");
+  expectEqllu(internUsed(names), 1003, "counts every string once");
+
+  internDestroy(&names);
+  expectNull(names, "destroy sets pointer to NULL");
+}
+
+#ifdef INTERN_THREADS
+enum { THREADS = 4, STRINGS = 2000 };
+static const char *seen[THREADS][STRINGS];
+
+typedef struct {
+  intern_t *names;
+  int id;
+} worker_t;
+
+static void *internMany(void *argument) {
+  const worker_t *worker = (const worker_t *)argument;
+  char key[16];
+  for (int i = 0; i < STRINGS; i++) {
+    // Each thread visits the strings in a different order
+    const int index = (i * 7 + worker->id * 13) % STRINGS;
+    snprintf(key, sizeof(key), "key%d", index);
+    seen[worker->id][index] = internString(worker->names, key);
+  }
+  return NULL;
+}
+
+void shared(void) {
+  intern_t *names = internCreateShared();
+  panicif(!names, "cannot create intern");
+
+  pthread_t threads[THREADS];
+  worker_t workers[THREADS];
+  for (int i = 0; i < THREADS; i++) {
+    workers[i].names = names;
+    workers[i].id = i;
+    pthread_create(&threads[i], NULL, internMany, &workers[i]);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  int agree = 1;
+  for (int i = 0; i < STRINGS; i++) {
+    for (int t = 1; t < THREADS; t++) {
+      agree &= seen[t][i] == seen[0][i];
+    }
+  }
+  expectTrue(agree, "threads get the same pointers");
+  expectEqllu(internUsed(names), STRINGS, "stores each string once");
+
+  internDestroy(&names);
+}
+#endif
+
+int main(void) {
+  suite(internEquality);
+#ifdef INTERN_THREADS
+  suite(shared);
+#endif
+
+  return report();
+}
+
+#endif
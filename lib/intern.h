@@ -0,0 +1,147 @@
+// Intern (v0.0.1)
+// ---
+//
+// A table keeping one canonical copy of each string. Interning the same
+// bytes twice returns the same pointer, so interned strings are compared
+// with ==. Copies live in an arena next to their hash and length, and stay
+// valid until the table is destroyed.
+//
+// internCreateShared returns a table that can be used from several threads.
+//
+// ```c
+// intern_t* names = internCreate();
+//
+// const char* a = internString(names, "tenant");
+// const char* b = internString(names, "tenant");
+// a == b;                        // true
+// internLength(a);               // returns 6
+//
+// internDestroy(&names);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "alloc.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define INTERN_THREADS 1
+#endif
+
+typedef uint64_t intern_size_t;
+
+typedef struct {
+  uint64_t hash;
+  size_t length;
+  char string[]; // NUL-terminated
+} intern_entry_t;
+
+typedef struct {
+  intern_size_t count;
+  intern_size_t capacity; // a power of two
+  intern_entry_t **slots;
+  arena_t *arena;
+  int shared;
+#ifdef INTERN_THREADS
+  pthread_mutex_t lock;
+#endif
+} intern_t;
+
+/**
+ * Create a new empty table for a single thread.
+ * @name internCreate
+ * @returns {intern_t*} Pointer to the newly created table, or NULL on failure
+ * @example
+ *   intern_t* names = internCreate();
+ */
+intern_t *internCreate(void);
+
+/**
+ * Create a new empty table that several threads can use at once.
+ * @name internCreateShared
+ * @returns {intern_t*} Pointer to the newly created table, or NULL on failure
+ * @example
+ *   intern_t* names = internCreateShared();
+ */
+intern_t *internCreateShared(void);
+
+/**
+ * Get the canonical copy of a string, adding it if needed.
+ * @name internString
+ * @param {intern_t*} self - Pointer to the table
+ * @param {const char*} string - The string to intern
+ * @returns {const char*} The canonical copy, or NULL if memory runs out
+ * @example
+ *   const char* name = internString(names, "tenant");
+ */
+const char *internString(intern_t *self, const char *string);
+
+/**
+ * Get the canonical copy of length bytes, adding it if needed. The bytes
+ * don't need to be NUL-terminated.
+ * @name internBytes
+ * @param {intern_t*} self - Pointer to the table
+ * @param {const char*} bytes - The bytes to intern
+ * @param {size_t} length - Number of bytes
+ * @returns {const char*} The canonical copy, NUL-terminated, or NULL if
+ * memory runs out
+ * @example
+ *   const char* field = internBytes(names, line + start, end - start);
+ */
+const char *internBytes(intern_t *self, const char *bytes, size_t length);
+
+/**
+ * Get the canonical copy of a string without adding it.
+ * @name internLookup
+ * @param {intern_t*} self - Pointer to the table
+ * @param {const char*} string - The string to look up
+ * @returns {const char*} The canonical copy, or NULL if it was never interned
+ * @example
+ *   if (internLookup(names, "tenant") == tenant) {
+ *     // same string
+ *   }
+ */
+const char *internLookup(intern_t *self, const char *string);
+
+/**
+ * Get the length of an interned string without scanning it.
+ * @name internLength
+ * @param {const char*} interned - A string returned by the table
+ * @returns {size_t} The length in bytes
+ * @example
+ *   size_t length = internLength(name);
+ */
+size_t internLength(const char *interned);
+
+/**
+ * Get the hash of an interned string without computing it.
+ * @name internHash
+ * @param {const char*} interned - A string returned by the table
+ * @returns {uint64_t} The FNV-1a hash of the string
+ * @example
+ *   uint64_t hash = internHash(name);
+ */
+uint64_t internHash(const char *interned);
+
+/**
+ * Get the number of distinct strings in the table.
+ * @name internUsed
+ * @param {intern_t*} self - Pointer to the table
+ * @returns {intern_size_t} The number of strings
+ * @example
+ *   intern_size_t count = internUsed(names);
+ */
+intern_size_t internUsed(intern_t *self);
+
+/**
+ * Destroy the table and every string it returned.
+ * @name internDestroy
+ * @param {intern_t**} self - Pointer to the table pointer (will be set to
+ * NULL)
+ * @example
+ *   internDestroy(&names);
+ */
+void internDestroy(intern_t **self);
@@ -1,26 +1,17 @@
 #include "map.h"
 #include "alloc.h"
 #include "panic.h"
+#include "str.h"
 #include <string.h>
 
 static char MAP_TOMBSTONE[] = "___TOMBSTONE!!@@##";
 
-#if !defined(_POSIX_C_SOURCE) || _POSIX_C_SOURCE < 200809L
-// If strdup is not available, define it
-char *strdup(const char *s) {
-    size_t len = strlen(s) + 1;
-    char *d = malloc(len);
-    if (d == NULL) return NULL;
-    memcpy(d, s, len);
-    return d;
-}
-#endif
-
-static map_size_t mapMakeKey(const map_t *self, const_map_key_t key) {
+static map_size_t mapMakeKey(const map_t *self, const char *key,
+                             size_t length) {
   uint64_t hash = 14695981039346656037U;
   const uint64_t prime = 1099511628211U;
 
-  for (size_t i = 0; i < strlen(key); i++) {
+  for (size_t i = 0; i < length; i++) {
     hash ^= (uint64_t)(unsigned char)key[i];
     hash *= prime;
   }
@@ -28,10 +19,18 @@ static map_size_t mapMakeKey(const map_t *self, const_map_key_t key) {
   return hash % self->size;
 }
 
-static map_result_t mapGetIndex(const map_t *self, const_map_key_t key,
-                                map_size_t *result) {
+// Compare the key at index with a key that is not NUL-terminated. Keys of
+// another length are rejected without reading the stored bytes.
+static inline int mapKeyEquals(const map_t *self, map_size_t index,
+                               const char *key, size_t length) {
+  return strEquals(strMake(self->keys[index], self->lengths[index]),
+                   strMake(key, length));
+}
+
+static map_result_t mapGetIndex(const map_t *self, const char *key,
+                                size_t length, map_size_t *result) {
   panicif(!self, "map cannot be null");
-  const map_size_t index = mapMakeKey(self, key);
+  const map_size_t index = mapMakeKey(self, key, length);
 
   for (map_size_t i = 0; i < self->size; i++) {
     map_size_t probed_idx = (index + i) % self->size;
@@ -46,7 +45,7 @@ static map_result_t mapGetIndex(const map_t *self, const_map_key_t key,
       continue;
     }
 
-    if (strcmp(probed_key, key) == 0) {
+    if (mapKeyEquals(self, probed_idx, key, length)) {
       *result = probed_idx;
       return MAP_RESULT_OK;
     }
@@ -55,6 +54,23 @@ static map_result_t mapGetIndex(const map_t *self, const_map_key_t key,
   return MAP_ERROR_NOT_FOUND;
 }
 
+// Key copies come from the allocator of the map, if it has one
+static void *mapAllocate(const map_t *self, size_t size) {
+  if (self->allocator.alloc)
+    return self->allocator.alloc(self->allocator.context, size);
+  return allocateUninit(size);
+}
+
+static void mapDeallocate(const map_t *self, map_size_t index) {
+  map_key_t key = self->keys[index];
+  if (self->allocator.free) {
+    self->allocator.free(self->allocator.context, key,
+                         self->lengths[index] + 1);
+  } else {
+    deallocate(&key);
+  }
+}
+
 map_t *mapCreate(map_size_t size) {
   panicif(size == 0, "size cannot be zero");
 
@@ -62,15 +78,18 @@ map_t *mapCreate(map_size_t size) {
   if (!self)
     return NULL;
 
-  self->keys = (map_key_t *)allocate(sizeof(const char *) * size);
+  self->keys = (map_key_t *)allocateLarge(sizeof(const char *) * size);
   if (!self->keys) {
     deallocate(&self);
     return NULL;
   }
 
-  self->values = (value_t *)allocate(sizeof(void *) * size);
-  if (!self->values) {
-    deallocate(&self->keys);
+  self->values = (value_t *)allocateLarge(sizeof(void *) * size);
+  self->lengths = (size_t *)allocateLarge(sizeof(size_t) * size);
+  if (!self->values || !self->lengths) {
+    deallocateLarge(&self->keys);
+    deallocateLarge(&self->values);
+    deallocateLarge(&self->lengths);
     deallocate(&self);
     return NULL;
   }
@@ -80,16 +99,52 @@ map_t *mapCreate(map_size_t size) {
   return self;
 }
 
-map_result_t mapSet(map_t *self, const_map_key_t key, value_t value) {
+map_t *mapCreateWithAllocator(map_size_t size, const allocator_t *allocator) {
+  panicif(size == 0, "size cannot be zero");
+  panicif(!allocator || !allocator->alloc || !allocator->free,
+          "allocator cannot be null");
+
+  const size_t slots = sizeof(void *) * size;
+  const size_t lengths = sizeof(size_t) * size;
+  map_t *self = (map_t *)allocator->alloc(allocator->context, sizeof(map_t));
+  if (!self)
+    return NULL;
+  memset(self, 0, sizeof(map_t));
+  self->allocator = *allocator;
+
+  self->keys = (map_key_t *)allocator->alloc(allocator->context, slots);
+  self->values = (value_t *)allocator->alloc(allocator->context, slots);
+  self->lengths = (size_t *)allocator->alloc(allocator->context, lengths);
+  if (!self->keys || !self->values || !self->lengths) {
+    if (self->keys)
+      allocator->free(allocator->context, self->keys, slots);
+    if (self->values)
+      allocator->free(allocator->context, self->values, slots);
+    if (self->lengths)
+      allocator->free(allocator->context, self->lengths, lengths);
+    allocator->free(allocator->context, self, sizeof(map_t));
+    return NULL;
+  }
+
+  memset(self->keys, 0, slots);
+  memset(self->values, 0, slots);
+  memset(self->lengths, 0, lengths);
+  self->size = size;
+
+  return self;
+}
+
+static map_result_t mapSetLength(map_t *self, const char *key, size_t length,
+                                 value_t value) {
   panicif(!self, "map cannot be null");
-  map_size_t index = mapMakeKey(self, key);
+  map_size_t index = mapMakeKey(self, key, length);
   map_key_t old_key = self->keys[index];
-  int collides_with_old_key =
-      !!old_key && strcmp(key, old_key) != 0 && old_key != MAP_TOMBSTONE;
+  int collides_with_old_key = !!old_key && old_key != MAP_TOMBSTONE &&
+                              !mapKeyEquals(self, index, key, length);
 
   // When there is a collision with another key, look for the next free index
   if (collides_with_old_key) {
-    uint8_t i;
+    map_size_t i;
 
     for (i = 1; i < self->size; i++) {
       map_size_t probed_idx = (index + i) % self->size;
@@ -101,7 +156,8 @@ map_result_t mapSet(map_t *self, const_map_key_t key, value_t value) {
       //  - probed_key equals key -> we are overriding an existing key
       const int should_write_on_index = !probed_key ||
                                         probed_key == MAP_TOMBSTONE ||
-                                        (!strcmp(probed_key, key));
+                                        mapKeyEquals(self, probed_idx, key,
+                                                     length);
 
       if (should_write_on_index) {
         index = probed_idx;
@@ -115,32 +171,78 @@ map_result_t mapSet(map_t *self, const_map_key_t key, value_t value) {
   }
 
 set:
-  if (self->keys[index] && self->keys[index] != MAP_TOMBSTONE) {
-    deallocate(&self->keys[index]);
+  // Overriding an existing key keeps its copy
+  if (!self->keys[index] || self->keys[index] == MAP_TOMBSTONE) {
+    map_key_t copy = (map_key_t)mapAllocate(self, length + 1);
+    if (!copy)
+      return MAP_ERROR_ALLOCATION;
+    memcpy(copy, key, length);
+    copy[length] = '\0';
+    self->keys[index] = copy;
+    self->lengths[index] = length;
   }
-  self->keys[index] = strdup(key);
   self->values[index] = value;
   return MAP_RESULT_OK;
 }
 
-value_t mapGet(const map_t *self, const_map_key_t key) {
+map_result_t mapSet(map_t *self, const_map_key_t key, value_t value) {
+  return mapSetLength(self, key, strlen(key), value);
+}
+
+map_result_t mapSetStr(map_t *self, str_t key, value_t value) {
+  return mapSetLength(self, key.data, key.length, value);
+}
+
+map_result_t mapLoadFile(map_t *self, const char *path, char delimiter,
+                         file_t **file) {
+  panicif(!self, "map cannot be null");
+  panicif(!file, "file cannot be null");
+  *file = fileOpen(path);
+  if (!*file)
+    return MAP_ERROR_IO;
+
+  map_result_t result = MAP_RESULT_OK;
+  size_t offset = 0, length;
+  char *line;
+  while (result == MAP_RESULT_OK &&
+         fileNextLine(*file, &offset, &line, &length)) {
+    // Terminate the value in place, over the line ending
+    char *end = line + length;
+    *end = '\0';
+
+    char *separator = (char *)memchr(line, delimiter, length);
+    const value_t value = separator ? separator + 1 : end;
+    if (!separator)
+      separator = end;
+
+    if (separator > line)
+      result = mapSetLength(self, line, (size_t)(separator - line), value);
+  }
+
+  return result;
+}
+
+value_t mapGetStr(const map_t *self, str_t key) {
   panicif(!self, "map cannot be null");
   map_size_t index;
-  if (mapGetIndex(self, key, &index) == MAP_RESULT_OK) {
+  if (mapGetIndex(self, key.data, key.length, &index) == MAP_RESULT_OK) {
     return self->values[index];
   }
   return NULL;
 }
 
-value_t mapDelete(map_t *self, const_map_key_t key) {
+value_t mapGet(const map_t *self, const_map_key_t key) {
+  return mapGetStr(self, strFrom(key));
+}
+
+value_t mapDeleteStr(map_t *self, str_t key) {
   panicif(!self, "map cannot be null");
   map_size_t index;
-  if (mapGetIndex(self, key, &index) == MAP_RESULT_OK) {
+  if (mapGetIndex(self, key.data, key.length, &index) == MAP_RESULT_OK) {
     value_t previous = self->values[index];
     self->values[index] = NULL;
 
-    map_key_t old_key = self->keys[index];
-    deallocate(&old_key);
+    mapDeallocate(self, index);
 
     self->keys[index] = MAP_TOMBSTONE;
     return previous;
@@ -148,18 +250,35 @@ value_t mapDelete(map_t *self, const_map_key_t key) {
   return NULL;
 }
 
+value_t mapDelete(map_t *self, const_map_key_t key) {
+  return mapDeleteStr(self, strFrom(key));
+}
+
 void mapDestroy(map_t **self) {
   if (!self || !*self)
     return;
 
   for (size_t i = 0; i < (*self)->size; i++) {
-    if ((*self)->keys[i] != MAP_TOMBSTONE) {
-      deallocate(&(*self)->keys[i]);
+    if ((*self)->keys[i] && (*self)->keys[i] != MAP_TOMBSTONE) {
+      mapDeallocate(*self, i);
     }
   }
 
-  deallocate(&(*self)->keys);
-  deallocate(&(*self)->values);
+  if ((*self)->allocator.free) {
+    const allocator_t allocator = (*self)->allocator;
+    const size_t slots = sizeof(void *) * (*self)->size;
+    allocator.free(allocator.context, (*self)->keys, slots);
+    allocator.free(allocator.context, (*self)->values, slots);
+    allocator.free(allocator.context, (*self)->lengths,
+                   sizeof(size_t) * (*self)->size);
+    allocator.free(allocator.context, *self, sizeof(map_t));
+    *self = NULL;
+    return;
+  }
+
+  deallocateLarge(&(*self)->keys);
+  deallocateLarge(&(*self)->values);
+  deallocateLarge(&(*self)->lengths);
   deallocate(self);
 }
 
@@ -277,10 +396,387 @@ void collisions(void) {
   mapDestroy(&map);
 }
 
+void loadFile(void) {
+  const char *path = "map.test.txt";
+  FILE *stream = fopen(path, "wb");
+  panicif(!stream, "cannot create test file");
+  fputs("alpha=1\nbeta=2\r\n\ngamma\n=4\nalpha=5\ndelta=x=y", stream);
+  fclose(stream);
+
+  map_t *map = mapCreate(16);
+  panicif(!map, "cannot create map");
+
+  file_t *file;
+  expectEqlu(mapLoadFile(map, path, '=', &file), MAP_RESULT_OK,
+             "loads the file");
+  expectTrue(strcmp(mapGet(map, "alpha"), "5") == 0,
+             "later lines override earlier ones");
+  expectTrue(strcmp(mapGet(map, "beta"), "2") == 0, "strips CRLF endings");
+  expectTrue(strcmp(mapGet(map, "gamma"), "") == 0,
+             "maps lines without delimiter to empty values");
+  expectTrue(strcmp(mapGet(map, "delta"), "x=y") == 0,
+             "splits on the first delimiter only");
+  expectNull(mapGet(map, ""), "skips empty keys");
+  fileClose(&file);
+
+  test("errors");
+  expectEqlu(mapLoadFile(map, "missing.test.txt", '=', &file), MAP_ERROR_IO,
+             "fails on missing file");
+  expectNull(file, "does not return a file");
+
+  map_t *small = mapCreate(2);
+  panicif(!small, "cannot create map");
+  expectEqlu(mapLoadFile(small, path, '=', &file), MAP_ERROR_FULL,
+             "fails when the map fills up");
+  fileClose(&file);
+
+  mapDestroy(&small);
+  mapDestroy(&map);
+  remove(path);
+}
+
+void largeTables(void) {
+  // Slot arrays past ALLOC_LARGE_THRESHOLD are mapped rather than on the heap
+  map_t *map = mapCreate(1 << 19);
+  panicif(!map, "cannot create map");
+
+  int value = 7;
+  char key[16];
+  int all_found = 1;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    (void)mapSet(map, key, &value);
+  }
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    all_found &= mapGet(map, key) == &value;
+  }
+  expectTrue(all_found, "finds every key");
+  expectNull(mapGet(map, "missing"), "starts from zeroed slots");
+  expectTrue((uintptr_t)map->keys % 64 == 0, "aligns slots to cache lines");
+
+  mapDestroy(&map);
+}
+
+static size_t freed;
+
+static void *countingAlloc(void *context, size_t size) {
+  (*(size_t *)context)++;
+  return allocateUninit(size);
+}
+
+static void countingFree(void *context, void *ptr, size_t size) {
+  (*(size_t *)context)--;
+  freed += size;
+  deallocate(&ptr);
+}
+
+void allocators(void) {
+  size_t live = 0;
+  allocator_t counting = {countingAlloc, NULL, countingFree, &live};
+  map_t *map = mapCreateWithAllocator(8, &counting);
+  panicif(!map, "cannot create map");
+  expectEqllu(live, 4, "allocates the map and its slots");
+
+  int value = 1;
+  (void)mapSet(map, "key", &value);
+  (void)mapSet(map, "other", &value);
+  expectEqllu(live, 6, "allocates key copies");
+  expectTrue(mapGet(map, "other") == &value, "finds keys");
+
+  freed = 0;
+  (void)mapDelete(map, "key");
+  expectEqllu(freed, 4, "frees keys with their size");
+  mapDestroy(&map);
+  expectEqllu(live, 0, "frees everything on destroy");
+  expectNull(map, "destroy sets pointer to NULL");
+
+  test("arena");
+  arena_t *arena = arenaCreate(0);
+  panicif(!arena, "cannot create arena");
+  allocator_t allocator = allocatorArena(arena);
+  map = mapCreateWithAllocator(8, &allocator);
+  panicif(!map, "cannot create map");
+  (void)mapSet(map, "key", &value);
+  expectTrue(mapGet(map, "key") == &value, "stores keys in the arena");
+  expectNull(mapGet(map, "missing"), "starts from empty slots");
+  arenaDestroy(&arena); // releases the map at once
+}
+
+void strKeys(void) {
+  map_t *map = mapCreate(8);
+  panicif(!map, "cannot create map");
+
+  int value = 1, other = 2;
+  const char *line = "tenant=42,field=7";
+  expectEqlu(mapSetStr(map, strMake(line, 6), &value), MAP_RESULT_OK,
+             "sets keys that are not NUL-terminated");
+  expectTrue(mapGet(map, "tenant") == &value, "copies only the view");
+  expectTrue(mapGetStr(map, STR("tenant")) == &value, "gets by view");
+  expectNull(mapGetStr(map, strMake(line, 5)), "does not match prefixes");
+  expectNull(mapGetStr(map, strMake(line, 7)), "does not match longer keys");
+
+  (void)mapSetStr(map, strMake(line + 10, 5), &other);
+  expectTrue(mapGet(map, "field") == &other, "sets more views");
+  expectTrue(mapDeleteStr(map, STR("field")) == &other, "deletes by view");
+  expectNull(mapGet(map, "field"), "removes the key");
+
+  mapDestroy(&map);
+}
+
+#define SCALING_LOOKUPS 4096
+
+static const size_t scalingSizes[] = {500, 2000, 8000, 32000, 0};
+static map_t *scalingMaps[4];
+static char scalingKeys[32000][8];
+static value_t scalingFound;
+
+// Looks up the same keys whatever the size of the map. They stay in cache,
+// so only the work of a lookup is compared, not the memory hierarchy.
+static void scalingGets(size_t n) {
+  int map = 0;
+  while (scalingSizes[map] != n) {
+    map++;
+  }
+  for (size_t i = 0; i < SCALING_LOOKUPS; i++) {
+    scalingFound = mapGet(scalingMaps[map], scalingKeys[i * 7919 % 500]);
+  }
+}
+
+// Looks up a missing key of n bytes
+static void scalingLongKeys(size_t n) {
+  static char key[32001];
+  memset(key, 'k', n);
+  key[n] = '\0';
+  testResetTimer();
+  for (int i = 0; i < 16; i++) {
+    scalingFound = mapGet(scalingMaps[0], key);
+  }
+}
+
+void scaling(void) {
+  int value = 1;
+  for (size_t i = 0; i < 32000; i++) {
+    snprintf(scalingKeys[i], sizeof(scalingKeys[i]), "k%zu", i);
+  }
+  for (int m = 0; m < 4; m++) {
+    scalingMaps[m] = mapCreate(2 * scalingSizes[m]);
+    panicif(!scalingMaps[m], "cannot create map");
+    for (size_t i = 0; i < scalingSizes[m]; i++) {
+      (void)mapSet(scalingMaps[m], scalingKeys[i], &value);
+    }
+  }
+
+  expectComplexity(scalingGets, scalingSizes, O_1,
+                   "looks keys up in constant time");
+  expectComplexity(scalingLongKeys, scalingSizes, O_N,
+                   "hashes keys in linear time");
+  expectTrue(testScaling(scalingLongKeys, scalingSizes, O_1) >
+                 TEST_SCALING_SLACK,
+             "tells linear from constant time");
+
+  for (int m = 0; m < 4; m++) {
+    mapDestroy(&scalingMaps[m]);
+  }
+}
+
 int main(void) {
   suite(getSet);
   suite(collisions);
+  suite(loadFile);
+  suite(largeTables);
+  suite(allocators);
+  suite(strKeys);
+  suite(scaling);
 
   return report();
 }
 #endif
+
+#ifdef MAP_C_BENCH
+
+#include "bench.h"
+#include <stdio.h>
+
+#define BENCH_OPS (1 << 20) // lookups drawn before timing and replayed
+#define BENCH_LOAD 75       // percent of the slots in use, unless varied
+#define BENCH_KEY 16        // bytes per key, unless varied
+
+// A map filled to a load factor. Its keys are a window of a pool twice as
+// large, which churn moves forward; the rest of the pool are misses.
+typedef struct {
+  map_t *map;
+  map_size_t size;
+  int load;
+  size_t length;           // bytes per key
+  size_t count;            // keys in the map
+  size_t start;            // pool index of the oldest key in the map
+  size_t next;             // keys inserted by benchInsert so far
+  char *pool;              // 2 * count keys
+  uint32_t ops[BENCH_OPS]; // pool indexes to look up
+} workload_t;
+
+static uint64_t benchState = 88172645463325252ULL;
+static workload_t benchWorkload;
+static int benchValue;
+static char benchName[BENCH_NAME];
+
+static inline const char *benchKey(size_t index) {
+  const workload_t *w = &benchWorkload;
+  return w->pool + index % (2 * w->count) * (w->length + 1);
+}
+
+// Build a map of size slots with load percent of them in use, reusing the
+// current one when it matches and no benchmark changed it
+static void benchPrepare(map_size_t size, int load, size_t length) {
+  workload_t *w = &benchWorkload;
+  if (w->map && w->size == size && w->load == load && w->length == length &&
+      w->start == 0 && w->next == 0)
+    return;
+
+  if (w->map) {
+    mapDestroy(&w->map);
+    free(w->pool);
+  }
+  w->size = size;
+  w->load = load;
+  w->length = length;
+  w->count = (size_t)(size * (map_size_t)load / 100);
+  w->start = 0;
+  w->next = 0;
+  w->pool = benchStrings(2 * w->count, length, &benchState);
+  w->map = mapCreate(size);
+  panicif(!w->pool || !w->map, "cannot allocate workload");
+  for (size_t i = 0; i < w->count; i++) {
+    mapSet(w->map, benchKey(i), &benchValue);
+  }
+}
+
+// Draw lookups: hit percent of them are keys in the map, picked with a Zipf
+// exponent (0 for uniform), and the others are keys that were never inserted
+static void benchDraw(double exponent, int hit) {
+  workload_t *w = &benchWorkload;
+  panicif(!benchZipf(w->ops, BENCH_OPS, (uint32_t)w->count, exponent,
+                     &benchState),
+          "cannot draw lookups");
+  for (size_t i = 0; i < BENCH_OPS; i++) {
+    // Scatter the ranks so the popular keys are not the first inserted
+    size_t index = (size_t)(w->ops[i] * 2654435761ULL % w->count);
+    if ((int)(benchRandom(&benchState) % 100) >= hit)
+      index += w->count;
+    w->ops[i] = (uint32_t)((w->start + index) % (2 * w->count));
+  }
+}
+
+static void benchGet(bench_t *b) {
+  const workload_t *w = &benchWorkload;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    value_t value = mapGet(w->map, benchKey(w->ops[i & (BENCH_OPS - 1)]));
+    benchDoNotOptimize(value);
+  }
+}
+
+// Fills an empty map up to the load, then starts over with a new one
+static void benchInsert(bench_t *b) {
+  workload_t *w = &benchWorkload;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    if (w->next % w->count == 0) {
+      benchPause(b);
+      mapDestroy(&w->map);
+      w->map = mapCreate(w->size);
+      panicif(!w->map, "cannot allocate map");
+      benchResume(b);
+    }
+    mapSet(w->map, benchKey(w->next++ % w->count), &benchValue);
+  }
+}
+
+// Deletes the oldest key and inserts a new one. Every delete leaves a
+// tombstone, so later samples probe further than earlier ones.
+static void benchChurn(bench_t *b) {
+  workload_t *w = &benchWorkload;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    mapDelete(w->map, benchKey(w->start));
+    mapSet(w->map, benchKey(w->start + w->count), &benchValue);
+    w->start = (w->start + 1) % (2 * w->count);
+  }
+}
+
+static void benchLookups(const char *kind, map_size_t size, int load,
+                         size_t length, double exponent, int hit) {
+  snprintf(benchName, sizeof(benchName),
+           "map/get/%s/hit=%d/slots=%llu/load=%d/key=%zu", kind, hit,
+           (unsigned long long)size, load, length);
+  if (!benchSelected(benchName))
+    return;
+  benchPrepare(size, load, length);
+  benchDraw(exponent, hit);
+  benchmarkWith(benchName, benchGet, NULL);
+}
+
+static void benchWrites(const char *kind, bench_fn_t fn, map_size_t size) {
+  snprintf(benchName, sizeof(benchName), "map/%s/slots=%llu/load=%d/key=%d",
+           kind, (unsigned long long)size, BENCH_LOAD, BENCH_KEY);
+  if (!benchSelected(benchName))
+    return;
+  benchPrepare(size, BENCH_LOAD, BENCH_KEY);
+  benchmarkWith(benchName, fn, NULL);
+}
+
+// Lookups once deletes have turned most free slots into tombstones
+static void benchChurned(map_size_t size, int hit) {
+  snprintf(benchName, sizeof(benchName),
+           "map/get-churned/uniform/hit=%d/slots=%llu/load=%d/key=%d", hit,
+           (unsigned long long)size, BENCH_LOAD, BENCH_KEY);
+  if (!benchSelected(benchName))
+    return;
+  benchPrepare(size, BENCH_LOAD, BENCH_KEY);
+  bench_t b;
+  b.iterations = 4 * size;
+  benchChurn(&b);
+  benchDraw(0, hit);
+  benchmarkWith(benchName, benchGet, NULL);
+}
+
+int main(void) {
+  // From tables that fit in L1 to about ten times a 16MB last level cache
+  const map_size_t sizes[] = {1 << 10, 1 << 14, 1 << 17, 1 << 20, 1 << 22};
+  const int loads[] = {50, 90, 95, 99};
+  const size_t lengths[] = {4, 64, 256};
+  const int hits[] = {90, 50, 10};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    benchLookups("uniform", sizes[i], BENCH_LOAD, BENCH_KEY, 0, 100);
+    benchLookups("zipf-1.0", sizes[i], BENCH_LOAD, BENCH_KEY, 1.0, 100);
+    benchLookups("uniform", sizes[i], BENCH_LOAD, BENCH_KEY, 0, 0);
+    benchWrites("insert", benchInsert, sizes[i]);
+  }
+
+  for (size_t i = 0; i < sizeof(hits) / sizeof(hits[0]); i++) {
+    benchLookups("uniform", 1 << 17, BENCH_LOAD, BENCH_KEY, 0, hits[i]);
+  }
+
+  for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+    benchLookups("uniform", 1 << 14, loads[i], BENCH_KEY, 0, 100);
+    benchLookups("uniform", 1 << 14, loads[i], BENCH_KEY, 0, 0);
+  }
+
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    benchLookups("uniform", 1 << 14, BENCH_LOAD, lengths[i], 0, 100);
+    benchLookups("uniform", 1 << 14, BENCH_LOAD, lengths[i], 0, 0);
+  }
+
+  for (map_size_t size = 1 << 14; size <= 1 << 17; size <<= 3) {
+    benchWrites("churn", benchChurn, size);
+    benchChurned(size, 100);
+    benchChurned(size, 0);
+  }
+
+  if (benchWorkload.map) {
+    mapDestroy(&benchWorkload.map);
+    free(benchWorkload.pool);
+  }
+  return benchReport();
+}
+
+#endif
@@ -1,8 +1,9 @@
-// Map (v0.0.1)
+// Map (v0.0.5)
 // ---
 //
 // A simple hashmap with owned keys and non-owned values. It handles conflicts
-// through linear probing and has static size.
+// through linear probing and has static size. Large tables are mapped
+// directly from the system, see allocateLarge.
 //
 // ```c
 // map_t* map = mapCreate(10);
@@ -13,16 +14,26 @@
 // my_type_t *resolved;
 // resolved = mapGet("key");
 //
+// mapGetStr(map, STR("key"));  // keys can also be views, see str.h
+//
 // my_type_t *deleted;
 // deleted = mapDelete("key");
 // myTypeDestroy(deleted);    // values are owned by the caller
 //
 // mapDestroy(&map);
+//
+// file_t* file;
+// mapLoadFile(map, "config.ini", '=', &file); // values point into file
+// fileClose(&file);
 // ```
 // ___HEADER_END___
 
 #pragma once
 
+#include "alloc.h"
+#include "file.h"
+#include "str.h"
+#include <stddef.h>
 #include <stdint.h>
 
 typedef char *map_key_t;
@@ -33,13 +44,17 @@ typedef uint64_t map_size_t;
 typedef enum {
   MAP_RESULT_OK = 0,
   MAP_ERROR_FULL,
-  MAP_ERROR_NOT_FOUND
+  MAP_ERROR_NOT_FOUND,
+  MAP_ERROR_ALLOCATION,
+  MAP_ERROR_IO
 } map_result_t;
 
 typedef struct {
   map_size_t size;
   map_key_t *keys;
   value_t *values;
+  size_t *lengths; // lengths of the keys, compared before their bytes
+  allocator_t allocator; // all zero for the default allocation
 } map_t;
 
 /**
@@ -52,19 +67,68 @@ typedef struct {
  */
 map_t *mapCreate(map_size_t size);
 
+/**
+ * Create a new map whose memory, including slots and key copies, comes from
+ * an allocator.
+ * @name mapCreateWithAllocator
+ * @param {map_size_t} size - The maximum number of entries the map can hold
+ * @param {const allocator_t*} allocator - The allocator, copied into the map
+ * @returns {map_t*} Pointer to the newly created map, or NULL on failure
+ * @example
+ *   allocator_t allocator = allocatorArena(arena);
+ *   map_t* map = mapCreateWithAllocator(64, &allocator);
+ */
+map_t *mapCreateWithAllocator(map_size_t size, const allocator_t *allocator);
+
 /**
  * Set a key-value pair in the map. The key is copied and owned by the map.
  * @name mapSet
  * @param {map_t*} self - Pointer to the map
  * @param {const_map_key_t} key - The key to set
  * @param {value_t} value - The value to associate with the key
- * @returns {map_result_t} MAP_RESULT_OK on success, MAP_ERROR_FULL if full
+ * @returns {map_result_t} MAP_RESULT_OK on success, MAP_ERROR_FULL if full,
+ * MAP_ERROR_ALLOCATION if the key cannot be copied
  * @example
  *   my_type_t value;
  *   mapSet(map, "key", &value);
  */
 map_result_t mapSet(map_t *self, const_map_key_t key, value_t value);
 
+/**
+ * Set a key-value pair like mapSet, with the key given as a view.
+ * @name mapSetStr
+ * @param {map_t*} self - Pointer to the map
+ * @param {str_t} key - The key to set, copied by the map
+ * @param {value_t} value - The value to associate with the key
+ * @returns {map_result_t} Same as mapSet
+ * @example
+ *   mapSetStr(map, strMake(line, separator), &value);
+ */
+map_result_t mapSetStr(map_t *self, str_t key, value_t value);
+
+/**
+ * Set a key-value pair for every line of a file, split at the first
+ * delimiter. Keys are copied; values are NUL-terminated strings pointing into
+ * the file, which is mapped in memory when possible and stays open until the
+ * caller closes it. Lines without delimiter get an empty value and empty keys
+ * are skipped.
+ * @name mapLoadFile
+ * @param {map_t*} self - Pointer to the map
+ * @param {const char*} path - Path of the file
+ * @param {char} delimiter - Character separating key and value
+ * @param {file_t**} file - Receives the open file, or NULL if it cannot be
+ * read; close it with fileClose once the values are no longer used
+ * @returns {map_result_t} MAP_RESULT_OK on success, MAP_ERROR_IO if the file
+ * cannot be read, or the first error returned while setting
+ * @example
+ *   file_t* file;
+ *   mapLoadFile(map, "config.ini", '=', &file);
+ *   char* name = mapGet(map, "name");
+ *   fileClose(&file);
+ */
+map_result_t mapLoadFile(map_t *self, const char *path, char delimiter,
+                         file_t **file);
+
 /**
  * Get a value from the map by its key.
  * @name mapGet
@@ -76,6 +140,17 @@ map_result_t mapSet(map_t *self, const_map_key_t key, value_t value);
  */
 value_t mapGet(const map_t *self, const_map_key_t key);
 
+/**
+ * Get a value from the map like mapGet, with the key given as a view.
+ * @name mapGetStr
+ * @param {const map_t*} self - Pointer to the map
+ * @param {str_t} key - The key to look up
+ * @returns {value_t} The value associated with the key, or NULL if not found
+ * @example
+ *   my_type_t* result = mapGetStr(map, STR("key"));
+ */
+value_t mapGetStr(const map_t *self, str_t key);
+
 /**
  * Delete a key-value pair from the map and return the value.
  * @name mapDelete
@@ -88,6 +163,17 @@ value_t mapGet(const map_t *self, const_map_key_t key);
  */
 value_t mapDelete(map_t *self, const_map_key_t key);
 
+/**
+ * Delete a key-value pair like mapDelete, with the key given as a view.
+ * @name mapDeleteStr
+ * @param {map_t*} self - Pointer to the map
+ * @param {str_t} key - The key to delete
+ * @returns {value_t} The deleted value, or NULL if key was not found
+ * @example
+ *   my_type_t* deleted = mapDeleteStr(map, STR("key"));
+ */
+value_t mapDeleteStr(map_t *self, str_t key);
+
 /**
  * Destroy the map and free all allocated memory.
  * @name mapDestroy
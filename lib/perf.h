@@ -0,0 +1,359 @@
+// Perf (v0.0.1)
+// ---
+//
+// Hardware performance counters around a region of code: cycles,
+// instructions, last level cache misses, branch mispredictions and data TLB
+// misses, plus page faults and context switches. perfBegin and perfEnd
+// bracket the region, and perfPerOp divides a count by the operations it
+// ran, e.g. cache misses per lookup. bench.h adds them to its results.
+//
+// On Linux the hardware counters come from perf_event_open, opened as one
+// group so they count over the same time, and are scaled when the kernel
+// multiplexes them. syscall is only declared with _DEFAULT_SOURCE or
+// _GNU_SOURCE (the default of gnu99, see the bench targets of the Makefile).
+// Containers and virtual machines often hide these counters: perfHas then
+// returns 0 for them and perfPerOp returns -1. Page faults and context
+// switches always come from getrusage, for the whole process.
+//
+// ```c
+// perf_t perf;
+// perfOpen(&perf);
+//
+// perfBegin(&perf);
+// for (int i = 0; i < 1000; i++) mapGet(map, keys[i]);
+// perfEnd(&perf);
+//
+// perfPerOp(&perf, PERF_CACHE_MISSES, 1000);  // cache misses per lookup
+// perfPrint(&perf, "lookups", 1000);         // every counter, to stderr
+// perfClose(&perf);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "panic.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#if defined(_DEFAULT_SOURCE) || defined(_GNU_SOURCE)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define PERF_EVENTS 1
+#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define PERF_RUSAGE 1
+#endif
+
+typedef enum {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_TLB_MISSES,
+  PERF_PAGE_FAULTS, // the counters from here on come from getrusage
+  PERF_CONTEXT_SWITCHES,
+  PERF_COUNTERS
+} perf_counter_t;
+
+typedef struct {
+  int leader;                   // first hardware counter opened, or -1
+  int fds[PERF_COUNTERS];       // -1 for the counters that didn't open
+  int running;                  // 1 between perfBegin or perfResume and
+                                // perfPause or perfEnd
+  double values[PERF_COUNTERS]; // counts of the last region, -1 if missing
+  double usage[2];              // page faults and context switches so far
+} perf_t;
+
+static inline void __perfUsage(double *usage) {
+#ifdef PERF_RUSAGE
+  struct rusage now;
+  if (getrusage(RUSAGE_SELF, &now) == 0) {
+    usage[0] = (double)now.ru_minflt + (double)now.ru_majflt;
+    usage[1] = (double)now.ru_nvcsw + (double)now.ru_nivcsw;
+    return;
+  }
+#endif
+  usage[0] = usage[1] = -1;
+}
+
+#ifdef PERF_EVENTS
+static inline int __perfOpenEvent(uint32_t type, uint64_t config, int leader) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = leader == -1; // the others follow the leader
+  attr.exclude_kernel = 1;      // allowed by the default perf_event_paranoid
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+#endif
+
+// Adds the software counts since the region started or resumed
+static inline void __perfAddUsage(perf_t *self) {
+  double now[2];
+  __perfUsage(now);
+  for (int i = 0; i < 2; i++) {
+    if (now[i] >= 0 && self->values[PERF_PAGE_FAULTS + i] >= 0)
+      self->values[PERF_PAGE_FAULTS + i] += now[i] - self->usage[i];
+  }
+}
+
+/**
+ * Get the name of a counter, as used in reports.
+ * @name perfName
+ * @param {perf_counter_t} counter - The counter
+ * @returns {const char*} Its name, e.g. "cache_misses"
+ * @example
+ *   printf("%s\n", perfName(PERF_BRANCH_MISSES));
+ */
+static inline const char *perfName(perf_counter_t counter) {
+  static const char *names[PERF_COUNTERS] = {
+      "cycles",       "instructions", "cache_misses",    "branch_misses",
+      "tlb_misses",   "page_faults",  "context_switches"};
+  panicif(counter < 0 || counter >= PERF_COUNTERS, "unknown counter");
+  return names[counter];
+}
+
+/**
+ * Open every counter the system allows. Opening fails silently, counter by
+ * counter; use perfHas to know which ones are counted.
+ * @name perfOpen
+ * @param {perf_t*} self - Pointer to the counters
+ * @returns {int} Number of counters available
+ * @example
+ *   perf_t perf;
+ *   if (perfOpen(&perf) < PERF_COUNTERS)
+ *     fprintf(stderr, "some counters are missing\n");
+ */
+static inline int perfOpen(perf_t *self) {
+  panicif(!self, "perf cannot be null");
+  self->leader = -1;
+  self->running = 0;
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    self->fds[i] = -1;
+    self->values[i] = -1;
+  }
+
+  int available = 0;
+#ifdef PERF_EVENTS
+  const uint64_t tlb = PERF_COUNT_HW_CACHE_DTLB |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  const uint32_t types[PERF_PAGE_FAULTS] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+      PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+  const uint64_t configs[PERF_PAGE_FAULTS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES, tlb};
+  for (int i = 0; i < PERF_PAGE_FAULTS; i++) {
+    self->fds[i] = __perfOpenEvent(types[i], configs[i], self->leader);
+    if (self->fds[i] < 0) {
+      self->fds[i] = -1;
+      continue;
+    }
+    if (self->leader == -1)
+      self->leader = self->fds[i];
+    available++;
+  }
+#endif
+
+  double usage[2];
+  __perfUsage(usage);
+  return available + (usage[0] >= 0) + (usage[1] >= 0);
+}
+
+/**
+ * Check whether a counter was opened. A counter that was opened can still
+ * miss a region when the kernel couldn't schedule it, see perfPerOp.
+ * @name perfHas
+ * @param {const perf_t*} self - Pointer to the counters
+ * @param {perf_counter_t} counter - The counter
+ * @returns {int} 1 if it is counted, 0 otherwise
+ * @example
+ *   if (perfHas(&perf, PERF_INSTRUCTIONS)) printIpc(&perf);
+ */
+static inline int perfHas(const perf_t *self, perf_counter_t counter) {
+  panicif(!self, "perf cannot be null");
+  panicif(counter < 0 || counter >= PERF_COUNTERS, "unknown counter");
+  if (counter >= PERF_PAGE_FAULTS) {
+#ifdef PERF_RUSAGE
+    return 1;
+#else
+    return 0;
+#endif
+  }
+  return self->fds[counter] >= 0;
+}
+
+/**
+ * Start counting a region, from zero.
+ * @name perfBegin
+ * @param {perf_t*} self - Pointer to opened counters
+ * @example
+ *   perfBegin(&perf);
+ */
+static inline void perfBegin(perf_t *self) {
+  panicif(!self, "perf cannot be null");
+  for (int i = PERF_PAGE_FAULTS; i < PERF_COUNTERS; i++) {
+    self->values[i] = 0;
+  }
+  __perfUsage(self->usage);
+  self->running = 1;
+#ifdef PERF_EVENTS
+  if (self->leader >= 0) {
+    ioctl(self->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(self->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+/**
+ * Stop counting for a while, e.g. while a benchmark prepares its input.
+ * @name perfPause
+ * @param {perf_t*} self - Pointer to the counters
+ * @example
+ *   perfPause(&perf);
+ *   rebuildTable(table);
+ *   perfResume(&perf);
+ */
+static inline void perfPause(perf_t *self) {
+  panicif(!self, "perf cannot be null");
+  if (!self->running)
+    return;
+#ifdef PERF_EVENTS
+  if (self->leader >= 0)
+    ioctl(self->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  __perfAddUsage(self);
+  self->running = 0;
+}
+
+/**
+ * Count again after perfPause.
+ * @name perfResume
+ * @param {perf_t*} self - Pointer to the counters
+ * @example
+ *   perfResume(&perf);
+ */
+static inline void perfResume(perf_t *self) {
+  panicif(!self, "perf cannot be null");
+  if (self->running)
+    return;
+  __perfUsage(self->usage);
+  self->running = 1;
+#ifdef PERF_EVENTS
+  if (self->leader >= 0)
+    ioctl(self->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+/**
+ * Stop counting and read the counts of the region. Counts are scaled up when
+ * the counters only ran for part of it.
+ * @name perfEnd
+ * @param {perf_t*} self - Pointer to the counters
+ * @example
+ *   perfEnd(&perf);
+ *   double cycles = perf.values[PERF_CYCLES];
+ */
+static inline void perfEnd(perf_t *self) {
+  panicif(!self, "perf cannot be null");
+  perfPause(self);
+#ifdef PERF_EVENTS
+  if (self->leader < 0)
+    return;
+
+  // The group reads as its size, the times enabled and running, then the
+  // counts in the order the counters were opened
+  uint64_t group[3 + PERF_PAGE_FAULTS];
+  const ssize_t bytes = read(self->leader, group, sizeof(group));
+  const int valid = bytes >= (ssize_t)(3 * sizeof(uint64_t)) && group[2] > 0;
+  const double scale = valid ? (double)group[1] / (double)group[2] : 0;
+  uint64_t slot = 0;
+  for (int i = 0; i < PERF_PAGE_FAULTS; i++) {
+    if (self->fds[i] < 0)
+      continue;
+    self->values[i] = valid && slot < group[0]
+                          ? (double)group[3 + slot] * scale
+                          : -1; // never scheduled
+    slot++;
+  }
+#endif
+}
+
+/**
+ * Divide a count of the last region by the operations it ran.
+ * @name perfPerOp
+ * @param {const perf_t*} self - Pointer to the counters
+ * @param {perf_counter_t} counter - The counter
+ * @param {uint64_t} operations - Operations the region ran
+ * @returns {double} The count per operation, or -1 if it is missing
+ * @example
+ *   double ipc = perfPerOp(&perf, PERF_INSTRUCTIONS, 1) /
+ *                perfPerOp(&perf, PERF_CYCLES, 1);
+ */
+static inline double perfPerOp(const perf_t *self, perf_counter_t counter,
+                               uint64_t operations) {
+  panicif(!self, "perf cannot be null");
+  panicif(counter < 0 || counter >= PERF_COUNTERS, "unknown counter");
+  const double value = self->values[counter];
+  if (value < 0 || operations == 0)
+    return -1;
+  return value / (double)operations;
+}
+
+/**
+ * Print every counter of the last region per operation to stderr, with
+ * "n/a" for the missing ones.
+ * @name perfPrint
+ * @param {const perf_t*} self - Pointer to the counters
+ * @param {const char*} name - Name of the region
+ * @param {uint64_t} operations - Operations the region ran
+ * @example
+ *   perfPrint(&perf, "mapGet", lookups);
+ */
+static inline void perfPrint(const perf_t *self, const char *name,
+                             uint64_t operations) {
+  panicif(!self, "perf cannot be null");
+  fprintf(stderr, "%s, per operation:", name);
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    const double value = perfPerOp(self, (perf_counter_t)i, operations);
+    if (value < 0)
+      fprintf(stderr, " %s n/a", perfName((perf_counter_t)i));
+    else
+      fprintf(stderr, " %s %.3f", perfName((perf_counter_t)i), value);
+  }
+  fprintf(stderr, "\n");
+}
+
+/**
+ * Close the counters.
+ * @name perfClose
+ * @param {perf_t*} self - Pointer to the counters
+ * @example
+ *   perfClose(&perf);
+ */
+static inline void perfClose(perf_t *self) {
+  panicif(!self, "perf cannot be null");
+#ifdef PERF_EVENTS
+  for (int i = 0; i < PERF_PAGE_FAULTS; i++) {
+    if (self->fds[i] >= 0)
+      close(self->fds[i]);
+  }
+#endif
+  self->leader = -1;
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    self->fds[i] = -1;
+  }
+}
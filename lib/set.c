@@ -1,32 +1,20 @@
+#include "set.h"
 #include "alloc.h"
+#include "file.h"
 #include "panic.h"
-#include "strdup.h"
+#include "str.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
-typedef char *set_key_t;
-typedef const char *const_set_key_t;
-typedef uint64_t set_size_t;
-
 static char SET_TOMBSTONE[] = "___TOMBSTONE!!@@##";
 
-typedef enum {
-  SET_RESULT_OK = 0,
-  SET_ERROR_FULL,
-  SET_ERROR_NOT_FOUND
-} set_result_t;
-
-typedef struct {
-  set_size_t size;
-  set_key_t *keys;
-} set_t;
-
-static inline set_size_t setMakeKey(const set_t *self, const_set_key_t key) {
+static inline set_size_t setMakeKey(const set_t *self, const char *key,
+                                     size_t length) {
   uint64_t hash = 14695981039346656037U;
   const uint64_t prime = 1099511628211U;
 
-  for (size_t i = 0; i < strlen(key); i++) {
+  for (size_t i = 0; i < length; i++) {
     hash ^= (uint64_t)(unsigned char)key[i];
     hash *= prime;
   }
@@ -34,10 +22,18 @@ static inline set_size_t setMakeKey(const set_t *self, const_set_key_t key) {
   return hash % self->size;
 }
 
-static inline set_result_t setGetIndex(const set_t *self, const_set_key_t key,
-                                       set_size_t *result) {
+// Compare the key at index with a key that is not NUL-terminated. Keys of
+// another length are rejected without reading the stored bytes.
+static inline int setKeyEquals(const set_t *self, set_size_t index,
+                               const char *key, size_t length) {
+  return strEquals(strMake(self->keys[index], self->lengths[index]),
+                   strMake(key, length));
+}
+
+static inline set_result_t setGetIndex(const set_t *self, const char *key,
+                                       size_t length, set_size_t *result) {
   panicif(!self, "set cannot be null");
-  const set_size_t index = setMakeKey(self, key);
+  const set_size_t index = setMakeKey(self, key, length);
 
   for (set_size_t i = 0; i < self->size; i++) {
     set_size_t probed_idx = (index + i) % self->size;
@@ -52,7 +48,7 @@ static inline set_result_t setGetIndex(const set_t *self, const_set_key_t key,
       continue;
     }
 
-    if (strcmp(probed_key, key) == 0) {
+    if (setKeyEquals(self, probed_idx, key, length)) {
       *result = probed_idx;
       return SET_RESULT_OK;
     }
@@ -61,14 +57,34 @@ static inline set_result_t setGetIndex(const set_t *self, const_set_key_t key,
   return SET_ERROR_NOT_FOUND;
 }
 
+// Key copies come from the allocator of the set, if it has one
+static void *setAllocate(const set_t *self, size_t size) {
+  if (self->allocator.alloc)
+    return self->allocator.alloc(self->allocator.context, size);
+  return allocateUninit(size);
+}
+
+static void setDeallocate(const set_t *self, set_size_t index) {
+  set_key_t key = self->keys[index];
+  if (self->allocator.free) {
+    self->allocator.free(self->allocator.context, key,
+                         self->lengths[index] + 1);
+  } else {
+    deallocate(&key);
+  }
+}
+
 set_t *setCreate(set_size_t size) {
   panicif(size <= 0, "size cannot be null");
   set_t *self = (set_t *)allocate(sizeof(set_t));
   if (!self)
     return NULL;
 
-  self->keys = (set_key_t *)allocate(sizeof(const char *) * size);
-  if (!self->keys) {
+  self->keys = (set_key_t *)allocateLarge(sizeof(const char *) * size);
+  self->lengths = (size_t *)allocateLarge(sizeof(size_t) * size);
+  if (!self->keys || !self->lengths) {
+    deallocateLarge(&self->keys);
+    deallocateLarge(&self->lengths);
     deallocate(&self);
     return NULL;
   }
@@ -78,12 +94,44 @@ set_t *setCreate(set_size_t size) {
   return self;
 }
 
-set_result_t setAdd(set_t *self, const_set_key_t key) {
+set_t *setCreateWithAllocator(set_size_t size, const allocator_t *allocator) {
+  panicif(size <= 0, "size cannot be null");
+  panicif(!allocator || !allocator->alloc || !allocator->free,
+          "allocator cannot be null");
+
+  const size_t slots = sizeof(const char *) * size;
+  const size_t lengths = sizeof(size_t) * size;
+  set_t *self = (set_t *)allocator->alloc(allocator->context, sizeof(set_t));
+  if (!self)
+    return NULL;
+  memset(self, 0, sizeof(set_t));
+  self->allocator = *allocator;
+
+  self->keys = (set_key_t *)allocator->alloc(allocator->context, slots);
+  self->lengths = (size_t *)allocator->alloc(allocator->context, lengths);
+  if (!self->keys || !self->lengths) {
+    if (self->keys)
+      allocator->free(allocator->context, self->keys, slots);
+    if (self->lengths)
+      allocator->free(allocator->context, self->lengths, lengths);
+    allocator->free(allocator->context, self, sizeof(set_t));
+    return NULL;
+  }
+
+  memset(self->keys, 0, slots);
+  memset(self->lengths, 0, lengths);
+  self->size = size;
+
+  return self;
+}
+
+static set_result_t setAddLength(set_t *self, const char *key,
+                                 size_t length) {
   panicif(!self, "set cannot be null");
-  set_size_t index = setMakeKey(self, key);
+  set_size_t index = setMakeKey(self, key, length);
   set_key_t old_key = self->keys[index];
-  int collides_with_old_key =
-      !!old_key && strcmp(key, old_key) != 0 && old_key != SET_TOMBSTONE;
+  int collides_with_old_key = !!old_key && old_key != SET_TOMBSTONE &&
+                              !setKeyEquals(self, index, key, length);
 
   // When there is a collision with another key, look for the next free index
   if (collides_with_old_key) {
@@ -104,7 +152,7 @@ set_result_t setAdd(set_t *self, const_set_key_t key) {
       }
 
       // The key is already there just return
-      if (!strcmp(probed_key, key)) {
+      if (setKeyEquals(self, probed_idx, key, length)) {
         return SET_RESULT_OK;
       }
     }
@@ -115,30 +163,75 @@ set_result_t setAdd(set_t *self, const_set_key_t key) {
   }
 
 set:
+  // The key is already in its home slot
   if (self->keys[index] && self->keys[index] != SET_TOMBSTONE) {
-    deallocate(&self->keys[index]);
+    return SET_RESULT_OK;
   }
-  self->keys[index] = strdup(key);
+
+  set_key_t copy = (set_key_t)setAllocate(self, length + 1);
+  if (!copy)
+    return SET_ERROR_ALLOCATION;
+  memcpy(copy, key, length);
+  copy[length] = '\0';
+  self->keys[index] = copy;
+  self->lengths[index] = length;
   return SET_RESULT_OK;
 }
 
-int setHas(const set_t *self, const_set_key_t key) {
+set_result_t setAdd(set_t *self, const_set_key_t key) {
+  return setAddLength(self, key, strlen(key));
+}
+
+set_result_t setAddStr(set_t *self, str_t key) {
+  return setAddLength(self, key.data, key.length);
+}
+
+set_result_t setLoadFile(set_t *self, const char *path, char delimiter) {
+  panicif(!self, "set cannot be null");
+  file_t *file = fileOpen(path);
+  if (!file)
+    return SET_ERROR_IO;
+
+  set_result_t result = SET_RESULT_OK;
+  size_t offset = 0, length;
+  char *line;
+  while (result == SET_RESULT_OK &&
+         fileNextLine(file, &offset, &line, &length)) {
+    const char *end = (const char *)memchr(line, delimiter, length);
+    if (end)
+      length = (size_t)(end - line);
+    if (length > 0)
+      result = setAddLength(self, line, length);
+  }
+
+  fileClose(&file);
+  return result;
+}
+
+int setHasStr(const set_t *self, str_t key) {
   panicif(!self, "set cannot be null");
   set_size_t index;
-  return setGetIndex(self, key, &index) == SET_RESULT_OK;
+  return setGetIndex(self, key.data, key.length, &index) == SET_RESULT_OK;
 }
 
-void setDelete(set_t *self, const_set_key_t key) {
+int setHas(const set_t *self, const_set_key_t key) {
+  return setHasStr(self, strFrom(key));
+}
+
+void setDeleteStr(set_t *self, str_t key) {
   panicif(!self, "set cannot be null");
   set_size_t index;
-  if (setGetIndex(self, key, &index) == SET_RESULT_OK) {
-    set_key_t old_key = self->keys[index];
-    deallocate(&old_key);
+  if (setGetIndex(self, key.data, key.length, &index) == SET_RESULT_OK) {
+    setDeallocate(self, index);
     self->keys[index] = SET_TOMBSTONE;
   }
   return;
 }
 
+void setDelete(set_t *self, const_set_key_t key) {
+  setDeleteStr(self, strFrom(key));
+}
+
 set_size_t setUsed(const set_t *self) {
   set_size_t used = 0;
   for (size_t i = 0; i < self->size; i++) {
@@ -150,17 +243,40 @@ set_size_t setUsed(const set_t *self) {
   return used;
 }
 
+const_set_key_t setNext(const set_t *self, set_size_t *cursor) {
+  panicif(!self, "set cannot be null");
+  while (*cursor < self->size) {
+    const set_key_t key = self->keys[(*cursor)++];
+    if (key && key != SET_TOMBSTONE) {
+      return key;
+    }
+  }
+  return NULL;
+}
+
 void setDestroy(set_t **self) {
   if (!self || !*self)
     return;
 
   for (size_t i = 0; i < (*self)->size; i++) {
-    if ((*self)->keys[i] != SET_TOMBSTONE) {
-      deallocate(&(*self)->keys[i]);
+    if ((*self)->keys[i] && (*self)->keys[i] != SET_TOMBSTONE) {
+      setDeallocate(*self, i);
     }
   }
 
-  deallocate(&(*self)->keys);
+  if ((*self)->allocator.free) {
+    const allocator_t allocator = (*self)->allocator;
+    allocator.free(allocator.context, (*self)->keys,
+                   sizeof(const char *) * (*self)->size);
+    allocator.free(allocator.context, (*self)->lengths,
+                   sizeof(size_t) * (*self)->size);
+    allocator.free(allocator.context, *self, sizeof(set_t));
+    *self = NULL;
+    return;
+  }
+
+  deallocateLarge(&(*self)->keys);
+  deallocateLarge(&(*self)->lengths);
   deallocate(self);
 }
 
@@ -249,11 +365,342 @@ void collisions(void) {
   setDestroy(&set);
 }
 
+void loadFile(void) {
+  const char *path = "set.test.txt";
+  FILE *stream = fopen(path, "wb");
+  panicif(!stream, "cannot create test file");
+  fputs("alpha,1\nbeta,2\r\n\ngamma\n,4\nalpha,5\ndelta,6", stream);
+  fclose(stream);
+
+  set_t *set = setCreate(16);
+  panicif(!set, "cannot create set");
+
+  expectEqlu(setLoadFile(set, path, ','), SET_RESULT_OK, "loads the file");
+  expectEqllu(setUsed(set), 4, "adds each distinct key once");
+  expectTrue(setHas(set, "alpha"), "finds first key");
+  expectTrue(setHas(set, "beta"), "strips CRLF line endings");
+  expectTrue(setHas(set, "gamma"), "uses lines without delimiter");
+  expectTrue(setHas(set, "delta"), "reads last line without newline");
+  expectFalse(setHas(set, "alpha,1"), "stops keys at the delimiter");
+  expectFalse(setHas(set, ""), "skips empty keys");
+
+  test("errors");
+  expectEqlu(setLoadFile(set, "missing.test.txt", ','), SET_ERROR_IO,
+             "fails on missing file");
+
+  set_t *small = setCreate(2);
+  panicif(!small, "cannot create set");
+  expectEqlu(setLoadFile(small, path, ','), SET_ERROR_FULL,
+             "fails when the set fills up");
+
+  setDestroy(&small);
+  setDestroy(&set);
+  remove(path);
+}
+
+void iteration(void) {
+  set_t *set = setCreate(8);
+  panicif(!set, "cannot create set");
+  (void)setAdd(set, "a");
+  (void)setAdd(set, "b");
+  (void)setAdd(set, "c");
+  setDelete(set, "b");
+
+  set_size_t cursor = 0, seen = 0;
+  const char *key;
+  int found_a = 0, found_c = 0;
+  while ((key = setNext(set, &cursor))) {
+    found_a |= !strcmp(key, "a");
+    found_c |= !strcmp(key, "c");
+    seen++;
+  }
+  expectEqllu(seen, 2, "visits every live key once");
+  expectTrue(found_a && found_c, "returns the stored keys");
+  expectNull(setNext(set, &cursor), "keeps returning NULL at the end");
+
+  setDestroy(&set);
+}
+
+void allocators(void) {
+  arena_t *arena = arenaCreate(0);
+  panicif(!arena, "cannot create arena");
+  allocator_t allocator = allocatorArena(arena);
+
+  set_t *set = setCreateWithAllocator(8, &allocator);
+  panicif(!set, "cannot create set");
+  expectEqlu(setAdd(set, "key"), SET_RESULT_OK, "adds key");
+  expectTrue(setHas(set, "key"), "stores keys in the arena");
+  expectFalse(setHas(set, "missing"), "starts from empty slots");
+  setDelete(set, "key");
+  expectFalse(setHas(set, "key"), "deletes keys");
+  setDestroy(&set);
+  expectNull(set, "destroy sets pointer to NULL");
+
+  arenaDestroy(&arena);
+}
+
+void strKeys(void) {
+  set_t *set = setCreate(8);
+  panicif(!set, "cannot create set");
+
+  const char *line = "tenant,field";
+  expectEqlu(setAddStr(set, strMake(line, 6)), SET_RESULT_OK,
+             "adds keys that are not NUL-terminated");
+  expectTrue(setHas(set, "tenant"), "copies only the view");
+  expectTrue(setHasStr(set, STR("tenant")), "finds views");
+  expectFalse(setHasStr(set, strMake(line, 5)), "does not match prefixes");
+  expectFalse(setHasStr(set, strMake(line, 7)), "does not match longer keys");
+
+  (void)setAddStr(set, strMake(line + 7, 5));
+  setDeleteStr(set, STR("field"));
+  expectFalse(setHas(set, "field"), "deletes by view");
+  expectEqllu(setUsed(set), 1, "keeps the other keys");
+
+  setDestroy(&set);
+}
+
+#define SCALING_LOOKUPS 4096
+
+static const size_t scalingSizes[] = {500, 2000, 8000, 32000, 0};
+static set_t *scalingSets[4];
+static char scalingKeys[64000][8];
+static int scalingFound;
+
+// Checks the same keys whatever the size of the set. They stay in cache, so
+// only the work of a lookup is compared, not the memory hierarchy.
+static void scalingHas(size_t n, size_t offset) {
+  int set = 0;
+  while (scalingSizes[set] != n) {
+    set++;
+  }
+  for (size_t i = 0; i < SCALING_LOOKUPS; i++) {
+    scalingFound =
+        setHas(scalingSets[set], scalingKeys[offset + i * 7919 % 500]);
+  }
+}
+
+static void scalingHits(size_t n) { scalingHas(n, 0); }
+static void scalingMisses(size_t n) { scalingHas(n, 32000); }
+
+void scaling(void) {
+  for (size_t i = 0; i < 64000; i++) {
+    snprintf(scalingKeys[i], sizeof(scalingKeys[i]), "k%zu", i);
+  }
+  for (int s = 0; s < 4; s++) {
+    scalingSets[s] = setCreate(2 * scalingSizes[s]);
+    panicif(!scalingSets[s], "cannot create set");
+    for (size_t i = 0; i < scalingSizes[s]; i++) {
+      (void)setAdd(scalingSets[s], scalingKeys[i]);
+    }
+  }
+
+  expectComplexity(scalingHits, scalingSizes, O_1,
+                   "finds keys in constant time");
+  expectComplexity(scalingMisses, scalingSizes, O_1,
+                   "rejects missing keys in constant time");
+
+  for (int s = 0; s < 4; s++) {
+    setDestroy(&scalingSets[s]);
+  }
+}
+
 int main(void) {
   suite(addHas);
   suite(collisions);
+  suite(loadFile);
+  suite(iteration);
+  suite(allocators);
+  suite(strKeys);
+  suite(scaling);
 
   return report();
 }
 
 #endif
+
+#ifdef SET_C_BENCH
+
+#include "bench.h"
+#include <stdio.h>
+
+#define BENCH_OPS (1 << 20) // lookups drawn before timing and replayed
+#define BENCH_LOAD 75       // percent of the slots in use, unless varied
+#define BENCH_KEY 16        // bytes per key, unless varied
+
+// A set filled to a load factor. Its keys are a window of a pool twice as
+// large, which churn moves forward; the rest of the pool are misses.
+typedef struct {
+  set_t *set;
+  set_size_t size;
+  int load;
+  size_t length;           // bytes per key
+  size_t count;            // keys in the set
+  size_t start;            // pool index of the oldest key in the set
+  size_t next;             // keys inserted by benchInsert so far
+  char *pool;              // 2 * count keys
+  uint32_t ops[BENCH_OPS]; // pool indexes to look up
+} workload_t;
+
+static uint64_t benchState = 88172645463325252ULL;
+static workload_t benchWorkload;
+static char benchName[BENCH_NAME];
+
+static inline const char *benchKey(size_t index) {
+  const workload_t *w = &benchWorkload;
+  return w->pool + index % (2 * w->count) * (w->length + 1);
+}
+
+// Build a set of size slots with load percent of them in use, reusing the
+// current one when it matches and no benchmark changed it
+static void benchPrepare(set_size_t size, int load, size_t length) {
+  workload_t *w = &benchWorkload;
+  if (w->set && w->size == size && w->load == load && w->length == length &&
+      w->start == 0 && w->next == 0)
+    return;
+
+  if (w->set) {
+    setDestroy(&w->set);
+    free(w->pool);
+  }
+  w->size = size;
+  w->load = load;
+  w->length = length;
+  w->count = (size_t)(size * (set_size_t)load / 100);
+  w->start = 0;
+  w->next = 0;
+  w->pool = benchStrings(2 * w->count, length, &benchState);
+  w->set = setCreate(size);
+  panicif(!w->pool || !w->set, "cannot allocate workload");
+  for (size_t i = 0; i < w->count; i++) {
+    setAdd(w->set, benchKey(i));
+  }
+}
+
+// Draw lookups: hit percent of them are keys in the set, picked with a Zipf
+// exponent (0 for uniform), and the others are keys that were never inserted
+static void benchDraw(double exponent, int hit) {
+  workload_t *w = &benchWorkload;
+  panicif(!benchZipf(w->ops, BENCH_OPS, (uint32_t)w->count, exponent,
+                     &benchState),
+          "cannot draw lookups");
+  for (size_t i = 0; i < BENCH_OPS; i++) {
+    // Scatter the ranks so the popular keys are not the first inserted
+    size_t index = (size_t)(w->ops[i] * 2654435761ULL % w->count);
+    if ((int)(benchRandom(&benchState) % 100) >= hit)
+      index += w->count;
+    w->ops[i] = (uint32_t)((w->start + index) % (2 * w->count));
+  }
+}
+
+static void benchHas(bench_t *b) {
+  const workload_t *w = &benchWorkload;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    int found = setHas(w->set, benchKey(w->ops[i & (BENCH_OPS - 1)]));
+    benchDoNotOptimize(found);
+  }
+}
+
+// Fills an empty set up to the load, then starts over with a new one
+static void benchInsert(bench_t *b) {
+  workload_t *w = &benchWorkload;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    if (w->next % w->count == 0) {
+      benchPause(b);
+      setDestroy(&w->set);
+      w->set = setCreate(w->size);
+      panicif(!w->set, "cannot allocate set");
+      benchResume(b);
+    }
+    setAdd(w->set, benchKey(w->next++ % w->count));
+  }
+}
+
+// Deletes the oldest key and inserts a new one. Every delete leaves a
+// tombstone, so later samples probe further than earlier ones.
+static void benchChurn(bench_t *b) {
+  workload_t *w = &benchWorkload;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    setDelete(w->set, benchKey(w->start));
+    setAdd(w->set, benchKey(w->start + w->count));
+    w->start = (w->start + 1) % (2 * w->count);
+  }
+}
+
+static void benchLookups(const char *kind, set_size_t size, int load,
+                         size_t length, double exponent, int hit) {
+  snprintf(benchName, sizeof(benchName),
+           "set/has/%s/hit=%d/slots=%llu/load=%d/key=%zu", kind, hit,
+           (unsigned long long)size, load, length);
+  if (!benchSelected(benchName))
+    return;
+  benchPrepare(size, load, length);
+  benchDraw(exponent, hit);
+  benchmarkWith(benchName, benchHas, NULL);
+}
+
+static void benchWrites(const char *kind, bench_fn_t fn, set_size_t size) {
+  snprintf(benchName, sizeof(benchName), "set/%s/slots=%llu/load=%d/key=%d",
+           kind, (unsigned long long)size, BENCH_LOAD, BENCH_KEY);
+  if (!benchSelected(benchName))
+    return;
+  benchPrepare(size, BENCH_LOAD, BENCH_KEY);
+  benchmarkWith(benchName, fn, NULL);
+}
+
+// Lookups once deletes have turned most free slots into tombstones
+static void benchChurned(set_size_t size, int hit) {
+  snprintf(benchName, sizeof(benchName),
+           "set/has-churned/uniform/hit=%d/slots=%llu/load=%d/key=%d", hit,
+           (unsigned long long)size, BENCH_LOAD, BENCH_KEY);
+  if (!benchSelected(benchName))
+    return;
+  benchPrepare(size, BENCH_LOAD, BENCH_KEY);
+  bench_t b;
+  b.iterations = 4 * size;
+  benchChurn(&b);
+  benchDraw(0, hit);
+  benchmarkWith(benchName, benchHas, NULL);
+}
+
+int main(void) {
+  // From tables that fit in L1 to about ten times a 16MB last level cache
+  const set_size_t sizes[] = {1 << 10, 1 << 14, 1 << 17, 1 << 20, 1 << 22};
+  const int loads[] = {50, 90, 95, 99};
+  const size_t lengths[] = {4, 64, 256};
+  const int hits[] = {90, 50, 10};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    benchLookups("uniform", sizes[i], BENCH_LOAD, BENCH_KEY, 0, 100);
+    benchLookups("zipf-1.0", sizes[i], BENCH_LOAD, BENCH_KEY, 1.0, 100);
+    benchLookups("uniform", sizes[i], BENCH_LOAD, BENCH_KEY, 0, 0);
+    benchWrites("insert", benchInsert, sizes[i]);
+  }
+
+  for (size_t i = 0; i < sizeof(hits) / sizeof(hits[0]); i++) {
+    benchLookups("uniform", 1 << 17, BENCH_LOAD, BENCH_KEY, 0, hits[i]);
+  }
+
+  for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+    benchLookups("uniform", 1 << 14, loads[i], BENCH_KEY, 0, 100);
+    benchLookups("uniform", 1 << 14, loads[i], BENCH_KEY, 0, 0);
+  }
+
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    benchLookups("uniform", 1 << 14, BENCH_LOAD, lengths[i], 0, 100);
+    benchLookups("uniform", 1 << 14, BENCH_LOAD, lengths[i], 0, 0);
+  }
+
+  for (set_size_t size = 1 << 14; size <= 1 << 17; size <<= 3) {
+    benchWrites("churn", benchChurn, size);
+    benchChurned(size, 100);
+    benchChurned(size, 0);
+  }
+
+  if (benchWorkload.set) {
+    setDestroy(&benchWorkload.set);
+    free(benchWorkload.pool);
+  }
+  return benchReport();
+}
+
+#endif
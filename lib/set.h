@@ -1,8 +1,9 @@
-// set (v0.0.1)
+// set (v0.0.6)
 // ---
 //
 // A simple hashset with owned keys. It handles conflicts through linear
-// probing and has static size.
+// probing and has static size. Large tables are mapped directly from the
+// system, see allocateLarge.
 //
 // ```c
 // set_t* set = setCreate(10);
@@ -11,15 +12,21 @@
 //
 // setHas(set, "key"); // returns true
 // setHas(set, "another key"); // returns false
+// setHasStr(set, STR("key")); // keys can also be views, see str.h
 //
 // setDelete(set, "key");
 //
+// setLoadFile(set, "words.txt", '\n'); // adds every line
+//
 // setDestroy(&set);
 // ```
 // ___HEADER_END___
 
 #pragma once
 
+#include "alloc.h"
+#include "str.h"
+#include <stddef.h>
 #include <stdint.h>
 
 typedef char *set_key_t;
@@ -29,12 +36,16 @@ typedef uint64_t set_size_t;
 typedef enum {
   SET_RESULT_OK = 0,
   SET_ERROR_FULL,
-  SET_ERROR_NOT_FOUND
+  SET_ERROR_NOT_FOUND,
+  SET_ERROR_ALLOCATION,
+  SET_ERROR_IO
 } set_result_t;
 
 typedef struct {
   set_size_t size;
   set_key_t *keys;
+  size_t *lengths; // lengths of the keys, compared before their bytes
+  allocator_t allocator; // all zero for the default allocation
 } set_t;
 
 /**
@@ -47,17 +58,57 @@ typedef struct {
  */
 set_t *setCreate(set_size_t size);
 
+/**
+ * Create a new set whose memory, including slots and key copies, comes from
+ * an allocator.
+ * @name setCreateWithAllocator
+ * @param {set_size_t} size - The maximum number of entries the set can hold
+ * @param {const allocator_t*} allocator - The allocator, copied into the set
+ * @returns {set_t*} Pointer to the newly created set, or NULL on failure
+ * @example
+ *   allocator_t allocator = allocatorArena(arena);
+ *   set_t* set = setCreateWithAllocator(64, &allocator);
+ */
+set_t *setCreateWithAllocator(set_size_t size, const allocator_t *allocator);
+
 /**
  * Add a key to the set. The key is copied and owned by the set.
  * @name setAdd
  * @param {set_t*} self - Pointer to the set
  * @param {const_set_key_t} key - The key to add
- * @returns {set_result_t} SET_RESULT_OK on success, SET_ERROR_FULL if full
+ * @returns {set_result_t} SET_RESULT_OK on success, SET_ERROR_FULL if full,
+ * SET_ERROR_ALLOCATION if the key cannot be copied
  * @example
  *   setAdd(set, "key");
  */
 set_result_t setAdd(set_t *self, const_set_key_t key);
 
+/**
+ * Add a key like setAdd, with the key given as a view.
+ * @name setAddStr
+ * @param {set_t*} self - Pointer to the set
+ * @param {str_t} key - The key to add, copied by the set
+ * @returns {set_result_t} Same as setAdd
+ * @example
+ *   setAddStr(set, strMake(line, comma));
+ */
+set_result_t setAddStr(set_t *self, str_t key);
+
+/**
+ * Add a key for every line of a file. The key is the start of the line up to
+ * the first delimiter, so '\n' uses whole lines; empty keys are skipped. The
+ * file is mapped in memory when possible and each key is copied once.
+ * @name setLoadFile
+ * @param {set_t*} self - Pointer to the set
+ * @param {const char*} path - Path of the file
+ * @param {char} delimiter - Character ending the key within a line
+ * @returns {set_result_t} SET_RESULT_OK on success, SET_ERROR_IO if the file
+ * cannot be read, or the first error returned while adding
+ * @example
+ *   setLoadFile(set, "users.csv", ',');
+ */
+set_result_t setLoadFile(set_t *self, const char *path, char delimiter);
+
 /**
  * Check if a key exists in the set.
  * @name setHas
@@ -71,6 +122,17 @@ set_result_t setAdd(set_t *self, const_set_key_t key);
  */
 int setHas(const set_t *self, const_set_key_t key);
 
+/**
+ * Check if a key exists like setHas, with the key given as a view.
+ * @name setHasStr
+ * @param {const set_t*} self - Pointer to the set
+ * @param {str_t} key - The key to look up
+ * @returns {int} 1 if the key exists, 0 otherwise
+ * @example
+ *   setHasStr(set, STR("key"));
+ */
+int setHasStr(const set_t *self, str_t key);
+
 /**
  * Delete a key from the set.
  * @name setDelete
@@ -81,6 +143,16 @@ int setHas(const set_t *self, const_set_key_t key);
  */
 void setDelete(set_t *self, const_set_key_t key);
 
+/**
+ * Delete a key like setDelete, with the key given as a view.
+ * @name setDeleteStr
+ * @param {set_t*} self - Pointer to the set
+ * @param {str_t} key - The key to delete
+ * @example
+ *   setDeleteStr(set, STR("key"));
+ */
+void setDeleteStr(set_t *self, str_t key);
+
 /**
  * Get the number of keys currently stored in the set.
  * @name setUsed
@@ -91,6 +163,22 @@ void setDelete(set_t *self, const_set_key_t key);
  */
 set_size_t setUsed(const set_t *self);
 
+/**
+ * Iterate over the keys of the set, in no particular order. The set must not
+ * change during the iteration.
+ * @name setNext
+ * @param {const set_t*} self - Pointer to the set
+ * @param {set_size_t*} cursor - Iteration state, 0 to start; updated on return
+ * @returns {const_set_key_t} The next key, or NULL when all keys were visited
+ * @example
+ *   set_size_t cursor = 0;
+ *   const char* key;
+ *   while ((key = setNext(set, &cursor))) {
+ *     printf("%s\n", key);
+ *   }
+ */
+const_set_key_t setNext(const set_t *self, set_size_t *cursor);
+
 /**
  * Destroy the set and free all allocated memory.
  * @name setDestroy
@@ -0,0 +1,625 @@
+#include "sketch.h"
+#include "alloc.h"
+#include "map.h"
+#include "panic.h"
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a as used by map, followed by the MurmurHash3 finalizer so that both
+// halves of the hash can index rows independently
+static uint64_t sketchHash(const char *key) {
+  uint64_t hash = 14695981039346656037U;
+  const uint64_t prime = 1099511628211U;
+  const size_t length = strlen(key);
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint64_t)(unsigned char)key[i];
+    hash *= prime;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static char *sketchCopyKey(const char *key) {
+  const size_t length = strlen(key) + 1;
+  char *copy = (char *)allocate(length);
+  if (copy)
+    memcpy(copy, key, length);
+  return copy;
+}
+
+// Row i uses the hash h1 + i * h2 (Kirsch-Mitzenmacher double hashing)
+static inline uint64_t *cmsCounter(const cms_t *self, uint64_t hash,
+                                   uint32_t row) {
+  const uint32_t h1 = (uint32_t)hash;
+  const uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  const uint32_t column = (uint32_t)((h1 + (uint64_t)row * h2) % self->width);
+  return &self->counters[(uint64_t)row * self->width + column];
+}
+
+cms_t *cmsCreate(uint32_t width, uint32_t depth) {
+  panicif(width == 0 || depth == 0, "width and depth cannot be zero");
+
+  cms_t *self = (cms_t *)allocate(sizeof(cms_t));
+  if (!self)
+    return NULL;
+
+  self->counters =
+      (uint64_t *)allocate(sizeof(uint64_t) * (uint64_t)width * depth);
+  if (!self->counters) {
+    deallocate(&self);
+    return NULL;
+  }
+
+  self->width = width;
+  self->depth = depth;
+  return self;
+}
+
+uint64_t cmsAdd(cms_t *self, const char *key, uint64_t count) {
+  panicif(!self, "cms cannot be null");
+  const uint64_t hash = sketchHash(key);
+
+  uint64_t estimate = UINT64_MAX;
+  for (uint32_t row = 0; row < self->depth; row++) {
+    const uint64_t counter = *cmsCounter(self, hash, row);
+    if (counter < estimate)
+      estimate = counter;
+  }
+
+  estimate += count;
+  for (uint32_t row = 0; row < self->depth; row++) {
+    uint64_t *counter = cmsCounter(self, hash, row);
+    if (*counter < estimate)
+      *counter = estimate;
+  }
+
+  self->total += count;
+  return estimate;
+}
+
+uint64_t cmsEstimate(const cms_t *self, const char *key) {
+  panicif(!self, "cms cannot be null");
+  const uint64_t hash = sketchHash(key);
+
+  uint64_t estimate = UINT64_MAX;
+  for (uint32_t row = 0; row < self->depth; row++) {
+    const uint64_t counter = *cmsCounter(self, hash, row);
+    if (counter < estimate)
+      estimate = counter;
+  }
+  return estimate;
+}
+
+sketch_result_t cmsMerge(cms_t *self, const cms_t *source) {
+  panicif(!self || !source, "cms cannot be null");
+  if (self->width != source->width || self->depth != source->depth)
+    return SKETCH_ERROR_MISMATCH;
+
+  const uint64_t counters = (uint64_t)self->width * self->depth;
+  for (uint64_t i = 0; i < counters; i++) {
+    self->counters[i] += source->counters[i];
+  }
+  self->total += source->total;
+  return SKETCH_RESULT_OK;
+}
+
+void cmsDestroy(cms_t **self) {
+  if (!self || !*self)
+    return;
+
+  deallocate(&(*self)->counters);
+  deallocate(self);
+}
+
+static void topkSwap(topk_t *self, uint32_t a, uint32_t b) {
+  topk_entry_t *entry = self->heap[a];
+  self->heap[a] = self->heap[b];
+  self->heap[b] = entry;
+  self->heap[a]->position = a;
+  self->heap[b]->position = b;
+}
+
+static void topkSiftUp(topk_t *self, uint32_t position) {
+  while (position > 0) {
+    uint32_t parent = (position - 1) / 2;
+    if (self->heap[parent]->count <= self->heap[position]->count)
+      return;
+    topkSwap(self, parent, position);
+    position = parent;
+  }
+}
+
+static void topkSiftDown(topk_t *self, uint32_t position) {
+  for (;;) {
+    uint32_t smallest = position;
+    uint32_t left = 2 * position + 1, right = left + 1;
+    if (left < self->length &&
+        self->heap[left]->count < self->heap[smallest]->count)
+      smallest = left;
+    if (right < self->length &&
+        self->heap[right]->count < self->heap[smallest]->count)
+      smallest = right;
+    if (smallest == position)
+      return;
+    topkSwap(self, position, smallest);
+    position = smallest;
+  }
+}
+
+// Deleted keys leave tombstones behind in map_t, which lengthen probing for
+// misses. Rebuilding the index once per K evictions keeps lookups short.
+static sketch_result_t topkRebuildIndex(topk_t *self) {
+  map_t *index = mapCreate((map_size_t)self->k * 2);
+  if (!index)
+    return SKETCH_ERROR_ALLOCATION;
+
+  for (uint32_t i = 0; i < self->length; i++) {
+    if (mapSet(index, self->entries[i].key, &self->entries[i]) !=
+        MAP_RESULT_OK) {
+      mapDestroy(&index);
+      return SKETCH_ERROR_ALLOCATION;
+    }
+  }
+
+  mapDestroy(&self->index);
+  self->index = index;
+  self->evictions = 0;
+  return SKETCH_RESULT_OK;
+}
+
+topk_t *topkCreate(uint32_t k) {
+  panicif(k == 0, "k cannot be zero");
+
+  topk_t *self = (topk_t *)allocate(sizeof(topk_t));
+  if (!self)
+    return NULL;
+
+  self->k = k;
+  self->entries = (topk_entry_t *)allocate(sizeof(topk_entry_t) * k);
+  self->heap = (topk_entry_t **)allocate(sizeof(topk_entry_t *) * k);
+  self->index = mapCreate((map_size_t)k * 2);
+  if (!self->entries || !self->heap || !self->index) {
+    topkDestroy(&self);
+    return NULL;
+  }
+
+  return self;
+}
+
+sketch_result_t topkAdd(topk_t *self, const char *key, uint64_t count) {
+  panicif(!self, "topk cannot be null");
+
+  topk_entry_t *entry = (topk_entry_t *)mapGet(self->index, key);
+  if (entry) {
+    entry->count += count;
+    topkSiftDown(self, entry->position);
+    return SKETCH_RESULT_OK;
+  }
+
+  char *copy = sketchCopyKey(key);
+  if (!copy)
+    return SKETCH_ERROR_ALLOCATION;
+
+  // The key is indexed first, so a failed insert leaves the heap untouched
+  entry = self->length < self->k ? &self->entries[self->length]
+                                 : self->heap[0];
+  if (mapSet(self->index, copy, entry) != MAP_RESULT_OK) {
+    deallocate(&copy);
+    return SKETCH_ERROR_ALLOCATION;
+  }
+
+  if (self->length < self->k) {
+    entry->key = copy;
+    entry->count = count;
+    entry->error = 0;
+    entry->position = self->length;
+    self->heap[self->length++] = entry;
+    topkSiftUp(self, entry->position);
+    return SKETCH_RESULT_OK;
+  }
+
+  // Replace the least frequent candidate, which bounds the error of the new
+  (void)mapDelete(self->index, entry->key);
+  deallocate(&entry->key);
+  entry->key = copy;
+  entry->error = entry->count;
+  entry->count += count;
+  topkSiftDown(self, 0);
+
+  if (++self->evictions >= self->k)
+    return topkRebuildIndex(self);
+  return SKETCH_RESULT_OK;
+}
+
+static int topkCompareEntries(const void *a, const void *b) {
+  const topk_entry_t *left = *(const topk_entry_t *const *)a;
+  const topk_entry_t *right = *(const topk_entry_t *const *)b;
+  if (left->count != right->count)
+    return left->count < right->count ? 1 : -1;
+  return strcmp(left->key, right->key);
+}
+
+uint32_t topkList(const topk_t *self, const topk_entry_t **result,
+                  uint32_t capacity) {
+  panicif(!self, "topk cannot be null");
+  if (self->length == 0)
+    return 0;
+
+  const topk_entry_t **sorted =
+      (const topk_entry_t **)allocate(sizeof(topk_entry_t *) * self->length);
+  if (!sorted)
+    return 0;
+
+  for (uint32_t i = 0; i < self->length; i++) {
+    sorted[i] = self->heap[i];
+  }
+  qsort((void *)sorted, self->length, sizeof(topk_entry_t *),
+        topkCompareEntries);
+
+  const uint32_t count = capacity < self->length ? capacity : self->length;
+  memcpy((void *)result, (const void *)sorted, sizeof(topk_entry_t *) * count);
+  deallocate(&sorted);
+  return count;
+}
+
+sketch_result_t topkMerge(topk_t *self, const topk_t *source) {
+  panicif(!self || !source, "topk cannot be null");
+  if (self->k != source->k)
+    return SKETCH_ERROR_MISMATCH;
+
+  // A full tracker may have missed a key up to its smallest count
+  const uint64_t self_min = self->length == self->k ? self->heap[0]->count : 0;
+  const uint64_t source_min =
+      source->length == source->k ? source->heap[0]->count : 0;
+
+  const uint32_t total = self->length + source->length;
+  topk_entry_t *candidates =
+      (topk_entry_t *)allocate(sizeof(topk_entry_t) * total);
+  topk_entry_t **sorted =
+      (topk_entry_t **)allocate(sizeof(topk_entry_t *) * total);
+  if (!candidates || !sorted) {
+    deallocate(&candidates);
+    deallocate(&sorted);
+    return SKETCH_ERROR_ALLOCATION;
+  }
+
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < self->length; i++) {
+    const topk_entry_t *entry = &self->entries[i];
+    const topk_entry_t *other = (const topk_entry_t *)mapGet(source->index,
+                                                             entry->key);
+    candidates[length] = *entry;
+    candidates[length].count += other ? other->count : source_min;
+    candidates[length].error += other ? other->error : source_min;
+    length++;
+  }
+  for (uint32_t i = 0; i < source->length; i++) {
+    const topk_entry_t *entry = &source->entries[i];
+    if (mapGet(self->index, entry->key))
+      continue;
+    candidates[length] = *entry;
+    candidates[length].count += self_min;
+    candidates[length].error += self_min;
+    length++;
+  }
+
+  for (uint32_t i = 0; i < length; i++) {
+    sorted[i] = &candidates[i];
+  }
+  qsort((void *)sorted, length, sizeof(topk_entry_t *), topkCompareEntries);
+  if (length > self->k)
+    length = self->k;
+
+  // Copy the surviving keys before releasing the old ones they may alias
+  sketch_result_t result = SKETCH_RESULT_OK;
+  for (uint32_t i = 0; i < length; i++) {
+    char *copy = sketchCopyKey(sorted[i]->key);
+    if (!copy) {
+      for (uint32_t j = 0; j < i; j++) {
+        deallocate(&sorted[j]->key);
+      }
+      result = SKETCH_ERROR_ALLOCATION;
+      break;
+    }
+    sorted[i]->key = copy;
+  }
+
+  if (result == SKETCH_RESULT_OK) {
+    for (uint32_t i = 0; i < self->length; i++) {
+      deallocate(&self->entries[i].key);
+    }
+
+    // Sorted by descending count, so the reversed order is a valid min-heap
+    self->length = length;
+    for (uint32_t i = 0; i < length; i++) {
+      self->entries[i] = *sorted[length - 1 - i];
+      self->entries[i].position = i;
+      self->heap[i] = &self->entries[i];
+    }
+    result = topkRebuildIndex(self);
+  }
+
+  deallocate(&candidates);
+  deallocate(&sorted);
+  return result;
+}
+
+void topkDestroy(topk_t **self) {
+  if (!self || !*self)
+    return;
+
+  if ((*self)->entries) {
+    for (uint32_t i = 0; i < (*self)->length; i++) {
+      deallocate(&(*self)->entries[i].key);
+    }
+  }
+
+  mapDestroy(&(*self)->index);
+  deallocate(&(*self)->entries);
+  deallocate(&(*self)->heap);
+  deallocate(self);
+}
+
+#ifdef SKETCH_C_TEST
+
+#include "test.h"
+#include <stdio.h>
+
+void countMin(void) {
+  cms_t *cms = cmsCreate(1024, 4);
+  panicif(!cms, "cannot create cms");
+
+  expectEqllu(cmsEstimate(cms, "key"), 0, "unseen keys estimate zero");
+  (void)cmsAdd(cms, "key", 3);
+  expectEqllu(cmsAdd(cms, "key", 2), 5, "add returns the new estimate");
+  expectEqllu(cmsEstimate(cms, "key"), 5, "estimates a lone key exactly");
+
+  test("overestimation");
+  char key[32];
+  int never_under = 1;
+  for (int i = 0; i < 5000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    (void)cmsAdd(cms, key, (uint64_t)(i % 10 + 1));
+  }
+  for (int i = 0; i < 5000; i++) {
+    snprintf(key, sizeof(key), "key-%d", i);
+    never_under &= cmsEstimate(cms, key) >= (uint64_t)(i % 10 + 1);
+  }
+  expectTrue(never_under, "never underestimates");
+  expectEqllu(cms->total, 27505, "tracks the total");
+
+  test("merge");
+  cms_t *other = cmsCreate(1024, 4);
+  (void)cmsAdd(other, "key", 10);
+  expectEqlu(cmsMerge(cms, other), SKETCH_RESULT_OK, "merge returns OK");
+  expectTrue(cmsEstimate(cms, "key") >= 15, "adds counts of both");
+
+  cms_t *narrow = cmsCreate(512, 4);
+  expectEqlu(cmsMerge(cms, narrow), SKETCH_ERROR_MISMATCH,
+             "refuses different dimensions");
+
+  cmsDestroy(&narrow);
+  cmsDestroy(&other);
+  cmsDestroy(&cms);
+  expectNull(cms, "destroy sets pointer to NULL");
+}
+
+// Fails every allocation while *context is set
+static void *sketchFailingAlloc(void *context, size_t size) {
+  return *(int *)context ? NULL : allocateUninit(size);
+}
+
+static void *sketchFailingRealloc(void *context, void *ptr, size_t old_size,
+                                  size_t size) {
+  (void)old_size;
+  return *(int *)context ? NULL : reallocate(&ptr, size);
+}
+
+static void sketchFailingFree(void *context, void *ptr, size_t size) {
+  (void)context;
+  (void)size;
+  deallocate(&ptr);
+}
+
+void topK(void) {
+  topk_t *topk = topkCreate(3);
+  panicif(!topk, "cannot create topk");
+
+  (void)topkAdd(topk, "a", 5);
+  (void)topkAdd(topk, "b", 3);
+  (void)topkAdd(topk, "c", 1);
+  (void)topkAdd(topk, "a", 1);
+
+  const topk_entry_t *top[3];
+  uint32_t count = topkList(topk, top, 3);
+  expectEqlu(count, 3, "lists tracked keys");
+  expectEqls(top[0]->key, "a", 2, "most frequent first");
+  expectEqllu(top[0]->count, 6, "sums counts");
+  expectEqllu(top[0]->error, 0, "exact while not full");
+
+  test("eviction");
+  (void)topkAdd(topk, "d", 1);
+  count = topkList(topk, top, 3);
+  expectEqls(top[2]->key, "d", 2, "replaces least frequent");
+  expectEqllu(top[2]->count, 2, "inherits evicted count");
+  expectEqllu(top[2]->error, 1, "records inherited count as error");
+
+  test("heavy hitters");
+  topk_t *stream = topkCreate(10);
+  char key[32];
+  for (int round = 0; round < 200; round++) {
+    // Hot keys are well above the n / k frequency space-saving guarantees
+    for (int i = 0; i < 5; i++) {
+      snprintf(key, sizeof(key), "hot-%d", i);
+      (void)topkAdd(stream, key, 10);
+    }
+    for (int i = 0; i < 20; i++) {
+      snprintf(key, sizeof(key), "cold-%d-%d", round, i);
+      (void)topkAdd(stream, key, 1);
+    }
+  }
+  const topk_entry_t *hot[5];
+  count = topkList(stream, hot, 5);
+  int found_hot = 1;
+  for (uint32_t i = 0; i < count; i++) {
+    found_hot &= strncmp(hot[i]->key, "hot-", 4) == 0;
+  }
+  expectTrue(found_hot, "keeps hot keys among churn");
+
+  test("merge");
+  topk_t *a = topkCreate(3);
+  topk_t *b = topkCreate(3);
+  (void)topkAdd(a, "x", 10);
+  (void)topkAdd(a, "y", 4);
+  (void)topkAdd(b, "x", 5);
+  (void)topkAdd(b, "z", 7);
+  expectEqlu(topkMerge(a, b), SKETCH_RESULT_OK, "merge returns OK");
+  count = topkList(a, top, 3);
+  expectEqlu(count, 3, "keeps union of candidates");
+  expectEqls(top[0]->key, "x", 2, "merged most frequent first");
+  expectEqllu(top[0]->count, 15, "adds counts of both");
+  expectEqlu(topkMerge(a, stream), SKETCH_ERROR_MISMATCH,
+             "refuses different k");
+
+  test("allocation failure");
+  topk_t *failing = topkCreate(2);
+  int fail = 0;
+  allocator_t allocator = {sketchFailingAlloc, sketchFailingRealloc,
+                           sketchFailingFree, &fail};
+  mapDestroy(&failing->index);
+  failing->index = mapCreateWithAllocator(4, &allocator);
+  (void)topkAdd(failing, "a", 5);
+  fail = 1;
+  expectEqlu(topkAdd(failing, "b", 3), SKETCH_ERROR_ALLOCATION,
+             "reports a failed insert");
+  expectEqlu(failing->length, 1, "leaves the heap as it was");
+  fail = 0;
+  (void)topkAdd(failing, "b", 3);
+  fail = 1;
+  expectEqlu(topkAdd(failing, "c", 1), SKETCH_ERROR_ALLOCATION,
+             "reports a failed eviction");
+  fail = 0;
+  (void)topkAdd(failing, "b", 1);
+  count = topkList(failing, top, 2);
+  expectTrue(count == 2 && strcmp(top[0]->key, "a") == 0 &&
+                 strcmp(top[1]->key, "b") == 0 && top[1]->count == 4,
+             "keeps every entry indexed");
+
+  topkDestroy(&failing);
+  topkDestroy(&b);
+  topkDestroy(&a);
+  topkDestroy(&stream);
+  topkDestroy(&topk);
+}
+
+int main(void) {
+  suite(countMin);
+  suite(topK);
+
+  return report();
+}
+#endif
+
+#ifdef SKETCH_C_BENCH
+
+#include "bench.h"
+#include <stdio.h>
+
+#define BENCH_KEYS 100000
+#define BENCH_STREAM 2000000
+#define BENCH_TOP 10
+
+static uint64_t benchState = 88172645463325252ULL;
+static char benchKeys[BENCH_KEYS][16];
+static uint32_t *benchStream;
+
+// Baseline: one heap-allocated counter per key as the value of a map
+static void benchCounters(bench_t *b) {
+  map_t *counters = (map_t *)b->context;
+  uint32_t next = 0;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    const char *key = benchKeys[benchStream[next]];
+    next = next + 1 == BENCH_STREAM ? 0 : next + 1;
+
+    uint64_t *counter = (uint64_t *)mapGet(counters, key);
+    if (!counter) {
+      counter = (uint64_t *)allocate(sizeof(uint64_t));
+      (void)mapSet(counters, key, counter);
+    }
+    (*counter)++;
+  }
+}
+
+static void benchCountMin(bench_t *b) {
+  cms_t *cms = (cms_t *)b->context;
+  uint32_t next = 0;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    (void)cmsAdd(cms, benchKeys[benchStream[next]], 1);
+    next = next + 1 == BENCH_STREAM ? 0 : next + 1;
+  }
+}
+
+static void benchSpaceSaving(bench_t *b) {
+  topk_t *topk = (topk_t *)b->context;
+  uint32_t next = 0;
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    (void)topkAdd(topk, benchKeys[benchStream[next]], 1);
+    next = next + 1 == BENCH_STREAM ? 0 : next + 1;
+  }
+}
+
+int main(void) {
+  for (uint32_t i = 0; i < BENCH_KEYS; i++) {
+    snprintf(benchKeys[i], sizeof(benchKeys[i]), "key-%u", i);
+  }
+
+  benchStream = (uint32_t *)allocate(sizeof(uint32_t) * BENCH_STREAM);
+  panicif(!benchStream, "cannot allocate stream");
+
+  const double exponents[] = {0.8, 1.1, 1.5};
+  char name[64];
+  for (size_t e = 0; e < sizeof(exponents) / sizeof(exponents[0]); e++) {
+    panicif(!benchZipf(benchStream, BENCH_STREAM, BENCH_KEYS, exponents[e],
+                       &benchState),
+            "cannot draw stream");
+
+    map_t *counters = mapCreate(BENCH_KEYS * 2);
+    cms_t *cms = cmsCreate(4096, 4);
+    topk_t *topk = topkCreate(BENCH_TOP * 10);
+    panicif(!counters || !cms || !topk, "cannot create counters");
+
+    snprintf(name, sizeof(name), "zipf-%.1f/map-of-counters", exponents[e]);
+    benchmarkWith(name, benchCounters, counters);
+    snprintf(name, sizeof(name), "zipf-%.1f/count-min-4096x4", exponents[e]);
+    benchmarkWith(name, benchCountMin, cms);
+    snprintf(name, sizeof(name), "zipf-%.1f/space-saving-100", exponents[e]);
+    benchmarkWith(name, benchSpaceSaving, topk);
+
+    // Zipf ranks are ordered by frequency, so the true top keys are 0..9
+    const topk_entry_t *top[BENCH_TOP];
+    uint32_t count = topkList(topk, top, BENCH_TOP), hits = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      hits += (uint32_t)atoi(top[i]->key + 4) < BENCH_TOP;
+    }
+    if (count > 0)
+      fprintf(stderr, "zipf-%.1f: space-saving found %u of the top %u keys\n",
+              exponents[e], hits, BENCH_TOP);
+
+    topkDestroy(&topk);
+    cmsDestroy(&cms);
+    for (map_size_t i = 0; i < counters->size; i++) {
+      deallocate(&counters->values[i]);
+    }
+    mapDestroy(&counters);
+  }
+
+  deallocate(&benchStream);
+  return benchReport();
+}
+#endif
@@ -0,0 +1,177 @@
+// Sketch (v0.0.1)
+// ---
+//
+// Frequency estimation in bounded memory. A count-min sketch estimates how
+// often any key was seen; a top-K tracker keeps the K most frequent keys with
+// the space-saving algorithm, holding only the candidates in a small map.
+// Both can be merged, so each thread can keep its own and combine them later.
+//
+// ```c
+// cms_t* cms = cmsCreate(2048, 4);
+// cmsAdd(cms, "key", 1);
+// cmsEstimate(cms, "key");    // returns at least 1
+// cmsDestroy(&cms);
+//
+// topk_t* topk = topkCreate(10);
+// topkAdd(topk, "key", 1);
+//
+// const topk_entry_t* top[10];
+// uint32_t count = topkList(topk, top, 10);  // most frequent first
+// topkDestroy(&topk);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "map.h"
+#include <stdint.h>
+
+typedef enum {
+  SKETCH_RESULT_OK = 0,
+  SKETCH_ERROR_ALLOCATION,
+  SKETCH_ERROR_MISMATCH
+} sketch_result_t;
+
+typedef struct {
+  uint32_t width;
+  uint32_t depth;
+  uint64_t total;     // sum of all counts added
+  uint64_t *counters; // depth rows of width counters
+} cms_t;
+
+typedef struct {
+  char *key;
+  uint64_t count; // estimated count, never below the real one
+  uint64_t error; // how much count may overestimate the real one
+  uint32_t position;
+} topk_entry_t;
+
+typedef struct {
+  uint32_t k;
+  uint32_t length;
+  uint32_t evictions; // deletions from index since it was last rebuilt
+  map_t *index;       // key -> topk_entry_t*
+  topk_entry_t *entries;
+  topk_entry_t **heap; // min-heap on count
+} topk_t;
+
+/**
+ * Create a new count-min sketch. Estimates exceed the real count by at most
+ * e / width of the total with probability 1 - exp(-depth).
+ * @name cmsCreate
+ * @param {uint32_t} width - Counters per row
+ * @param {uint32_t} depth - Number of rows
+ * @returns {cms_t*} Pointer to the newly created sketch, or NULL on failure
+ * @example
+ *   cms_t* cms = cmsCreate(2048, 4);
+ */
+cms_t *cmsCreate(uint32_t width, uint32_t depth);
+
+/**
+ * Count occurrences of a key. Uses conservative update: only the counters
+ * that would otherwise fall below the new estimate are raised.
+ * @name cmsAdd
+ * @param {cms_t*} self - Pointer to the sketch
+ * @param {const char*} key - The key to count
+ * @param {uint64_t} count - Number of occurrences
+ * @returns {uint64_t} The estimated count of the key after the update
+ * @example
+ *   cmsAdd(cms, "key", 1);
+ */
+uint64_t cmsAdd(cms_t *self, const char *key, uint64_t count);
+
+/**
+ * Estimate how many times a key was counted. Never underestimates.
+ * @name cmsEstimate
+ * @param {const cms_t*} self - Pointer to the sketch
+ * @param {const char*} key - The key to look up
+ * @returns {uint64_t} The estimated count
+ * @example
+ *   uint64_t seen = cmsEstimate(cms, "key");
+ */
+uint64_t cmsEstimate(const cms_t *self, const char *key);
+
+/**
+ * Add the counts of a sketch into another with the same dimensions.
+ * @name cmsMerge
+ * @param {cms_t*} self - Pointer to the destination sketch
+ * @param {const cms_t*} source - Pointer to the sketch to merge
+ * @returns {sketch_result_t} SKETCH_RESULT_OK on success,
+ * SKETCH_ERROR_MISMATCH if width or depth differ
+ * @example
+ *   cmsMerge(total, perThread);
+ */
+sketch_result_t cmsMerge(cms_t *self, const cms_t *source);
+
+/**
+ * Destroy the sketch and free all allocated memory.
+ * @name cmsDestroy
+ * @param {cms_t**} self - Pointer to the sketch pointer (will be set to NULL)
+ * @example
+ *   cmsDestroy(&cms);
+ */
+void cmsDestroy(cms_t **self);
+
+/**
+ * Create a new top-K tracker.
+ * @name topkCreate
+ * @param {uint32_t} k - Number of keys to track
+ * @returns {topk_t*} Pointer to the newly created tracker, or NULL on failure
+ * @example
+ *   topk_t* topk = topkCreate(10);
+ */
+topk_t *topkCreate(uint32_t k);
+
+/**
+ * Count occurrences of a key. When the tracker is full the least frequent
+ * candidate is replaced and its count inherited as error.
+ * @name topkAdd
+ * @param {topk_t*} self - Pointer to the tracker
+ * @param {const char*} key - The key to count
+ * @param {uint64_t} count - Number of occurrences
+ * @returns {sketch_result_t} SKETCH_RESULT_OK on success,
+ * SKETCH_ERROR_ALLOCATION if memory runs out
+ * @example
+ *   topkAdd(topk, "key", 1);
+ */
+sketch_result_t topkAdd(topk_t *self, const char *key, uint64_t count);
+
+/**
+ * List the tracked keys, most frequent first.
+ * @name topkList
+ * @param {const topk_t*} self - Pointer to the tracker
+ * @param {const topk_entry_t**} result - Array receiving the entries
+ * @param {uint32_t} capacity - Size of the result array
+ * @returns {uint32_t} Number of entries written
+ * @example
+ *   const topk_entry_t* top[10];
+ *   uint32_t count = topkList(topk, top, 10);
+ *   printf("%s: %llu\n", top[0]->key, top[0]->count);
+ */
+uint32_t topkList(const topk_t *self, const topk_entry_t **result,
+                  uint32_t capacity);
+
+/**
+ * Merge a tracker into another with the same K. Keys missing from one side
+ * are assumed to have that side's smallest count, as in the parallel
+ * space-saving algorithm.
+ * @name topkMerge
+ * @param {topk_t*} self - Pointer to the destination tracker
+ * @param {const topk_t*} source - Pointer to the tracker to merge
+ * @returns {sketch_result_t} SKETCH_RESULT_OK on success,
+ * SKETCH_ERROR_MISMATCH if K differs, SKETCH_ERROR_ALLOCATION if memory runs
+ * out
+ * @example
+ *   topkMerge(total, perThread);
+ */
+sketch_result_t topkMerge(topk_t *self, const topk_t *source);
+
+/**
+ * Destroy the tracker and free all allocated memory.
+ * @name topkDestroy
+ * @param {topk_t**} self - Pointer to the tracker pointer (will be set to
+ * NULL)
+ * @example
+ *   topkDestroy(&topk);
+ */
+void topkDestroy(topk_t **self);
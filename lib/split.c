@@ -0,0 +1,304 @@
+#include "split.h"
+#include "panic.h"
+#include <string.h>
+
+#if defined(__AVX2__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SPLIT_AVX2 1
+#endif
+
+static inline unsigned splitLowestBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned)__builtin_ctzll(bits);
+#else
+  unsigned i = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+// Sets every bit from a quote up to, not including, the matching quote
+static inline uint64_t splitPrefixXor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+// Finds the delimiters, line feeds and quotes of 64 bytes
+static inline void splitMatch(const char *block, char delimiter, char quote,
+                              uint64_t *ends, uint64_t *quotes) {
+#if defined(SPLIT_AVX2)
+  const __m256i delimiters = _mm256_set1_epi8(delimiter);
+  const __m256i lines = _mm256_set1_epi8('\n');
+  const __m256i quoted = _mm256_set1_epi8(quote);
+  *ends = 0;
+  *quotes = 0;
+  for (int i = 0; i < SPLIT_BLOCK; i += 32) {
+    const __m256i bytes =
+        _mm256_loadu_si256((const __m256i *)(const void *)(block + i));
+    const __m256i end = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, delimiters),
+                                        _mm256_cmpeq_epi8(bytes, lines));
+    *ends |= (uint64_t)(uint32_t)_mm256_movemask_epi8(end) << i;
+    *quotes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                   _mm256_cmpeq_epi8(bytes, quoted))
+               << i;
+  }
+#elif defined(STR_SSE2)
+  const __m128i delimiters = _mm_set1_epi8(delimiter);
+  const __m128i lines = _mm_set1_epi8('\n');
+  const __m128i quoted = _mm_set1_epi8(quote);
+  *ends = 0;
+  *quotes = 0;
+  for (int i = 0; i < SPLIT_BLOCK; i += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128((const __m128i *)(const void *)(block + i));
+    const __m128i end = _mm_or_si128(_mm_cmpeq_epi8(bytes, delimiters),
+                                     _mm_cmpeq_epi8(bytes, lines));
+    *ends |= (uint64_t)(unsigned)_mm_movemask_epi8(end) << i;
+    *quotes |= (uint64_t)(unsigned)_mm_movemask_epi8(
+                   _mm_cmpeq_epi8(bytes, quoted))
+               << i;
+  }
+#else
+  *ends = 0;
+  *quotes = 0;
+  for (int i = 0; i < SPLIT_BLOCK; i++) {
+    *ends |= (uint64_t)(block[i] == delimiter || block[i] == '\n') << i;
+    *quotes |= (uint64_t)(block[i] == quote) << i;
+  }
+#endif
+}
+
+// Classifies the next block, keeping only the field ends outside quotes
+static void splitClassify(split_t *self) {
+  const char *block = self->data + self->next;
+  const size_t available = self->length - self->next;
+  char padded[SPLIT_BLOCK];
+  uint64_t valid = ~(uint64_t)0;
+  if (available < SPLIT_BLOCK) {
+    memset(padded, 0, sizeof(padded));
+    memcpy(padded, block, available);
+    block = padded;
+    valid = ((uint64_t)1 << available) - 1;
+  }
+
+  uint64_t ends, quotes;
+  splitMatch(block, self->delimiter, self->quote, &ends, &quotes);
+  if (!self->quote)
+    quotes = 0;
+
+  const uint64_t inside = splitPrefixXor(quotes & valid) ^ self->inside;
+  self->inside = (uint64_t)0 - (inside >> 63);
+  self->mask = ends & ~inside & valid;
+  self->base = self->next;
+  self->next += SPLIT_BLOCK;
+}
+
+// Returns the offset of the next field end, or length when there is none
+static inline size_t splitNextEnd(split_t *self) {
+  while (!self->mask) {
+    if (self->next >= self->length)
+      return self->length;
+    splitClassify(self);
+  }
+
+  const size_t end = self->base + splitLowestBit(self->mask);
+  self->mask &= self->mask - 1;
+  return end;
+}
+
+void splitInit(split_t *self, const char *data, size_t length, char delimiter,
+               char quote) {
+  panicif(!self, "split cannot be null");
+  panicif(!data && length > 0, "data cannot be null");
+  panicif(delimiter == '\n', "delimiter cannot be a line feed");
+  panicif(quote && (quote == delimiter || quote == '\n'),
+          "quote must differ from delimiter and line feed");
+  self->data = data;
+  self->length = length;
+  self->position = 0;
+  self->base = 0;
+  self->next = 0;
+  self->mask = 0;
+  self->inside = 0;
+  self->delimiter = delimiter;
+  self->quote = quote;
+}
+
+size_t splitRecord(split_t *self, str_t *fields, size_t capacity) {
+  panicif(!self, "split cannot be null");
+  panicif(!fields || capacity == 0, "fields cannot be empty");
+  if (self->position >= self->length)
+    return 0;
+
+  size_t count = 0;
+  for (;;) {
+    const size_t start = self->position;
+    size_t end = splitNextEnd(self);
+
+    // The last view takes the rest of the record
+    int rest = 0;
+    if (count + 1 == capacity) {
+      while (end < self->length && self->data[end] != '\n') {
+        end = splitNextEnd(self);
+        rest = 1;
+      }
+    }
+
+    self->position = end + 1;
+    const int last = end == self->length || self->data[end] == '\n';
+    if (last && end > start && self->data[end - 1] == '\r')
+      end--;
+
+    str_t field = strMake(self->data + start, end - start);
+    if (!rest && self->quote && field.length >= 2 &&
+        field.data[0] == self->quote &&
+        field.data[field.length - 1] == self->quote) {
+      field = strSlice(field, 1, field.length - 1);
+    }
+    fields[count++] = field;
+
+    if (last)
+      return count;
+  }
+}
+
+size_t splitUnescape(str_t field, char quote, char *out) {
+  size_t length = 0;
+  for (size_t i = 0; i < field.length; i++) {
+    out[length++] = field.data[i];
+    if (field.data[i] == quote && i + 1 < field.length &&
+        field.data[i + 1] == quote)
+      i++;
+  }
+  return length;
+}
+
+#ifdef SPLIT_C_TEST
+
+#include "test.h"
+#include <stdlib.h>
+
+static int splitFieldIs(str_t field, const char *expected) {
+  return strEquals(field, strFrom(expected));
+}
+
+void splitFields(void) {
+  const char *text = "alpha,beta,,gamma\n"
+                     "\n"
+                     "one,two\r\n"
+                     "last,";
+  split_t split;
+  splitInit(&split, text, strlen(text), ',', '\0');
+  str_t fields[8];
+
+  expectEqllu(splitRecord(&split, fields, 8), 4, "splits a record");
+  expectTrue(splitFieldIs(fields[0], "alpha") &&
+                 splitFieldIs(fields[1], "beta") &&
+                 splitFieldIs(fields[2], "") &&
+                 splitFieldIs(fields[3], "gamma"),
+             "returns every field in order");
+  expectTrue(fields[0].data == text, "points into the input");
+  expectEqllu(splitRecord(&split, fields, 8), 1, "returns empty lines");
+  expectEqllu(fields[0].length, 0, "as a single empty field");
+  expectEqllu(splitRecord(&split, fields, 8), 2, "splits CRLF lines");
+  expectTrue(splitFieldIs(fields[1], "two"), "strips the carriage return");
+  expectEqllu(splitRecord(&split, fields, 8), 2, "splits the last line");
+  expectTrue(splitFieldIs(fields[1], ""), "keeps the trailing empty field");
+  expectEqllu(splitRecord(&split, fields, 8), 0, "stops at the end");
+  expectEqllu(splitRecord(&split, fields, 8), 0, "keeps returning 0");
+
+  test("capacity");
+  splitInit(&split, "key=a=b=c\nnext", 14, '=', '\0');
+  expectEqllu(splitRecord(&split, fields, 2), 2, "returns capacity fields");
+  expectTrue(splitFieldIs(fields[1], "a=b=c"),
+             "keeps the rest of the record");
+  expectEqllu(splitRecord(&split, fields, 1), 1, "resumes at the next record");
+  expectTrue(splitFieldIs(fields[0], "next"), "returns the next record");
+
+  test("quotes");
+  text = "\"a,b\",plain,\"say \"\"hi\"\"\"\n\"multi\nline\",x";
+  splitInit(&split, text, strlen(text), ',', '"');
+  expectEqllu(splitRecord(&split, fields, 8), 3, "ignores quoted delimiters");
+  expectTrue(splitFieldIs(fields[0], "a,b"), "strips the outer quotes");
+  expectTrue(splitFieldIs(fields[1], "plain"), "keeps unquoted fields");
+  char unescaped[32];
+  const size_t length = splitUnescape(fields[2], '"', unescaped);
+  expectTrue(strEquals(strMake(unescaped, length), STR("say \"hi\"")),
+             "unescapes doubled quotes");
+  expectEqllu(splitRecord(&split, fields, 8), 2, "ignores quoted line feeds");
+  expectTrue(splitFieldIs(fields[0], "multi\nline"), "keeps quoted lines");
+}
+
+// Splits one byte at a time with the same rules as splitRecord
+static size_t splitSlowly(const char *data, size_t length, size_t *position,
+                          str_t *fields) {
+  if (*position >= length)
+    return 0;
+  size_t count = 0, start = *position;
+  int inside = 0;
+  for (size_t i = *position;; i++) {
+    if (i < length && data[i] == '"')
+      inside = !inside;
+    if (i == length || (!inside && (data[i] == ',' || data[i] == '\n'))) {
+      const int last = i == length || data[i] == '\n';
+      size_t end = i;
+      if (last && end > start && data[end - 1] == '\r')
+        end--;
+      str_t field = strMake(data + start, end - start);
+      if (field.length >= 2 && field.data[0] == '"' &&
+          field.data[field.length - 1] == '"')
+        field = strSlice(field, 1, field.length - 1);
+      fields[count++] = field;
+      start = i + 1;
+      if (last) {
+        *position = i + 1;
+        return count;
+      }
+    }
+  }
+}
+
+void splitBlocks(void) {
+  static const char alphabet[] = "aaaaaab,,\n\"\r";
+  static char text[1000];
+  static str_t fast[1000], slow[1000];
+  srand(42);
+
+  int same = 1;
+  for (int round = 0; round < 200; round++) {
+    const size_t length = (size_t)rand() % sizeof(text);
+    for (size_t i = 0; i < length; i++) {
+      text[i] = alphabet[(size_t)rand() % (sizeof(alphabet) - 1)];
+    }
+
+    split_t split;
+    splitInit(&split, text, length, ',', '"');
+    size_t position = 0, count;
+    while ((count = splitSlowly(text, length, &position, slow))) {
+      same &= splitRecord(&split, fast, 1000) == count;
+      for (size_t i = 0; same && i < count; i++) {
+        same &= fast[i].data == slow[i].data &&
+                fast[i].length == slow[i].length;
+      }
+    }
+    same &= splitRecord(&split, fast, 1000) == 0;
+  }
+  expectTrue(same, "matches a byte by byte split across blocks");
+}
+
+int main(void) {
+  suite(splitFields);
+  suite(splitBlocks);
+
+  return report();
+}
+
+#endif
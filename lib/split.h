@@ -0,0 +1,97 @@
+// Split (v0.0.1)
+// ---
+//
+// A tokenizer for delimited text such as CSV, TSV or log lines. Fields are
+// returned as views into the input, so nothing is copied, and a whole record
+// (one line) is returned per call.
+//
+// The input is classified 64 bytes at a time: SIMD compares turn the bytes
+// into bitmasks of delimiters, line endings and quotes, a prefix XOR of the
+// quote mask marks the bytes inside quotes, and fields are cut at the
+// remaining set bits. AVX2 is used when the compiler targets it, then SSE2,
+// then plain loops.
+//
+// With a quote character, a field wrapped in quotes may contain delimiters
+// and line endings, and the view excludes the outer quotes. Quotes inside
+// are escaped by doubling them, as in RFC 4180; splitUnescape copies such a
+// field with the escapes removed. "\r\n" line endings are accepted.
+//
+// ```c
+// split_t split;
+// splitInit(&split, text, length, ',', '"');
+//
+// str_t fields[8];
+// size_t count;
+// while ((count = splitRecord(&split, fields, 8))) {
+//   setAddStr(names, fields[0]);
+// }
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "str.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPLIT_BLOCK 64 // bytes classified at once
+
+typedef struct {
+  const char *data;
+  size_t length;
+  size_t position; // start of the next field, past length when done
+  size_t base;     // offset of the block the mask belongs to
+  size_t next;     // offset of the next block to classify
+  uint64_t mask;   // field ends in the current block not returned yet
+  uint64_t inside; // all ones when the next block starts inside quotes
+  char delimiter;
+  char quote; // '\0' when fields are never quoted
+} split_t;
+
+/**
+ * Start splitting length bytes of text. The text must outlive the views
+ * returned by splitRecord.
+ * @name splitInit
+ * @param {split_t*} self - Pointer to the tokenizer
+ * @param {const char*} data - The text, which doesn't need to be
+ * NUL-terminated
+ * @param {size_t} length - Number of bytes
+ * @param {char} delimiter - Character between fields, e.g. ',' or '\t'
+ * @param {char} quote - Character around quoted fields, or '\0' for none
+ * @example
+ *   split_t split;
+ *   splitInit(&split, file->data, file->size, '\t', '\0');
+ */
+void splitInit(split_t *self, const char *data, size_t length, char delimiter,
+               char quote);
+
+/**
+ * Split the next record into fields. When the record has more than capacity
+ * fields, the last view holds the rest of the record as it is.
+ * @name splitRecord
+ * @param {split_t*} self - Pointer to the tokenizer
+ * @param {str_t*} fields - Receives the fields of the record
+ * @param {size_t} capacity - Number of views fields can hold, at least 1
+ * @returns {size_t} Number of fields, at least 1 for each record and 0 once
+ * the text is exhausted
+ * @example
+ *   str_t fields[2];
+ *   while (splitRecord(&split, fields, 2)) {
+ *     mapSetStr(map, fields[0], NULL);
+ *   }
+ */
+size_t splitRecord(split_t *self, str_t *fields, size_t capacity);
+
+/**
+ * Copy a quoted field, turning doubled quotes into single ones. Fields
+ * without quotes, checked with strFindByte, can be used as they are.
+ * @name splitUnescape
+ * @param {str_t} field - A field returned by splitRecord
+ * @param {char} quote - The quote character given to splitInit
+ * @param {char*} out - Receives the bytes, at least field.length of them
+ * @returns {size_t} Number of bytes written
+ * @example
+ *   char value[256];
+ *   size_t length = splitUnescape(fields[1], '"', value);
+ */
+size_t splitUnescape(str_t field, char quote, char *out);
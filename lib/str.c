@@ -0,0 +1,214 @@
+// str.h is header-only, this file holds its tests
+#include "str.h"
+
+#ifdef STR_C_TEST
+
+#include "test.h"
+#include <stdint.h>
+
+// Bytes that sit on the edges of the case folding, including high-bit ones
+static const char strAlphabet[] = "aAbBzZ@[`{\x80\xc1\xe1\xff";
+
+static uint64_t strRandom(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void strFill(uint64_t *state, char *bytes, size_t length,
+                    size_t letters) {
+  for (size_t i = 0; i < length; i++) {
+    bytes[i] = strAlphabet[strRandom(state) % letters];
+  }
+}
+
+static int strSign(int value) { return (value > 0) - (value < 0); }
+
+// Byte by byte references for the SSE2 paths
+
+static int strReferenceCompare(str_t a, str_t b, int ignore_case) {
+  const size_t length = a.length < b.length ? a.length : b.length;
+  for (size_t i = 0; i < length; i++) {
+    int x = (unsigned char)a.data[i], y = (unsigned char)b.data[i];
+    if (ignore_case) {
+      x = x >= 'A' && x <= 'Z' ? x + 32 : x;
+      y = y >= 'A' && y <= 'Z' ? y + 32 : y;
+    }
+    if (x != y)
+      return strSign(x - y);
+  }
+  return (a.length > b.length) - (a.length < b.length);
+}
+
+static size_t strReferenceFind(str_t self, str_t needle) {
+  for (size_t i = 0; i + needle.length <= self.length; i++) {
+    if (memcmp(self.data + i, needle.data, needle.length) == 0)
+      return i;
+  }
+  return STR_NOT_FOUND;
+}
+
+static int strMatchesReference(str_t a, str_t b) {
+  const int compare = strReferenceCompare(a, b, 0);
+  const int folded = strReferenceCompare(a, b, 1);
+  return strEquals(a, b) == (compare == 0) &&
+         strSign(strCompare(a, b)) == compare &&
+         strEqualsIgnoreCase(a, b) == (folded == 0) &&
+         strSign(strCompareIgnoreCase(a, b)) == folded;
+}
+
+void strComparisons(void) {
+  expectTrue(strEquals(STR("tenant"), strFrom("tenant")), "equals itself");
+  expectFalse(strEquals(STR("tenant"), STR("tenants")),
+              "rejects other lengths");
+  expectTrue(strCompare(STR("Tenant"), STR("tenant")) < 0,
+             "sorts upper case first");
+  expectTrue(strCompare(STR("ten"), STR("tenant")) < 0,
+             "sorts prefixes first");
+  expectTrue(strCompare(STR("\xff"), STR("a")) > 0,
+             "compares bytes as unsigned");
+  expectTrue(strEqualsIgnoreCase(STR("Content-Type"), STR("content-TYPE")),
+             "ignores the case of letters");
+  expectTrue(strEquals(strSlice(STR("tenant"), 1, 3), STR("en")),
+             "slices views");
+
+  test("boundaries");
+  char a[80], b[80];
+  uint64_t state = 7;
+  int same = 1;
+  for (size_t length = 0; length <= 64; length++) {
+    strFill(&state, a, length, 10);
+    memcpy(b, a, length);
+    same &= strMatchesReference(strMake(a, length), strMake(b, length));
+    for (size_t at = 0; at < length; at++) {
+      b[at] = a[at] == 'a' ? 'b' : 'a';
+      same &= strMatchesReference(strMake(a, length), strMake(b, length));
+      b[at] = (char)(a[at] ^ 0x20);
+      same &= strMatchesReference(strMake(a, length), strMake(b, length));
+      b[at] = a[at];
+    }
+  }
+  expectTrue(same, "finds a mismatch at every position up to 64 bytes");
+
+  // 17 bytes runs one 16 byte block and a tail of one
+  expectTrue(strCompare(STR("aaaaaaaaaaaaaaaab"), STR("aaaaaaaaaaaaaaaac")) <
+                 0,
+             "compares a mismatch in the tail");
+  expectFalse(strEqualsIgnoreCase(STR("aaaaaaaaaaaaaaaa\xc1"),
+                                  STR("aaaaaaaaaaaaaaaa\xe1")),
+              "doesn't fold high-bit bytes in the tail");
+  expectFalse(strEqualsIgnoreCase(STR("\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1"
+                                      "\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1"),
+                                  STR("\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1"
+                                      "\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1")),
+              "doesn't fold high-bit bytes in a block");
+  expectTrue(strCompareIgnoreCase(STR("@@@@@@@@@@@@@@@@"),
+                                  STR("````````````````")) < 0 &&
+                 strCompareIgnoreCase(STR("[[[[[[[[[[[[[[[["),
+                                      STR("{{{{{{{{{{{{{{{{")) < 0,
+             "doesn't fold the bytes around the letters");
+
+  test("random");
+  same = 1;
+  for (int i = 0; i < 20000; i++) {
+    const size_t length = strRandom(&state) % 70;
+    const size_t other = strRandom(&state) % 4 ? length : strRandom(&state) % 70;
+    // Few letters make equal prefixes likely
+    const size_t letters = 2 + strRandom(&state) % (sizeof(strAlphabet) - 2);
+    strFill(&state, a, length, letters);
+    memcpy(b, a, length < other ? length : other);
+    if (other > length)
+      strFill(&state, b + length, other - length, letters);
+    for (size_t at = 0; at < other; at++) {
+      if (strRandom(&state) % 8 == 0)
+        b[at] = (char)(b[at] ^ 0x20);
+    }
+    same &= strMatchesReference(strMake(a, length), strMake(b, other));
+  }
+  expectTrue(same, "matches the byte by byte reference");
+}
+
+void strSearches(void) {
+  const str_t name = STR("Tenant-42");
+  expectEqllu(strFindByte(name, '-'), 6, "finds a byte");
+  expectEqllu(strFind(name, STR("42")), 7, "finds a substring");
+  expectTrue(strFind(name, STR("43")) == STR_NOT_FOUND,
+             "reports missing substrings");
+  expectEqllu(strFind(name, STR("")), 0, "finds the empty needle at 0");
+  expectEqllu(strFind(STR(""), STR("")), 0, "finds it in an empty view");
+  expectTrue(strFind(STR("ten"), STR("tenant")) == STR_NOT_FOUND,
+             "rejects needles longer than the view");
+  expectTrue(strFindByte(STR(""), 'a') == STR_NOT_FOUND,
+             "finds no byte in an empty view");
+
+  test("boundaries");
+  char haystack[80];
+  int same = 1;
+  for (size_t length = 0; length <= 64; length++) {
+    memset(haystack, 'a', length);
+    same &= strFindByte(strMake(haystack, length), '\xff') == STR_NOT_FOUND;
+    for (size_t at = 0; at < length; at++) {
+      haystack[at] = '\xff';
+      if (at + 1 < length)
+        haystack[length - 1] = '\xff';
+      same &= strFindByte(strMake(haystack, length), '\xff') == at;
+      memset(haystack, 'a', length);
+    }
+  }
+  expectTrue(same, "finds a byte at every position up to 64 bytes");
+
+  same = 1;
+  const str_t needle = STR("bcb");
+  for (size_t length = 0; length <= 64; length++) {
+    // "bab" shares the first and last bytes, so it passes the filter
+    for (size_t i = 0; i < length; i++) {
+      haystack[i] = i % 3 == 1 ? 'a' : 'b';
+    }
+    same &= strFind(strMake(haystack, length), needle) == STR_NOT_FOUND;
+    for (size_t at = 0; at + 3 <= length; at++) {
+      char saved[3];
+      memcpy(saved, haystack + at, 3);
+      memcpy(haystack + at, "bcb", 3);
+      same &= strFind(strMake(haystack, length), needle) ==
+              strReferenceFind(strMake(haystack, length), needle);
+      memcpy(haystack + at, saved, 3);
+    }
+  }
+  expectTrue(same, "finds a substring at every position up to 64 bytes");
+  expectEqllu(strFind(STR("xxxxxxxxxxxxxxxxxxx42"), STR("42")), 19,
+              "finds a substring in the tail");
+
+  test("random");
+  char bytes[80];
+  uint64_t state = 11;
+  same = 1;
+  for (int i = 0; i < 20000; i++) {
+    const size_t length = strRandom(&state) % 70;
+    const size_t letters = 2 + strRandom(&state) % 3;
+    strFill(&state, haystack, length, letters);
+    const size_t needle_length = strRandom(&state) % 8;
+    str_t wanted = strMake(bytes, needle_length);
+    if (needle_length <= length && strRandom(&state) % 2) {
+      const size_t at = strRandom(&state) % (length - needle_length + 1);
+      wanted.data = haystack + at;
+    } else {
+      strFill(&state, bytes, needle_length, letters);
+    }
+    const str_t view = strMake(haystack, length);
+    same &= strFind(view, wanted) == strReferenceFind(view, wanted);
+    if (needle_length)
+      same &= strFindByte(view, wanted.data[0]) ==
+              strReferenceFind(view, strMake(wanted.data, 1));
+  }
+  expectTrue(same, "matches the byte by byte reference");
+}
+
+int main(void) {
+  suite(strComparisons);
+  suite(strSearches);
+
+  return report();
+}
+
+#endif
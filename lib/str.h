@@ -0,0 +1,290 @@
+// Str (v0.0.1)
+// ---
+//
+// A string view: a pointer and a length, so the length is computed once
+// instead of by every strlen, and comparisons can reject strings of
+// different lengths before reading them. Views don't own their bytes and
+// don't need to be NUL-terminated.
+//
+// Equality, comparison and searches work on 16 bytes at a time with SSE2
+// when the compiler targets it, and byte by byte otherwise. Case-insensitive
+// functions only fold ASCII letters.
+//
+// ```c
+// str_t name = strFrom("Tenant-42");
+// str_t prefix = STR("tenant");
+//
+// strEquals(name, prefix);                            // false
+// strEqualsIgnoreCase(strSlice(name, 0, 6), prefix);  // true
+// strCompare(name, prefix);                           // < 0, 'T' < 't'
+// strFindByte(name, '-');                             // returns 6
+// strFind(name, STR("42"));                           // returns 7
+// strFind(name, STR("43"));                           // STR_NOT_FOUND
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include "panic.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#include <emmintrin.h>
+#define STR_SSE2 1
+#endif
+
+#define STR_NOT_FOUND ((size_t)-1)
+
+typedef struct {
+  const char *data;
+  size_t length;
+} str_t;
+
+/**
+ * Make a view of a string literal without calling strlen.
+ * @name STR
+ * @param {const char*} Literal - A string literal
+ * @returns {str_t} The view
+ * @example
+ *   str_t key = STR("tenant");
+ */
+#define STR(Literal) ((str_t){(Literal), sizeof(Literal) - 1})
+
+/**
+ * Make a view of length bytes.
+ * @name strMake
+ * @param {const char*} data - The first byte
+ * @param {size_t} length - Number of bytes
+ * @returns {str_t} The view
+ * @example
+ *   str_t field = strMake(line + start, end - start);
+ */
+static inline str_t strMake(const char *data, size_t length) {
+  str_t result;
+  result.data = data;
+  result.length = length;
+  return result;
+}
+
+/**
+ * Make a view of a NUL-terminated string.
+ * @name strFrom
+ * @param {const char*} string - The string
+ * @returns {str_t} The view, without the NUL
+ * @example
+ *   str_t name = strFrom(argv[1]);
+ */
+static inline str_t strFrom(const char *string) {
+  return strMake(string, strlen(string));
+}
+
+/**
+ * Get the bytes from start up to, not including, end.
+ * @name strSlice
+ * @param {str_t} self - The view
+ * @param {size_t} start - Index of the first byte
+ * @param {size_t} end - Index after the last byte
+ * @returns {str_t} The view of the bytes
+ * @example
+ *   strSlice(STR("tenant"), 1, 3);   // "en"
+ */
+static inline str_t strSlice(str_t self, size_t start, size_t end) {
+  panicdbg(start > end || end > self.length, "str slice out of bounds");
+  return strMake(self.data + start, end - start);
+}
+
+#ifdef STR_SSE2
+static inline __m128i __strLoad(const char *bytes) {
+  return _mm_loadu_si128((const __m128i *)(const void *)bytes);
+}
+
+// Maps ASCII upper case letters to lower case, 16 bytes at a time. Bytes
+// above 0x7f are negative as signed chars so they are never in range.
+static inline __m128i __strLower(__m128i bytes) {
+  const __m128i upper =
+      _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)),
+                    _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+static inline unsigned char __strLowerByte(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 0x20) : c;
+}
+
+// Returns the index of the first byte that differs, or length if none does
+static inline size_t __strMismatch(const char *a, const char *b,
+                                   size_t length) {
+  size_t i = 0;
+#ifdef STR_SSE2
+  for (; i + 16 <= length; i += 16) {
+    const int same =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(__strLoad(a + i), __strLoad(b + i)));
+    if (same != 0xffff)
+      return i + (size_t)__builtin_ctz((unsigned)~same & 0xffffu);
+  }
+#endif
+  while (i < length && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+static inline size_t __strMismatchIgnoreCase(const char *a, const char *b,
+                                             size_t length) {
+  size_t i = 0;
+#ifdef STR_SSE2
+  for (; i + 16 <= length; i += 16) {
+    const int same = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        __strLower(__strLoad(a + i)), __strLower(__strLoad(b + i))));
+    if (same != 0xffff)
+      return i + (size_t)__builtin_ctz((unsigned)~same & 0xffffu);
+  }
+#endif
+  while (i < length && __strLowerByte((unsigned char)a[i]) ==
+                           __strLowerByte((unsigned char)b[i])) {
+    i++;
+  }
+  return i;
+}
+
+/**
+ * Check whether two views hold the same bytes. Views of different lengths
+ * are rejected without reading them.
+ * @name strEquals
+ * @param {str_t} a - The first view
+ * @param {str_t} b - The second view
+ * @returns {int} 1 if they are equal, 0 otherwise
+ * @example
+ *   strEquals(STR("key"), strFrom(input));
+ */
+static inline int strEquals(str_t a, str_t b) {
+  return a.length == b.length &&
+         __strMismatch(a.data, b.data, a.length) == a.length;
+}
+
+/**
+ * Compare two views byte by byte as unsigned chars, like strcmp. A view
+ * sorts before the longer views it is a prefix of.
+ * @name strCompare
+ * @param {str_t} a - The first view
+ * @param {str_t} b - The second view
+ * @returns {int} Negative, zero or positive when a sorts before, equal to or
+ * after b
+ * @example
+ *   strCompare(STR("apple"), STR("banana"));   // < 0
+ */
+static inline int strCompare(str_t a, str_t b) {
+  const size_t length = a.length < b.length ? a.length : b.length;
+  const size_t i = __strMismatch(a.data, b.data, length);
+  if (i < length)
+    return (int)(unsigned char)a.data[i] - (int)(unsigned char)b.data[i];
+  return (a.length > b.length) - (a.length < b.length);
+}
+
+/**
+ * Check whether two views are equal ignoring the case of ASCII letters.
+ * @name strEqualsIgnoreCase
+ * @param {str_t} a - The first view
+ * @param {str_t} b - The second view
+ * @returns {int} 1 if they are equal, 0 otherwise
+ * @example
+ *   strEqualsIgnoreCase(STR("Content-Type"), STR("content-type"));  // 1
+ */
+static inline int strEqualsIgnoreCase(str_t a, str_t b) {
+  return a.length == b.length &&
+         __strMismatchIgnoreCase(a.data, b.data, a.length) == a.length;
+}
+
+/**
+ * Compare two views like strCompare, ignoring the case of ASCII letters.
+ * @name strCompareIgnoreCase
+ * @param {str_t} a - The first view
+ * @param {str_t} b - The second view
+ * @returns {int} Negative, zero or positive when a sorts before, equal to or
+ * after b
+ * @example
+ *   strCompareIgnoreCase(STR("ABC"), STR("abd"));   // < 0
+ */
+static inline int strCompareIgnoreCase(str_t a, str_t b) {
+  const size_t length = a.length < b.length ? a.length : b.length;
+  const size_t i = __strMismatchIgnoreCase(a.data, b.data, length);
+  if (i < length)
+    return (int)__strLowerByte((unsigned char)a.data[i]) -
+           (int)__strLowerByte((unsigned char)b.data[i]);
+  return (a.length > b.length) - (a.length < b.length);
+}
+
+/**
+ * Find the first occurrence of a byte.
+ * @name strFindByte
+ * @param {str_t} self - The view to search
+ * @param {char} byte - The byte to find
+ * @returns {size_t} Its index, or STR_NOT_FOUND
+ * @example
+ *   size_t separator = strFindByte(line, '=');
+ */
+static inline size_t strFindByte(str_t self, char byte) {
+  size_t i = 0;
+#ifdef STR_SSE2
+  const __m128i wanted = _mm_set1_epi8(byte);
+  for (; i + 16 <= self.length; i += 16) {
+    const int found = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(__strLoad(self.data + i), wanted));
+    if (found)
+      return i + (size_t)__builtin_ctz((unsigned)found);
+  }
+#endif
+  for (; i < self.length; i++) {
+    if (self.data[i] == byte)
+      return i;
+  }
+  return STR_NOT_FOUND;
+}
+
+/**
+ * Find the first occurrence of a substring. With SSE2, 16 positions are
+ * filtered at once by their first and last bytes before comparing the rest.
+ * @name strFind
+ * @param {str_t} self - The view to search
+ * @param {str_t} needle - The bytes to find
+ * @returns {size_t} The index where they start, or STR_NOT_FOUND. An empty
+ * needle is found at 0.
+ * @example
+ *   size_t at = strFind(header, STR("charset="));
+ */
+static inline size_t strFind(str_t self, str_t needle) {
+  if (needle.length == 0)
+    return 0;
+  if (needle.length > self.length)
+    return STR_NOT_FOUND;
+  if (needle.length == 1)
+    return strFindByte(self, needle.data[0]);
+
+  const size_t last = needle.length - 1;
+  const size_t end = self.length - last; // positions where needle can start
+  size_t i = 0;
+#ifdef STR_SSE2
+  const __m128i first_byte = _mm_set1_epi8(needle.data[0]);
+  const __m128i last_byte = _mm_set1_epi8(needle.data[last]);
+  for (; i + 16 <= end; i += 16) {
+    unsigned candidates = (unsigned)_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(__strLoad(self.data + i), first_byte),
+        _mm_cmpeq_epi8(__strLoad(self.data + i + last), last_byte)));
+    while (candidates) {
+      const size_t at = i + (size_t)__builtin_ctz(candidates);
+      if (memcmp(self.data + at + 1, needle.data + 1, last - 1) == 0)
+        return at;
+      candidates &= candidates - 1;
+    }
+  }
+#endif
+  for (; i < end; i++) {
+    if (self.data[i] == needle.data[0] &&
+        self.data[i + last] == needle.data[last] &&
+        memcmp(self.data + i + 1, needle.data + 1, last - 1) == 0)
+      return i;
+  }
+  return STR_NOT_FOUND;
+}
@@ -0,0 +1,561 @@
+#include "strbuf.h"
+#include "alloc.h"
+#include "panic.h"
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define STRBUF_IOV 64 // buffers passed to one writev call
+
+static const char strbufDigits[] = "00010203040506070809"
+                                   "10111213141516171819"
+                                   "20212223242526272829"
+                                   "30313233343536373839"
+                                   "40414243444546474849"
+                                   "50515253545556575859"
+                                   "60616263646566676869"
+                                   "70717273747576777879"
+                                   "80818283848586878889"
+                                   "90919293949596979899";
+
+static const uint64_t strbufPowers[] = {1ULL,
+                                        10ULL,
+                                        100ULL,
+                                        1000ULL,
+                                        10000ULL,
+                                        100000ULL,
+                                        1000000ULL,
+                                        10000000ULL,
+                                        100000000ULL,
+                                        1000000000ULL,
+                                        10000000000ULL,
+                                        100000000000ULL,
+                                        1000000000000ULL,
+                                        10000000000000ULL,
+                                        100000000000000ULL,
+                                        1000000000000000ULL,
+                                        10000000000000000ULL,
+                                        100000000000000000ULL};
+
+void strbufInit(strbuf_t *self) {
+  panicif(!self, "strbuf cannot be null");
+  self->data = self->inline_data;
+  self->length = 0;
+  self->capacity = STRBUF_INLINE;
+  self->data[0] = '\0';
+}
+
+void strbufDeinit(strbuf_t *self) {
+  panicif(!self, "strbuf cannot be null");
+  if (self->data != self->inline_data) {
+    deallocate(&self->data);
+  }
+  strbufInit(self);
+}
+
+strbuf_result_t strbufReserve(strbuf_t *self, size_t extra) {
+  panicif(!self, "strbuf cannot be null");
+  if (extra < self->capacity - self->length)
+    return STRBUF_RESULT_OK;
+  if (extra > (size_t)-1 / 2 - self->length)
+    return STRBUF_ERROR_ALLOCATION;
+
+  const size_t needed = self->length + extra + 1;
+  size_t capacity = self->capacity * 2;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+
+  char *data;
+  if (self->data == self->inline_data) {
+    data = (char *)allocateUninit(capacity);
+    if (data)
+      memcpy(data, self->data, self->length + 1);
+  } else {
+    data = (char *)reallocate((void **)&self->data, capacity);
+  }
+  if (!data)
+    return STRBUF_ERROR_ALLOCATION;
+
+  self->data = data;
+  self->capacity = capacity;
+  return STRBUF_RESULT_OK;
+}
+
+strbuf_result_t strbufAppend(strbuf_t *self, const char *bytes,
+                             size_t length) {
+  if (strbufReserve(self, length) != STRBUF_RESULT_OK)
+    return STRBUF_ERROR_ALLOCATION;
+
+  if (length > 0)
+    memcpy(self->data + self->length, bytes, length);
+  self->length += length;
+  self->data[self->length] = '\0';
+  return STRBUF_RESULT_OK;
+}
+
+strbuf_result_t strbufAppendString(strbuf_t *self, const char *string) {
+  return strbufAppend(self, string, strlen(string));
+}
+
+strbuf_result_t strbufAppendChar(strbuf_t *self, char c) {
+  if (strbufReserve(self, 1) != STRBUF_RESULT_OK)
+    return STRBUF_ERROR_ALLOCATION;
+
+  self->data[self->length++] = c;
+  self->data[self->length] = '\0';
+  return STRBUF_RESULT_OK;
+}
+
+strbuf_result_t strbufAppendMany(strbuf_t *self, const strbuf_piece_t *pieces,
+                                 size_t count) {
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (pieces[i].length > (size_t)-1 - total)
+      return STRBUF_ERROR_ALLOCATION;
+    total += pieces[i].length;
+  }
+  if (strbufReserve(self, total) != STRBUF_RESULT_OK)
+    return STRBUF_ERROR_ALLOCATION;
+
+  char *end = self->data + self->length;
+  for (size_t i = 0; i < count; i++) {
+    if (pieces[i].length > 0)
+      memcpy(end, pieces[i].data, pieces[i].length);
+    end += pieces[i].length;
+  }
+  self->length += total;
+  self->data[self->length] = '\0';
+  return STRBUF_RESULT_OK;
+}
+
+// Writes the digits of value ending right before end, two at a time
+static char *strbufFormatUint(char *end, uint64_t value) {
+  while (value >= 100) {
+    const size_t pair = (size_t)(value % 100) * 2;
+    value /= 100;
+    *--end = strbufDigits[pair + 1];
+    *--end = strbufDigits[pair];
+  }
+  if (value >= 10) {
+    const size_t pair = (size_t)value * 2;
+    *--end = strbufDigits[pair + 1];
+    *--end = strbufDigits[pair];
+  } else {
+    *--end = (char)('0' + value);
+  }
+  return end;
+}
+
+strbuf_result_t strbufAppendUint(strbuf_t *self, uint64_t value) {
+  char digits[20];
+  char *end = digits + sizeof(digits);
+  char *start = strbufFormatUint(end, value);
+  return strbufAppend(self, start, (size_t)(end - start));
+}
+
+strbuf_result_t strbufAppendInt(strbuf_t *self, int64_t value) {
+  char digits[21];
+  char *end = digits + sizeof(digits);
+  // Negate in unsigned arithmetic so INT64_MIN doesn't overflow
+  const uint64_t magnitude =
+      value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  char *start = strbufFormatUint(end, magnitude);
+  if (value < 0)
+    *--start = '-';
+  return strbufAppend(self, start, (size_t)(end - start));
+}
+
+// Splits value into two halves of 26 bits, so their products are exact
+static void strbufSplit(double value, double *high, double *low) {
+  const double scaled = value * 134217729.0; // 2^27 + 1
+  *high = scaled - (scaled - value);
+  *low = value - *high;
+}
+
+// Rounds magnitude * power, whose rounded product is scaled, to the nearest
+// integer with ties to even, as printf does. Dekker's two-product gives the
+// error of scaled exactly, so values near a half round the right way.
+static uint64_t strbufRound(double magnitude, double power, double scaled) {
+  double magnitude_high, magnitude_low, power_high, power_low;
+  strbufSplit(magnitude, &magnitude_high, &magnitude_low);
+  strbufSplit(power, &power_high, &power_low);
+  const double error = ((magnitude_high * power_high - scaled) +
+                        magnitude_high * power_low +
+                        magnitude_low * power_high) +
+                       magnitude_low * power_low;
+
+  // Below 2^53 the fraction and its distance to a half are exact. Once > 0
+  // has failed, >= 0 only holds for an exact 0.
+  uint64_t whole = (uint64_t)scaled;
+  const double half = (scaled - (double)whole) - 0.5;
+  if (half > 0 || (half >= 0 && (error > 0 || (error >= 0 && whole & 1))))
+    whole++;
+  return whole;
+}
+
+strbuf_result_t strbufAppendDouble(strbuf_t *self, double value,
+                                   int precision) {
+  if (precision < 0)
+    precision = 0;
+
+  const double magnitude = signbit(value) ? -value : value;
+  const double power = precision <= 17 ? (double)strbufPowers[precision] : 0;
+  const double scaled = magnitude * power;
+  // Past 2^53 the scaled value is no longer exact, leave those to printf, as
+  // well as platforms computing doubles with more precision
+  if (precision > 17 || !(scaled < 9007199254740992.0) ||
+      FLT_EVAL_METHOD != 0) {
+    return strbufAppendFormat(self, "%.*f", precision, value);
+  }
+
+  const uint64_t rounded = strbufRound(magnitude, power, scaled);
+  const uint64_t divisor = strbufPowers[precision];
+
+  char digits[40];
+  char *end = digits + sizeof(digits);
+  char *start = end;
+  if (precision > 0) {
+    char *fraction = strbufFormatUint(end, rounded % divisor);
+    while (end - fraction < precision) {
+      *--fraction = '0';
+    }
+    start = fraction;
+    *--start = '.';
+  }
+  start = strbufFormatUint(start, rounded / divisor);
+  if (signbit(value))
+    *--start = '-';
+  return strbufAppend(self, start, (size_t)(end - start));
+}
+
+strbuf_result_t strbufAppendFormat(strbuf_t *self, const char *format, ...) {
+  panicif(!self, "strbuf cannot be null");
+  va_list arguments;
+  va_list retry;
+  va_start(arguments, format);
+  va_copy(retry, arguments);
+
+  // Try the space already there first, most formats fit
+  const size_t available = self->capacity - self->length;
+  const int written =
+      vsnprintf(self->data + self->length, available, format, arguments);
+  va_end(arguments);
+  if (written < 0) {
+    self->data[self->length] = '\0';
+    va_end(retry);
+    return STRBUF_ERROR_IO;
+  }
+
+  if ((size_t)written >= available) {
+    if (strbufReserve(self, (size_t)written) != STRBUF_RESULT_OK) {
+      self->data[self->length] = '\0';
+      va_end(retry);
+      return STRBUF_ERROR_ALLOCATION;
+    }
+    vsnprintf(self->data + self->length, self->capacity - self->length, format,
+              retry);
+  }
+  va_end(retry);
+  self->length += (size_t)written;
+  return STRBUF_RESULT_OK;
+}
+
+const char *strbufString(const strbuf_t *self) {
+  panicif(!self, "strbuf cannot be null");
+  return self->data;
+}
+
+void strbufClear(strbuf_t *self) {
+  panicif(!self, "strbuf cannot be null");
+  self->length = 0;
+  self->data[0] = '\0';
+}
+
+char *strbufDetach(strbuf_t *self, size_t *length) {
+  panicif(!self, "strbuf cannot be null");
+  char *string;
+  if (self->data == self->inline_data) {
+    string = (char *)allocateUninit(self->length + 1);
+    if (!string)
+      return NULL;
+    memcpy(string, self->data, self->length + 1);
+  } else {
+    string = self->data;
+  }
+
+  if (length)
+    *length = self->length;
+  strbufInit(self);
+  return string;
+}
+
+strbuf_result_t strbufWrite(strbuf_t *self, int fd) {
+  panicif(!self, "strbuf cannot be null");
+  size_t written = 0;
+  while (written < self->length) {
+    const ssize_t result =
+        write(fd, self->data + written, self->length - written);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      return STRBUF_ERROR_IO;
+    }
+    written += (size_t)result;
+  }
+
+  strbufClear(self);
+  return STRBUF_RESULT_OK;
+}
+
+strbuf_result_t strbufWriteMany(strbuf_t **buffers, size_t count, int fd) {
+  panicif(!buffers && count > 0, "buffers cannot be null");
+  struct iovec parts[STRBUF_IOV];
+  size_t index = 0;  // first buffer not fully written
+  size_t offset = 0; // bytes of it already written
+
+  while (index < count) {
+    int used = 0;
+    for (size_t i = index; i < count && used < STRBUF_IOV; i++) {
+      const size_t skip = i == index ? offset : 0;
+      if (buffers[i]->length == skip)
+        continue;
+      parts[used].iov_base = buffers[i]->data + skip;
+      parts[used].iov_len = buffers[i]->length - skip;
+      used++;
+    }
+    if (used == 0)
+      break;
+
+    ssize_t result = writev(fd, parts, used);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      return STRBUF_ERROR_IO;
+    }
+
+    // Advance past whatever the kernel took, possibly part of a buffer
+    size_t remaining = (size_t)result;
+    while (index < count && remaining >= buffers[index]->length - offset) {
+      remaining -= buffers[index]->length - offset;
+      offset = 0;
+      index++;
+    }
+    offset += remaining;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    strbufClear(buffers[i]);
+  }
+  return STRBUF_RESULT_OK;
+}
+
+#ifdef STRBUF_C_TEST
+
+#include "test.h"
+
+void strbufAppends(void) {
+  strbuf_t line;
+  strbufInit(&line);
+  expectEqls(strbufString(&line), "", 1, "starts empty");
+
+  strbufAppendString(&line, "tenant");
+  strbufAppendChar(&line, '=');
+  strbufAppend(&line, "42xyz", 2);
+  expectEqls(strbufString(&line), "tenant=42", 16, "appends bytes");
+  expectEqllu(line.length, 9, "tracks the length");
+  expectTrue(line.data == line.inline_data, "keeps short strings inline");
+
+  test("growth");
+  for (int i = 0; i < 1000; i++) {
+    strbufAppendChar(&line, (char)('a' + i % 26));
+  }
+  expectEqllu(line.length, 1009, "keeps every byte");
+  expectTrue(line.data != line.inline_data, "moves long strings to the heap");
+  expectEqls(strbufString(&line), "tenant=42abc", 12, "keeps the inline bytes");
+  expectEqli(line.data[line.length], '\0', "stays NUL-terminated");
+  const size_t capacity = line.capacity;
+  strbufClear(&line);
+  expectEqllu(line.capacity, capacity, "clear keeps the memory");
+
+  test("many");
+  strbuf_piece_t pieces[] = {{"key", 3}, {"", 0}, {"=", 1}, {"value", 5}};
+  strbufAppendMany(&line, pieces, 4);
+  expectEqls(strbufString(&line), "key=value", 16, "appends pieces in order");
+
+  test("format");
+  strbufAppendFormat(&line, " %04x", 255);
+  expectEqls(strbufString(&line), "key=value 00ff", 32, "appends format");
+  strbufClear(&line);
+  strbufAppendFormat(&line, "%0300d", 7);
+  expectEqllu(line.length, 300, "grows for long formats");
+  expectEqli(line.data[299], '7', "formats into the grown buffer");
+
+  test("detach");
+  size_t length = 0;
+  char *string = strbufDetach(&line, &length);
+  expectEqllu(length, 300, "returns the length");
+  expectEqli(string[299], '7', "returns the contents");
+  expectEqllu(line.length, 0, "leaves the buffer empty");
+  deallocate(&string);
+  strbufAppendString(&line, "short");
+  string = strbufDetach(&line, NULL);
+  expectEqls(string, "short", 8, "copies inline contents");
+  deallocate(&string);
+
+  strbufDeinit(&line);
+}
+
+static uint64_t strbufRandom(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// Doubles of any magnitude, and doubles within a few ulps of a decimal half
+static double strbufRandomDouble(uint64_t *state, int precision) {
+  const uint64_t bits = strbufRandom(state);
+  double value;
+  if (bits & 1) {
+    const double mantissa = (double)(bits >> 11) / 9007199254740992.0;
+    value = ldexp(mantissa, (int)(strbufRandom(state) % 80) - 50);
+  } else {
+    const uint64_t digits = strbufRandom(state) % 10000000;
+    value = ((double)digits + 0.5) / (double)strbufPowers[precision];
+    uint64_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+    raw += (bits >> 1) % 7 - 3;
+    memcpy(&value, &raw, sizeof(value));
+  }
+  return bits & 2 ? -value : value;
+}
+
+void strbufNumbers(void) {
+  strbuf_t line;
+  strbufInit(&line);
+  char expected[64];
+
+  const int64_t ints[] = {0,         -1,        9,
+                          10,        -99,       100,
+                          12345,     -987654321, 1000000,
+                          INT64_MAX, INT64_MIN, 1234567890123456789LL};
+  int same = 1;
+  for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+    strbufClear(&line);
+    strbufAppendInt(&line, ints[i]);
+    snprintf(expected, sizeof(expected), "%lld", (long long)ints[i]);
+    same &= strcmp(strbufString(&line), expected) == 0;
+  }
+  expectTrue(same, "formats integers like printf");
+
+  strbufClear(&line);
+  strbufAppendUint(&line, UINT64_MAX);
+  expectEqls(strbufString(&line), "18446744073709551615", 32,
+             "formats the largest unsigned integer");
+
+  test("doubles");
+  uint64_t state = 42;
+  size_t mismatches = 0;
+  double first = 0;
+  int first_precision = 0;
+  for (int precision = 0; precision <= 17; precision++) {
+    for (int i = 0; i < 20000; i++) {
+      const double value = strbufRandomDouble(&state, precision);
+      strbufClear(&line);
+      strbufAppendDouble(&line, value, precision);
+      snprintf(expected, sizeof(expected), "%.*f", precision, value);
+      if (strcmp(strbufString(&line), expected) != 0 && !mismatches++) {
+        first = value;
+        first_precision = precision;
+      }
+    }
+  }
+  expectf(mismatches == 0, "formats random doubles like printf",
+          "%zu mismatches, first %.17g at precision %d", mismatches, first,
+          first_precision);
+
+  const double halves[] = {0.5, 1.5, 2.5, -2.5, 0.125, 0.375};
+  const char *rounded[] = {"0", "2", "2", "-2", "0.12", "0.38"};
+  same = 1;
+  for (size_t i = 0; i < sizeof(halves) / sizeof(halves[0]); i++) {
+    strbufClear(&line);
+    strbufAppendDouble(&line, halves[i], i < 4 ? 0 : 2);
+    same &= strcmp(strbufString(&line), rounded[i]) == 0;
+  }
+  expectTrue(same, "rounds exact halves to even");
+  strbufClear(&line);
+  strbufAppendDouble(&line, 0.67763499999999999, 5);
+  expectEqls(strbufString(&line), "0.67763", 16,
+             "rounds values just below a half down");
+
+  strbufClear(&line);
+  strbufAppendDouble(&line, 1e300, 2);
+  char huge[400];
+  snprintf(huge, sizeof(huge), "%.2f", 1e300);
+  expectEqls(strbufString(&line), huge, sizeof(huge),
+             "falls back for huge values");
+  strbufClear(&line);
+  strbufAppendDouble(&line, INFINITY, 2);
+  expectEqls(strbufString(&line), "inf", 8, "formats infinity");
+
+  strbufDeinit(&line);
+}
+
+void strbufWrites(void) {
+  int fds[2];
+  panicif(pipe(fds) != 0, "cannot create pipe");
+  char received[4096];
+
+  strbuf_t line;
+  strbufInit(&line);
+  strbufAppendString(&line, "hello\n");
+  expectTrue(strbufWrite(&line, fds[1]) == STRBUF_RESULT_OK, "writes");
+  expectEqllu(line.length, 0, "clears after writing");
+  ssize_t got = read(fds[0], received, sizeof(received));
+  expectEqllu((size_t)got, 6, "writes every byte");
+  expectTrue(memcmp(received, "hello\n", 6) == 0, "writes the contents");
+
+  test("writev");
+  strbuf_t other;
+  strbufInit(&other);
+  strbuf_t empty;
+  strbufInit(&empty);
+  strbufAppendString(&line, "key=");
+  for (int i = 0; i < 100; i++) {
+    strbufAppendUint(&other, (uint64_t)i % 10);
+  }
+  strbuf_t *buffers[] = {&line, &empty, &other};
+  expectTrue(strbufWriteMany(buffers, 3, fds[1]) == STRBUF_RESULT_OK,
+             "writes many");
+  got = read(fds[0], received, sizeof(received));
+  expectEqllu((size_t)got, 104, "writes every buffer");
+  expectTrue(memcmp(received, "key=0123", 8) == 0, "writes them in order");
+  expectEqllu(other.length, 0, "clears the buffers");
+
+  test("errors");
+  strbufAppendString(&line, "lost");
+  expectTrue(strbufWrite(&line, -1) == STRBUF_ERROR_IO, "reports failures");
+  expectEqllu(line.length, 4, "keeps the contents on failure");
+
+  close(fds[0]);
+  close(fds[1]);
+  strbufDeinit(&line);
+  strbufDeinit(&other);
+  strbufDeinit(&empty);
+}
+
+int main(void) {
+  suite(strbufAppends);
+  suite(strbufNumbers);
+  suite(strbufWrites);
+
+  return report();
+}
+
+#endif
@@ -0,0 +1,237 @@
+// Strbuf (v0.0.2)
+// ---
+//
+// A growable string builder. Short strings live inline in the struct, longer
+// ones move to the heap and the capacity doubles as they grow, so appending
+// is amortised constant time. Integers and doubles are formatted without
+// going through printf, and finished buffers are handed to write or writev
+// without being copied. The contents are always NUL-terminated.
+//
+// Buffers point into themselves while they are short, so they must not be
+// copied by value; pass pointers around instead.
+//
+// ```c
+// strbuf_t line;
+// strbufInit(&line);
+//
+// strbufAppendString(&line, "tenant=");
+// strbufAppendUint(&line, 42);
+// strbufAppendChar(&line, ' ');
+// strbufAppendDouble(&line, 0.25, 3);   // appends 0.250
+// strbufString(&line);                  // returns "tenant=42 0.250"
+//
+// strbufWrite(&line, 1);                // writes to stdout and clears
+// strbufDeinit(&line);
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRBUF_INLINE 64 // bytes stored inline, including the NUL
+
+typedef enum {
+  STRBUF_RESULT_OK = 0,
+  STRBUF_ERROR_ALLOCATION,
+  STRBUF_ERROR_IO
+} strbuf_result_t;
+
+typedef struct {
+  char *data;      // NUL-terminated
+  size_t length;   // bytes before the NUL
+  size_t capacity; // bytes available in data, including the NUL
+  char inline_data[STRBUF_INLINE];
+} strbuf_t;
+
+typedef struct {
+  const char *data;
+  size_t length;
+} strbuf_piece_t;
+
+/**
+ * Initialize an empty buffer using its inline storage.
+ * @name strbufInit
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @example
+ *   strbuf_t line;
+ *   strbufInit(&line);
+ */
+void strbufInit(strbuf_t *self);
+
+/**
+ * Release the heap memory of the buffer and leave it empty.
+ * @name strbufDeinit
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @example
+ *   strbufDeinit(&line);
+ */
+void strbufDeinit(strbuf_t *self);
+
+/**
+ * Make room for at least extra more bytes without growing again.
+ * @name strbufReserve
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {size_t} extra - Number of bytes about to be appended
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufReserve(&line, 4096);
+ */
+strbuf_result_t strbufReserve(strbuf_t *self, size_t extra);
+
+/**
+ * Append length bytes.
+ * @name strbufAppend
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {const char*} bytes - The bytes to append
+ * @param {size_t} length - Number of bytes
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppend(&line, field, field_length);
+ */
+strbuf_result_t strbufAppend(strbuf_t *self, const char *bytes,
+                             size_t length);
+
+/**
+ * Append a NUL-terminated string.
+ * @name strbufAppendString
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {const char*} string - The string to append
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppendString(&line, "tenant=");
+ */
+strbuf_result_t strbufAppendString(strbuf_t *self, const char *string);
+
+/**
+ * Append a single character.
+ * @name strbufAppendChar
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {char} c - The character to append
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppendChar(&line, '\n');
+ */
+strbuf_result_t strbufAppendChar(strbuf_t *self, char c);
+
+/**
+ * Append several pieces, growing the buffer at most once.
+ * @name strbufAppendMany
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {const strbuf_piece_t*} pieces - The pieces to append in order
+ * @param {size_t} count - Number of pieces
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbuf_piece_t pieces[] = {{key, key_length}, {"=", 1}, {value, 5}};
+ *   strbufAppendMany(&line, pieces, 3);
+ */
+strbuf_result_t strbufAppendMany(strbuf_t *self, const strbuf_piece_t *pieces,
+                                 size_t count);
+
+/**
+ * Append an unsigned integer in decimal.
+ * @name strbufAppendUint
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {uint64_t} value - The value to append
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppendUint(&line, 42);   // appends 42
+ */
+strbuf_result_t strbufAppendUint(strbuf_t *self, uint64_t value);
+
+/**
+ * Append a signed integer in decimal.
+ * @name strbufAppendInt
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {int64_t} value - The value to append
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppendInt(&line, -7);    // appends -7
+ */
+strbuf_result_t strbufAppendInt(strbuf_t *self, int64_t value);
+
+/**
+ * Append a double with a fixed number of decimals, like "%.*f". The exact
+ * binary value is rounded to nearest, with exact halves going to the even
+ * digit, so the text matches printf. Values too large to format exactly
+ * fall back to snprintf.
+ * @name strbufAppendDouble
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {double} value - The value to append
+ * @param {int} precision - Number of decimals, from 0 to 17
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppendDouble(&line, 3.14159, 2);   // appends 3.14
+ */
+strbuf_result_t strbufAppendDouble(strbuf_t *self, double value,
+                                   int precision);
+
+/**
+ * Append formatted text like printf. Prefer the typed appends on hot paths.
+ * @name strbufAppendFormat
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {const char*} format - The printf format
+ * @returns {strbuf_result_t} Result of the operation
+ * @example
+ *   strbufAppendFormat(&line, "%08x", flags);
+ */
+strbuf_result_t strbufAppendFormat(strbuf_t *self, const char *format, ...);
+
+/**
+ * Get the contents as a NUL-terminated string, valid until the next change.
+ * @name strbufString
+ * @param {const strbuf_t*} self - Pointer to the buffer
+ * @returns {const char*} The contents
+ * @example
+ *   puts(strbufString(&line));
+ */
+const char *strbufString(const strbuf_t *self);
+
+/**
+ * Empty the buffer, keeping its memory.
+ * @name strbufClear
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @example
+ *   strbufClear(&line);
+ */
+void strbufClear(strbuf_t *self);
+
+/**
+ * Take the contents as a heap string to be released with deallocate. The
+ * buffer is left empty.
+ * @name strbufDetach
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {size_t*} length - Set to the length of the string, may be NULL
+ * @returns {char*} The string, or NULL if memory runs out
+ * @example
+ *   char* message = strbufDetach(&line, NULL);
+ *   deallocate(&message);
+ */
+char *strbufDetach(strbuf_t *self, size_t *length);
+
+/**
+ * Write the whole contents to a file descriptor, then clear the buffer.
+ * @name strbufWrite
+ * @param {strbuf_t*} self - Pointer to the buffer
+ * @param {int} fd - The file descriptor
+ * @returns {strbuf_result_t} STRBUF_ERROR_IO if writing fails, the buffer is
+ * left untouched then
+ * @example
+ *   strbufWrite(&line, STDOUT_FILENO);
+ */
+strbuf_result_t strbufWrite(strbuf_t *self, int fd);
+
+/**
+ * Write several buffers in order with writev, then clear them.
+ * @name strbufWriteMany
+ * @param {strbuf_t**} buffers - The buffers to write
+ * @param {size_t} count - Number of buffers
+ * @param {int} fd - The file descriptor
+ * @returns {strbuf_result_t} STRBUF_ERROR_IO if writing fails, the buffers
+ * are left untouched then
+ * @example
+ *   strbuf_t* parts[] = {&header, &body};
+ *   strbufWriteMany(parts, 2, STDOUT_FILENO);
+ */
+strbuf_result_t strbufWriteMany(strbuf_t **buffers, size_t count, int fd);
@@ -1,4 +1,4 @@
-// Test (v1.0.0)
+// Test (v1.3.0)
 // ---
 //
 // ## Getting Started
@@ -6,7 +6,22 @@
 // Compile the test executable returning `report()` to get the number of
 // failed tests as the status code.
 //
-// Define FAILED_ONLY to see only failures.
+// Passing assertions cost a comparison: messages are only formatted when an
+// assertion fails, and passes in a row with the same name print as one line,
+// e.g. "ok - keeps the order (x100000)". Define FAILED_ONLY to see only
+// failures. report prints the assertions, failures and CPU seconds of every
+// suite before the totals.
+//
+// expectComplexity catches accidental quadratic code: it times a function at
+// increasing sizes and fails when the time grows faster than the expected
+// class allows, see TEST_SCALING_SLACK.
+//
+// Define TEST_PARALLEL as a number of workers to fork every suite into its
+// own process, running that many at once. A suite that panics, crashes or
+// runs longer than TEST_TIMEOUT seconds (300 by default) counts as one
+// failure without stopping the others, and the output of each suite is
+// printed in order once it finishes. It needs POSIX, e.g.
+// `make test TEST_FLAGS="-D_DEFAULT_SOURCE -DTEST_PARALLEL=8"`.
 //
 // ```c
 // // example.test.c
@@ -31,10 +46,9 @@
 // #include "../test/test.h"
 //
 // void expectEqlMyType(const MyType* a, const MyType* b, const char* name) {
-//   char msg[256];
-//   snprintf(msg, 256, "Expected %s to equal %s", myStruct_toString(a),
-//   myStruct_toString(b));
-//   expect(myStruct_eql(a, b), name, msg);
+//   // The message is only formatted if the assertion fails
+//   expectf(myStruct_eql(a, b), name, "Expected %s to equal %s",
+//           myStruct_toString(a), myStruct_toString(b));
 // }
 //
 // // define main as above
@@ -44,9 +58,43 @@
 #pragma once
 
 #include <math.h>    // fabs
+#include <stdarg.h>  // va_list
 #include <stdbool.h> // bool
-#include <stdio.h>   // printf, snprintf
+#include <stdio.h>   // printf, vprintf
+#include <stdlib.h>  // qsort, realloc
 #include <string.h>  // strncmp
+#include <time.h>    // clock
+
+#if defined(TEST_PARALLEL) && (defined(__unix__) || defined(__APPLE__))
+#if defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) &&                   \
+    !defined(_DEFAULT_SOURCE) && !defined(_GNU_SOURCE)
+#error "TEST_PARALLEL needs POSIX, define _POSIX_C_SOURCE=200809L"
+#endif
+#include <poll.h>     // poll
+#include <signal.h>   // SIGALRM
+#include <sys/wait.h> // waitpid
+#include <unistd.h>   // fork, pipe
+#if TEST_PARALLEL < 1
+#error "TEST_PARALLEL is the number of workers, at least 1"
+#endif
+#define TEST_FORK 1
+#endif
+
+#ifndef TEST_TIMEOUT
+#define TEST_TIMEOUT 300 // seconds a forked suite may run
+#endif
+#ifndef TEST_SCALING_ROUNDS
+#define TEST_SCALING_ROUNDS 5 // times each size is measured, the fastest wins
+#endif
+#ifndef TEST_SCALING_SECONDS
+#define TEST_SCALING_SECONDS 0.005 // CPU time of one measurement
+#endif
+#ifndef TEST_SCALING_SLACK
+#define TEST_SCALING_SLACK 0.5 // exponent of n allowed above the class
+#endif
+#define TEST_SCALING_SIZES 32 // sizes given to expectComplexity
+#define TEST_SUITES 256 // suites listed by report
+#define TEST_NAME 128   // bytes of a name compared to collapse passes
 
 #define FLOAT_THRESHOOLD 1e-6f
 #define DOUBLE_THRESHOOLD 1e-6f
@@ -54,6 +102,91 @@
 static int total = 0;
 static int failed = 0;
 
+#ifndef FAILED_ONLY
+static char __test_passing[TEST_NAME]; // name of the passes not printed yet
+#endif
+static int __test_passes = 0; // how many of them in a row
+
+typedef struct {
+  const char *name;
+  int total;
+  int failed;
+  double seconds; // CPU time, -1 when the suite didn't finish
+} __test_timing_t;
+
+static __test_timing_t __test_timings[TEST_SUITES];
+static int __test_timing_count = 0;
+
+// Prints the passes collected so far as one line
+static void __testFlush(void) {
+  if (__test_passes == 0)
+    return;
+#ifndef FAILED_ONLY
+  if (__test_passes == 1)
+    printf("   ok  - %s\n", __test_passing);
+  else
+    printf("   ok  - %s (x%d)\n", __test_passing, __test_passes);
+#endif
+  __test_passes = 0;
+}
+
+static void __testPass(const char *name) {
+  total++;
+#ifdef FAILED_ONLY
+  (void)name;
+#else
+  if (__test_passes > 0 && strcmp(name, __test_passing) == 0) {
+    __test_passes++;
+    return;
+  }
+  __testFlush();
+  strncpy(__test_passing, name, TEST_NAME - 1);
+  __test_passing[TEST_NAME - 1] = '\0';
+  __test_passes = 1;
+#endif
+}
+
+static void __testFailV(const char *name, const char *format, va_list args) {
+  __testFlush();
+  total++;
+  failed++;
+  printf("  fail - %s: ", name);
+  vprintf(format, args);
+  printf("\n");
+}
+
+static void __testFail(const char *name, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  __testFailV(name, format, args);
+  va_end(args);
+}
+
+static void __testRecord(const char *name, int suite_total, int suite_failed,
+                         double seconds) {
+  if (__test_timing_count == TEST_SUITES)
+    return;
+  __test_timing_t *timing = &__test_timings[__test_timing_count++];
+  timing->name = name;
+  timing->total = suite_total;
+  timing->failed = suite_failed;
+  timing->seconds = seconds;
+}
+
+// Runs a suite in this process and records its counts and time
+void __testRun(const char *name, void (*fn)(void)) {
+  __testFlush();
+#ifndef FAILED_ONLY
+  printf("\n> %s\n", name);
+#endif
+  const int before_total = total, before_failed = failed;
+  const clock_t start = clock();
+  fn();
+  __testFlush();
+  __testRecord(name, total - before_total, failed - before_failed,
+               (double)(clock() - start) / CLOCKS_PER_SEC);
+}
+
 /**
  * Asserts a condition and prints the result. Use it to implement custom
  * assertions.
@@ -63,13 +196,28 @@ static int failed = 0;
  *   expect(a == 1, "a is one", "Should be true");
  */
 void expect(bool condition, const char *name, const char *message) {
-  total++;
-  if (!condition) {
-    failed++;
-    printf("  fail - %s: %s\n", name, message);
+  if (condition)
+    __testPass(name);
+  else
+    __testFail(name, "%s", message);
+}
+
+/**
+ * Asserts a condition, formatting the message like printf only if it fails.
+ * Use it to implement custom assertions.
+ * @name expectf
+ * @example
+ *   expectf(size == 3, "has three items", "Expected 3 items, got %d", size);
+ */
+void expectf(bool condition, const char *name, const char *format, ...) {
+  if (condition) {
+    __testPass(name);
     return;
   }
-  printf("   ok  - %s\n", name);
+  va_list args;
+  va_start(args, format);
+  __testFailV(name, format, args);
+  va_end(args);
 }
 
 /**
@@ -121,9 +269,10 @@ void expectNull(const void *a, const char *name) {
  *   expectEqli(3, 3, "3 equals 3");
  */
 void expectEqli(const int a, const int b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %d to equal %d", a, b);
-  expect(a == b, name, msg);
+  if (a == b)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %d to equal %d", a, b);
 }
 
 /**
@@ -133,9 +282,10 @@ void expectEqli(const int a, const int b, const char *name) {
  *   expectNeqi(3, 4, "3 does not equal 4");
  */
 void expectNeqi(const int a, const int b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %d not to equal %d", a, b);
-  expect(a != b, name, msg);
+  if (a != b)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %d not to equal %d", a, b);
 }
 
 /**
@@ -145,9 +295,10 @@ void expectNeqi(const int a, const int b, const char *name) {
  *   expectEqlu(3, 3, "3 equals 3");
  */
 void expectEqlu(const unsigned int a, const unsigned int b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %u to equal %u", a, b);
-  expect(a == b, name, msg);
+  if (a == b)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %u to equal %u", a, b);
 }
 
 /**
@@ -157,9 +308,10 @@ void expectEqlu(const unsigned int a, const unsigned int b, const char *name) {
  *   expectNeqlu(3, 4, "3 does not equal 4");
  */
 void expectNeqlu(const unsigned int a, const unsigned int b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %u not to equal %u", a, b);
-  expect(a != b, name, msg);
+  if (a != b)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %u not to equal %u", a, b);
 }
 
 /**
@@ -169,9 +321,10 @@ void expectNeqlu(const unsigned int a, const unsigned int b, const char *name) {
  *   expectEqllu(3, 3, "3 equals 3");
  */
 void expectEqllu(const size_t a, const size_t b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %lu to equal %lu", a, b);
-  expect(a == b, name, msg);
+  if (a == b)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %zu to equal %zu", a, b);
 }
 
 /**
@@ -181,9 +334,10 @@ void expectEqllu(const size_t a, const size_t b, const char *name) {
  *   expectNeqllu(3, 4, "3 does not equal 4");
  */
 void expectNeqllu(const size_t a, const size_t b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %lu not to equal %lu", a, b);
-  expect(a != b, name, msg);
+  if (a != b)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %zu not to equal %zu", a, b);
 }
 
 /**
@@ -193,9 +347,10 @@ void expectNeqllu(const size_t a, const size_t b, const char *name) {
  *   expectEqlf(1.0f, 1.0f, "floats are equal");
  */
 void expectEqlf(const float a, const float b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %f to equal %f", a, b);
-  expect(fabsf(a - b) < FLOAT_THRESHOOLD, name, msg);
+  if (fabsf(a - b) < FLOAT_THRESHOOLD)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %f to equal %f", a, b);
 }
 
 /**
@@ -205,9 +360,10 @@ void expectEqlf(const float a, const float b, const char *name) {
  *   expectNeqf(1.0f, 2.0f, "floats are not equal");
  */
 void expectNeqf(const float a, const float b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %f not to equal %f", a, b);
-  expect(fabsf(a - b) >= FLOAT_THRESHOOLD, name, msg);
+  if (fabsf(a - b) >= FLOAT_THRESHOOLD)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %f not to equal %f", a, b);
 }
 
 /**
@@ -217,9 +373,10 @@ void expectNeqf(const float a, const float b, const char *name) {
  *   expectEqld(1.0, 1.0, "doubles are equal");
  */
 void expectEqld(const double a, const double b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %f to equal %f", a, b);
-  expect(fabs(a - b) < DOUBLE_THRESHOOLD, name, msg);
+  if (fabs(a - b) < DOUBLE_THRESHOOLD)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %f to equal %f", a, b);
 }
 
 /**
@@ -229,9 +386,10 @@ void expectEqld(const double a, const double b, const char *name) {
  *   expectNeqd(1.0, 2.0, "doubles are not equal");
  */
 void expectNeqd(const double a, const double b, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected %f not to equal %f", a, b);
-  expect(fabs(a - b) >= DOUBLE_THRESHOOLD, name, msg);
+  if (fabs(a - b) >= DOUBLE_THRESHOOLD)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %f not to equal %f", a, b);
 }
 
 /**
@@ -242,9 +400,10 @@ void expectNeqd(const double a, const double b, const char *name) {
  */
 void expectEqls(const char *a, const char *b, size_t max_size,
                 const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected '%s' to equal '%s'", a, b);
-  expect(strncmp(a, b, max_size) == 0, name, msg);
+  if (strncmp(a, b, max_size) == 0)
+    __testPass(name);
+  else
+    __testFail(name, "Expected '%s' to equal '%s'", a, b);
 }
 
 /**
@@ -255,9 +414,10 @@ void expectEqls(const char *a, const char *b, size_t max_size,
  */
 void expectNeqs(const char *a, const char *b, size_t max_size,
                 const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected '%s' not to equal '%s'", a, b);
-  expect(strncmp(a, b, max_size) != 0, name, msg);
+  if (strncmp(a, b, max_size) != 0)
+    __testPass(name);
+  else
+    __testFail(name, "Expected '%s' not to equal '%s'", a, b);
 }
 
 /**
@@ -267,10 +427,363 @@ void expectNeqs(const char *a, const char *b, size_t max_size,
  *   expectIncls("foobar", "bar", "strings are included");
  */
 void expectIncls(const char *big, const char *small, const char *name) {
-  char msg[256];
-  snprintf(msg, 256, "Expected '%s' to include '%s'", big, small);
-  expect(strstr(big, small) != NULL, name, msg);
+  if (strstr(big, small) != NULL)
+    __testPass(name);
+  else
+    __testFail(name, "Expected '%s' to include '%s'", big, small);
+}
+
+typedef enum { O_1 = 0, O_LOG_N, O_N, O_N_LOG_N, O_N2 } test_complexity_t;
+
+static clock_t __test_timer;
+
+// Natural logarithm, so that test binaries don't need -lm
+static double __testLog(double x) {
+  const double ln2 = 0.69314718055994531;
+  double result = 0;
+  while (x > 2) {
+    x /= 2;
+    result += ln2;
+  }
+  while (x < 1) {
+    x *= 2;
+    result -= ln2;
+  }
+  // log(x) = 2 atanh((x - 1) / (x + 1)), converging fast for x in [1, 2]
+  const double y = (x - 1) / (x + 1);
+  double term = y, sum = 0;
+  for (int k = 1; k < 40; k += 2) {
+    sum += term / k;
+    term *= y * y;
+  }
+  return result + 2 * sum;
+}
+
+static double __testGrowth(test_complexity_t complexity, double n) {
+  const double log_n = n > 2 ? __testLog(n) : __testLog(2);
+  switch (complexity) {
+  case O_LOG_N:
+    return log_n;
+  case O_N:
+    return n;
+  case O_N_LOG_N:
+    return n * log_n;
+  case O_N2:
+    return n * n;
+  case O_1:
+  default:
+    return 1;
+  }
+}
+
+static const char *__testComplexityName(test_complexity_t complexity) {
+  static const char *names[] = {"O(1)", "O(log n)", "O(n)", "O(n log n)",
+                                "O(n^2)"};
+  return names[complexity];
+}
+
+// Returns the CPU seconds of one call, repeating it for TEST_SCALING_SECONDS
+static double __testMeasure(void (*fn)(size_t n), size_t n) {
+  double ticks = 0;
+  long calls = 0;
+  do {
+    __test_timer = clock();
+    fn(n);
+    ticks += (double)(clock() - __test_timer);
+    calls++;
+  } while (ticks < TEST_SCALING_SECONDS * CLOCKS_PER_SEC);
+  return ticks / CLOCKS_PER_SEC / (double)calls;
+}
+
+static int __testOrder(const void *a, const void *b) {
+  const double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Restarts the clock of expectComplexity and testScaling, so the setup done
+ * so far by the function isn't timed.
+ * @name testResetTimer
+ * @example
+ *   void lookups(size_t n) {
+ *     map_t* map = filledMap(n);
+ *     testResetTimer();
+ *     for (int i = 0; i < 1000; i++) mapGet(map, keys[i % n]);
+ *     mapDestroy(&map);
+ *   }
+ */
+void testResetTimer(void) { __test_timer = clock(); }
+
+/**
+ * Measures how much faster than a complexity class a function's time grows.
+ * Every size is timed TEST_SCALING_ROUNDS times, interleaved with the others
+ * so a noisy moment doesn't hit a single size, and the fastest time is kept.
+ * The result is the median slope between pairs of sizes (Theil-Sen) of
+ * log(time / growth of the class) over log n.
+ * @name testScaling
+ * @param {void(*)(size_t)} fn - Runs the operation at size n, taking at
+ * least microseconds
+ * @param {const size_t*} sizes - Increasing sizes, ending with 0
+ * @param {test_complexity_t} complexity - The class to compare with
+ * @returns {double} The exponent e such that the time grows like the class
+ * times n^e: about 0 when it matches, 1 for n^2 against O(n)
+ * @example
+ *   const size_t sizes[] = {1000, 4000, 16000, 64000, 0};
+ *   printf("%.2f\n", testScaling(sortItems, sizes, O_N_LOG_N));
+ */
+double testScaling(void (*fn)(size_t n), const size_t *sizes,
+                   test_complexity_t complexity) {
+  int count = 0;
+  while (sizes[count] && count < TEST_SCALING_SIZES) {
+    count++;
+  }
+
+  double fastest[TEST_SCALING_SIZES];
+  for (int round = 0; round < TEST_SCALING_ROUNDS; round++) {
+    for (int i = 0; i < count; i++) {
+      const double seconds = __testMeasure(fn, sizes[i]);
+      if (round == 0 || seconds < fastest[i])
+        fastest[i] = seconds;
+    }
+  }
+
+  static double slopes[TEST_SCALING_SIZES * (TEST_SCALING_SIZES - 1) / 2];
+  int pairs = 0;
+  for (int i = 0; i < count; i++) {
+    for (int j = i + 1; j < count; j++) {
+      if (sizes[j] == sizes[i])
+        continue;
+      // Times below a clock tick are rounded up to keep the logarithm finite
+      const double a = (fastest[i] > 1e-9 ? fastest[i] : 1e-9) /
+                       __testGrowth(complexity, (double)sizes[i]);
+      const double b = (fastest[j] > 1e-9 ? fastest[j] : 1e-9) /
+                       __testGrowth(complexity, (double)sizes[j]);
+      slopes[pairs++] = (__testLog(b) - __testLog(a)) /
+                        (__testLog((double)sizes[j]) -
+                         __testLog((double)sizes[i]));
+    }
+  }
+  if (pairs == 0)
+    return 0;
+  qsort(slopes, (size_t)pairs, sizeof(double), __testOrder);
+  return pairs % 2 ? slopes[pairs / 2]
+                   : (slopes[pairs / 2 - 1] + slopes[pairs / 2]) / 2;
+}
+
+/**
+ * Asserts that the time of a function grows no faster than a complexity
+ * class, within n^TEST_SCALING_SLACK, as measured by testScaling. Log
+ * factors are within that slack, so it tells apart O(1), O(n) and O(n^2)
+ * rather than O(n) and O(n log n).
+ * @name expectComplexity
+ * @example
+ *   const size_t sizes[] = {1000, 4000, 16000, 64000, 0};
+ *   expectComplexity(lookups, sizes, O_1, "looks up in constant time");
+ */
+void expectComplexity(void (*fn)(size_t n), const size_t *sizes,
+                      test_complexity_t complexity, const char *name) {
+  const double excess = testScaling(fn, sizes, complexity);
+  if (excess <= TEST_SCALING_SLACK)
+    __testPass(name);
+  else
+    __testFail(name, "Expected %s, the time grew like %s times n^%.2f",
+               __testComplexityName(complexity),
+               __testComplexityName(complexity), excess);
+}
+
+#ifdef TEST_FORK
+typedef struct {
+  const char *name;
+  pid_t pid;
+  int output;  // read end of the suite's stdout and stderr
+  int results; // read end of its assertion counts
+  int done;
+  __test_timing_t timing;
+  char *text; // output collected so far
+  size_t length;
+  size_t capacity;
+} __test_suite_t;
+
+static __test_suite_t *__test_suites = NULL;
+static int __test_suite_count = 0;
+static int __test_running = 0;
+static int __test_printed = 0; // suites printed so far, in order
+static pid_t __test_child = 0;  // process of the forked suite, in the child
+
+// Prints the passes not printed yet when a forked suite crashes or times
+// out, then dies of the same signal. Processes the suite forks itself keep
+// quiet, as they share its output.
+static void __testCrash(int number) {
+  if (getpid() == __test_child) {
+    __testFlush();
+    fflush(stdout);
+  }
+  signal(number, SIG_DFL);
+  raise(number);
+}
+
+// Prints the passes not printed yet when a forked suite calls exit
+static void __testExit(void) {
+  if (getpid() == __test_child)
+    __testFlush();
+}
+
+static void __testAppend(__test_suite_t *suite, const char *data,
+                         size_t length) {
+  if (suite->length + length > suite->capacity) {
+    size_t capacity = suite->capacity ? suite->capacity : 4096;
+    while (capacity < suite->length + length) {
+      capacity *= 2;
+    }
+    char *text = (char *)realloc(suite->text, capacity);
+    if (!text)
+      return; // keeps the counts, loses the output
+    suite->text = text;
+    suite->capacity = capacity;
+  }
+  memcpy(suite->text + suite->length, data, length);
+  suite->length += length;
+}
+
+// Reaps a suite whose output ended and merges its counts
+static void __testFinish(__test_suite_t *suite) {
+  int status = 0;
+  waitpid(suite->pid, &status, 0);
+  const ssize_t bytes =
+      read(suite->results, &suite->timing, sizeof(suite->timing));
+  close(suite->output);
+  close(suite->results);
+
+  char message[256];
+  if (bytes == (ssize_t)sizeof(suite->timing)) {
+    total += suite->timing.total;
+    failed += suite->timing.failed;
+    message[0] = '\0';
+  } else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+    snprintf(message, sizeof(message),
+             "  fail - %s: timed out after %d seconds\n", suite->name,
+             TEST_TIMEOUT);
+  } else if (WIFSIGNALED(status)) {
+    snprintf(message, sizeof(message), "  fail - %s: killed by signal %d\n",
+             suite->name, WTERMSIG(status));
+  } else {
+    snprintf(message, sizeof(message), "  fail - %s: exited with status %d\n",
+             suite->name, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+  }
+  if (message[0]) {
+    total++;
+    failed++;
+    suite->timing.total = suite->timing.failed = 1;
+    suite->timing.seconds = -1;
+    __testAppend(suite, message, strlen(message));
+  }
+  suite->done = 1;
+  __test_running--;
+
+  // Print the finished suites that are next in order
+  while (__test_printed < __test_suite_count &&
+         __test_suites[__test_printed].done) {
+    __test_suite_t *next = &__test_suites[__test_printed++];
+    __testRecord(next->name, next->timing.total, next->timing.failed,
+                 next->timing.seconds);
+    fwrite(next->text, 1, next->length, stdout);
+    free(next->text);
+    next->text = NULL;
+  }
+  fflush(stdout);
+}
+
+// Reads the output of the running suites until one of them finishes
+static void __testWait(void) {
+  struct pollfd fds[TEST_PARALLEL];
+  int indexes[TEST_PARALLEL];
+  for (;;) {
+    int count = 0;
+    for (int i = __test_printed; i < __test_suite_count; i++) {
+      if (!__test_suites[i].done) {
+        fds[count].fd = __test_suites[i].output;
+        fds[count].events = POLLIN;
+        indexes[count++] = i;
+      }
+    }
+    if (count == 0 || poll(fds, (nfds_t)count, -1) < 0)
+      return;
+
+    for (int i = 0; i < count; i++) {
+      if (!fds[i].revents)
+        continue;
+      __test_suite_t *suite = &__test_suites[indexes[i]];
+      char buffer[4096];
+      const ssize_t bytes = read(suite->output, buffer, sizeof(buffer));
+      if (bytes > 0) {
+        __testAppend(suite, buffer, (size_t)bytes);
+        continue;
+      }
+      __testFinish(suite);
+      return;
+    }
+  }
+}
+
+// Runs a suite in a child process, once fewer than TEST_PARALLEL are running
+void __testFork(const char *name, void (*fn)(void)) {
+  while (__test_running >= TEST_PARALLEL) {
+    __testWait();
+  }
+  __test_suite_t *suites = (__test_suite_t *)realloc(
+      __test_suites, sizeof(__test_suite_t) * ((size_t)__test_suite_count + 1));
+  int output[2], results[2];
+  if (!suites || pipe(output) != 0) {
+    fprintf(stderr, "test: cannot run %s in parallel\n", name);
+    exit(1);
+  }
+  if (pipe(results) != 0) {
+    fprintf(stderr, "test: cannot run %s in parallel\n", name);
+    exit(1);
+  }
+  __test_suites = suites;
+
+  fflush(stdout);
+  fflush(stderr);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(output[0]);
+    close(results[0]);
+    dup2(output[1], STDOUT_FILENO);
+    dup2(output[1], STDERR_FILENO);
+    close(output[1]);
+    setvbuf(stdout, NULL, _IOLBF, 0); // keeps the lines before a crash
+    total = failed = 0;
+    __test_timing_count = 0;
+    __test_child = getpid();
+    atexit(__testExit);
+    const int crashes[] = {SIGABRT, SIGALRM, SIGBUS, SIGFPE, SIGILL, SIGSEGV};
+    for (size_t i = 0; i < sizeof(crashes) / sizeof(crashes[0]); i++) {
+      signal(crashes[i], __testCrash);
+    }
+    alarm(TEST_TIMEOUT);
+    __testRun(name, fn);
+    fflush(stdout);
+    const __test_timing_t *timing = &__test_timings[0];
+    _exit(write(results[1], timing, sizeof(*timing)) == sizeof(*timing) ? 0
+                                                                         : 1);
+  }
+  close(output[1]);
+  close(results[1]);
+  if (pid < 0) {
+    fprintf(stderr, "test: cannot fork %s\n", name);
+    exit(1);
+  }
+
+  __test_suite_t *suite = &__test_suites[__test_suite_count++];
+  memset(suite, 0, sizeof(*suite));
+  suite->name = name;
+  suite->pid = pid;
+  suite->output = output[0];
+  suite->results = results[0];
+  __test_running++;
 }
+#endif
 
 /**
  * Prints a summary of test results and returns the number of failed tests.
@@ -279,6 +792,23 @@ void expectIncls(const char *big, const char *small, const char *name) {
  *   return report();
  */
 int report(void) {
+#ifdef TEST_FORK
+  while (__test_running > 0) {
+    __testWait();
+  }
+  free(__test_suites);
+#endif
+  __testFlush();
+  printf("\n%-32s %10s %8s %10s\n", "suite", "assertions", "failed",
+         "seconds");
+  for (int i = 0; i < __test_timing_count; i++) {
+    const __test_timing_t *timing = &__test_timings[i];
+    printf("%-32s %10d %8d", timing->name, timing->total, timing->failed);
+    if (timing->seconds < 0)
+      printf(" %10s\n", "-");
+    else
+      printf(" %10.3f\n", timing->seconds);
+  }
 #ifndef FAILED_ONLY
   printf("\n%d assertions, %d failed\n", total, failed);
 #else
@@ -294,26 +824,20 @@ int report(void) {
  *    test("my test");
  */
 #ifndef FAILED_ONLY
-#define test(name) printf("  %s:\n", name)
+#define test(name) (__testFlush(), printf("  %s:\n", name))
 #else
 #define test(name)
 #endif
 
 /**
- * Runs a test suite and prints its name.
+ * Runs a test suite and prints its name. With TEST_PARALLEL, it runs in a
+ * child process and report waits for it.
  * @name suite
  * @example
  *    suite(myTestFunction);
  */
-#ifndef FAILED_ONLY
-#define suite(name)                                                            \
-  {                                                                            \
-    printf("\n> %s\n", #name);                                                 \
-    name();                                                                    \
-  }
+#ifdef TEST_FORK
+#define suite(name) __testFork(#name, name)
 #else
-#define suite(name)                                                            \
-  {                                                                            \
-    name();                                                                    \
-  }
+#define suite(name) __testRun(#name, name)
 #endif
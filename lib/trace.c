@@ -0,0 +1,595 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#endif
+
+#include "trace.h"
+
+#ifdef TRACE
+
+#include "alloc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_CALIBRATION 10000000 // ns of clock the TSC is measured against
+
+__thread trace_buffer_t *__trace_buffer;
+
+static trace_buffer_t *traceBuffers; // every registered thread, newest first
+static uint32_t traceLastThread;
+static pthread_once_t traceOnce = PTHREAD_ONCE_INIT;
+static uint64_t traceStartTicks, traceStartClock;
+static const char *traceExitPath;
+
+typedef struct {
+  const char *name;
+  const char *function;
+} time_site_t;
+
+static time_site_t timeSites[TIME_SITES + 1] = {
+    [TIME_SITES] = {"(other)", ""},
+};
+
+uint64_t __traceClock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void traceStart(void) {
+  traceStartClock = __traceClock();
+  traceStartTicks = __traceNow();
+}
+
+trace_buffer_t *__traceRegister(void) {
+  pthread_once(&traceOnce, traceStart);
+
+  trace_buffer_t *buffer = allocate(sizeof(trace_buffer_t));
+  panicif(!buffer, "cannot allocate the trace buffer");
+  buffer->thread = __atomic_add_fetch(&traceLastThread, 1, __ATOMIC_RELAXED);
+
+  // Buffers outlive their threads so that exited threads are still dumped
+  buffer->next = __atomic_load_n(&traceBuffers, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&traceBuffers, &buffer->next, buffer, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+
+  __trace_buffer = buffer;
+  return buffer;
+}
+
+// Ticks of __traceNow per microsecond, measured since the first event
+static double traceTicksPerMicrosecond(void) {
+#ifdef TRACE_TSC
+  uint64_t clock = __traceClock();
+  while (clock - traceStartClock < TRACE_CALIBRATION) {
+    clock = __traceClock();
+  }
+  const uint64_t ticks = __traceNow();
+  return (double)(ticks - traceStartTicks) /
+         ((double)(clock - traceStartClock) / 1000.0);
+#else
+  return 1000.0;
+#endif
+}
+
+static void traceWriteName(FILE *file, const char *name) {
+  for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fprintf(file, "\\%c", *c);
+    else if (*c < 0x20)
+      fprintf(file, "\\u%04x", *c);
+    else
+      fputc(*c, file);
+  }
+}
+
+trace_result_t traceDump(const char *path) {
+  panicif(!path, "path cannot be null");
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return TRACE_ERROR_IO;
+
+  pthread_once(&traceOnce, traceStart);
+  const double scale = traceTicksPerMicrosecond();
+  const int pid = (int)getpid();
+  int first = 1;
+
+  fprintf(file, "{\"traceEvents\":[");
+  trace_buffer_t *buffer = __atomic_load_n(&traceBuffers, __ATOMIC_ACQUIRE);
+  for (; buffer; buffer = buffer->next) {
+    const uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    const uint64_t tail = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+    for (uint64_t i = tail; i < head; i++) {
+      const trace_event_t *event = &buffer->events[i & (TRACE_EVENTS - 1)];
+      fprintf(file, "%s\n{\"name\":\"", first ? "" : ",");
+      traceWriteName(file, event->name);
+      fprintf(file, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u%s}",
+              event->phase, (double)(event->time - traceStartTicks) / scale,
+              pid, buffer->thread, event->phase == 'i' ? ",\"s\":\"t\"" : "");
+      first = 0;
+    }
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  const int failed = ferror(file);
+  if (fclose(file) != 0 || failed)
+    return TRACE_ERROR_IO;
+  return TRACE_RESULT_OK;
+}
+
+static void traceExit(void) { traceDump(traceExitPath); }
+
+void traceDumpAtExit(const char *path) {
+  panicif(!path, "path cannot be null");
+  if (!traceExitPath)
+    atexit(traceExit);
+  traceExitPath = path;
+}
+
+static size_t timeSite(const char *name, const char *function) {
+  const size_t hash =
+      ((uintptr_t)name >> 3) ^ ((uintptr_t)function >> 3) * 2654435761U;
+  for (size_t i = 0; i < TIME_SITES; i++) {
+    const size_t index = (hash + i) % TIME_SITES;
+    time_site_t *site = &timeSites[index];
+    const char *owner = __atomic_load_n(&site->name, __ATOMIC_ACQUIRE);
+    if (!owner && __atomic_compare_exchange_n(&site->name, &owner, name, 0,
+                                              __ATOMIC_ACQ_REL,
+                                              __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&site->function, function, __ATOMIC_RELEASE);
+      return index;
+    }
+
+    if (owner == name) {
+      // A NULL function means the owner is still filling in the site
+      const char *owner_function;
+      while (!(owner_function =
+                   __atomic_load_n(&site->function, __ATOMIC_ACQUIRE))) {
+      }
+      if (owner_function == function)
+        return index;
+    }
+  }
+  return TIME_SITES;
+}
+
+static size_t timeBucket(uint64_t ticks) {
+  if (ticks < (1u << TIME_PRECISION))
+    return (size_t)ticks;
+  const unsigned exponent = 63 - (unsigned)__builtin_clzll(ticks);
+  return ((size_t)(exponent - TIME_PRECISION + 1) << TIME_PRECISION) +
+         (size_t)(ticks >> (exponent - TIME_PRECISION)) -
+         (1u << TIME_PRECISION);
+}
+
+// Highest duration counted in a bucket
+static uint64_t timeBucketMax(size_t bucket) {
+  if (bucket < (1u << TIME_PRECISION))
+    return bucket;
+  const unsigned shift = (unsigned)(bucket >> TIME_PRECISION) - 1;
+  const uint64_t low = ((uint64_t)(1u << TIME_PRECISION) +
+                        (bucket & ((1u << TIME_PRECISION) - 1)))
+                       << shift;
+  return low + (((uint64_t)1 << shift) - 1);
+}
+
+void __timeStop(__time_scope_t *scope) {
+  const uint64_t elapsed = __traceNow() - scope->start;
+  scope->open = 0;
+
+  trace_buffer_t *buffer = __trace_buffer;
+  if (!buffer)
+    buffer = __traceRegister();
+  const size_t site = timeSite(scope->name, scope->function);
+  time_histogram_t *histogram = buffer->histograms[site];
+  if (!histogram) {
+    histogram = allocate(sizeof(time_histogram_t));
+    panicif(!histogram, "cannot allocate the time histogram");
+    __atomic_store_n(&buffer->histograms[site], histogram, __ATOMIC_RELEASE);
+  }
+
+  histogram->count++;
+  histogram->total += elapsed;
+  if (elapsed > histogram->max)
+    histogram->max = elapsed;
+  histogram->buckets[timeBucket(elapsed)]++;
+}
+
+// Adds the histograms every thread keeps for a site
+static void timeMerge(size_t site, time_histogram_t *merged) {
+  trace_buffer_t *buffer = __atomic_load_n(&traceBuffers, __ATOMIC_ACQUIRE);
+  for (; buffer; buffer = buffer->next) {
+    const time_histogram_t *histogram =
+        __atomic_load_n(&buffer->histograms[site], __ATOMIC_ACQUIRE);
+    if (!histogram)
+      continue;
+    merged->count += histogram->count;
+    merged->total += histogram->total;
+    if (histogram->max > merged->max)
+      merged->max = histogram->max;
+    for (size_t i = 0; i < TIME_BUCKETS; i++) {
+      merged->buckets[i] += histogram->buckets[i];
+    }
+  }
+}
+
+static double timeQuantile(const time_histogram_t *histogram, double quantile,
+                           double scale) {
+  const double target = quantile * (double)histogram->count;
+  uint64_t rank = (uint64_t)target;
+  if ((double)rank < target || rank == 0)
+    rank++;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < TIME_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      const uint64_t ticks = timeBucketMax(i);
+      return (double)(ticks < histogram->max ? ticks : histogram->max) / scale;
+    }
+  }
+  return (double)histogram->max / scale;
+}
+
+// scale is ticks per nanosecond
+static time_stats_t timeSummarize(const time_histogram_t *histogram,
+                                  double scale) {
+  time_stats_t stats = {0, 0, 0, 0, 0, 0};
+  if (!histogram->count)
+    return stats;
+  stats.count = histogram->count;
+  stats.mean = (double)histogram->total / (double)histogram->count / scale;
+  stats.p50 = timeQuantile(histogram, 0.5, scale);
+  stats.p99 = timeQuantile(histogram, 0.99, scale);
+  stats.p999 = timeQuantile(histogram, 0.999, scale);
+  stats.max = (double)histogram->max / scale;
+  return stats;
+}
+
+time_stats_t timeStats(const char *name) {
+  panicif(!name, "name cannot be null");
+  time_histogram_t *merged = allocate(sizeof(time_histogram_t));
+  panicif(!merged, "cannot allocate the time histogram");
+  for (size_t i = 0; i < TIME_SITES; i++) {
+    const char *owner = __atomic_load_n(&timeSites[i].name, __ATOMIC_ACQUIRE);
+    if (owner && strcmp(owner, name) == 0)
+      timeMerge(i, merged);
+  }
+
+  pthread_once(&traceOnce, traceStart);
+  const time_stats_t stats =
+      timeSummarize(merged, traceTicksPerMicrosecond() / 1000.0);
+  deallocate(&merged);
+  return stats;
+}
+
+static int timeOrder(const void *a, const void *b) {
+  const time_histogram_t *left = *(const time_histogram_t *const *)a;
+  const time_histogram_t *right = *(const time_histogram_t *const *)b;
+  if (left->total != right->total)
+    return left->total < right->total ? 1 : -1;
+  return 0;
+}
+
+void timeReport(FILE *stream) {
+  panicif(!stream, "stream cannot be null");
+  time_histogram_t *merged =
+      allocate((TIME_SITES + 1) * sizeof(time_histogram_t));
+  time_histogram_t **rows =
+      allocate((TIME_SITES + 1) * sizeof(time_histogram_t *));
+  panicif(!merged || !rows, "cannot allocate the time report");
+
+  size_t count = 0;
+  for (size_t i = 0; i <= TIME_SITES; i++) {
+    timeMerge(i, &merged[i]);
+    if (merged[i].count)
+      rows[count++] = &merged[i];
+  }
+  qsort(rows, count, sizeof(time_histogram_t *), timeOrder);
+
+  pthread_once(&traceOnce, traceStart);
+  const double scale = traceTicksPerMicrosecond() / 1000.0;
+  fprintf(stream, "%-32s %10s %12s %12s %12s %12s %12s  %s\n", "scope",
+          "count", "mean ns", "p50 ns", "p99 ns", "p999 ns", "max ns",
+          "function");
+  for (size_t i = 0; i < count; i++) {
+    const time_site_t *site = &timeSites[rows[i] - merged];
+    const time_stats_t stats = timeSummarize(rows[i], scale);
+    fprintf(stream, "%-32s %10llu %12.0f %12.0f %12.0f %12.0f %12.0f  %s\n",
+            site->name, (unsigned long long)stats.count, stats.mean, stats.p50,
+            stats.p99, stats.p999, stats.max, site->function);
+  }
+
+  deallocate(&rows);
+  deallocate(&merged);
+}
+
+#endif
+
+#ifdef TRACE_C_TEST
+
+#include "file.h"
+#include "test.h"
+#include <string.h>
+
+static char traceTestPath[64];
+
+// Dumps to a file of this process, as suites may run in parallel
+static file_t *traceTestDump(void) {
+  snprintf(traceTestPath, sizeof(traceTestPath), "trace.test.%d.json",
+           (int)getpid());
+  if (traceDump(traceTestPath) != TRACE_RESULT_OK)
+    return NULL;
+  return fileOpen(traceTestPath);
+}
+
+static void traceTestClose(file_t **file) {
+  if (*file)
+    fileClose(file);
+  remove(traceTestPath);
+}
+
+// Counts the lines of the dump holding every given fragment
+static size_t traceCount(const file_t *file, const char *name,
+                         const char *fragment) {
+  size_t offset = 0, length, count = 0;
+  char *line;
+  char text[256];
+  while (fileNextLine(file, &offset, &line, &length)) {
+    if (length >= sizeof(text))
+      continue;
+    memcpy(text, line, length);
+    text[length] = '\0';
+    count += strstr(text, name) && strstr(text, fragment);
+  }
+  return count;
+}
+
+// Reads the timestamp of a dumped line
+static double traceTime(const char *line, size_t length) {
+  char text[256];
+  double ts = -1;
+  if (length >= sizeof(text))
+    return ts;
+  memcpy(text, line, length);
+  text[length] = '\0';
+  const char *field = strstr(text, "\"ts\":");
+  if (field)
+    sscanf(field + 5, "%lf", &ts);
+  return ts;
+}
+
+void traceEvents(void) {
+  traceBegin("events/outer");
+  traceBegin("events/inner");
+  traceInstant("events/\"quoted\"");
+  traceEnd("events/inner");
+  traceEnd("events/outer");
+
+  file_t *file = traceTestDump();
+  expectTrue(file != NULL, "dumps the trace");
+  if (!file)
+    return;
+  expectTrue(strncmp(file->data, "{\"traceEvents\":[", 16) == 0,
+             "writes Chrome trace JSON");
+  expectEqllu(traceCount(file, "\"events/outer\"", "\"ph\":\"B\""), 1,
+              "records span beginnings");
+  expectEqllu(traceCount(file, "\"events/outer\"", "\"ph\":\"E\""), 1,
+              "records span ends");
+  expectEqllu(traceCount(file, "\"events/\\\"quoted\\\"\"", "\"s\":\"t\""), 1,
+              "records instants with escaped names");
+  expectEqllu(traceCount(file, "\"events/inner\"", "\"tid\":1"), 2,
+              "tags events with the thread");
+  traceTestClose(&file);
+
+  test("errors");
+  expectTrue(traceDump("missing/directory/trace.json") == TRACE_ERROR_IO,
+             "reports files that cannot be written");
+}
+
+void traceClock(void) {
+  traceBegin("clock/span");
+  const uint64_t start = __traceClock();
+  while (__traceClock() - start < 20000000) {
+  }
+  traceEnd("clock/span");
+
+  file_t *file = traceTestDump();
+  if (!file) {
+    expectTrue(0, "dumps the trace");
+    return;
+  }
+  size_t offset = 0, length;
+  char *line;
+  double begin = -1, end = -1;
+  while (fileNextLine(file, &offset, &line, &length)) {
+    if (length > 20 && strncmp(line, "{\"name\":\"clock/span\"", 20) == 0) {
+      if (begin < 0)
+        begin = traceTime(line, length);
+      else
+        end = traceTime(line, length);
+    }
+  }
+  traceTestClose(&file);
+
+  // A loaded machine can stretch the span a lot, but not by a factor of 1000
+  expectf(end - begin > 19000 && end - begin < 200000,
+          "converts timestamps to microseconds", "the 20 ms span took %.0f us",
+          end - begin);
+}
+
+static void *traceWorker(void *argument) {
+  for (int i = 0; i < 256; i++) {
+    traceBegin("threads/work");
+    traceEnd("threads/work");
+  }
+  *(uint32_t *)argument = __trace_buffer->thread;
+  return NULL;
+}
+
+void traceThreads(void) {
+  pthread_t threads[4];
+  uint32_t ids[4];
+  for (int i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, traceWorker, &ids[i]);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  file_t *file = traceTestDump();
+  if (!file) {
+    expectTrue(0, "dumps the trace");
+    return;
+  }
+  expectEqllu(traceCount(file, "\"threads/work\"", "\"ph\":\"B\""), 1024,
+              "keeps the events of exited threads");
+  int tagged = 1;
+  for (int i = 0; i < 4; i++) {
+    char tid[32];
+    snprintf(tid, sizeof(tid), "\"tid\":%u}", ids[i]);
+    tagged &= traceCount(file, "\"threads/work\"", tid) == 512;
+  }
+  expectTrue(tagged, "gives every thread its own tid");
+  traceTestClose(&file);
+}
+
+static void *traceFlood(void *argument) {
+  for (int i = 0; i < TRACE_EVENTS + 100; i++) {
+    traceInstant("ring/flood");
+  }
+  (void)argument;
+  return NULL;
+}
+
+void traceRing(void) {
+  pthread_t thread;
+  pthread_create(&thread, NULL, traceFlood, NULL);
+  pthread_join(thread, NULL);
+
+  file_t *file = traceTestDump();
+  if (!file) {
+    expectTrue(0, "dumps the trace");
+    return;
+  }
+  expectEqllu(traceCount(file, "\"ring/flood\"", "\"ph\":\"i\""),
+              TRACE_EVENTS, "keeps the last TRACE_EVENTS events");
+
+  size_t offset = 0, length;
+  char *line;
+  double last = 0;
+  int ordered = 1;
+  while (fileNextLine(file, &offset, &line, &length)) {
+    if (length > 22 && strncmp(line, "{\"name\":\"ring/flood\"", 20) == 0) {
+      const double ts = traceTime(line, length);
+      ordered &= ts >= last;
+      last = ts;
+    }
+  }
+  expectTrue(ordered, "dumps them oldest first");
+  traceTestClose(&file);
+}
+
+void timeBuckets(void) {
+  int exact = 1, bounded = 1, ordered = 1;
+  for (uint64_t ticks = 0; ticks < 1000; ticks++) {
+    exact &= ticks >= 32 || timeBucketMax(timeBucket(ticks)) == ticks;
+    ordered &= ticks == 0 || timeBucket(ticks) >= timeBucket(ticks - 1);
+  }
+  uint64_t state = 42;
+  for (int i = 0; i < 100000; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    const uint64_t ticks = state >> (state & 63);
+    const uint64_t high = timeBucketMax(timeBucket(ticks));
+    bounded &= high >= ticks && high - ticks <= ticks >> TIME_PRECISION;
+    bounded &= timeBucket(ticks) < TIME_BUCKETS;
+  }
+  expectTrue(exact, "keeps short durations exact");
+  expectTrue(ordered, "orders buckets by duration");
+  expectTrue(bounded, "keeps long durations within the precision");
+  expectTrue(timeBucket(UINT64_MAX) == TIME_BUCKETS - 1,
+             "fits the longest duration");
+}
+
+void timeScopes(void) {
+  for (int i = 0; i < 200; i++) {
+    timeScope("scopes/wait") {
+      const uint64_t start = __traceClock();
+      while (__traceClock() - start < 20000) {
+      }
+    }
+  }
+  for (int i = 0; i < 10; i++) {
+    timeScope("scopes/empty") {}
+  }
+
+  const time_stats_t stats = timeStats("scopes/wait");
+  expectEqllu(stats.count, 200, "counts every scope");
+  expectTrue(stats.p50 > 19000 && stats.p50 < 60000,
+             "measures durations in nanoseconds");
+  expectTrue(stats.p50 <= stats.p99 && stats.p99 <= stats.p999 &&
+                 stats.p999 <= stats.max && stats.mean <= stats.max,
+             "orders the percentiles");
+  expectEqllu(timeStats("scopes/empty").count, 10, "keeps sites apart");
+  expectEqllu(timeStats("scopes/missing").count, 0,
+              "returns nothing for unknown names");
+}
+
+static void *timeWorker(void *argument) {
+  for (int i = 0; i < 100; i++) {
+    timeScope("threads/scope") {}
+  }
+  (void)argument;
+  return NULL;
+}
+
+void timeThreads(void) {
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, timeWorker, NULL);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  expectEqllu(timeStats("threads/scope").count, 400,
+              "merges the histograms of every thread");
+}
+
+void timeReports(void) {
+  timeScope("reports/scope") {}
+
+  FILE *stream = tmpfile();
+  timeReport(stream);
+  rewind(stream);
+  char line[256];
+  int header = 0, row = 0;
+  while (fgets(line, sizeof(line), stream)) {
+    header |= strncmp(line, "scope", 5) == 0 && strstr(line, "p999 ns");
+    row |= strncmp(line, "reports/scope ", 14) == 0 &&
+           strstr(line, " timeReports\n");
+  }
+  fclose(stream);
+  expectTrue(header, "prints a header");
+  expectTrue(row, "prints a row per site with its function");
+}
+
+int main(void) {
+  suite(traceEvents);
+  suite(traceClock);
+  suite(traceThreads);
+  suite(traceRing);
+  suite(timeBuckets);
+  suite(timeScopes);
+  suite(timeThreads);
+  suite(timeReports);
+
+  return report();
+}
+
+#endif
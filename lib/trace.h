@@ -0,0 +1,237 @@
+// Trace (v0.1.0)
+// ---
+//
+// A low overhead event tracer and scope timer. Spans and instants are recorded
+// into a ring buffer owned by the calling thread, so recording takes no lock
+// and costs a timestamp and three stores. traceDump writes every thread's
+// events as Chrome trace JSON, which chrome://tracing and
+// https://ui.perfetto.dev open.
+//
+// Tracing is compiled in with -DTRACE; without it every macro expands to
+// nothing. Timestamps come from the TSC on x86 and from CLOCK_MONOTONIC
+// elsewhere. Names are kept as pointers, so they must be string literals or
+// otherwise outlive the dump. Each thread keeps its last TRACE_EVENTS events.
+//
+// timeScope times a block and adds the duration to a log-linear histogram of
+// its call site, kept per thread, so thousands of measurements cost no more
+// than a few counters. timeReport merges the threads and prints the
+// percentiles of every site, timeStats returns those of one name.
+//
+// ```c
+// traceDumpAtExit("parse.trace.json");
+//
+// traceBegin("parse");
+// while (splitRecord(&split, fields, 8)) {
+//   traceInstant("record");
+// }
+// traceEnd("parse");
+//
+// timeScope("insert batch") {
+//   for (size_t i = 0; i < 64; i++)
+//     mapSet(map, keys[i], values[i]);
+// }
+// timeReport(stderr); // count, mean, p50, p99, p999 and max of each site
+// ```
+// ___HEADER_END___
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+  TRACE_RESULT_OK = 0,
+  TRACE_ERROR_IO, // the file could not be written
+} trace_result_t;
+
+typedef struct {
+  uint64_t count; // scopes timed, 0 when the name was never timed
+  double mean;    // nanoseconds, as are the rest
+  double p50;
+  double p99;
+  double p999;
+  double max;
+} time_stats_t;
+
+#ifdef TRACE
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "TRACE needs GCC or Clang"
+#endif
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 65536 // events kept per thread
+#endif
+
+#if TRACE_EVENTS & (TRACE_EVENTS - 1)
+#error "TRACE_EVENTS must be a power of two"
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRACE_TSC 1
+#endif
+
+#ifndef TIME_SITES
+#define TIME_SITES 256 // timeScope sites, later ones share a single row
+#endif
+
+// Durations below 1 << TIME_PRECISION ticks are exact, larger ones are kept
+// within 1 / (1 << TIME_PRECISION) of their value
+#define TIME_PRECISION 5
+#define TIME_BUCKETS ((64 - TIME_PRECISION + 1) << TIME_PRECISION)
+
+typedef struct {
+  uint64_t count;
+  uint64_t total; // ticks, as are the rest
+  uint64_t max;
+  uint64_t buckets[TIME_BUCKETS];
+} time_histogram_t;
+
+typedef struct {
+  const char *name;
+  const char *function;
+  uint64_t start;
+  int open;
+} __time_scope_t;
+
+typedef struct {
+  uint64_t time; // ticks of __traceNow
+  const char *name;
+  char phase; // 'B' begins a span, 'E' ends it, 'i' is an instant
+} trace_event_t;
+
+typedef struct trace_buffer_t {
+  struct trace_buffer_t *next; // buffers of every thread, newest first
+  uint64_t head;               // events recorded, published after each one
+  uint32_t thread;             // tid in the dump, from 1
+  time_histogram_t *histograms[TIME_SITES + 1]; // by site, on first use
+  trace_event_t events[TRACE_EVENTS];
+} trace_buffer_t;
+
+extern __thread trace_buffer_t *__trace_buffer;
+
+trace_buffer_t *__traceRegister(void);
+uint64_t __traceClock(void);
+void __timeStop(__time_scope_t *scope);
+
+static inline uint64_t __traceNow(void) {
+#ifdef TRACE_TSC
+  uint32_t low, high;
+  __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+#else
+  return __traceClock();
+#endif
+}
+
+static inline void __traceRecord(const char *name, char phase) {
+  trace_buffer_t *buffer = __trace_buffer;
+  if (!buffer)
+    buffer = __traceRegister();
+
+  const uint64_t head = buffer->head;
+  trace_event_t *event = &buffer->events[head & (TRACE_EVENTS - 1)];
+  event->time = __traceNow();
+  event->name = name;
+  event->phase = phase;
+  __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Begin a span on the calling thread, ended by traceEnd with the same name.
+ * Spans nest.
+ * @name traceBegin
+ * @param {const char*} name - Name of the span, a string literal
+ * @example
+ *   traceBegin("load");
+ */
+#define traceBegin(name) __traceRecord((name), 'B')
+
+/**
+ * End the innermost span of the calling thread.
+ * @name traceEnd
+ * @param {const char*} name - Name given to traceBegin
+ * @example
+ *   traceEnd("load");
+ */
+#define traceEnd(name) __traceRecord((name), 'E')
+
+/**
+ * Record a point in time on the calling thread.
+ * @name traceInstant
+ * @param {const char*} name - Name of the event, a string literal
+ * @example
+ *   traceInstant("flush");
+ */
+#define traceInstant(name) __traceRecord((name), 'i')
+
+/**
+ * Write the events of every thread as Chrome trace JSON. Threads may keep
+ * recording, though events recorded during the dump can be missing from it.
+ * @name traceDump
+ * @param {const char*} path - File to write, replaced if it exists
+ * @returns {trace_result_t} TRACE_RESULT_OK, or TRACE_ERROR_IO
+ * @example
+ *   traceDump("run.trace.json");
+ */
+trace_result_t traceDump(const char *path);
+
+/**
+ * Dump the events to path when the program exits. Only the last path given
+ * is written.
+ * @name traceDumpAtExit
+ * @param {const char*} path - File to write, which must outlive the program
+ * @example
+ *   traceDumpAtExit("run.trace.json");
+ */
+void traceDumpAtExit(const char *path);
+
+/**
+ * Time the block that follows and add the duration to the histogram of this
+ * site, told apart by name and function. Leaving the block with break,
+ * return or goto skips the measurement.
+ * @name timeScope
+ * @param {const char*} name - Name of the site, a string literal
+ * @example
+ *   timeScope("mapSet") {
+ *     mapSet(map, key, value);
+ *   }
+ */
+#define timeScope(name)                                                        \
+  for (__time_scope_t __time_scope = {(name), __func__, __traceNow(), 1};      \
+       __time_scope.open; __timeStop(&__time_scope))
+
+/**
+ * Merge the histograms of every site and thread timed under a name. Counts
+ * are exact once the threads timing it are idle.
+ * @name timeStats
+ * @param {const char*} name - Name given to timeScope
+ * @returns {time_stats_t} Count, mean and percentiles in nanoseconds
+ * @example
+ *   time_stats_t stats = timeStats("mapSet");
+ *   printf("p99 %.0f ns\n", stats.p99);
+ */
+time_stats_t timeStats(const char *name);
+
+/**
+ * Print the count, mean, p50, p99, p999 and max of every timeScope site,
+ * the sites with the most total time first.
+ * @name timeReport
+ * @param {FILE*} stream - Where to print the table, e.g. stderr or a file
+ * @example
+ *   timeReport(stderr);
+ */
+void timeReport(FILE *stream);
+
+#else
+
+#define traceBegin(name) ((void)0)
+#define traceEnd(name) ((void)0)
+#define traceInstant(name) ((void)0)
+#define traceDump(path) ((void)(path), TRACE_RESULT_OK)
+#define traceDumpAtExit(path) ((void)(path))
+#define timeScope(name)
+#define timeStats(name) ((void)(name), (time_stats_t){0, 0, 0, 0, 0, 0})
+#define timeReport(stream) ((void)(stream))
+
+#endif
@@ -0,0 +1,154 @@
+// vec.h is header-only, this file holds its tests
+#include "vec.h"
+
+#ifdef VEC_C_TEST
+
+#include "test.h"
+#include <stdint.h>
+
+VEC_DEFINE(ints, int)
+VEC_DEFINE_SMALL(bytes, char, 8)
+
+// Elements too large for any allocation to hold many of them
+typedef struct {
+  char bytes[1 << 20];
+} vec_huge_t;
+
+VEC_DEFINE(huges, vec_huge_t)
+
+static int intsAre(const ints_t *self, const int *expected, size_t length) {
+  return self->length == length &&
+         memcmp(self->data, expected, length * sizeof(int)) == 0;
+}
+
+void vecPlain(void) {
+  ints_t numbers;
+  intsInit(&numbers);
+  expectTrue(numbers.length == 0 && numbers.data == NULL,
+             "starts empty without memory");
+
+  int pushed = 1;
+  for (int i = 0; i < 100; i++) {
+    pushed &= intsPush(&numbers, i) == VEC_RESULT_OK;
+  }
+  expectTrue(pushed, "pushes values");
+  expectEqllu(numbers.length, 100, "counts pushed values");
+  expectTrue(numbers.capacity >= 100 && numbers.capacity < 200,
+             "doubles its capacity");
+  expectEqli(intsGet(&numbers, 42), 42, "gets values by index");
+  *intsAt(&numbers, 42) = -42;
+  expectEqli(intsGet(&numbers, 42), -42, "points at values");
+  expectEqli(intsPop(&numbers), 99, "pops the last value");
+  expectEqllu(numbers.length, 99, "shrinks when popping");
+
+  test("insert and remove");
+  intsClear(&numbers);
+  const int values[] = {1, 2, 3};
+  expectEqli(intsAppend(&numbers, values, 3), VEC_RESULT_OK,
+             "appends values");
+  (void)intsInsert(&numbers, 0, 0);
+  (void)intsInsert(&numbers, 2, 9);
+  (void)intsInsert(&numbers, numbers.length, 4);
+  expectTrue(intsAre(&numbers, (const int[]){0, 1, 9, 2, 3, 4}, 6),
+             "inserts at the front, middle and end");
+  expectEqli(intsRemove(&numbers, 2), 9, "removes by index");
+  expectEqli(intsRemove(&numbers, 0), 0, "removes the front");
+  expectTrue(intsAre(&numbers, (const int[]){1, 2, 3, 4}, 4),
+             "keeps the order when removing");
+  expectEqli(intsSwapRemove(&numbers, 0), 1, "swap removes by index");
+  expectTrue(intsAre(&numbers, (const int[]){4, 2, 3}, 3),
+             "moves the last value into the gap");
+
+  test("reserve");
+  expectEqli(intsReserve(&numbers, 1000), VEC_RESULT_OK, "reserves capacity");
+  int *data = numbers.data;
+  for (int i = 0; i < 997; i++) {
+    (void)intsPush(&numbers, i);
+  }
+  expectTrue(numbers.data == data, "fills reserved capacity in place");
+  expectTrue(numbers.data[0] == 4 && numbers.data[999] == 996,
+             "keeps values when growing");
+  numbers.length = 10;
+  intsShrink(&numbers);
+  expectEqllu(numbers.capacity, 10, "shrinks to the length");
+  expectTrue(intsAre(&numbers, (const int[]){4, 2, 3, 0, 1, 2, 3, 4, 5, 6},
+                     10),
+             "keeps values when shrinking");
+
+  intsDeinit(&numbers);
+  expectTrue(numbers.data == NULL && numbers.capacity == 0,
+             "deinit releases the memory");
+}
+
+void vecSmall(void) {
+  bytes_t buffer;
+  bytesInit(&buffer);
+  expectTrue(buffer.data == buffer.inline_data && buffer.capacity == 8,
+             "starts with the inline storage");
+
+  (void)bytesAppend(&buffer, "abcdefgh", 8);
+  expectTrue(buffer.data == buffer.inline_data,
+             "stays inline up to its capacity");
+  expectEqli(bytesInsert(&buffer, 0, '>'), VEC_RESULT_OK,
+             "inserts past the inline capacity");
+  expectTrue(buffer.data != buffer.inline_data && buffer.capacity >= 9,
+             "spills to the heap");
+  expectTrue(buffer.length == 9 && memcmp(buffer.data, ">abcdefgh", 9) == 0,
+             "keeps values when spilling");
+
+  (void)bytesPush(&buffer, 'i');
+  expectEqli(bytesRemove(&buffer, 0), '>', "removes from the heap");
+  expectEqli(bytesPop(&buffer), 'i', "pops from the heap");
+  bytesShrink(&buffer);
+  expectTrue(buffer.data == buffer.inline_data &&
+                 memcmp(buffer.data, "abcdefgh", 8) == 0,
+             "moves back inline when shrinking");
+
+  (void)bytesPush(&buffer, 'i');
+  bytesDeinit(&buffer);
+  expectTrue(buffer.data == buffer.inline_data && buffer.length == 0,
+             "deinit returns to the inline storage");
+}
+
+void vecFailure(void) {
+  ints_t numbers;
+  intsInit(&numbers);
+  (void)intsPush(&numbers, 1);
+  expectEqli(intsReserve(&numbers, (size_t)-1 / sizeof(int) + 1),
+             VEC_ERROR_ALLOCATION, "refuses capacities that overflow");
+  expectEqli(intsAppend(&numbers, (const int[]){2}, (size_t)-1),
+             VEC_ERROR_ALLOCATION, "refuses lengths that overflow");
+  expectTrue(numbers.length == 1 && numbers.data[0] == 1,
+             "keeps values after a failure");
+  intsDeinit(&numbers);
+
+  // Half the address space cannot be allocated
+  volatile size_t half = SIZE_MAX / 2;
+  const size_t count = half / sizeof(vec_huge_t);
+  huges_t huges;
+  hugesInit(&huges);
+  expectEqli(hugesReserve(&huges, count), VEC_ERROR_ALLOCATION,
+             "reports failed heap allocations");
+  expectTrue(huges.data == NULL && huges.capacity == 0,
+             "keeps the vector unchanged");
+
+  bytes_t buffer;
+  bytesInit(&buffer);
+  (void)bytesAppend(&buffer, "abc", 3);
+  expectEqli(bytesReserve(&buffer, half), VEC_ERROR_ALLOCATION,
+             "reports failed spills");
+  expectTrue(buffer.data == buffer.inline_data && buffer.length == 3 &&
+                 memcmp(buffer.data, "abc", 3) == 0,
+             "keeps the inline values");
+  bytesDeinit(&buffer);
+}
+
+int main(void) {
+  suite(vecPlain);
+  suite(vecSmall);
+  suite(vecFailure);
+
+  return report();
+}
+
+#endif
@@ -0,0 +1,208 @@
+// Vec (v0.1.0)
+// ---
+//
+// Typed growable arrays generated by a macro. Capacity doubles when full, so
+// pushing is amortised constant time. VEC_DEFINE_SMALL adds inline storage
+// for a few elements: short vectors never touch the heap. Index checks panic
+// in debug builds, like panicdbg.
+//
+// Small vectors point into themselves, so vectors must not be copied by
+// value; pass pointers around instead.
+//
+// ```c
+// VEC_DEFINE(ints, int)                 // ints_t, intsPush, intsGet, ...
+// VEC_DEFINE_SMALL(bytes, char, 32)     // bytes_t with 32 inline chars
+//
+// ints_t numbers;
+// intsInit(&numbers);
+// intsPush(&numbers, 42);               // returns result
+// intsAppend(&numbers, (int[]){1, 2}, 2);
+// intsGet(&numbers, 0);                 // returns 42
+// intsInsert(&numbers, 0, 7);           // shifts the rest up
+// intsRemove(&numbers, 0);              // shifts the rest down
+// intsSwapRemove(&numbers, 0);          // moves the last element to 0
+// intsDeinit(&numbers);
+// ```
+// ___HEADER_END___
+#pragma once
+
+#include "alloc.h"
+#include "panic.h"
+#include <stddef.h>
+#include <string.h>
+
+typedef enum { VEC_RESULT_OK = 0, VEC_ERROR_ALLOCATION } vec_result_t;
+
+// InlineData is the inline buffer of self, or NULL for plain vectors
+#define __VEC_FUNCTIONS(name, T, InlineCapacity, InlineData)                   \
+  static inline void name##Init(name##_t *self) {                              \
+    self->length = 0;                                                          \
+    self->capacity = (InlineCapacity);                                         \
+    self->data = (T *)(InlineData);                                            \
+  }                                                                            \
+                                                                               \
+  static inline void name##Deinit(name##_t *self) {                            \
+    if (self->data != (T *)(InlineData)) {                                     \
+      deallocate(&self->data);                                                 \
+    }                                                                          \
+    name##Init(self);                                                          \
+  }                                                                            \
+                                                                               \
+  static inline vec_result_t name##Reserve(name##_t *self, size_t capacity) {  \
+    if (capacity <= self->capacity)                                            \
+      return VEC_RESULT_OK;                                                    \
+                                                                               \
+    size_t grown = self->capacity ? self->capacity * 2 : 8;                    \
+    if (grown < capacity)                                                      \
+      grown = capacity;                                                        \
+    if (grown > (size_t)-1 / sizeof(T))                                        \
+      return VEC_ERROR_ALLOCATION;                                             \
+                                                                               \
+    T *data;                                                                   \
+    if ((InlineCapacity) && self->data == (T *)(InlineData)) {                 \
+      data = (T *)allocateUninit(grown * sizeof(T));                           \
+      if (data && self->length)                                                \
+        memcpy(data, self->data, self->length * sizeof(T));                    \
+    } else {                                                                   \
+      data = (T *)reallocate((void **)&self->data, grown * sizeof(T));         \
+    }                                                                          \
+    if (!data)                                                                 \
+      return VEC_ERROR_ALLOCATION;                                             \
+                                                                               \
+    self->data = data;                                                         \
+    self->capacity = grown;                                                    \
+    return VEC_RESULT_OK;                                                      \
+  }                                                                            \
+                                                                               \
+  static inline void name##Shrink(name##_t *self) {                            \
+    if (self->data == (T *)(InlineData) || self->length == self->capacity)     \
+      return;                                                                  \
+                                                                               \
+    if (self->length <= (InlineCapacity)) {                                    \
+      T *heap = self->data;                                                    \
+      self->data = (T *)(InlineData);                                          \
+      self->capacity = (InlineCapacity);                                       \
+      if (self->length)                                                        \
+        memcpy(self->data, heap, self->length * sizeof(T));                    \
+      deallocate(&heap);                                                       \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    T *data = (T *)reallocate((void **)&self->data, self->length * sizeof(T)); \
+    if (data) {                                                                \
+      self->data = data;                                                       \
+      self->capacity = self->length;                                           \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline vec_result_t name##Push(name##_t *self, T value) {             \
+    if (self->length == self->capacity &&                                      \
+        name##Reserve(self, self->length + 1) != VEC_RESULT_OK)                \
+      return VEC_ERROR_ALLOCATION;                                             \
+    self->data[self->length++] = value;                                        \
+    return VEC_RESULT_OK;                                                      \
+  }                                                                            \
+                                                                               \
+  static inline vec_result_t name##Append(name##_t *self, const T *values,     \
+                                          size_t count) {                      \
+    if (count == 0)                                                            \
+      return VEC_RESULT_OK;                                                    \
+    if (count > (size_t)-1 - self->length ||                                   \
+        name##Reserve(self, self->length + count) != VEC_RESULT_OK)            \
+      return VEC_ERROR_ALLOCATION;                                             \
+    memcpy(self->data + self->length, values, count * sizeof(T));              \
+    self->length += count;                                                     \
+    return VEC_RESULT_OK;                                                      \
+  }                                                                            \
+                                                                               \
+  static inline T *name##At(const name##_t *self, size_t index) {              \
+    panicdbg(index >= self->length, #name " index out of bounds");             \
+    return &self->data[index];                                                 \
+  }                                                                            \
+                                                                               \
+  static inline T name##Get(const name##_t *self, size_t index) {              \
+    return *name##At(self, index);                                             \
+  }                                                                            \
+                                                                               \
+  static inline T name##Pop(name##_t *self) {                                  \
+    panicdbg(self->length == 0, #name " is empty");                            \
+    return self->data[--self->length];                                         \
+  }                                                                            \
+                                                                               \
+  static inline vec_result_t name##Insert(name##_t *self, size_t index,       \
+                                          T value) {                           \
+    panicdbg(index > self->length, #name " index out of bounds");              \
+    if (self->length == self->capacity &&                                      \
+        name##Reserve(self, self->length + 1) != VEC_RESULT_OK)                \
+      return VEC_ERROR_ALLOCATION;                                             \
+    memmove(self->data + index + 1, self->data + index,                        \
+            (self->length - index) * sizeof(T));                               \
+    self->data[index] = value;                                                 \
+    self->length++;                                                            \
+    return VEC_RESULT_OK;                                                      \
+  }                                                                            \
+                                                                               \
+  static inline T name##Remove(name##_t *self, size_t index) {                 \
+    panicdbg(index >= self->length, #name " index out of bounds");             \
+    const T removed = self->data[index];                                       \
+    self->length--;                                                            \
+    memmove(self->data + index, self->data + index + 1,                        \
+            (self->length - index) * sizeof(T));                               \
+    return removed;                                                            \
+  }                                                                            \
+                                                                               \
+  static inline T name##SwapRemove(name##_t *self, size_t index) {             \
+    panicdbg(index >= self->length, #name " index out of bounds");             \
+    const T removed = self->data[index];                                       \
+    self->data[index] = self->data[--self->length];                            \
+    return removed;                                                            \
+  }                                                                            \
+                                                                               \
+  static inline void name##Clear(name##_t *self) { self->length = 0; }
+
+/**
+ * Define a vector type name_t of T, with the functions nameInit,
+ * nameDeinit, nameReserve, nameShrink, namePush, nameAppend, nameAt,
+ * nameGet, namePop, nameInsert, nameRemove, nameSwapRemove and nameClear.
+ * @name VEC_DEFINE
+ * @param {identifier} name - Prefix of the type and functions
+ * @param {type} T - Type of the elements
+ * @example
+ *   VEC_DEFINE(ints, int)
+ *
+ *   ints_t numbers;
+ *   intsInit(&numbers);
+ *   intsPush(&numbers, 42);
+ *   intsDeinit(&numbers);
+ */
+#define VEC_DEFINE(name, T)                                                    \
+  typedef struct {                                                             \
+    size_t length;                                                             \
+    size_t capacity;                                                           \
+    T *data;                                                                   \
+  } name##_t;                                                                  \
+  __VEC_FUNCTIONS(name, T, 0, NULL)
+
+/**
+ * Define a vector type like VEC_DEFINE that stores up to Capacity elements
+ * inline before moving to the heap.
+ * @name VEC_DEFINE_SMALL
+ * @param {identifier} name - Prefix of the type and functions
+ * @param {type} T - Type of the elements
+ * @param {size_t} Capacity - Number of elements stored inline
+ * @example
+ *   VEC_DEFINE_SMALL(bytes, char, 32)
+ *
+ *   bytes_t buffer;
+ *   bytesInit(&buffer);
+ *   bytesAppend(&buffer, "hello", 5);  // no heap allocation
+ *   bytesDeinit(&buffer);
+ */
+#define VEC_DEFINE_SMALL(name, T, Capacity)                                    \
+  typedef struct {                                                             \
+    size_t length;                                                             \
+    size_t capacity;                                                           \
+    T *data;                                                                   \
+    T inline_data[Capacity];                                                   \
+  } name##_t;                                                                  \
+  __VEC_FUNCTIONS(name, T, Capacity, self->inline_data)